@@ -38,9 +38,17 @@ dbLoadRecords("$(NED)/db/nEDCommon.db","P=$(PREFIX)")
 
 ### Core Support Modules
 
+# Back large buffers with huge pages and lock memory, must precede plugins
+#nedMemoryConfig("hugetlb", 1)
+
+# Workers processing plugin messages instead of per-plugin threads, disabled by default, must precede plugins
+#nedExecutorConfig(8)
+
 OccConfigure("occ", "/dev/snsocb0", 41943040)
 #OccConfigure("occ", "/tmp/occ.rx,/tmp/occ.tx") # occ_sim
 dbLoadRecords("$(NED)/db/OccPortDriver.db","P=$(PREFIX)occ1:,PORT=occ")
+# Pin OCC threads to NUMA node closest to the card, requires real-time privileges
+#nedThreadConfig("occ", "node0", "fifo", 50)
 
 CmdDispatcherConfigure("cmd", "occ")
 dbLoadRecords("$(NED)/db/CmdDispatcherPlugin.db","P=$(PREFIX)cmd1:,PORT=cmd")
@@ -85,6 +93,10 @@ dbLoadRecords("$(NED)/db/DebugPlugin.db","P=$(PREFIX)dbg1:,PORT=dbg")
 #PixelMapPluginConfigure("pixmap", "occ", 1, "/tmp/test.pixelmap", 4194304)
 #dbLoadRecords("$(NED)/db/PixelMapPlugin.db","P=$(PREFIX)pm1:,PORT=pixmap")
 
+# Consumers connect to router_Neutrons, router_Monitors, router_Meta, router_Vetoed or router_<bank>
+#EventRouterPluginConfigure("router", "pixmap", "bank1:0-1023,bank2:1024-2047")
+#dbLoadRecords("$(NED)/db/EventRouterPlugin.db","P=$(PREFIX)router:,PORT=router")
+
 #BnlFlatFieldPluginConfigure("ff", "occ", "$(NED)/FlatField/9_152_37_177.prmcalc", "$(NED)/FlatField/9_152_37_177.val", 41836544)
 #dbLoadRecords("$(NED)/db/BnlFlatFieldPlugin.db","P=$(PREFIX)ff:,PORT=ff")
 
@@ -39,6 +39,8 @@ AdaraPlugin::AdaraPlugin(const char *portName, const char *dataPlugins, const ch
     createParam("AdcEventsEn",  asynParamInt32, &AdcEventsEn, 1);// WRITE - Enable forwarding ADC events
     createParam("ChopEventsEn", asynParamInt32, &ChopEventsEn, 1);// WRITE - Enable forwarding chopper events
     createParam("NoRtdlPktsEn", asynParamInt32, &NoRtdlPktsEn, 1);// WRITE - Enable packets without RTDL information
+    // Never lose data on its way to storage
+    setLosslessQueue();
     callParamCallbacks();
 
     BasePlugin::connect(dataPlugins, MsgDasData);
@@ -68,6 +70,7 @@ asynStatus AdaraPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
 void AdaraPlugin::clientConnected()
 {
     LOG_INFO("ADARA client connected");
+    // New client needs fresh stream state, cached RTDLs are sent again to all clients
     reset();
 }
 
@@ -94,10 +97,8 @@ bool AdaraPlugin::sendHeartbeat()
     outpacket[2] = now.secPastEpoch;
     outpacket[3] = now.nsec;
 
-    // If sending fails, send() will automatically close the socket
-    this->unlock();
+    // send() only queues data, failed clients are closed by periodic check
     bool ret = send(outpacket, 4*sizeof(uint32_t));
-    this->lock();
 
     if (ret) {
         addIntegerParam(CntPingPkts, 1);
@@ -128,10 +129,7 @@ bool AdaraPlugin::sendRtdl(epicsTimeStamp timestamp, const RtdlHeader &rtdl, con
         }
     }
 
-    this->unlock();
-    bool ret = send(outpacket, sizeof(outpacket));
-    this->lock();
-    return ret;
+    return send(outpacket, sizeof(outpacket));
 }
 
 template <typename T>
@@ -201,11 +199,7 @@ bool AdaraPlugin::sendEvents(epicsTimeStamp &timestamp, bool mapped, const T *ev
         }
     }
 
-    this->unlock();
-    bool ret = send(outpacket, len*sizeof(uint32_t));
-    this->lock();
-
-    return ret;
+    return send(outpacket, len*sizeof(uint32_t));
 }
 
 void AdaraPlugin::recvDownstream(const RtdlPacketList &packets)
@@ -272,8 +266,12 @@ void AdaraPlugin::recvDownstream(const DasDataPacketList &packets)
             sent = sendEvents(timestamp, mapped, packet->getEvents<Event::BNL::Diag>(), nEvents);
         } else if (packet->getEventsFormat() == DasDataPacket::EVENT_FMT_CROC_DIAG) {
             sent = sendEvents(timestamp, mapped, packet->getEvents<Event::CROC::Diag>(), nEvents);
+        } else if (packet->getEventsFormat() == DasDataPacket::EVENT_FMT_CROC_DIAG_COMPACT) {
+            sent = sendEvents(timestamp, mapped, packet->getEvents<Event::CROC::DiagCompact>(), nEvents);
         } else if (packet->getEventsFormat() == DasDataPacket::EVENT_FMT_ACPC_DIAG) {
             sent = sendEvents(timestamp, mapped, packet->getEvents<Event::ACPC::Diag>(), nEvents);
+        } else if (packet->getEventsFormat() == DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT) {
+            sent = sendEvents(timestamp, mapped, packet->getEvents<Event::ACPC::DiagCompact>(), nEvents);
         }
 
         sentPackets += (sent ? 1 : 0);
@@ -30,9 +30,12 @@
  *
  * When enabled, processing of packets will only occur if there's a client
  * which accepts data. In this case, the Neutron Event data packets and RTDL
- * packets are transformed into ADARA format and sent over socket, one packet
- * at a time. Client socket is disconnected on any error. ADARA is supposed
- * to reconnect immediately.
+ * packets are transformed into ADARA format and queued for all connected
+ * clients, one packet at a time. Every client has its own send queue, slow
+ * SMS doesn't stall the data path. Client socket is disconnected on any
+ * error or when its queue overflows. ADARA is supposed to reconnect
+ * immediately. Additional clients, like test SMS, can be connected when
+ * MaxClients allows it, they receive the same stream.
  */
 class AdaraPlugin : public BaseSocketPlugin {
     private:
@@ -0,0 +1,254 @@
+/* ArocPosCalcPlugin.cpp
+ *
+ * Copyright (c) 2017 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "ArocPosCalcPlugin.h"
+#include "Bits.h"
+#include "Log.h"
+#include "likely.h"
+
+#include <algorithm>
+
+EPICS_REGISTER_PLUGIN(ArocPosCalcPlugin, 2, "Port name", string, "Parent plugins", string);
+
+#define POS_ORDER_A     0x10    //!< A samples are in channel order, reversed otherwise
+#define POS_ORDER_B     0x20    //!< B samples are in channel order, reversed otherwise
+
+ArocPosCalcPlugin::ArocPosCalcPlugin(const char *portName, const char *parentPlugins)
+    : BasePlugin(portName, 1)
+{
+    createParam("ErrMem",           asynParamInt32, &ErrMem, 0);            // READ - Buffer allocation error
+    createParam("ResetCnt",         asynParamInt32, &ResetCnt);             // WRITE - Reset counters
+    createParam("CalcEn",           asynParamInt32, &CalcEn, 0);            // WRITE - Toggle position calculation
+    createParam("PassVetoes",       asynParamInt32, &PassVetoes, 0);        // WRITE - Allow vetoes in output stream (0=no, 1=yes)
+    createParam("MinCharge",        asynParamInt32, &MinCharge, 0);         // WRITE - Low charge threshold in each dimension
+    createParam("XMaxOut",          asynParamInt32, &XMaxOut, 127);         // WRITE - Max X pixel value
+    createParam("YMaxOut",          asynParamInt32, &YMaxOut, 127);         // WRITE - Max Y pixel value
+    createParam("CntTotalEvents",   asynParamInt32, &CntTotalEvents, 0);    // READ - Number of all events
+    createParam("CntGoodEvents",    asynParamInt32, &CntGoodEvents, 0);     // READ - Number of good events
+    createParam("CntLowChargeVetos",asynParamInt32, &CntLowChargeVetos, 0); // READ - Number of low charge vetoes
+
+    for (uint32_t i = 0; i < N_CHANNELS; i++) {
+        createParam("X" + std::to_string(i+1) + "Baseline",  asynParamInt32, &XBaselines[i], 0);     // WRITE - Channel baseline in ADC counts
+        createParam("X" + std::to_string(i+1) + "Gain",      asynParamInt32, &XGains[i], 1000);      // WRITE - Channel gain in 1/1000
+        createParam("X" + std::to_string(i+1) + "Threshold", asynParamInt32, &XThresholds[i], 0);    // WRITE - Min calibrated channel value
+    }
+    for (uint32_t i = 0; i < N_CHANNELS; i++) {
+        createParam("Y" + std::to_string(i+1) + "Baseline",  asynParamInt32, &YBaselines[i], 0);     // WRITE - Channel baseline in ADC counts
+        createParam("Y" + std::to_string(i+1) + "Gain",      asynParamInt32, &YGains[i], 1000);      // WRITE - Channel gain in 1/1000
+        createParam("Y" + std::to_string(i+1) + "Threshold", asynParamInt32, &YThresholds[i], 0);    // WRITE - Min calibrated channel value
+    }
+    callParamCallbacks();
+
+    m_cntTotalEvents    = createCounter(CntTotalEvents);
+    m_cntGoodEvents     = createCounter(CntGoodEvents);
+    m_cntLowChargeVetos = createCounter(CntLowChargeVetos);
+
+    updateResolution();
+
+    BasePlugin::connect(parentPlugins, {MsgDasData});
+}
+
+asynStatus ArocPosCalcPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    if (pasynUser->reason == ResetCnt) {
+        resetCounter(m_cntTotalEvents);
+        resetCounter(m_cntGoodEvents);
+        resetCounter(m_cntLowChargeVetos);
+        callParamCallbacks();
+        return asynSuccess;
+    } else if (pasynUser->reason == MinCharge) {
+        m_calcParams.minCharge = value;
+    } else if (pasynUser->reason == XMaxOut || pasynUser->reason == YMaxOut) {
+        if (value <= 0)
+            return asynError;
+        asynStatus ret = BasePlugin::writeInt32(pasynUser, value);
+        updateResolution();
+        return ret;
+    } else {
+        for (uint32_t i = 0; i < N_CHANNELS; i++) {
+            Channel &x = m_calcParams.channels[i];
+            Channel &y = m_calcParams.channels[N_CHANNELS + i];
+            if      (pasynUser->reason == XBaselines[i])    x.baseline = value;
+            else if (pasynUser->reason == XGains[i])        x.gain = value / 1000.0;
+            else if (pasynUser->reason == XThresholds[i])   x.threshold = value;
+            else if (pasynUser->reason == YBaselines[i])    y.baseline = value;
+            else if (pasynUser->reason == YGains[i])        y.gain = value / 1000.0;
+            else if (pasynUser->reason == YThresholds[i])   y.threshold = value;
+            else continue;
+            break;
+        }
+    }
+    return BasePlugin::writeInt32(pasynUser, value);
+}
+
+asynStatus ArocPosCalcPlugin::recvParam(const std::string &remotePort, const std::string &paramName, epicsInt32 value)
+{
+    asynUser a;
+    asynStatus ret = asynPortDriver::findParam(paramName.c_str(), &a.reason);
+    if (ret == asynSuccess) {
+        ret = writeInt32(&a, value);
+        if (ret == asynSuccess) {
+            // For the read-write asyn mechanism to pick up new values
+            setIntegerParam(a.reason, value);
+            callParamCallbacks();
+        }
+    }
+    return ret;
+}
+
+void ArocPosCalcPlugin::updateResolution()
+{
+    uint32_t xMaxOut = getIntegerParam(XMaxOut);
+    uint32_t yMaxOut = getIntegerParam(YMaxOut);
+    uint32_t xRange = Bits::roundUpPower2(xMaxOut + 1);
+    uint32_t yRange = Bits::roundUpPower2(yMaxOut + 1);
+
+    m_calcParams.xScale = 1.0 * xMaxOut / (N_CHANNELS - 1);
+    m_calcParams.yScale = 1.0 * yMaxOut / (N_CHANNELS - 1);
+    m_calcParams.xShift = 0;
+    while ((1U << m_calcParams.xShift) < yRange)
+        m_calcParams.xShift++;
+    m_calcParams.positionMask = ~(xRange * yRange - 1) & ~Event::Pixel::VETO_MASK;
+}
+
+void ArocPosCalcPlugin::recvDownstream(const DasDataPacketList &packets)
+{
+    DasDataPacketList outPackets;
+    std::vector<DasDataPacket *> pooledPackets;
+    Stats stats;
+
+    if (getBooleanParam(CalcEn) == false) {
+        // Optimize pass-thru
+        sendDownstream(packets);
+        return;
+    }
+
+    bool passVetoes = getBooleanParam(PassVetoes);
+    for (const auto &packet: packets) {
+        if (packet->getEventsFormat() != DasDataPacket::EVENT_FMT_AROC_RAW) {
+            outPackets.push_back(packet);
+            continue;
+        }
+
+        uint32_t nEvents = packet->getNumEvents();
+        DasDataPacket *destPacket = m_packetsPool.get(DasDataPacket::getLength(DasDataPacket::EVENT_FMT_PIXEL, nEvents));
+        if (!destPacket) {
+            addIntegerParam(ErrMem, 1);
+            continue;
+        }
+
+        destPacket->init(DasDataPacket::EVENT_FMT_PIXEL, packet->getTimeStamp(), nEvents);
+        auto *srcEvents = packet->getEvents<const Event::AROC::Raw>();
+        auto *destEvents = destPacket->getEvents<Event::Pixel>();
+        uint32_t nOutEvents = processEvents(srcEvents, nEvents, destEvents, passVetoes, stats);
+        if (nOutEvents != nEvents) {
+            // Vetoed events were dropped, only header is rewritten
+            destPacket->init(DasDataPacket::EVENT_FMT_PIXEL, packet->getTimeStamp(), nOutEvents);
+        }
+
+        outPackets.push_back(destPacket);
+        pooledPackets.push_back(destPacket);
+    }
+
+    // Send to subscribed plugins and wait they complete processing
+    sendDownstream(outPackets);
+
+    for (auto &packet: pooledPackets) {
+        m_packetsPool.put(packet);
+    }
+
+    *m_cntTotalEvents    += stats.nTotal;
+    *m_cntGoodEvents     += stats.nGood;
+    *m_cntLowChargeVetos += stats.nLowCharge;
+    callParamCallbacksRatelimit();
+}
+
+uint32_t ArocPosCalcPlugin::processEvents(const Event::AROC::Raw *srcEvents, uint32_t nEvents, Event::Pixel *destEvents, bool passVetoes, Stats &stats)
+{
+    Batch batch;
+    uint32_t nOutEvents = 0;
+    const float minCharge = std::max(m_calcParams.minCharge, 0.0f);
+
+    for (uint32_t start = 0; start < nEvents; start += BATCH_SIZE) {
+        uint32_t n = std::min(nEvents - start, BATCH_SIZE);
+
+        // Transpose samples into channel arrays, always in channel order
+        for (uint32_t i = 0; i < n; i++) {
+            const Event::AROC::Raw &event = srcEvents[start + i];
+            bool orderA = (event.position & POS_ORDER_A);
+            bool orderB = (event.position & POS_ORDER_B);
+            for (uint32_t ch = 0; ch < N_CHANNELS; ch++) {
+                batch.samples[ch][i]              = event.sample_a[orderA ? ch : N_CHANNELS - 1 - ch];
+                batch.samples[N_CHANNELS + ch][i] = event.sample_b[orderB ? ch : N_CHANNELS - 1 - ch];
+            }
+        }
+
+        calculateBatch(batch, n, m_calcParams);
+
+        for (uint32_t i = 0; i < n; i++) {
+            const Event::AROC::Raw &event = srcEvents[start + i];
+            uint32_t pixelid = (event.position & m_calcParams.positionMask) | batch.pixelid[i];
+
+            stats.nTotal++;
+            if (batch.sumX[i] <= 0.0f || batch.sumY[i] <= 0.0f || batch.sumX[i] < minCharge || batch.sumY[i] < minCharge) {
+                stats.nLowCharge++;
+                if (!passVetoes)
+                    continue;
+                pixelid |= Event::Pixel::VETO_MASK;
+            } else {
+                stats.nGood++;
+            }
+
+            destEvents[nOutEvents].tof = event.tof;
+            destEvents[nOutEvents].pixelid = pixelid;
+            nOutEvents++;
+        }
+    }
+
+    return nOutEvents;
+}
+
+NED_VECTORIZE
+void ArocPosCalcPlugin::calculateBatch(Batch &batch, uint32_t nEvents, const CalcParams &calcParams)
+{
+    std::fill_n(batch.sumX, nEvents, 0.0f);
+    std::fill_n(batch.sumY, nEvents, 0.0f);
+    std::fill_n(batch.momentX, nEvents, 0.0f);
+    std::fill_n(batch.momentY, nEvents, 0.0f);
+
+    // Accumulate one channel at a time for all events in a batch
+    for (uint32_t ch = 0; ch < N_CHANNELS; ch++) {
+        const Channel &x = calcParams.channels[ch];
+        const Channel &y = calcParams.channels[N_CHANNELS + ch];
+        const float weight = ch;
+        const float *samplesX = batch.samples[ch];
+        const float *samplesY = batch.samples[N_CHANNELS + ch];
+
+        for (uint32_t i = 0; i < nEvents; i++) {
+            float valueX = x.gain * (samplesX[i] - x.baseline);
+            float valueY = y.gain * (samplesY[i] - y.baseline);
+            valueX = (valueX < x.threshold ? 0.0f : valueX);
+            valueY = (valueY < y.threshold ? 0.0f : valueY);
+            batch.sumX[i] += valueX;
+            batch.sumY[i] += valueY;
+            batch.momentX[i] += weight * valueX;
+            batch.momentY[i] += weight * valueY;
+        }
+    }
+
+    const float xMax = calcParams.xScale * (N_CHANNELS - 1);
+    const float yMax = calcParams.yScale * (N_CHANNELS - 1);
+    for (uint32_t i = 0; i < nEvents; i++) {
+        float x = calcParams.xScale * batch.momentX[i] / (batch.sumX[i] > 0.0f ? batch.sumX[i] : 1.0f) + 0.5f;
+        float y = calcParams.yScale * batch.momentY[i] / (batch.sumY[i] > 0.0f ? batch.sumY[i] : 1.0f) + 0.5f;
+        x = (x < 0.0f ? 0.0f : (x > xMax ? xMax : x));
+        y = (y < 0.0f ? 0.0f : (y > yMax ? yMax : y));
+        batch.pixelid[i] = (static_cast<int32_t>(x) << calcParams.xShift) | static_cast<int32_t>(y);
+    }
+}
@@ -0,0 +1,170 @@
+/* ArocPosCalcPlugin.h
+ *
+ * Copyright (c) 2017 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef AROC_POS_CALC_PLUGIN_H
+#define AROC_POS_CALC_PLUGIN_H
+
+#include "BasePlugin.h"
+#include "Event.h"
+#include "ObjectPool.h"
+
+
+/**
+ * ArocPosCalcPlugin converts AROC raw data into pixel data.
+ *
+ * AROC raw events carry 8 X samples (A) and 8 Y samples (B). Depending
+ * on position flags samples come in reversed order, they're always
+ * reordered to go from first to last channel. Each sample is calibrated
+ * with channel baseline and gain, values below channel threshold are
+ * discarded:
+ *
+ *   value = gain * (sample - baseline), 0 if value < threshold
+ *
+ * Centroid of calibrated values in each dimension defines X and Y
+ * position, which are scaled to output resolution to form pixel id
+ * the same way as FlatFieldPlugin does it:
+ *
+ *   pixelid = position | x << bits(YMaxOut) | y
+ *
+ * Raw events are 72 bytes while pixel events are only 8 bytes, so doing
+ * this early in the chain saves a lot of bandwidth to all downstream
+ * plugins. Events are processed in batches, calibration and centroid
+ * loops go over events in a batch and are vectorized by compiler.
+ *
+ * Events with too low charge in any dimension are vetoed. Vetoed events
+ * are dropped unless PassVetoes is enabled, in which case they're flagged
+ * with Event::Pixel::VETO_MASK.
+ */
+class ArocPosCalcPlugin : public BasePlugin {
+    private: // definitions
+        static const uint32_t BATCH_SIZE = 64;  //!< Number of events calculated together
+        static const uint32_t N_CHANNELS = 8;   //!< Number of samples in each dimension
+
+        /**
+         * Event counters of processed packets, added to plugin counters
+         * once per received list of packets.
+         */
+        struct Stats {
+            uint32_t nTotal{0};     //!< Total number of events
+            uint32_t nGood{0};      //!< Number of good events
+            uint32_t nLowCharge{0}; //!< Number of events with low charge - vetoed
+        };
+
+        /**
+         * Calibration of a single channel.
+         */
+        struct Channel {
+            float baseline{0.0};
+            float gain{1.0};
+            float threshold{0.0};
+        };
+
+        /**
+         * Events being calculated, stored as arrays for vectorization.
+         */
+        struct Batch {
+            float samples[2*N_CHANNELS][BATCH_SIZE];    //!< X samples followed by Y samples
+            float sumX[BATCH_SIZE];                     //!< Sum of calibrated X values
+            float sumY[BATCH_SIZE];                     //!< Sum of calibrated Y values
+            float momentX[BATCH_SIZE];                  //!< First moment of calibrated X values
+            float momentY[BATCH_SIZE];                  //!< First moment of calibrated Y values
+            uint32_t pixelid[BATCH_SIZE];               //!< Calculated pixel id without position
+        };
+
+        /**
+         * Calculation parameters used by single packet processing.
+         */
+        struct CalcParams {
+            Channel channels[2*N_CHANNELS];     //!< X channels followed by Y channels
+            float minCharge{0.0};               //!< Low charge threshold in each dimension
+            float xScale{0.0};                  //!< Centroid to X pixel conversion
+            float yScale{0.0};                  //!< Centroid to Y pixel conversion
+            uint32_t xShift{0};                 //!< Number of bits used by Y
+            uint32_t positionMask{0};           //!< Position bits not overlapping with X,Y
+        };
+
+    private: // variables
+        CalcParams m_calcParams;            //!< Container for all calculation parameters
+        Counter *m_cntTotalEvents;          //!< Number of all events
+        Counter *m_cntGoodEvents;           //!< Number of good events
+        Counter *m_cntLowChargeVetos;       //!< Number of low charge vetoes
+        ObjectPool<DasDataPacket> m_packetsPool{true};  //!< Pool of allocated data packets to store modified data
+
+    public:
+        /**
+         * Constructor for ArocPosCalcPlugin
+         *
+         * Constructor will create and populate PVs with default values.
+         *
+         * @param[in] portName asyn port name.
+         * @param[in] parentPlugins Name of the plugins to connect to.
+         */
+        ArocPosCalcPlugin(const char *portName, const char *parentPlugins);
+
+    private:
+        /**
+         * Handle writing integer values.
+         */
+        asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value) override;
+
+        /**
+         * Handle inter-plugin params.
+         */
+        asynStatus recvParam(const std::string &remotePort, const std::string &paramName, epicsInt32 value) override;
+
+        /**
+         * Overloaded function to process incoming data packets.
+         */
+        void recvDownstream(const DasDataPacketList &packets) override;
+
+        /**
+         * Convert events and write them to destination events.
+         *
+         * @param[in] srcEvents Source events
+         * @param[in] nEvents Number of events to process
+         * @param[out] destEvents Output events, must have room for nEvents
+         * @param[in] passVetoes Flag vetoed events instead of dropping them
+         * @param[out] stats Event counters are incremented
+         * @return Number of events written
+         */
+        uint32_t processEvents(const Event::AROC::Raw *srcEvents, uint32_t nEvents, Event::Pixel *destEvents, bool passVetoes, Stats &stats);
+
+        /**
+         * Calculate X,Y pixel for all events in a batch.
+         *
+         * Loops go over events and have no branches, they're
+         * expected to be vectorized.
+         */
+        static void calculateBatch(Batch &batch, uint32_t nEvents, const CalcParams &calcParams);
+
+        /**
+         * Recalculate output pixel scales from X,Y resolution.
+         */
+        void updateResolution();
+
+    protected:
+        int ErrMem;             //!< Error allocating buffer
+        int ResetCnt;           //!< Reset counters
+        int CalcEn;             //!< Toggle position calculation
+        int PassVetoes;         //!< Allow vetoes in output stream
+        int MinCharge;          //!< Low charge threshold
+        int XMaxOut;            //!< Max X pixel value
+        int YMaxOut;            //!< Max Y pixel value
+        int CntTotalEvents;     //!< Number of all events
+        int CntGoodEvents;      //!< Number of good events
+        int CntLowChargeVetos;  //!< Number of low charge vetoes
+        int XBaselines[N_CHANNELS]; //!< X channel baselines
+        int XGains[N_CHANNELS];     //!< X channel gains
+        int XThresholds[N_CHANNELS];//!< X channel thresholds
+        int YBaselines[N_CHANNELS]; //!< Y channel baselines
+        int YGains[N_CHANNELS];     //!< Y channel gains
+        int YThresholds[N_CHANNELS];//!< Y channel thresholds
+};
+
+#endif // AROC_POS_CALC_PLUGIN_H
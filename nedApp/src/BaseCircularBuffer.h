@@ -34,6 +34,14 @@ class BaseCircularBuffer {
          */
         virtual void clear() { };
 
+        /**
+         * Populate buffer memory from calling thread.
+         *
+         * Producer thread should call it when it starts, before any data
+         * arrives. Base implementation does nothing.
+         */
+        virtual void prefault() { };
+
         /**
          * Copy data from memory area data to the circular buffer.
          *
@@ -12,6 +12,7 @@
 #include "Log.h"
 
 #include <algorithm>
+#include <climits>
 #include <epicsThread.h>
 #include <numeric>
 #include <string>
@@ -42,10 +43,13 @@ BasePlugin::BasePlugin(const char *portName, int blocking, int interfaceMask, in
     : asynPortDriver(portName, /*maxAddr=*/0, interfaceMask | defaultInterfaceMask,
                      interruptMask | defaultInterruptMask, asynFlags, 1, priority, stackSize)
     , m_portName(portName)
-    , m_messageQueue(queueSize, sizeof(void*))
+    , m_queueSize(std::max(queueSize, 1))
+    , m_queuePolicy(QUEUE_DROP_NEWEST)
     , m_thread(0)
     , m_shutdown(false)
     , m_lastParamsCallback(epicsTime::getCurrent())
+    , m_cpuTime(0)
+    , m_lastLatencyUpdate(LatencyHistogram::now())
 {
     createParam("MsgOldDas",    asynParamGenericPointer,    &MsgOldDas);
     createParam("MsgError",     asynParamGenericPointer,    &MsgError);
@@ -54,8 +58,29 @@ BasePlugin::BasePlugin(const char *portName, int blocking, int interfaceMask, in
     createParam("MsgDasRtdl",   asynParamGenericPointer,    &MsgDasRtdl);
     createParam("MsgParamExch", asynParamGenericPointer,    &MsgParamExch);
     createParam("ParamsUpdateRate", asynParamFloat64,       &ParamsUpdateRate);
-
-    if (blocking) {
+    createParam("QueueWaitP50", asynParamFloat64,   &QueueWaitP50, 0.0);    // READ - Median time message waited in queue, in us
+    createParam("QueueWaitP99", asynParamFloat64,   &QueueWaitP99, 0.0);    // READ - 99th percentile of queue wait time, in us
+    createParam("QueueWaitMax", asynParamFloat64,   &QueueWaitMax, 0.0);    // READ - Max queue wait time, in us
+    createParam("ProcTimeP50",  asynParamFloat64,   &ProcTimeP50, 0.0);     // READ - Median message processing time, in us
+    createParam("ProcTimeP99",  asynParamFloat64,   &ProcTimeP99, 0.0);     // READ - 99th percentile of processing time, in us
+    createParam("ProcTimeMax",  asynParamFloat64,   &ProcTimeMax, 0.0);     // READ - Max processing time, in us
+    createParam("SendWaitP50",  asynParamFloat64,   &SendWaitP50, 0.0);     // READ - Median time waiting for subscribers, in us
+    createParam("SendWaitP99",  asynParamFloat64,   &SendWaitP99, 0.0);     // READ - 99th percentile of time waiting for subscribers, in us
+    createParam("SendWaitMax",  asynParamFloat64,   &SendWaitMax, 0.0);     // READ - Max time waiting for subscribers, in us
+    createParam("CpuLoad",      asynParamFloat64,   &CpuLoad, 0.0);         // READ - Percentage of single CPU used processing data
+    createParam("QueuePolicy",  asynParamInt32,     &QueuePolicy, QUEUE_DROP_NEWEST); // WRITE - Action when receive queue is full
+    createParam("QueueSize",    asynParamInt32,     &QueueSize, (int)m_queueSize); // WRITE - Max number of messages in receive queue
+    createParam("QueueUsed",    asynParamInt32,     &QueueUsed, 0);         // READ - Max number of queued messages in last period
+    createParam("QueueDropPkts",asynParamInt32,     &QueueDropPkts, 0);     // READ - Number of packets discarded due to full queue
+    createParam("QueueDropEvents",asynParamInt32,   &QueueDropEvents, 0);   // READ - Number of events discarded due to full queue
+    createParam("FanOut",       asynParamInt32,     &FanOut, 0);            // WRITE - Subscribers process messages serially (0) or concurrently (1)
+
+    std::function<float()> countersCb = std::bind(&BasePlugin::countersTimerCb, this);
+    m_countersTimer.schedule(countersCb, 1.0);
+
+    if (blocking)
+        m_executor = Executor::get();
+    if (blocking && !m_executor) {
         std::string threadName = m_portName + "_Thread";
         m_thread = new Thread(
             threadName.c_str(),
@@ -70,13 +95,42 @@ BasePlugin::BasePlugin(const char *portName, int blocking, int interfaceMask, in
 
 BasePlugin::~BasePlugin()
 {
+    m_countersTimer.cancel();
+
+    if (m_executor) {
+        // Submitted job will see shutdown flag and not resubmit itself
+        m_queueMutex.lock();
+        m_shutdown = true;
+        m_queueMutex.unlock();
+        m_queueSpaceEvent.signal();
+        while (true) {
+            m_queueMutex.lock();
+            bool scheduled = m_scheduled;
+            m_queueMutex.unlock();
+            if (!scheduled)
+                break;
+            m_unscheduledEvent.wait();
+        }
+
+        for (auto &q: m_queue)
+            q.msg->release();
+        m_queue.clear();
+    }
+
     if (m_thread) {
         // Wake-up processing thread by sending a dummy message. The thread
         // will then exit based on the changed m_shutdown param.
+        m_queueMutex.lock();
         m_shutdown = true;
-        m_messageQueue.send(0, 0);
+        m_queueMutex.unlock();
+        m_queueEvent.signal();
+        m_queueSpaceEvent.signal();
         m_thread->stop();
         delete m_thread;
+
+        for (auto &q: m_queue)
+            q.msg->release();
+        m_queue.clear();
     }
 
     disconnect();
@@ -242,48 +296,231 @@ void BasePlugin::recvDownstreamCb(asynUser *pasynUser, void *ptr)
     PluginMessage *msg = reinterpret_cast<PluginMessage *>(ptr);
     if (msg != 0) {
 
-        if (m_thread == 0) {
+        Executor *executor = (msg->isParallel() ? Executor::get() : nullptr);
+
+        if (m_thread == 0 && m_executor == nullptr && executor != nullptr) {
+            /* Sender allows concurrent processing and waits for all subscribers
+             * to release message, which keeps messages in order.
+             */
+            msg->claim();
+            executor->submit([this, msgType, msg]() {
+                processMessage(msgType, msg);
+                msg->release();
+            });
+        } else if (m_thread == 0 && m_executor == nullptr) {
             /* In blocking mode, process the callback in calling thread. Return when
              * processing is complete.
              */
-            lock();
-            recvDownstream(msgType, msg);
-            unlock();
+            processMessage(msgType, msg);
         } else {
             /* Non blocking mode means the callback will be processed in our background
-             * thread. Make a reservation so that it doesn't go away.
+             * thread or executor. Make a reservation so that it doesn't go away.
              */
+            bool submit = false;
             msg->claim();
-            std::pair<int, PluginMessage*> *q = new std::pair<int, PluginMessage *>(msgType, msg);
-            if (q == nullptr || m_messageQueue.trySend(&q, sizeof(&q)) == -1) {
-                msg->release();
-                if (q != nullptr) {
-                    LOG_ERROR("Message queue full, discarding message");
-                    m_messageQueue.show();
+
+            m_queueMutex.lock();
+            while (m_queue.size() >= m_queueSize && !m_shutdown) {
+                if (m_queuePolicy == QUEUE_DROP_NEWEST) {
+                    dropMessage(msgType, msg);
+                    msg = nullptr;
+                    break;
+                } else if (m_queuePolicy == QUEUE_DROP_OLDEST) {
+                    dropMessage(m_queue.front().type, m_queue.front().msg);
+                    m_queue.pop_front();
+                } else {
+                    m_queueMutex.unlock();
+                    Executor::blockingWait(m_queueSpaceEvent);
+                    m_queueMutex.lock();
                 }
             }
+            if (msg != nullptr) {
+                if (m_shutdown) {
+                    msg->release();
+                } else {
+                    m_queue.push_back(QueuedMessage{msgType, msg, LatencyHistogram::now()});
+                    m_queueMaxUsed = std::max(m_queueMaxUsed, (uint32_t)m_queue.size());
+                    // Other senders may be waiting for space as well
+                    if (m_queue.size() < m_queueSize)
+                        m_queueSpaceEvent.signal();
+                    if (m_executor && !m_scheduled)
+                        submit = m_scheduled = true;
+                }
+            }
+            m_queueMutex.unlock();
+            if (submit)
+                m_executor->submit(std::bind(&BasePlugin::recvDownstreamJob, this));
+            else if (m_thread)
+                m_queueEvent.signal();
         }
     }
 }
 
+void BasePlugin::dropMessage(int type, PluginMessage *msg)
+{
+    if (type == MsgDasData) {
+        const DasDataPacketList *packets = msg->get<const DasDataPacketList>();
+        m_dropPkts += packets->size();
+        for (const auto &packet: *packets)
+            m_dropEvents += packet->getNumEvents();
+    } else if (type == MsgOldDas) {
+        m_dropPkts += msg->get<const DasPacketList>()->size();
+    } else if (type == MsgDasCmd) {
+        m_dropPkts += msg->get<const DasCmdPacketList>()->size();
+    } else if (type == MsgDasRtdl) {
+        m_dropPkts += msg->get<const RtdlPacketList>()->size();
+    } else if (type == MsgError) {
+        m_dropPkts += msg->get<const ErrorPacketList>()->size();
+    }
+    msg->release();
+}
+
 void BasePlugin::recvDownstreamThread(epicsEvent *shutdown)
 {
-    while (!m_shutdown) {
-        std::pair<int, PluginMessage *> *q = NULL;
-        if (m_messageQueue.receive(&q, sizeof(&q)) <= 0)
-            continue;
+    std::vector<QueuedMessage> batch;
+
+    while (true) {
+        m_queueMutex.lock();
+        while (m_queue.empty() && !m_shutdown) {
+            m_queueMutex.unlock();
+            m_queueEvent.wait();
+            m_queueMutex.lock();
+        }
+        if (m_shutdown) {
+            m_queueMutex.unlock();
+            break;
+        }
+
+        dequeueBatch(batch);
+        m_queueMutex.unlock();
+        m_queueSpaceEvent.signal();
+
+        processBatch(batch);
+    }
+}
+
+void BasePlugin::recvDownstreamJob()
+{
+    std::vector<QueuedMessage> batch;
+
+    m_queueMutex.lock();
+    if (!m_queue.empty() && !m_shutdown)
+        dequeueBatch(batch);
+    m_queueMutex.unlock();
+    m_queueSpaceEvent.signal();
+
+    if (!batch.empty())
+        processBatch(batch);
+
+    m_queueMutex.lock();
+    bool resubmit = (!m_queue.empty() && !m_shutdown);
+    m_scheduled = resubmit;
+    // Signal while locked, destructor may proceed as soon as it's unlocked
+    if (!resubmit)
+        m_unscheduledEvent.signal();
+    m_queueMutex.unlock();
+
+    if (resubmit)
+        m_executor->submit(std::bind(&BasePlugin::recvDownstreamJob, this));
+}
+
+void BasePlugin::dequeueBatch(std::vector<QueuedMessage> &batch)
+{
+    batch.clear();
+    batch.push_back(m_queue.front());
+    m_queue.pop_front();
+    if (m_queuePolicy == QUEUE_COALESCE && batch.front().type == MsgDasData) {
+        while (!m_queue.empty() && m_queue.front().type == MsgDasData) {
+            batch.push_back(m_queue.front());
+            m_queue.pop_front();
+        }
+    }
+}
 
-        int msgType = q->first;
-        PluginMessage *msg = q->second;
+void BasePlugin::processBatch(std::vector<QueuedMessage> &batch)
+{
+    uint64_t now = LatencyHistogram::now();
+    for (auto &q: batch)
+        m_queueWait.add(now - q.queued);
 
-        if (msg != 0) {
-            lock();
-            recvDownstream(msgType, msg);
-            unlock();
-            msg->release();
+    if (batch.size() == 1) {
+        processMessage(batch.front().type, batch.front().msg);
+    } else {
+        m_coalesced.clear();
+        for (auto &q: batch) {
+            const DasDataPacketList *packets = q.msg->get<const DasDataPacketList>();
+            m_coalesced.insert(m_coalesced.end(), packets->begin(), packets->end());
         }
-        delete q;
+        PluginMessage msg(&m_coalesced);
+        processMessage(MsgDasData, &msg);
     }
+
+    for (auto &q: batch)
+        q.msg->release();
+}
+
+void BasePlugin::processMessage(int type, PluginMessage *msg)
+{
+    if (m_unlockedProcessing)
+        m_processMutex.lock();
+    else
+        lock();
+
+    uint64_t cpuStart = LatencyHistogram::threadCpuTime();
+    uint64_t start = LatencyHistogram::now();
+
+    recvDownstream(type, msg);
+
+    uint64_t end = LatencyHistogram::now();
+    m_cpuTime += LatencyHistogram::threadCpuTime() - cpuStart;
+    m_procTime.add(end - start);
+
+    if (m_unlockedProcessing)
+        m_processMutex.unlock();
+    else
+        unlock();
+}
+
+void BasePlugin::updateStatsParams(uint64_t now)
+{
+    uint64_t interval = now - m_lastLatencyUpdate;
+    if (interval == 0)
+        return;
+    m_lastLatencyUpdate = now;
+
+    LatencyHistogram::Summary queueWait = m_queueWait.collect();
+    setDoubleParam(QueueWaitP50, queueWait.p50);
+    setDoubleParam(QueueWaitP99, queueWait.p99);
+    setDoubleParam(QueueWaitMax, queueWait.max);
+
+    LatencyHistogram::Summary procTime = m_procTime.collect();
+    setDoubleParam(ProcTimeP50, procTime.p50);
+    setDoubleParam(ProcTimeP99, procTime.p99);
+    setDoubleParam(ProcTimeMax, procTime.max);
+
+    LatencyHistogram::Summary sendWait = m_sendWait.collect();
+    setDoubleParam(SendWaitP50, sendWait.p50);
+    setDoubleParam(SendWaitP99, sendWait.p99);
+    setDoubleParam(SendWaitMax, sendWait.max);
+
+    setDoubleParam(CpuLoad, 100.0 * m_cpuTime.exchange(0) / interval);
+
+    m_queueMutex.lock();
+    uint32_t maxUsed = m_queueMaxUsed;
+    uint32_t dropPkts = m_dropPkts;
+    uint32_t dropEvents = m_dropEvents;
+    m_queueMaxUsed = m_queue.size();
+    m_dropPkts = 0;
+    m_dropEvents = 0;
+    m_queueMutex.unlock();
+
+    setIntegerParam(QueueUsed, maxUsed);
+    if (dropPkts > 0) {
+        addIntegerParam(QueueDropPkts, dropPkts);
+        addIntegerParam(QueueDropEvents, dropEvents);
+        LOG_WARN("Receive queue full, discarded %u packets", dropPkts);
+    }
+    callParamCallbacks();
 }
 
 void BasePlugin::recvDownstream(int type, PluginMessage *msg)
@@ -307,10 +544,12 @@ void BasePlugin::recvDownstream(int type, PluginMessage *msg)
     }
 }
 
-std::unique_ptr<PluginMessage> BasePlugin::sendDownstream(int type, const void *data, bool wait)
+std::unique_ptr<PluginMessage> BasePlugin::sendDownstream(int type, const void *data, bool wait, bool parallel)
 {
+    uint64_t start = LatencyHistogram::now();
     std::unique_ptr<PluginMessage> msg(new PluginMessage(data));
     if (msg) {
+        msg->setParallel((wait || parallel) && m_parallelFanOut);
         msg->claim();
         void *ptr = reinterpret_cast<void *>(msg.get());
         doCallbacksGenericPointer(ptr, type, 0);
@@ -318,11 +557,21 @@ std::unique_ptr<PluginMessage> BasePlugin::sendDownstream(int type, const void *
         if (wait) {
             msg->waitAllReleased();
             msg.reset();
+            m_sendWait.add(LatencyHistogram::now() - start);
         }
     }
     return msg;
 }
 
+void BasePlugin::waitAllReleased(const std::vector< std::unique_ptr<PluginMessage> > &messages, uint64_t sendStart)
+{
+    for (const auto &msg: messages) {
+        if (msg)
+            msg->waitAllReleased();
+    }
+    m_sendWait.add(LatencyHistogram::now() - sendStart);
+}
+
 asynStatus BasePlugin::writeGenericPointer(asynUser *pasynUser, void *ptr)
 {
     int msgType = pasynUser->reason;
@@ -340,6 +589,38 @@ asynStatus BasePlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
         ParamsExch *p = reinterpret_cast<ParamsExch *>(pasynUser->userData);
         return this->recvParam(p->portName, p->paramName, value);
     }
+    if (pasynUser->reason == QueuePolicy) {
+        if (value < QUEUE_BLOCK || value > QUEUE_COALESCE) {
+            LOG_ERROR("Invalid queue policy %d", value);
+            return asynError;
+        }
+        if (m_queueLossless && (value == QUEUE_DROP_NEWEST || value == QUEUE_DROP_OLDEST)) {
+            LOG_ERROR("Plugin must not discard messages, queue policy not changed");
+            return asynError;
+        }
+        m_queueMutex.lock();
+        m_queuePolicy = static_cast<OverflowPolicy>(value);
+        m_queueMutex.unlock();
+        m_queueSpaceEvent.signal();
+    }
+    if (pasynUser->reason == FanOut) {
+        if (value < 0 || value > 1) {
+            LOG_ERROR("Invalid fan-out mode %d", value);
+            return asynError;
+        }
+        setParallelFanOut(value == 1);
+    }
+    if (pasynUser->reason == QueueSize) {
+        if (value < 1) {
+            LOG_ERROR("Queue size must be at least 1");
+            return asynError;
+        }
+        m_queueMutex.lock();
+        m_queueSize = value;
+        // Shrinking queue keeps already queued messages
+        m_queueMutex.unlock();
+        m_queueSpaceEvent.signal();
+    }
     return asynPortDriver::writeInt32(pasynUser, value);
 }
 
@@ -530,3 +811,113 @@ void BasePlugin::callParamCallbacksRatelimit() {
         m_lastParamsCallback = now;
     }
 }
+
+void BasePlugin::setUnlockedProcessing()
+{
+    m_unlockedProcessing = true;
+}
+
+void BasePlugin::setLosslessQueue(OverflowPolicy policy)
+{
+    if (policy == QUEUE_DROP_NEWEST || policy == QUEUE_DROP_OLDEST)
+        policy = QUEUE_BLOCK;
+
+    m_queueMutex.lock();
+    m_queueLossless = true;
+    m_queuePolicy = policy;
+    m_queueMutex.unlock();
+    setIntegerParam(QueuePolicy, policy);
+}
+
+BasePlugin::Counter *BasePlugin::createCounter(int param)
+{
+    asynParamType type;
+    if (getParamType(param, &type) != asynSuccess || (type != asynParamInt32 && type != asynParamFloat64)) {
+        LOG_ERROR("Counter requires Int32 or Float64 parameter");
+        return nullptr;
+    }
+
+    Counter *counter = new Counter(param, type);
+    m_countersMutex.lock();
+    m_counters.emplace_back(counter);
+    m_countersMutex.unlock();
+    return counter;
+}
+
+void BasePlugin::resetCounter(Counter *counter)
+{
+    counter->m_pending.exchange(0);
+    counter->m_total = 0;
+    if (counter->type == asynParamFloat64)
+        setDoubleParam(counter->param, 0.0);
+    else
+        setIntegerParam(counter->param, 0);
+    callParamCallbacks();
+}
+
+float BasePlugin::countersTimerCb()
+{
+    lock();
+    double period = getDoubleParam(ParamsUpdateRate);
+    updateStatsParams(LatencyHistogram::now());
+    publishCounters();
+    unlock();
+
+    // Parameter is not initialized until records are loaded
+    if (period <= 0.0)
+        period = 1.0;
+    return period;
+}
+
+void BasePlugin::publishCounters()
+{
+    bool changed = false;
+
+    m_countersMutex.lock();
+    for (auto &counter: m_counters) {
+        uint64_t increment = counter->m_pending.exchange(0);
+        if (increment == 0)
+            continue;
+
+        counter->m_total += increment;
+        if (counter->type == asynParamFloat64)
+            setDoubleParam(counter->param, counter->m_total % LLONG_MAX);
+        else
+            setIntegerParam(counter->param, counter->m_total % INT32_MAX);
+        changed = true;
+    }
+    m_countersMutex.unlock();
+
+    if (changed)
+        callParamCallbacks();
+}
+
+void BasePlugin::flushStatsParams()
+{
+    lock();
+    updateStatsParams(LatencyHistogram::now());
+    publishCounters();
+    unlock();
+}
+
+void BasePlugin::report(FILE *fp, int details)
+{
+    fprintf(fp, "Latency [us]      p50       p99       max\n");
+    fprintf(fp, "  queue wait %9.1f %9.1f %9.1f\n", getDoubleParam(QueueWaitP50), getDoubleParam(QueueWaitP99), getDoubleParam(QueueWaitMax));
+    fprintf(fp, "  processing %9.1f %9.1f %9.1f\n", getDoubleParam(ProcTimeP50), getDoubleParam(ProcTimeP99), getDoubleParam(ProcTimeMax));
+    fprintf(fp, "  send wait  %9.1f %9.1f %9.1f\n", getDoubleParam(SendWaitP50), getDoubleParam(SendWaitP99), getDoubleParam(SendWaitMax));
+    fprintf(fp, "CPU load: %.1f%%\n", getDoubleParam(CpuLoad));
+    fprintf(fp, "Fan-out: %s\n", (m_parallelFanOut ? "parallel" : "serial"));
+    if (m_thread || m_executor) {
+        static const char *policies[] = { "block", "drop newest", "drop oldest", "coalesce" };
+        m_queueMutex.lock();
+        size_t used = m_queue.size();
+        m_queueMutex.unlock();
+        fprintf(fp, "Queue: %zu/%zu used, policy %s, dropped %d packets %d events\n",
+                used, m_queueSize, policies[m_queuePolicy],
+                getIntegerParam(QueueDropPkts), getIntegerParam(QueueDropEvents));
+    }
+    fprintf(fp, "Threads:\n");
+    Thread::report(fp, m_portName);
+    asynPortDriver::report(fp, details);
+}
@@ -12,15 +12,22 @@
 
 #include "PluginMessage.h"
 #include "EpicsRegister.h"
+#include "Executor.h"
+#include "LatencyHistogram.h"
+#include "Log.h"
 #include "Thread.h"
+#include "Timer.h"
 
 #include <stdint.h>
 #include <string>
 #include <functional>
+#include <deque>
 #include <list>
 #include <memory>
+#include <vector>
 #include <asynPortDriver.h>
-#include <epicsMessageQueue.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
 #include <epicsThread.h>
 
 typedef std::vector<const DasPacket*> DasPacketList;
@@ -68,10 +75,46 @@ typedef std::vector<const ErrorPacket*> ErrorPacketList;
  * data - also called blocking mode. The opposite direction is called upstream
  * and is executed in callers' thread.
  *
+ * Every blocking plugin creates its own thread by default. When IOC wide
+ * Executor is enabled with nedExecutorConfig, plugins don't get their own
+ * threads and their messages are processed by executor workers instead.
+ * Plugin has at most one job submitted at any time which keeps processing
+ * of its messages serial and in order.
+ *
  * Parameters to be exposed to EPICS are created using asynPortDriver *param
  * mechanism. There's plenty of helper functions in this class to help derived
  * classes with managing those parameters.
  *
+ * Every plugin measures time messages spend waiting in queue, time spent
+ * in recvDownstream() and time sender waits for all subscribers to process
+ * message. Percentiles of these and CPU time spent processing messages are
+ * published as parameters every ParamsUpdateRate seconds by the counters
+ * timer, also when plugin doesn't receive any messages.
+ *
+ * Statistics counters incremented in data path should be created with
+ * createCounter(). Hot path only increments an atomic value and a shared
+ * low priority timer thread adds accumulated values to parameters every
+ * ParamsUpdateRate seconds, so data processing doesn't contend for
+ * parameters with clients.
+ *
+ * recvDownstream() is invoked with port locked by default. Plugins that
+ * take their configuration from a ConfigSnapshot and only update counters
+ * can call setUnlockedProcessing() to let parameter writes proceed while
+ * data is being processed.
+ *
+ * Plugins with a receive thread queue messages until the thread picks them
+ * up. What happens when the queue is full is defined by QueuePolicy
+ * parameter, sender can be blocked or messages can be discarded. Queue depth
+ * can be changed at runtime through QueueSize parameter.
+ *
+ * Plugins without receive queue process messages in sender's thread, one
+ * after another. With FanOut parameter set to parallel, sender hands
+ * those subscribers to executor so they process message concurrently.
+ * sendDownstream() still returns only after all subscribers processed
+ * message. Sender that publishes several messages before waiting for
+ * them with waitAllReleased() passes parallel flag to sendDownstream()
+ * to get the same.
+ *
  * Plugin instances can be loaded at compile time or at run time. For compile
  * time inclusion simply instantiate a new object of the plugin class somewhere
  * in the code. For runtime loaded plugins, the plugin class implementation must
@@ -83,6 +126,16 @@ class BasePlugin : public asynPortDriver {
         static const int defaultInterfaceMask = asynInt32Mask | asynGenericPointerMask | asynDrvUserMask | asynFloat64Mask;
         static const int defaultInterruptMask = asynInt32Mask | asynGenericPointerMask;
 
+        /**
+         * Action taken when receive queue is full.
+         */
+        enum OverflowPolicy {
+            QUEUE_BLOCK         = 0,    //!< Block sender until there's space in queue
+            QUEUE_DROP_NEWEST   = 1,    //!< Discard incoming message
+            QUEUE_DROP_OLDEST   = 2,    //!< Discard oldest queued message to make space for new one
+            QUEUE_COALESCE      = 3,    //!< Block sender, process consecutive queued data messages in one call
+        };
+
         /**
          * Constructor
          *
@@ -211,62 +264,78 @@ class BasePlugin : public asynPortDriver {
          * plugins have received and processed the message. No PluginMessage is
          * returned in that case.
          *
+         * Subscribers process message concurrently only when FanOut is
+         * parallel and sender waits for them, either in wait mode or by
+         * setting parallel flag and waiting for returned message later.
+         *
          * @param[in] type of message to be sent
          * @param[in] msg to be sent
          * @param[in] wait for plugins to process message before returning
+         * @param[in] parallel caller waits for returned message before data goes away
          */
-        std::unique_ptr<PluginMessage> sendDownstream(int type, const void *data, bool wait=true);
+        std::unique_ptr<PluginMessage> sendDownstream(int type, const void *data, bool wait=true, bool parallel=false);
 
         /**
          * Send DasPackets to any connected child plugins.
          *
-         * @see sendDownstream(int, const void *, bool)
+         * @see sendDownstream(int, const void *, bool, bool)
          */
-        std::unique_ptr<PluginMessage> sendDownstream(const DasPacketList &packets, bool wait=true)
+        std::unique_ptr<PluginMessage> sendDownstream(const DasPacketList &packets, bool wait=true, bool parallel=false)
         {
-            return sendDownstream(MsgOldDas, &packets, wait);
+            return sendDownstream(MsgOldDas, &packets, wait, parallel);
         }
 
         /**
          * Send DasDataPackets to any connected child plugins.
          *
-         * @see sendDownstream(int, const void *, bool)
+         * @see sendDownstream(int, const void *, bool, bool)
          */
-        std::unique_ptr<PluginMessage> sendDownstream(const DasDataPacketList &packets, bool wait=true)
+        std::unique_ptr<PluginMessage> sendDownstream(const DasDataPacketList &packets, bool wait=true, bool parallel=false)
         {
-            return sendDownstream(MsgDasData, &packets, wait);
+            return sendDownstream(MsgDasData, &packets, wait, parallel);
         }
 
         /**
          * Send DasCmdPackets to any connected child plugins.
          *
-         * @see sendDownstream(int, const void *, bool)
+         * @see sendDownstream(int, const void *, bool, bool)
          */
-        std::unique_ptr<PluginMessage> sendDownstream(const DasCmdPacketList &packets, bool wait=true)
+        std::unique_ptr<PluginMessage> sendDownstream(const DasCmdPacketList &packets, bool wait=true, bool parallel=false)
         {
-            return sendDownstream(MsgDasCmd, &packets, wait);
+            return sendDownstream(MsgDasCmd, &packets, wait, parallel);
         }
 
         /**
          * Send RtdlPackets to any connected child plugins.
          *
-         * @see sendDownstream(int, const void *, bool)
+         * @see sendDownstream(int, const void *, bool, bool)
          */
-        std::unique_ptr<PluginMessage> sendDownstream(const RtdlPacketList &packets, bool wait=true)
+        std::unique_ptr<PluginMessage> sendDownstream(const RtdlPacketList &packets, bool wait=true, bool parallel=false)
         {
-            return sendDownstream(MsgDasRtdl, &packets, wait);
+            return sendDownstream(MsgDasRtdl, &packets, wait, parallel);
         }
 
         /**
          * Send ErrorPackets to any connected child plugins.
          *
-         * @see sendDownstream(int, const void *, bool)
+         * @see sendDownstream(int, const void *, bool, bool)
          */
-        std::unique_ptr<PluginMessage> sendDownstream(const ErrorPacketList &packets, bool wait=true)
+        std::unique_ptr<PluginMessage> sendDownstream(const ErrorPacketList &packets, bool wait=true, bool parallel=false)
         {
-            return sendDownstream(MsgError, &packets, wait);
+            return sendDownstream(MsgError, &packets, wait, parallel);
         }
 
+        /**
+         * Wait for subscribers to release messages sent without waiting.
+         *
+         * Time since sendStart is accounted in SendWait statistics, same
+         * as for sendDownstream() in wait mode.
+         *
+         * @param[in] messages returned by sendDownstream(), empty ones are skipped
+         * @param[in] sendStart LatencyHistogram::now() before first message was sent
+         */
+        void waitAllReleased(const std::vector< std::unique_ptr<PluginMessage> > &messages, uint64_t sendStart);
+
         /**
          * A callback function called upon receiving message from child plugin.
          *
@@ -590,7 +659,118 @@ class BasePlugin : public asynPortDriver {
 	 */
         void callParamCallbacksRatelimit();
 
+        /**
+         * Print latency and CPU usage statistics in addition to asynPortDriver report.
+         */
+        void report(FILE *fp, int details) override;
+
+        /**
+         * Publish latency, CPU, queue parameters and counters without waiting for ParamsUpdateRate.
+         *
+         * Port must not be locked.
+         */
+        void flushStatsParams();
+
+    protected:
+        /**
+         * Statistics counter that can be incremented without port lock.
+         *
+         * Increments are accumulated in atomic variable and periodically
+         * added to associated parameter by counters thread. Running total
+         * is kept in 64 bits, Int32 parameter wraps at INT32_MAX.
+         */
+        class Counter {
+            public:
+                /**
+                 * Increment counter, safe to call from any thread.
+                 */
+                void add(uint64_t increment)
+                {
+                    m_pending.fetch_add(increment, std::memory_order_relaxed);
+                }
+
+                Counter &operator+=(uint64_t increment)
+                {
+                    add(increment);
+                    return *this;
+                }
+
+            private:
+                friend class BasePlugin;
+
+                Counter(int param_, asynParamType type_)
+                    : param(param_)
+                    , type(type_)
+                {}
+
+                const int param;                    //!< Associated Int32 or Float64 parameter
+                const asynParamType type;           //!< Associated parameter type
+                std::atomic<uint64_t> m_pending{0}; //!< Increments not yet added to parameter
+                uint64_t m_total{0};                //!< Value of counter, port lock protects it
+        };
+
+        /**
+         * Create counter associated with existing Int32 or Float64 parameter.
+         *
+         * Counters are owned by this class and are valid until plugin is
+         * destroyed.
+         *
+         * @return Counter or nullptr if parameter type is not supported.
+         */
+        Counter *createCounter(int param);
+
+        /**
+         * Discard pending increments and clear associated parameter.
+         *
+         * Port must be locked.
+         */
+        void resetCounter(Counter *counter);
+
+        /**
+         * Select queue policy that never discards messages.
+         *
+         * Archiving plugins should call this function from constructor.
+         * Afterwards only lossless policies can be selected through
+         * QueuePolicy parameter.
+         */
+        void setLosslessQueue(OverflowPolicy policy=QUEUE_BLOCK);
+
+        /**
+         * Account CPU time spent outside recvDownstream(), included in CpuLoad.
+         *
+         * Plugins producing data in their own thread should call it for
+         * every processed chunk of data. Safe to call from any thread.
+         *
+         * @param[in] ns CPU time in ns
+         */
+        void addCpuTime(uint64_t ns)
+        {
+            m_cpuTime += ns;
+        }
+
+        /**
+         * Invoke recvDownstream() without holding port lock.
+         *
+         * Calls are still serialized with an internal mutex, recvDownstream()
+         * implementation must not access parameters or any other state
+         * shared with parameter handlers. Should be called from constructor.
+         */
+        void setUnlockedProcessing();
+
+        /**
+         * Select serial or parallel fan-out like FanOut parameter does.
+         *
+         * For ports without their own records that should follow another
+         * port. Safe to call from any thread.
+         */
+        void setParallelFanOut(bool parallel)
+        {
+            m_parallelFanOut = parallel;
+        }
+
     private:
+        struct QueuedMessage;
+
         /**
          * Receive threads' main function when in blocking mode.
          *
@@ -599,12 +779,76 @@ class BasePlugin : public asynPortDriver {
          *
          * Runs until the shutdown flag is not set. It monitors message queue
          * and processes every message in receive thread context. Deffers
-         * the actual work to processUpstreamMsg() function.
+         * the actual work to processMessage() function. With coalesce policy
+         * all consecutive data messages in queue are processed as one.
          *
          * @param[out] shutdown Flags when the thread should stop.
          */
         void recvDownstreamThread(epicsEvent *shutdown);
 
+        /**
+         * Executor job processing one batch of queued messages.
+         *
+         * Job is submitted when first message is queued. It resubmits
+         * itself while there are more messages in queue, which lets other
+         * plugins' jobs run in between.
+         */
+        void recvDownstreamJob();
+
+        /**
+         * Take next batch of messages from queue.
+         *
+         * Queue mutex must be locked and queue must not be empty. With
+         * coalesce policy all consecutive data messages are taken.
+         */
+        void dequeueBatch(std::vector<QueuedMessage> &batch);
+
+        /**
+         * Process and release batch of messages taken from queue.
+         */
+        void processBatch(std::vector<QueuedMessage> &batch);
+
+        /**
+         * Invoke recvDownstream() and account time spent in it.
+         *
+         * Port must not be locked, function locks it or only serializes
+         * processing when setUnlockedProcessing() was selected.
+         */
+        void processMessage(int type, PluginMessage *msg);
+
+        /**
+         * Release message without processing it and account it as dropped.
+         *
+         * Queue mutex must be locked.
+         */
+        void dropMessage(int type, PluginMessage *msg);
+
+        /**
+         * Publish latency, CPU and queue parameters collected since last update.
+         *
+         * Port must be locked.
+         *
+         * @param[in] now Current monotonic time in ns
+         */
+        void updateStatsParams(uint64_t now);
+
+        /**
+         * Counters timer callback.
+         *
+         * Publishes counters and statistics every ParamsUpdateRate seconds
+         * at low priority.
+         *
+         * @return Delay until next invocation.
+         */
+        float countersTimerCb();
+
+        /**
+         * Add pending counter increments to parameters and do callbacks.
+         *
+         * Port must be locked.
+         */
+        void publishCounters();
+
     private:
         /**
          * Structure to describe asyn interface.
@@ -616,15 +860,50 @@ class BasePlugin : public asynPortDriver {
             void *asynGenericPointerInterrupt;      //!< Generic pointer interrupt handler
         };
 
+        /**
+         * Message waiting in queue for plugin thread.
+         */
+        struct QueuedMessage {
+            int type;                               //!< Message type
+            PluginMessage *msg;                     //!< Claimed message
+            uint64_t queued;                        //!< Monotonic time when queued, in ns
+        };
+
         std::string m_portName;                     //!< Port name
         std::list<RemotePort> m_connectedPorts;     //!< List of connected remote ports.
-        epicsMessageQueue m_messageQueue;           //!< Message queue for non-blocking mode
+        std::deque<QueuedMessage> m_queue;          //!< Message queue for non-blocking mode
+        epicsMutex m_queueMutex;                    //!< Protects m_queue and related members
+        epicsEvent m_queueEvent;                    //!< Signals new message in queue
+        epicsEvent m_queueSpaceEvent;               //!< Signals free space in queue
+        size_t m_queueSize;                         //!< Max number of messages in queue
+        OverflowPolicy m_queuePolicy;               //!< Action when queue is full
+        bool m_queueLossless{false};                //!< Only lossless policies allowed
+        uint32_t m_queueMaxUsed{0};                 //!< Max queue usage since last update
+        uint32_t m_dropPkts{0};                     //!< Dropped packets since last update
+        uint32_t m_dropEvents{0};                   //!< Dropped events since last update
+        DasDataPacketList m_coalesced;              //!< Packets of coalesced messages
         Thread *m_thread;                           //!< Thread ID if created during constructor, 0 otherwise
-        bool m_shutdown;                            //!< Flag to shutdown the thread, used in conjunction with messageQueue wakeup
+        Executor *m_executor{nullptr};              //!< Executor processing queued messages instead of m_thread
+        bool m_scheduled{false};                    //!< Job processing queue is submitted to executor
+        epicsEvent m_unscheduledEvent;              //!< Signals job completed without resubmitting itself
+        std::atomic<bool> m_parallelFanOut{false};  //!< Subscribers process sent messages concurrently
+        bool m_shutdown;                            //!< Flag to shutdown the thread, used in conjunction with queue wakeup
         bool m_locked{false};
+        bool m_unlockedProcessing{false};           //!< Don't lock port while in recvDownstream()
+        epicsMutex m_processMutex;                  //!< Serializes recvDownstream() calls in unlocked mode
 	epicsTime m_lastParamsCallback;             //!< Last time callParamCallbacksRatelimit() was called
+        LatencyHistogram m_queueWait;               //!< Time messages spent in queue
+        LatencyHistogram m_procTime;                //!< Time spent in recvDownstream()
+        LatencyHistogram m_sendWait;                //!< Time sendDownstream() waited for subscribers
+        std::atomic<uint64_t> m_cpuTime;            //!< CPU time spent processing data since last update, in ns
+        uint64_t m_lastLatencyUpdate;               //!< Last time latency params were updated, in ns
+        std::list<std::unique_ptr<Counter>> m_counters; //!< Counters published by counters thread
+        epicsMutex m_countersMutex;                 //!< Protects m_counters list
+        Timer m_countersTimer{true};                //!< Timer publishing counters and statistics
 
     protected:
+        Log::Sites m_logSites;                      //!< Rate limiting state of LOG_*_RATELIMIT call sites
+
         int MsgOldDas;
         int MsgError;
         int MsgDasData;
@@ -632,6 +911,22 @@ class BasePlugin : public asynPortDriver {
         int MsgDasRtdl;
         int MsgParamExch;
 	int ParamsUpdateRate;
+        int QueueWaitP50;   //!< Median time message waited in queue, in us
+        int QueueWaitP99;   //!< 99th percentile of time message waited in queue, in us
+        int QueueWaitMax;   //!< Max time message waited in queue, in us
+        int ProcTimeP50;    //!< Median time to process message, in us
+        int ProcTimeP99;    //!< 99th percentile of time to process message, in us
+        int ProcTimeMax;    //!< Max time to process message, in us
+        int SendWaitP50;    //!< Median time waiting for subscribers to process sent message, in us
+        int SendWaitP99;    //!< 99th percentile of time waiting for subscribers, in us
+        int SendWaitMax;    //!< Max time waiting for subscribers, in us
+        int CpuLoad;        //!< Percentage of single CPU spent processing data
+        int QueuePolicy;    //!< Action when receive queue is full, see BasePlugin::OverflowPolicy
+        int QueueSize;      //!< Max number of messages in receive queue
+        int QueueUsed;      //!< Max number of queued messages in last update period
+        int QueueDropPkts;  //!< Number of packets discarded due to full queue
+        int QueueDropEvents;//!< Number of events in discarded DAS data packets
+        int FanOut;         //!< Subscribers process sent messages one after another or concurrently
 };
 
 #endif // PLUGIN_DRIVER_H
@@ -9,6 +9,7 @@
 
 #include "Common.h"
 #include "BasePortPlugin.h"
+#include "HugePages.h"
 #include "Log.h"
 
 #include <cstring> // strerror
@@ -31,10 +32,22 @@ BasePortPlugin::BasePortPlugin(const char *pluginName, int blocking, int interfa
     createParam("DumpCmdPkts",      asynParamInt32,     &DumpCmdPkts, 0);           // WRITE - When enabled, dump inbound and outbound packets to console in hex format
     createParam("DumpDroppedPkts",  asynParamInt32,     &DumpDroppedPkts, 0);       // WRITE - When enabled, dump dropped packets
     createParam("CntDropPkts",      asynParamInt32,     &CntDropPkts, 0);        // READ - Number of packets dropped by SW
+    createParam("FlightRecSize",    asynParamInt32,     &FlightRecSize, 0);         // WRITE - Flight recorder size in MB, 0 disables recording
+    createParam("FlightRecAge",     asynParamInt32,     &FlightRecAge, 0);          // WRITE - Seconds of recorded data to save, 0 saves all
+    createParam("FlightRecDir",     asynParamOctet,     &FlightRecDir);             // WRITE - Directory where to save flight recordings
+    createParam("FlightRecTrigs",   asynParamInt32,     &FlightRecTrigs, 0xF);      // WRITE - Enabled flight recorder triggers bitmask
+    createParam("FlightRecSave",    asynParamInt32,     &FlightRecSave, 0);         // WRITE - Save flight recording now
+    createParam("FlightRecFile",    asynParamOctet,     &FlightRecFile);            // READ - Last saved flight recording
     callParamCallbacks();
 
+    m_flightRecorder = std::unique_ptr<FlightRecorder>(new FlightRecorder(
+        pluginName,
+        std::bind(&BasePortPlugin::flightRecSaved, this, std::placeholders::_1, std::placeholders::_2)
+    ));
+    m_flightRecorder->setTriggers(0xF);
+
     m_processThread = std::unique_ptr<Thread>(new Thread(
-        "Process incoming data",
+        (std::string(pluginName) + "_Process").c_str(),
         std::bind(&BasePortPlugin::processDataThread, this, std::placeholders::_1),
         epicsThreadGetStackSize(epicsThreadStackMedium),
         epicsThreadPriorityHigh
@@ -72,6 +85,56 @@ asynStatus BasePortPlugin::readInt32(asynUser *pasynUser, epicsInt32 *value)
     return asynPortDriver::readInt32(pasynUser, value);
 }
 
+asynStatus BasePortPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    if (pasynUser->reason == FlightRecSize) {
+        if (value < 0) {
+            LOG_ERROR("Invalid flight recorder size %d MB", value);
+            return asynError;
+        }
+        // Allocating and prefaulting takes a while, don't block other PVs
+        this->unlock();
+        m_flightRecorder->resize(value * 1024UL * 1024UL);
+        this->lock();
+    } else if (pasynUser->reason == FlightRecAge) {
+        m_flightRecorder->setMaxAge(value);
+    } else if (pasynUser->reason == FlightRecTrigs) {
+        m_flightRecorder->setTriggers(value);
+    } else if (pasynUser->reason == FlightRecSave) {
+        if (!m_flightRecorder->trigger(FlightRecorder::TRIG_MANUAL)) {
+            LOG_WARN("Flight recorder disabled or already saving");
+            return asynError;
+        }
+        return asynSuccess;
+    }
+    return BasePlugin::writeInt32(pasynUser, value);
+}
+
+asynStatus BasePortPlugin::writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual)
+{
+    if (pasynUser->reason == FlightRecDir) {
+        std::string dir(value, nChars);
+        while (dir.size() > 1 && dir.back() == '/')
+            dir.pop_back();
+        m_flightRecorder->setDirectory(dir);
+    }
+    return BasePlugin::writeOctet(pasynUser, value, nChars, nActual);
+}
+
+void BasePortPlugin::flightRecSaved(const std::string &path, int error)
+{
+    if (error != 0) {
+        LOG_ERROR("Failed to save flight recording to %s: %s", path.c_str(), strerror(error));
+        return;
+    }
+    LOG_INFO("Saved flight recording to %s", path.c_str());
+
+    this->lock();
+    setStringParam(FlightRecFile, path);
+    callParamCallbacks();
+    this->unlock();
+}
+
 void BasePortPlugin::recvUpstream(const DasCmdPacketList &packets)
 {
     bool forceOldPkts = getBooleanParam(OldPktsEn);
@@ -169,6 +232,7 @@ void BasePortPlugin::processDataThread(epicsEvent *shutdown)
         if (ret == -ETIME || ret == -ECONNRESET) {
             continue;
         } else if (ret != 0) {
+            m_flightRecorder->trigger(FlightRecorder::TRIG_ERROR);
             handleRecvError(ret);
             LOG_ERROR("Unable to read data from buffer, processing thread stopped - %s(%d)\n", strerror(-ret), ret);
             break;
@@ -177,7 +241,9 @@ void BasePortPlugin::processDataThread(epicsEvent *shutdown)
         m_lastDataLen = length;
 
         try {
+            uint64_t cpuStart = LatencyHistogram::threadCpuTime();
             uint32_t left = processData(reinterpret_cast<uint8_t*>(data), length);
+            addCpuTime(LatencyHistogram::threadCpuTime() - cpuStart);
             m_circularBuffer->consume(length - left);
             retryCounter = 0;
         } catch (std::runtime_error &e) {
@@ -190,6 +256,9 @@ void BasePortPlugin::processDataThread(epicsEvent *shutdown)
 
             // Still doesn't have enough data, abort thread. handleRecvError() will do OCC report if enabled
             LOG_ERROR("Aborting processing thread: %s", e.what());
+            // Offending data is not packet aligned, but that's what we need to see
+            m_flightRecorder->record(data, std::min(length, (uint32_t)m_flightRecorder->maxRecordSize()));
+            m_flightRecorder->trigger(FlightRecorder::TRIG_ERROR);
             handleRecvError(-ERANGE);
             break;
         }
@@ -208,9 +277,16 @@ uint32_t BasePortPlugin::processData(const uint8_t *ptr, uint32_t size)
     DasCmdPacketList dasCmd;
     RtdlPacketList rtdls;
     ErrorPacketList errors;
-    std::list<std::shared_ptr<uint8_t>> fromPool; //!< Packets to be returned back to pool
     uint32_t nPackets = 0; // Used for throwing an exception on first packet
     uint32_t nDropped = 0;
+    uint32_t trigger = 0;
+
+    // Record whole packets in chunks small enough for flight recorder
+    const uint8_t *recStart = ptr;
+    size_t recLimit = m_flightRecorder->maxRecordSize() / 2;
+
+    // Previous chunk has been fully processed by all plugins
+    m_convertArena.reset();
 
     const uint8_t *end = ptr + size;
     while (ptr < end) {
@@ -230,22 +306,20 @@ uint32_t BasePortPlugin::processData(const uint8_t *ptr, uint32_t size)
                 ptr += das1Packet->getLength();
                 oldDas.push_back(das1Packet);
 
-                // Convert to packet format used internally
-                size_t bufsize = 2 * das1Packet->getLength(); // just an estimate how much space we need
-                auto buffer = m_packetsPool.getPtr(bufsize);
-                if (buffer) {
-                    fromPool.push_back(buffer);
-                    packet = das1Packet->convert(buffer.get(), bufsize, dataFormat);
-                } else {
-                    throw std::runtime_error("Failed to allocate packet from pool");
-                }
+                // Convert to packet format used internally, converted
+                // packet is never longer than original
+                uint8_t *buffer = m_convertArena.reserve(das1Packet->getLength());
+                packet = das1Packet->convert(buffer, das1Packet->getLength(), dataFormat);
+                if (packet)
+                    m_convertArena.commit(packet->getLength());
                 // Will add new-style packet to list below
 
             } else if (version == 1) {
                 packet = Packet::cast(ptr, bytesLeft);
 
                 if (m_recvId != 0xFFFFFFFF && packet->getSequenceId() != ((m_recvId+1) % 255) && packet->getSequenceId() != 0) {
-                    LOG_ERROR("Expecting packet with sequence number %u, got %u", (m_recvId+1)%255, packet->getSequenceId());
+                    LOG_ERROR_RATELIMIT("Expecting packet with sequence number %u, got %u", (m_recvId+1)%255, packet->getSequenceId());
+                    trigger = FlightRecorder::TRIG_SEQUENCE;
                 }
                 m_recvId = packet->getSequenceId();
                 ptr += packet->getLength();
@@ -254,6 +328,10 @@ uint32_t BasePortPlugin::processData(const uint8_t *ptr, uint32_t size)
                 throw std::runtime_error("Unsupported packet received");
             }
             nPackets++;
+            if (recLimit > 0 && (size_t)(ptr - recStart) >= recLimit) {
+                m_flightRecorder->record(recStart, ptr - recStart);
+                recStart = ptr;
+            }
         } catch (...) {
             if (nPackets == 0)
                 throw;
@@ -272,7 +350,8 @@ uint32_t BasePortPlugin::processData(const uint8_t *ptr, uint32_t size)
                         throw std::runtime_error("integrity check failed");
                     dasData.push_back(dataPacket);
                 } catch (std::runtime_error &e) {
-                    LOG_WARN("Discarding DAS data packet, %s", e.what());
+                    LOG_WARN_RATELIMIT("Discarding DAS data packet, %s", e.what());
+                    trigger = FlightRecorder::TRIG_INTEGRITY;
                     dropped = true;
                 }
                 break;
@@ -283,7 +362,8 @@ uint32_t BasePortPlugin::processData(const uint8_t *ptr, uint32_t size)
                         throw std::runtime_error("integrity check failed");
                     rtdls.push_back(rtdlPacket);
                 } catch (std::runtime_error &e) {
-                    LOG_WARN("Discarding RTDL packet, %s", e.what());
+                    LOG_WARN_RATELIMIT("Discarding RTDL packet, %s", e.what());
+                    trigger = FlightRecorder::TRIG_INTEGRITY;
                     dropped = true;
                 }
                 break;
@@ -294,7 +374,8 @@ uint32_t BasePortPlugin::processData(const uint8_t *ptr, uint32_t size)
                         throw std::runtime_error("integrity check failed");
                     dasCmd.push_back(cmdPacket);
                 } catch (std::runtime_error &e) {
-                    LOG_WARN("Discarding DAS command packet, %s", e.what());
+                    LOG_WARN_RATELIMIT("Discarding DAS command packet, %s", e.what());
+                    trigger = FlightRecorder::TRIG_INTEGRITY;
                     dropped = true;
                 }
                 break;
@@ -302,7 +383,7 @@ uint32_t BasePortPlugin::processData(const uint8_t *ptr, uint32_t size)
                 errors.push_back(reinterpret_cast<const ErrorPacket *>(packet));
                 break;
             default:
-                LOG_WARN("Discarding unknown packet");
+                LOG_WARN_RATELIMIT("Discarding unknown packet");
                 dropped = true;
                 break;
             }
@@ -315,18 +396,25 @@ uint32_t BasePortPlugin::processData(const uint8_t *ptr, uint32_t size)
         }
     }
 
+    // Record before triggering so that the bad packet is saved too
+    if (recLimit > 0 && ptr > recStart)
+        m_flightRecorder->record(recStart, ptr - recStart);
+    if (trigger != 0)
+        m_flightRecorder->trigger(static_cast<FlightRecorder::Trigger>(trigger));
+
     // Publish all packets in parallel ..
+    uint64_t sendStart = LatencyHistogram::now();
     std::vector< std::unique_ptr<PluginMessage> > messages;
     if (!oldDas.empty())
-        messages.push_back(sendDownstream(oldDas, false));
+        messages.push_back(sendDownstream(oldDas, false, true));
     if (!dasCmd.empty())
-        messages.push_back(sendDownstream(dasCmd, false));
+        messages.push_back(sendDownstream(dasCmd, false, true));
     if (!dasData.empty())
-        messages.push_back(sendDownstream(dasData, false));
+        messages.push_back(sendDownstream(dasData, false, true));
     if (!rtdls.empty())
-        messages.push_back(sendDownstream(rtdls, false));
+        messages.push_back(sendDownstream(rtdls, false, true));
     if (!errors.empty())
-        messages.push_back(sendDownstream(errors, false));
+        messages.push_back(sendDownstream(errors, false, true));
 
     // ... in the mean time update PVs ...
     if (nDropped > 0) {
@@ -335,11 +423,7 @@ uint32_t BasePortPlugin::processData(const uint8_t *ptr, uint32_t size)
     }
 
     // .. and wait for all of them to get released
-    for (const auto& m: messages) {
-        if (m) {
-            m->waitAllReleased();
-        }
-    }
+    waitAllReleased(messages, sendStart);
 
     return (end - ptr);
 }
@@ -375,6 +459,8 @@ void BasePortPlugin::dump(const char *data, uint32_t len)
 void BasePortPlugin::report(FILE *fp, int details)
 {
     BasePlugin::report(fp, details);
+    HugePages::report(fp);
+    m_flightRecorder->report(fp);
     if (details & 0xF0 && m_lastData != nullptr) {
         fprintf(fp, "Last data received (%u bytes):\n    ", m_lastDataLen);
         for (uint32_t i = 0; i < m_lastDataLen/4; i++) {
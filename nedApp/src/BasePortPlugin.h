@@ -12,7 +12,8 @@
 
 #include "BasePlugin.h"
 #include "BaseCircularBuffer.h"
-#include "ObjectPool.h"
+#include "FlightRecorder.h"
+#include "PacketArena.h"
 #include "Thread.h"
 
 #include <vector>
@@ -24,6 +25,11 @@
  * don't connect to parent plugins, instead the communicate to hardware directly
  * in order to send and receive packets. BasePortPlugin implements common
  * functionality to all port plugins.
+ *
+ * All received data is also copied to FlightRecorder when enabled through
+ * FlightRecSize parameter. Recorded data is saved to FlightRecDir directory
+ * when processing stops due to an error, when packet sequence gap or
+ * integrity failure is detected, or on request.
  */
 class epicsShareFunc BasePortPlugin : public BasePlugin {
     public:
@@ -53,6 +59,16 @@ class epicsShareFunc BasePortPlugin : public BasePlugin {
          */
         asynStatus readInt32(asynUser *pasynUser, epicsInt32 *value);
 
+        /**
+         * Overloaded method to handle flight recorder parameters.
+         */
+        asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value) override;
+
+        /**
+         * Overloaded method to handle flight recorder directory.
+         */
+        asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual) override;
+
         /**
          * Overloaded method invoked by iocsh asynReport()
          *
@@ -103,6 +119,7 @@ class epicsShareFunc BasePortPlugin : public BasePlugin {
     protected:
         std::unique_ptr<Thread> m_processThread;        //!< Thread processing data from buffer
         BaseCircularBuffer *m_circularBuffer = nullptr; //!< Derived class must provide circular buffer
+        std::unique_ptr<FlightRecorder> m_flightRecorder; //!< Keeps most recent raw data for post-mortem analysis
 
         /**
          * Dump part of data from buffer.
@@ -113,7 +130,7 @@ class epicsShareFunc BasePortPlugin : public BasePlugin {
         unsigned m_sendId = 0;                          //!< Output packets sequence number
         unsigned m_recvId = 0;                          //!< Last received packet sequence number
         std::array<uint8_t, 4096> m_sendBuffer;         //!< Buffer used for sending
-        ObjectPool<uint8_t> m_packetsPool{true};        //!< Packets pool management, used for converting DAS 1.0 -> DAS 2.0 packets
+        PacketArena m_convertArena;                     //!< Storage for DAS 1.0 -> DAS 2.0 converted packets of single chunk
         const void *m_lastData{nullptr};                //!< Last data received
         uint32_t m_lastDataLen{0};                      //!< Length of last data received
         const Packet *m_lastGoodPacket{nullptr};        //!< Last good packet received and processed
@@ -128,6 +145,11 @@ class epicsShareFunc BasePortPlugin : public BasePlugin {
          */
         void processDataThread(epicsEvent *shutdown);
 
+        /**
+         * Report saved flight recording through PV, called from recorder thread.
+         */
+        void flightRecSaved(const std::string &path, int error);
+
     protected:
         int BufUsed;
         int BufSize;
@@ -138,6 +160,12 @@ class epicsShareFunc BasePortPlugin : public BasePlugin {
         int DumpCmdPkts;
         int DumpDroppedPkts;
         int CntDropPkts;
+        int FlightRecSize;
+        int FlightRecAge;
+        int FlightRecDir;
+        int FlightRecTrigs;
+        int FlightRecSave;
+        int FlightRecFile;
 };
 
 #endif // BASE_PORT_PLUGIN_H
@@ -11,15 +11,19 @@
 #include "likely.h"
 #include "Log.h"
 
-#include <fcntl.h>
 #include <poll.h>
 #include <osiSock.h>
 #include <string.h> // strerror
 
+#include <algorithm>
+
+#define DEFAULT_QUEUE_SIZE      (16*1024*1024)
+#define MIN_QUEUE_SIZE          (64*1024)
+
 BaseSocketPlugin::BaseSocketPlugin(const char *portName)
     : BasePlugin(portName, 1, asynOctetMask|asynFloat64Mask, asynOctetMask|asynFloat64Mask)
     , m_listenSock(-1)
-    , m_clientSock(-1)
+    , m_clientsSent(MAX_CLIENTS, 0)
 {
     createParam("ListenIp",     asynParamOctet,     &ListenIP);         // WRITE - Hostname or IP address to listen to
     createParam("ListenPort",   asynParamInt32,     &ListenPort);       // WRITE - Port number to listen to
@@ -27,10 +31,25 @@ BaseSocketPlugin::BaseSocketPlugin(const char *portName)
     createParam("ClientIp",     asynParamOctet,     &ClientIP, "");     // READ - Client IP if connected, or empty string
     createParam("CheckInt",     asynParamInt32,     &CheckInt, 2);      // WRITE - Check client interval in seconds
     createParam("ClientInactive",asynParamFloat64,  &ClientInactive, 0.0);// READ - Number of seconds of client inactivity
-    createParam("CloseClient",  asynParamInt32,     &CloseClient, 0);   // WRITE - Force client disconnect
+    createParam("CloseClient",  asynParamInt32,     &CloseClient, 0);   // WRITE - Force all clients disconnect
+    createParam("MaxClients",   asynParamInt32,     &MaxClients, 1);    // WRITE - Max number of concurrently connected clients
+    createParam("NumClients",   asynParamInt32,     &NumClients, 0);    // READ - Number of connected clients
+    createParam("SendQueueSize",asynParamInt32,     &SendQueueSize, DEFAULT_QUEUE_SIZE); // WRITE - Client send queue size in bytes, applied to new clients
+    for (unsigned i = 0; i < MAX_CLIENTS; i++) {
+        std::string prefix = "Client" + std::to_string(i + 1);
+        createParam(prefix + "Ip",      asynParamOctet,     &Clients[i].Ip, "");        // READ - Client IP if connected, or empty string
+        createParam(prefix + "Policy",  asynParamInt32,     &Clients[i].Policy, SocketClient::POLICY_DISCONNECT); // WRITE - Action when queue is full, applied to new client
+        createParam(prefix + "Rate",    asynParamFloat64,   &Clients[i].Rate, 0.0);     // READ - Throughput in MB/s
+        createParam(prefix + "Lag",     asynParamInt32,     &Clients[i].Lag, 0);        // READ - Bytes waiting in send queue
+        createParam(prefix + "Dropped", asynParamInt32,     &Clients[i].Dropped, 0);    // READ - Messages dropped due to full queue
+        createParam(prefix + "Close",   asynParamInt32,     &Clients[i].Close, 0);      // WRITE - Force client disconnect
+
+        m_clients.emplace_back(new SocketClient(std::string(portName) + "_Client" + std::to_string(i + 1)));
+    }
     callParamCallbacks();
 
     m_lastClientActivity = { 0, 0 };
+    m_lastStatsUpdate = { 0, 0 };
 
     // Schedule a periodic task to check for incoming client
     std::function<float()> cb = std::bind(&BaseSocketPlugin::checkClient, this);
@@ -40,6 +59,8 @@ BaseSocketPlugin::BaseSocketPlugin(const char *portName)
 BaseSocketPlugin::~BaseSocketPlugin()
 {
     m_watchdogTimer.cancel();
+    for (auto &client: m_clients)
+        client->detach();
 }
 
 bool BaseSocketPlugin::recv(uint32_t *data, uint32_t length, double timeout, uint32_t *actual)
@@ -48,8 +69,15 @@ bool BaseSocketPlugin::recv(uint32_t *data, uint32_t length, double timeout, uin
     int timeout_ms = (timeout > 0 ? timeout * 1000 : 0);
     int ret;
 
+    // Only first client can talk back
     this->lock();
-    fds.fd = m_clientSock;
+    fds.fd = -1;
+    for (auto &client: m_clients) {
+        if (client->isAttached()) {
+            fds.fd = client->getSocket();
+            break;
+        }
+    }
     this->unlock();
     fds.events = POLLIN;
     fds.revents = 0;
@@ -59,7 +87,9 @@ bool BaseSocketPlugin::recv(uint32_t *data, uint32_t length, double timeout, uin
     if (ret != 1 || fds.revents != POLLIN) {
         if (ret == -1) {
             LOG_ERROR("Closed socket due to poll() failure - %s", strerror(errno));
+            this->lock();
             disconnectClient();
+            this->unlock();
         }
         *actual = 0;
         return false;
@@ -69,8 +99,10 @@ bool BaseSocketPlugin::recv(uint32_t *data, uint32_t length, double timeout, uin
     // immediately, non-blocking.
     ret = read(fds.fd, reinterpret_cast<void *>(data), length);
     if (ret == -1) {
-        LOG_ERROR("Closed socket due to write error - %s", strerror(errno));
+        LOG_ERROR("Closed socket due to read error - %s", strerror(errno));
+        this->lock();
         disconnectClient();
+        this->unlock();
         *actual = 0;
         return false;
     } else if (ret > 0) {
@@ -86,71 +118,21 @@ bool BaseSocketPlugin::recv(uint32_t *data, uint32_t length, double timeout, uin
 
 bool BaseSocketPlugin::send(const uint32_t *data, uint32_t length)
 {
-    const char *rest = reinterpret_cast<const char *>(data);
-    epicsTimeStamp t1;
-    int myErrno = 0;
-    int retries = 3; // 1 second for each retry defined when client connects
-    int socket;
-    epicsTimeStamp lastClientActivity = { 0, 0 };
-
-    // Cache the same socket for the duration of this function. If client
-    // disconnects and a new client is connected,
-    // we don't want to send partial data to new client but rather fail this function.
-    this->lock();
-    socket = m_clientSock;
-    this->unlock();
-
-    if (socket == -1)
-        return false;
-
-    epicsTimeGetCurrent(&t1);
-    while (length > 0 && retries-- > 0) {
-        ssize_t sent = write(socket, rest, length);
-        if (likely(sent == length)) {
-            // Optimize most likely path, mainly avoid time consuming unlocking/locking
-            epicsTimeGetCurrent(&lastClientActivity);
-            length = 0;
-            break;
-        } else if (sent > 0) {
-            epicsTimeGetCurrent(&lastClientActivity);
-            length -= sent;
-            rest += sent;
-            myErrno = 0;
-            continue;
-        } else if (sent == -1) {
-            myErrno = errno;
-            // SO_SNDTIMEO will interrupt every 1.0s
-            if (myErrno == EAGAIN || myErrno == EWOULDBLOCK) {
-                // Export client inactivity time through parameter.
-                // PV database can be configured to automatically disconnect
-                // at certain threshold.
-                epicsTimeStamp t2;
-                epicsTimeGetCurrent(&t2);
-                double inactive = epicsTimeDiffInSeconds(&t2, &t1);
-                this->lock();
-                setDoubleParam(ClientInactive, inactive);
-                callParamCallbacks();
-                this->unlock();
-            }
-        } else { // sent == 0
-            myErrno = ENOSPC;
-        }
+    bool queued = false;
+    for (auto &client: m_clients) {
+        if (client->push(data, length))
+            queued = true;
     }
 
-    this->lock();
-    if (length > 0) {
-        disconnectClient();
-        if (retries == 0) {
-            LOG_ERROR("Closed socket, too many retries");
-        } else {
-            LOG_ERROR("Closed socket due to a write error - %s", strerror(myErrno));
-        }
-    } else {
-        m_lastClientActivity = lastClientActivity;
+    if (queued) {
+        epicsTimeStamp now;
+        epicsTimeGetCurrent(&now);
+        this->lock();
+        m_lastClientActivity = now;
+        this->unlock();
     }
-    this->unlock();
 
-    return (length == 0);
+    return queued;
 }
 
 asynStatus BaseSocketPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
@@ -192,7 +174,30 @@ asynStatus BaseSocketPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
     } else if (pasynUser->reason == CloseClient) {
         if (value > 0) {
             disconnectClient();
-            LOG_INFO("Disconnected client on user request");
+            LOG_INFO("Disconnected clients on user request");
+        }
+    } else if (pasynUser->reason == MaxClients) {
+        if (value < 1 || value > static_cast<int>(MAX_CLIENTS)) {
+            LOG_ERROR("Max clients must be between 1 and %u", MAX_CLIENTS);
+            return asynError;
+        }
+    } else if (pasynUser->reason == SendQueueSize) {
+        if (value < MIN_QUEUE_SIZE) {
+            LOG_ERROR("Send queue size must be at least %d bytes", MIN_QUEUE_SIZE);
+            return asynError;
+        }
+    }
+    for (unsigned i = 0; i < MAX_CLIENTS; i++) {
+        if (pasynUser->reason == Clients[i].Policy) {
+            if (value != SocketClient::POLICY_DISCONNECT && value != SocketClient::POLICY_DROP) {
+                LOG_ERROR("Invalid client queue policy %d", value);
+                return asynError;
+            }
+        } else if (pasynUser->reason == Clients[i].Close) {
+            if (value > 0 && m_clients[i]->isAttached()) {
+                LOG_INFO("Disconnected client %s on user request", m_clients[i]->getIp().c_str());
+                disconnectClient(i);
+            }
         }
     }
 
@@ -274,7 +279,7 @@ bool BaseSocketPlugin::setupListeningSocket(const std::string &host, uint16_t po
             break;
         }
 
-        if (listen(sock, 1) != 0) {
+        if (listen(sock, MAX_CLIENTS) != 0) {
             status = (errno == EADDRINUSE ? STATUS_IN_USE : STATUS_SOCKET_ERR);
             LOG_ERROR("Failed to listen to socket - %s", strerror(errno));
             close(sock);
@@ -296,65 +301,130 @@ bool BaseSocketPlugin::setupListeningSocket(const std::string &host, uint16_t po
 
 bool BaseSocketPlugin::isClientConnected()
 {
-    return (m_clientSock != -1);
+    return (getNumClients() > 0);
+}
+
+unsigned BaseSocketPlugin::getNumClients()
+{
+    unsigned n = 0;
+    for (auto &client: m_clients)
+        n += (client->isAttached() ? 1 : 0);
+    return n;
 }
 
 bool BaseSocketPlugin::connectClient()
 {
-    char clientip[128];
-    struct pollfd fds;
-    struct timeval timeout;
+    unsigned maxClients = std::min(static_cast<unsigned>(getIntegerParam(MaxClients)), MAX_CLIENTS);
+    unsigned nClients = getNumClients();
 
-    if (m_clientSock != -1)
-        return true;
+    while (nClients < maxClients) {
+        char clientip[128];
+        struct pollfd fds;
 
-    fds.fd = m_listenSock; // POSIX allows negative values, revents becomes 0
-    fds.events = POLLIN;
-    fds.revents = 0;
+        fds.fd = m_listenSock; // POSIX allows negative values, revents becomes 0
+        fds.events = POLLIN;
+        fds.revents = 0;
 
-    // Non-blocking check
-    if (poll(&fds, 1, 0) == 0 || fds.revents != POLLIN)
-        return false;
+        // Non-blocking check
+        if (poll(&fds, 1, 0) == 0 || fds.revents != POLLIN)
+            break;
 
-    // There should be client waiting now - accept() won't block
-    struct sockaddr client;
-    socklen_t len = sizeof(struct sockaddr);
-    m_clientSock = accept(m_listenSock, &client, &len);
-    if (m_clientSock == -1)
-        return false;
+        // There should be client waiting now - accept() won't block
+        struct sockaddr client;
+        socklen_t len = sizeof(struct sockaddr);
+        int sock = accept(m_listenSock, &client, &len);
+        if (sock == -1)
+            break;
 
-    sockAddrToDottedIP(&client, clientip, sizeof(clientip));
-    setStringParam(ClientIP, clientip);
-    callParamCallbacks();
+        sockAddrToDottedIP(&client, clientip, sizeof(clientip));
 
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 0;
-    if (setsockopt(m_clientSock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0) {
-        // Socket remains in blocking mode, hope client doesn't stall
-        LOG_ERROR("Failed to set socket timeout");
-    }
+        unsigned slot = 0;
+        while (slot < MAX_CLIENTS && m_clients[slot]->isAttached())
+            slot++;
+
+        auto policy = static_cast<SocketClient::Policy>(getIntegerParam(Clients[slot].Policy));
+        if (!m_clients[slot]->attach(sock, clientip, getIntegerParam(SendQueueSize), policy)) {
+            LOG_ERROR("Failed to setup client %s - %s", clientip, strerror(errno));
+            close(sock);
+            break;
+        }
+        nClients++;
 
-    clientConnected();
+        m_clientsSent[slot] = 0;
+        setStringParam(Clients[slot].Ip, clientip);
+        setIntegerParam(Clients[slot].Dropped, 0);
+        setIntegerParam(NumClients, nClients);
+        updateClientIp();
+        callParamCallbacks();
 
-    LOG_INFO("New TCP client from %s", clientip);
+        clientConnected();
+
+        LOG_INFO("New TCP client from %s", clientip);
+    }
 
-    return true;
+    return (nClients > 0);
 }
 
 void BaseSocketPlugin::disconnectClient()
 {
-    if (m_clientSock != -1) {
-        (void)fcntl(m_clientSock, F_SETFL, O_NONBLOCK);
-        (void)close(m_clientSock);
-        m_clientSock = -1;
+    for (unsigned i = 0; i < MAX_CLIENTS; i++)
+        disconnectClient(i);
+}
 
-        setStringParam(ClientIP, "");
+void BaseSocketPlugin::disconnectClient(unsigned slot)
+{
+    if (m_clients[slot]->isAttached()) {
+        m_clients[slot]->detach();
+
+        setStringParam(Clients[slot].Ip, "");
+        setDoubleParam(Clients[slot].Rate, 0.0);
+        setIntegerParam(Clients[slot].Lag, 0);
+        setIntegerParam(NumClients, getNumClients());
+        updateClientIp();
         callParamCallbacks();
 
         clientDisconnected();
     }
 }
 
+void BaseSocketPlugin::updateClientIp()
+{
+    for (auto &client: m_clients) {
+        if (client->isAttached()) {
+            setStringParam(ClientIP, client->getIp());
+            return;
+        }
+    }
+    setStringParam(ClientIP, "");
+}
+
+void BaseSocketPlugin::updateClientStats()
+{
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+    double elapsed = epicsTimeDiffInSeconds(&now, &m_lastStatsUpdate);
+    m_lastStatsUpdate = now;
+
+    double inactive = 0.0;
+    for (unsigned i = 0; i < MAX_CLIENTS; i++) {
+        if (!m_clients[i]->isAttached())
+            continue;
+
+        uint64_t sent = m_clients[i]->getSentBytes();
+        if (elapsed > 0.0)
+            setDoubleParam(Clients[i].Rate, (sent - m_clientsSent[i]) / elapsed / 1e6);
+        m_clientsSent[i] = sent;
+        setIntegerParam(Clients[i].Lag, m_clients[i]->getQueuedBytes());
+        setIntegerParam(Clients[i].Dropped, m_clients[i]->getDroppedMessages());
+        inactive = std::max(inactive, m_clients[i]->getInactive());
+    }
+    // Export client inactivity time through parameter.
+    // PV database can be configured to automatically disconnect
+    // at certain threshold.
+    setDoubleParam(ClientInactive, inactive);
+    callParamCallbacks();
+}
+
 float BaseSocketPlugin::checkClient()
 {
     int checkInt;
@@ -362,6 +432,16 @@ float BaseSocketPlugin::checkClient()
 
     lock();
 
+    for (unsigned i = 0; i < MAX_CLIENTS; i++) {
+        if (m_clients[i]->isFailed()) {
+            if (m_clients[i]->getError() == ENOBUFS)
+                LOG_ERROR("Closed socket to %s, send queue full", m_clients[i]->getIp().c_str());
+            else
+                LOG_ERROR("Closed socket to %s due to a write error - %s", m_clients[i]->getIp().c_str(), strerror(m_clients[i]->getError()));
+            disconnectClient(i);
+        }
+    }
+
     getIntegerParam(CheckInt, &checkInt);
     epicsTimeGetCurrent(&now);
 
@@ -371,10 +451,10 @@ float BaseSocketPlugin::checkClient()
         sendHeartbeat();
     }
 
-    // Now check again in case heartbeat failed and closed the socket
-    if (!isClientConnected()) {
-        connectClient();
-    }
+    // Accept new clients up to the limit
+    connectClient();
+
+    updateClientStats();
 
     unlock();
 
@@ -11,25 +11,41 @@
 #define BASESOCKET_PLUGIN_H
 
 #include "BasePlugin.h"
+#include "SocketClient.h"
 #include "Timer.h"
 
+#include <memory>
+#include <vector>
+
 /**
  * Plugin with server socket capabilities
  *
  * This abstract plugin provides server socket functionality. When listen IP and
  * port parameters are being set through asyn write handlers, plugin will
  * automatically open single listening socket. There's no thread running to
- * check when the client actually connects, instead derived class should
- * periodically call connectClient() function.
+ * check when the client actually connects, instead periodic timer accepts
+ * new clients.
+ *
+ * Up to MaxClients clients can be connected at the same time. Every client
+ * gets its own send queue and writer thread, send() only copies data to
+ * queues and never waits for the socket. Slow client can't stall the
+ * plugin or other clients. When client's queue is full, client's policy
+ * selects whether the message is dropped for that client or the client
+ * is disconnected.
  *
  * All functions in this class assume the plugin is locked while they're called,
- * except for send() and recv() which must be called while unlocked since they
- * can block.
+ * except for recv() which must be called while unlocked since it can block.
+ * send() can be called either way.
  */
 class BaseSocketPlugin : public BasePlugin {
+    public:
+        static const unsigned MAX_CLIENTS = 4;  //!< Number of client slots
+
     private:
         int m_listenSock;           //!< Socket for incoming connections, -1 when not listening
-        int m_clientSock;           //!< Client socket to send/receive data to/from, -1 when no client
+        std::vector<std::unique_ptr<SocketClient>> m_clients; //!< Client slots, always MAX_CLIENTS
+        std::vector<uint64_t> m_clientsSent;    //!< Bytes sent by each client at last statistics update
+        epicsTimeStamp m_lastStatsUpdate;       //!< When were client statistics last updated
         epicsTimeStamp m_lastClientActivity;    //!< When did client last send or receive something, useful for connection upkeeping
         Timer m_watchdogTimer{false};//!< Timer to run period callback
 
@@ -80,7 +96,7 @@ class BaseSocketPlugin : public BasePlugin {
         bool setupListeningSocket(const std::string &host, uint16_t port);
 
         /**
-         * Check whether there's a remote client connected to the server port.
+         * Check whether there's at least one remote client connected to the server port.
          *
          * Function does not validate connection. If the client disconnected but
          * the socket is still valid, function might return true.
@@ -90,43 +106,43 @@ class BaseSocketPlugin : public BasePlugin {
         bool isClientConnected();
 
         /**
-         * Try to connect client socket, don't block.
+         * Return number of connected clients.
+         */
+        unsigned getNumClients();
+
+        /**
+         * Accept all pending clients, don't block.
          *
-         * Caller must hold a lock. When returned with true, m_clientSock is a valid
-         * client id. Function updates CLIENT_IP parameter.
+         * Caller must hold a lock. Clients are accepted until MaxClients
+         * limit is reached, remaining ones wait in listen queue. Function
+         * updates ClientIp and per client parameters.
          *
-         * @return true if connected, false otherwise.
+         * @return true if at least one client is connected, false otherwise.
          */
         bool connectClient();
 
         /**
-         * Disconnect client if connected.
+         * Disconnect all clients.
          *
-         * Caller must hold a lock. Function updates CLIENT_IP parameter.
-         *
-         * @return true when disconnected or no client, false on error.
+         * Caller must hold a lock. Function updates ClientIp parameter.
          */
         void disconnectClient();
 
         /**
-         * Send all data to client through m_clientSock.
-         *
-         * Function ensures all data has been written to socket or the connection
-         * is dropped. When socket's buffer is full, the function will increase
-         * the ClientInactive parameter every second. It releases the lock while
-         * waiting, allowing CloseClient parameter to be used to kill the
-         * connection from outside.
+         * Queue data to be sent to all connected clients.
          *
-         * Caller must ensure the plugin is not locked when this function gets
-         * called. Function may block for some time.
+         * Data is copied to send queue of every client and written to socket
+         * by client's writer thread. Function never blocks on socket, it can
+         * be called with or without plugin locked. Data is never split,
+         * each client either gets all data or nothing.
          *
-         * Function can not be extended with a timeout parameter as the
-         * implementation could not guarantee data integrity on the socket -
-         * partial data can be transmitted to client when timeout would occur.
+         * When client's queue can not take data, client's policy decides
+         * whether the data is dropped for that client only or the client is
+         * marked failed and will be disconnected by the periodic check.
          *
          * @param[in] data Data to be sent through the socket.
          * @param[in] length Length of data in bytes.
-         * @return true if all data has been sent, false on error
+         * @return true if data has been queued for at least one client, false otherwise
          */
         bool send(const uint32_t *data, uint32_t length);
 
@@ -151,8 +167,8 @@ class BaseSocketPlugin : public BasePlugin {
         /**
          * Periodically called to check client connection status or new client
          *
-         * Check for new incoming client, connect it and update ClientIp PV.
-         * If client is already connected but no data was exchanged for a period
+         * Disconnect failed clients, accept new incoming clients and update
+         * per client statistics. If client is already connected but no data was exchanged for a period
          * of time defined by CheckInt parameter, function calls sendHeartbeat().
          *
          * Function is run by the epicsTimer in a background thread shared by
@@ -174,16 +190,18 @@ class BaseSocketPlugin : public BasePlugin {
          *
          * When this function is called, client connection is already established
          * and ready to use. There's periodic check for new client which is driven
-         * by the CheckInt parameter.
+         * by the CheckInt parameter. Called once for every client, getNumClients()
+         * tells whether other clients are already connected.
          */
         virtual void clientConnected() {};
 
         /**
-         * Signal that current client has disconnected.
+         * Signal that one of the clients has disconnected.
          *
          * Called when client disconnect has been detected. There's no active
          * mechanism to check whether the client is still alive. Detect mechanism
-         * is based on the error returned by writing to socket.
+         * is based on the error returned by writing to socket or on client's
+         * send queue overflow.
          */
         virtual void clientDisconnected() {};
 
@@ -199,7 +217,35 @@ class BaseSocketPlugin : public BasePlugin {
          */
         virtual bool sendHeartbeat() { return false; };
 
+    private:
+        /**
+         * Disconnect single client and update its parameters.
+         */
+        void disconnectClient(unsigned slot);
+
+        /**
+         * Set ClientIp to the address of first connected client.
+         */
+        void updateClientIp();
+
+        /**
+         * Update per client throughput, queue and inactivity parameters.
+         */
+        void updateClientStats();
+
     protected:
+        /**
+         * Per client parameters.
+         */
+        struct ClientParams {
+            int Ip;
+            int Policy;
+            int Rate;
+            int Lag;
+            int Dropped;
+            int Close;
+        };
+
         int ListenIP;
         int ListenPort;
         int ListenStatus;
@@ -207,6 +253,10 @@ class BaseSocketPlugin : public BasePlugin {
         int CheckInt;
         int ClientInactive;
         int CloseClient;
+        int MaxClients;
+        int NumClients;
+        int SendQueueSize;
+        ClientParams Clients[MAX_CLIENTS];
 };
 
 #endif // BASESOCKET_PLUGIN_H
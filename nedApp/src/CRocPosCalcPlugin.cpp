@@ -7,38 +7,35 @@
  * @author Klemen Vodopivec
  */
 
-#include "Bits.h"
 #include "CRocPosCalcPlugin.h"
+#include "EventTraits.h"
 #include "Log.h"
+#include "SortingNetwork.h"
 
 #include <algorithm>
+#include <cassert>
 #include <cstring>
 #include <likely.h>
 #include <limits>
 #include <math.h>
 
-EPICS_REGISTER_PLUGIN(CRocPosCalcPlugin, 3, "Port name", string, "Dispatcher port name", string, "Buffer size in bytes", int);
+EPICS_REGISTER_PLUGIN(CRocPosCalcPlugin, 2, "Port name", string, "Parent plugins", string);
 
-#define NUM_CROCPOSCALCPLUGIN_PARAMS      ((int)(&LAST_CROCPOSCALCPLUGIN_PARAM - &FIRST_CROCPOSCALCPLUGIN_PARAM + 1)) + (20 + 17)*3
-
-CRocPosCalcPlugin::CRocPosCalcPlugin(const char *portName, const char *dispatcherPortName, int bufSize)
-    : BaseDispatcherPlugin(portName, dispatcherPortName, 1, NUM_CROCPOSCALCPLUGIN_PARAMS, asynOctetMask, asynOctetMask)
+/**
+ * Input formats, both have the same raw fields layout.
+ */
+typedef EventFormats<
+    DasDataPacket::EVENT_FMT_CROC_RAW,
+    DasDataPacket::EVENT_FMT_CROC_VERBOSE
+> CRocInputFormats;
+
+CRocPosCalcPlugin::CRocPosCalcPlugin(const char *portName, const char *parentPlugins)
+    : BasePlugin(portName, 1)
+    , m_calcParams()
 {
-    if (bufSize > 0) {
-        m_bufferSize = bufSize;
-    } else {
-        m_bufferSize = 4*1024*1024;
-        LOG_INFO("Setting default buffer size to %u bytes", m_bufferSize);
-    }
-    m_buffer = reinterpret_cast<uint8_t *>(malloc(m_bufferSize));
-    if (m_buffer == 0) {
-        m_bufferSize = 0;
-    }
-
+    createParam("ErrMem",       asynParamInt32, &ErrMem, 0);                // READ - Buffer allocation error
     createParam("ResetCnt",     asynParamInt32, &ResetCnt);                 // WRITE - Reset counters
     createParam("CalcEn",       asynParamInt32, &CalcEn, 0);                // WRITE - Toggle position calculation (0=disabled,1=enabled)
-    createParam("OutExtMode",   asynParamInt32, &OutExtMode, 0);            // WRITE - Switch to toggle between normal and extended output format
-    createParam("CntSplit",     asynParamInt32, &CntSplit, 0);              // READ - Number of packet train splits
     createParam("PassVetoes",   asynParamInt32, &PassVetoes, 0);            // WRITE - Allow vetoes in output stream (0=no, 1=yes)
     createParam("GNongapMaxRatio",  asynParamInt32, &GNongapMaxRatio, 0);   // WRITE - TODO
     createParam("EfficiencyBoost",  asynParamInt32, &EfficiencyBoost, 0);   // WRITE - Lower the minimum count restriction (0=no, 1=yes)
@@ -49,6 +46,7 @@ CRocPosCalcPlugin::CRocPosCalcPlugin(const char *portName, const char *dispatche
     createParam("EchoDeadTime",     asynParamInt32, &EchoDeadTime, 250);    // WRITE - Time between two local events in 100ns
     createParam("EchoDeadArea",     asynParamInt32, &EchoDeadArea, 160);    // WRITE - Number of pixels defining the echo-detection area
     createParam("ProcessMode",      asynParamInt32, &ProcessMode, 0);       // WRITE - Select event verification algorithm (0=legacy,1=new)
+    createParam("DiagFormat",       asynParamInt32, &DiagFormat, 0);        // WRITE - Output events format (0=compact,1=double precision)
 
     createParam("CntTotalEvents",   asynParamInt32, &CntTotalEvents, 0);    // READ - Number of all events
     createParam("CntGoodEvents",    asynParamInt32, &CntGoodEvents, 0);     // READ - Number of good events
@@ -67,74 +65,90 @@ CRocPosCalcPlugin::CRocPosCalcPlugin(const char *portName, const char *dispatche
     createParam("CntVetoDelayed",   asynParamInt32, &CntVetoDelayed, 0);    // READ - Number of events delayed based on time range bins
 
     callParamCallbacks();
+
+    m_vetoCounters[Event::CROC::VETO_NO]                    = createCounter(CntGoodEvents);
+    m_vetoCounters[Event::CROC::VETO_Y_LOW_SIGNAL]          = createCounter(CntVetoYLow);
+    m_vetoCounters[Event::CROC::VETO_Y_HIGH_SIGNAL]         = createCounter(CntVetoYNoise);
+    m_vetoCounters[Event::CROC::VETO_X_LOW_SIGNAL]          = createCounter(CntVetoXLow);
+    m_vetoCounters[Event::CROC::VETO_X_HIGH_SIGNAL]         = createCounter(CntVetoXNoise);
+    m_vetoCounters[Event::CROC::VETO_G_LOW_SIGNAL]          = createCounter(CntVetoGLow);
+    m_vetoCounters[Event::CROC::VETO_G_HIGH_SIGNAL]         = createCounter(CntVetoGNoise);
+    m_vetoCounters[Event::CROC::VETO_G_GHOST]               = createCounter(CntVetoGGhost);
+    m_vetoCounters[Event::CROC::VETO_G_NON_ADJACENT]        = createCounter(CntVetoGNonAdj);
+    m_vetoCounters[Event::CROC::VETO_INVALID_POSITION]      = createCounter(CntVetoBadPos);
+    m_vetoCounters[Event::CROC::VETO_INVALID_CALC]          = createCounter(CntVetoBadCalc);
+    m_vetoCounters[Event::CROC::VETO_ECHO]                  = createCounter(CntVetoEcho);
+    m_vetoCounters[Event::CROC::VETO_TIMERANGE_BAD]         = createCounter(CntVetoTimeRange);
+    m_vetoCounters[Event::CROC::VETO_TIMERANGE_DELAYED]     = createCounter(CntVetoDelayed);
+    m_totalCounter = createCounter(CntTotalEvents);
+
+    // Match DiagFormat default
+    m_calcParams.diagCompact = true;
+
+    BasePlugin::connect(parentPlugins, {MsgDasData});
 }
 
 CRocPosCalcPlugin::~CRocPosCalcPlugin()
 {
-    // Prevent further parameter exchange
-    enableCallbacks(false);
-
     // Must deallocate by name, positions table could have multiple entries
     // to the same pointer.
     m_detParamsByPosition.clear();
     for (auto it=m_detParamsByName.begin(); it!=m_detParamsByName.end(); it++) {
-        free(it->second);
-        m_detParamsByName.erase(it);
+        delete it->second;
     }
+    m_detParamsByName.clear();
 }
 
 asynStatus CRocPosCalcPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
 {
-    bool handled = false;
-
-    m_paramsMutex.lock();
-    if (pasynUser->reason == REASON_PARAMS_EXCH) {
-        // CRocPlugin is sending CROC parameter, cache it locally
-        ParamsExch *p = reinterpret_cast<ParamsExch *>(pasynUser->userData);
-        saveDetectorParam(p->portName, p->paramName, value);
-        handled = true;
-    } else if (pasynUser->reason == ResetCnt) {
-        m_stats.reset();
-        handled = true;
+    if (pasynUser->reason == ResetCnt) {
+        for (auto &counter: m_vetoCounters)
+            resetCounter(counter.second);
+        resetCounter(m_totalCounter);
+        callParamCallbacks();
+        return asynSuccess;
     } else if (pasynUser->reason == PassVetoes) {
         m_calcParams.passVetoes = (value != 0);
-        handled = true;
+        return asynSuccess;
     } else if (pasynUser->reason == EfficiencyBoost) {
         m_calcParams.efficiencyBoost = (value != 0);
-        handled = true;
+        return asynSuccess;
     } else if (pasynUser->reason == GNongapMaxRatio) {
         m_calcParams.gNongapMaxRatio = value / 100.0;
-        handled = true;
+        return asynSuccess;
     } else if (pasynUser->reason == TimeRange1Min) {
         m_calcParams.timeRange1Min = value;
-        handled = true;
+        return asynSuccess;
     } else if (pasynUser->reason == TimeRange2Min) {
         m_calcParams.timeRange2Min = value;
-        handled = true;
+        return asynSuccess;
     } else if (pasynUser->reason == TimeRangeDelayMin) {
         m_calcParams.timeRangeDelayMin = value;
-        handled = true;
+        return asynSuccess;
     } else if (pasynUser->reason == TimeRangeSumMax) {
         m_calcParams.timeRangeSumMax = value;
-        handled = true;
+        return asynSuccess;
     } else if (pasynUser->reason == EchoDeadTime) {
         m_calcParams.echoDeadTime = value;
-        handled = true;
+        return asynSuccess;
     } else if (pasynUser->reason == EchoDeadArea) {
         m_calcParams.echoDeadArea = value / 2;
-        handled = true;
-    } else if (pasynUser->reason == OutExtMode) {
-        m_calcParams.outExtMode = (value != 0);
-        handled = true;
+        return asynSuccess;
     } else if (pasynUser->reason == ProcessMode) {
         m_calcParams.processModeNew = (value != 0);
-        handled = true;
-    }
-    m_paramsMutex.unlock();
-    if (handled == true)
         return asynSuccess;
+    } else if (pasynUser->reason == DiagFormat) {
+        m_calcParams.diagCompact = (value == 0);
+        return asynSuccess;
+    }
+    return BasePlugin::writeInt32(pasynUser, value);
+}
 
-    return BaseDispatcherPlugin::writeInt32(pasynUser, value);
+asynStatus CRocPosCalcPlugin::recvParam(const std::string &remotePort, const std::string &paramName, epicsInt32 value)
+{
+    // CRocPlugin is sending CROC parameter, cache it locally
+    saveDetectorParam(remotePort, paramName, value);
+    return asynSuccess;
 }
 
 void CRocPosCalcPlugin::saveDetectorParam(const std::string &detector, const std::string &param, epicsInt32 value)
@@ -146,7 +160,7 @@ void CRocPosCalcPlugin::saveDetectorParam(const std::string &detector, const std
     // First find existing CRocParam structure or create new one
     auto it = m_detParamsByName.find(detector);
     if (it == m_detParamsByName.end()) {
-        params = new CRocParams;
+        params = new CRocParams();
         params->position = 0xFFFFFFFF;
         m_detParamsByName[detector] = params;
     } else {
@@ -239,173 +253,178 @@ void CRocPosCalcPlugin::saveDetectorParam(const std::string &detector, const std
     }
 }
 
-void CRocPosCalcPlugin::processDataUnlocked(const DasPacketList * const packetList)
-{
-    int nReceived = 0;
-    int nProcessed = 0;
-    int nSplits = 0;
-    bool calcEn = false;
-    DataMode inDataMode;
-
-    this->lock();
-    getIntegerParam(RxCount,        &nReceived);
-    getIntegerParam(ProcCount,      &nProcessed);
-    getIntegerParam(CntSplit,       &nSplits);
-    getBooleanParam(CalcEn,         &calcEn);
-    inDataMode = getDataMode();
-    this->unlock();
-
-    if (inDataMode != BasePlugin::DATA_MODE_RAW && inDataMode != BasePlugin::DATA_MODE_EXTENDED)
-        calcEn = false;
-
-    nReceived += packetList->size();
-
-    // Optimize pass thru mode
-    if (calcEn == false) {
-        m_packetList.reset(packetList); // reset() automatically reserves
-        sendToPlugins(&m_packetList);
-        m_packetList.release();
-        m_packetList.waitAllReleased();
-        m_packetList.clear();
-    } else {
-        m_paramsMutex.lock();
+struct CRocPosCalcPlugin::ProcessPacket {
+    CRocPosCalcPlugin *plugin;
+    const DasDataPacket *srcPacket;
+    DasDataPacket *&destPacket;
+    Stats &stats;
+
+    template <typename Traits>
+    void operator()(const Traits &)
+    {
+        static_assert(Traits::diagFormat == DasDataPacket::EVENT_FMT_CROC_DIAG, "CROC format expected");
+
+        if (plugin->m_calcParams.diagCompact)
+            process<EventTraits<DasDataPacket::EVENT_FMT_CROC_DIAG_COMPACT>>(Traits::events(srcPacket), Traits::size);
+        else
+            process<EventTraits<DasDataPacket::EVENT_FMT_CROC_DIAG>>(Traits::events(srcPacket), Traits::size);
+    }
+
+    template <typename DestTraits>
+    void process(const void *events, uint32_t srcEventSize)
+    {
+        uint32_t nEvents = srcPacket->getNumEvents();
+        epicsTimeStamp timestamp = srcPacket->getTimeStamp();
+        uint64_t pulseId = (static_cast<uint64_t>(timestamp.secPastEpoch) << 32) | timestamp.nsec;
+
+        destPacket = plugin->m_packetsPool.get(DasDataPacket::getLength(DestTraits::format, nEvents));
+        if (destPacket) {
+            destPacket->init(DestTraits::format, timestamp, nEvents);
+            const uint8_t *srcEvents = reinterpret_cast<const uint8_t *>(events);
+            auto *destEvents = DestTraits::events(destPacket);
+            uint32_t nOutEvents = plugin->processEvents(srcEvents, srcEventSize, nEvents, pulseId, destEvents, stats);
+            if (nOutEvents != nEvents) {
+                // Rejected events were dropped, only header is rewritten
+                destPacket->init(DestTraits::format, timestamp, nOutEvents);
+            }
+        }
+    }
+};
 
-        m_calcParams.inExtMode = (inDataMode == BasePlugin::DATA_MODE_EXTENDED);
+void CRocPosCalcPlugin::recvDownstream(const DasDataPacketList &packets)
+{
+    DasDataPacketList outPackets;
+    std::vector<DasDataPacket *> pooledPackets;
+    Stats counters;
+
+    if (getBooleanParam(CalcEn) == false) {
+        // Optimize pass-thru
+        sendDownstream(packets);
+        return;
+    }
+
+    for (const auto &packet: packets) {
+        DasDataPacket *destPacket = nullptr;
+        Stats stats;
+        if (!CRocInputFormats::dispatch(packet->getEventsFormat(), ProcessPacket{this, packet, destPacket, stats})) {
+            // Not in right data format for this plugin
+            outPackets.push_back(packet);
+        } else if (destPacket != nullptr) {
+            outPackets.push_back(destPacket);
+            pooledPackets.push_back(destPacket);
+            counters += stats;
+        } else {
+            // Can't allocate packet
+            addIntegerParam(ErrMem, 1);
+        }
+    }
 
-        // Break single loop into two parts to have single point of sending data
-        for (auto it = packetList->cbegin(); it != packetList->cend(); ) {
-            uint32_t bufferOffset = 0;
-            m_packetList.clear();
-            m_packetList.reserve();
+    // Send to subscribed plugins and wait they complete processing
+    sendDownstream(outPackets);
 
-            for (; it != packetList->cend(); it++) {
-                const DasPacket *packet = *it;
+    for (auto &packet: pooledPackets) {
+        m_packetsPool.put(packet);
+    }
 
-                // Reuse the original packet if nothing to map
-                if (packet->isNeutronData() == false) {
-                    m_packetList.push_back(packet);
-                    continue;
-                }
+    for (auto &counter: m_vetoCounters)
+        *counter.second += counters.get(counter.first);
+    *m_totalCounter += counters.getTotal();
+    callParamCallbacksRatelimit();
+}
 
-                // Calculate space needed for this packet
-                uint32_t pktSize = packet->getLength();
-                if (!m_calcParams.inExtMode) {
-                    // Convert to extended mode, add space for pixel field
-                    uint32_t nEvents = (packet->getDataLength() / sizeof(CRocDataPacket::RawEvent));
-                    pktSize += 4*nEvents;
-                }
+template <typename T>
+uint32_t CRocPosCalcPlugin::processEvents(const uint8_t *srcEvents, uint32_t srcEventSize, uint32_t nEvents, uint64_t pulseId, T *destEvents, Stats &stats)
+{
+    Batch batch;
+    uint32_t nOutEvents = 0;
+
+    // Packet usually contains events from a single detector
+    uint32_t lastPosition = 0xFFFFFFFF;
+    CRocParams *lastParams = nullptr;
+
+    for (uint32_t offset = 0; offset < nEvents; offset += BATCH_SIZE) {
+        const uint8_t *batchEvents = srcEvents + offset*srcEventSize;
+        uint32_t batchSize = std::min(BATCH_SIZE, nEvents - offset);
+
+        for (uint32_t i = 0; i < batchSize; i++) {
+            const Event::CROC::Raw *event = reinterpret_cast<const Event::CROC::Raw *>(batchEvents + i*srcEventSize);
+            if (event->position != lastPosition) {
+                auto it = m_detParamsByPosition.find(event->position);
+                lastParams = (it != m_detParamsByPosition.end() ? it->second : nullptr);
+                lastPosition = event->position;
+            }
+            batch.params[i] = lastParams;
+        }
 
-                // If running out of space, send this batch
-                uint32_t remain = m_bufferSize - bufferOffset;
-                if (remain < pktSize) {
-                    nSplits++;
-                    break;
-                }
+        if (m_calcParams.processModeNew)
+            findPeaks(batchEvents, srcEventSize, batchSize, batch.params, batch.peaks);
+        else
+            rankEvents(batchEvents, srcEventSize, batchSize, batch.ranks);
 
-                nProcessed++;
+        for (uint32_t i = 0; i < batchSize; i++) {
+            const Event::CROC::Raw *event = reinterpret_cast<const Event::CROC::Raw *>(batchEvents + i*srcEventSize);
+            uint32_t pixel = 0;
+            Event::CROC::VetoType veto;
 
-                // Reserve part of buffer for this packet
-                DasPacket *newPacket = reinterpret_cast<DasPacket *>(m_buffer + bufferOffset);
-                m_packetList.push_back(newPacket);
-                bufferOffset += pktSize;
+            if (batch.params[i] == nullptr) {
+                veto = Event::CROC::VETO_INVALID_POSITION;
+                pixel = Event::CROC::VETO_INVALID_POSITION;
+            } else {
+                veto = calculatePixel(event, batch.params[i], batch.ranks[i], batch.peaks[i], pulseId, pixel);
+            }
 
-                // Process the packet
-                m_stats += processPacket(packet, newPacket);
+            if (veto == Event::CROC::VETO_NO || m_calcParams.passVetoes) {
+                T *destEvent = &destEvents[nOutEvents++];
+                *destEvent = *event;
+                destEvent->pixelid = pixel;
             }
 
-            sendToPlugins(&m_packetList);
-            m_packetList.release();
-            m_packetList.waitAllReleased();
+            stats.increment(veto);
         }
+    }
 
-        m_paramsMutex.unlock();
-    }
-
-    this->lock();
-    setIntegerParam(RxCount,    nReceived   % std::numeric_limits<int32_t>::max());
-    setIntegerParam(ProcCount,  nProcessed  % std::numeric_limits<int32_t>::max());
-    setIntegerParam(CntSplit,   nSplits     % std::numeric_limits<int32_t>::max());
-    setIntegerParam(CntTotalEvents,     m_stats.getTotal());
-    setIntegerParam(CntGoodEvents,      m_stats.get(CRocDataPacket::VETO_NO));
-    setIntegerParam(CntVetoYLow,        m_stats.get(CRocDataPacket::VETO_Y_LOW_SIGNAL));
-    setIntegerParam(CntVetoYNoise,      m_stats.get(CRocDataPacket::VETO_Y_HIGH_SIGNAL));
-    setIntegerParam(CntVetoXLow,        m_stats.get(CRocDataPacket::VETO_X_LOW_SIGNAL));
-    setIntegerParam(CntVetoXNoise,      m_stats.get(CRocDataPacket::VETO_X_HIGH_SIGNAL));
-    setIntegerParam(CntVetoGLow,        m_stats.get(CRocDataPacket::VETO_G_LOW_SIGNAL));
-    setIntegerParam(CntVetoGNoise,      m_stats.get(CRocDataPacket::VETO_G_HIGH_SIGNAL));
-    setIntegerParam(CntVetoGGhost,      m_stats.get(CRocDataPacket::VETO_G_GHOST));
-    setIntegerParam(CntVetoGNonAdj,     m_stats.get(CRocDataPacket::VETO_G_NON_ADJACENT));
-    setIntegerParam(CntVetoBadPos,      m_stats.get(CRocDataPacket::VETO_INVALID_POSITION));
-    setIntegerParam(CntVetoBadCalc,     m_stats.get(CRocDataPacket::VETO_INVALID_CALC));
-    setIntegerParam(CntVetoEcho,        m_stats.get(CRocDataPacket::VETO_ECHO));
-    setIntegerParam(CntVetoTimeRange,   m_stats.get(CRocDataPacket::VETO_TIMERANGE_BAD));
-    setIntegerParam(CntVetoDelayed,     m_stats.get(CRocDataPacket::VETO_TIMERANGE_DELAYED));
-    callParamCallbacks();
-    this->unlock();
+    return nOutEvents;
 }
 
-CRocPosCalcPlugin::Stats CRocPosCalcPlugin::processPacket(const DasPacket *inPacket, DasPacket *outPacket)
+NED_VECTORIZE
+void CRocPosCalcPlugin::rankEvents(const uint8_t *srcEvents, uint32_t srcEventSize, uint32_t nEvents, Ranks *ranks)
 {
-    Stats stats;
-    uint32_t inEventSize = (m_calcParams.inExtMode ? sizeof(CRocDataPacket::ExtendedEvent) : sizeof(CRocDataPacket::RawEvent));
-    uint32_t outEventSize = (m_calcParams.outExtMode ? sizeof(CRocDataPacket::ExtendedEvent) : sizeof(CRocDataPacket::NormalEvent));
-    uint32_t tmp;
-    uint32_t nInEvents, nOutEvents;
-    uint64_t pulseId = 0;
-
-    // Determine pulseId based on RTDL time
-    const RtdlHeader *rtdl = inPacket->getRtdlHeader();
-    if (rtdl) {
-        pulseId = ((uint64_t)rtdl->timestamp_sec << 32) | rtdl->timestamp_nsec;
-    }
-
-    // outPacket is guaranteed to be at least the size of srcPacket
-    (void)inPacket->copyHeader(outPacket, inPacket->getLength());
-
-    char *outData = const_cast<char *>(reinterpret_cast<const char *>(outPacket->getData(&tmp)));
-    const char *inData = reinterpret_cast<const char *>(inPacket->getData(&nInEvents));
-    nInEvents /= (inEventSize / sizeof(uint32_t));
-
-    // Iterate over all events
-    nOutEvents = 0;
-    while (nInEvents-- > 0) {
-        uint32_t pixel = 0;
-        CRocDataPacket::VetoType ret;
-
-        // Extended event is the same as raw event with an extra pixel at the end
-        // Since we don't use extended mode, pretend it's always raw
-        const CRocDataPacket::RawEvent *inEvent = reinterpret_cast<const CRocDataPacket::RawEvent *>(inData);
-
-        auto it = m_detParamsByPosition.find(inEvent->position);
-        if (it == m_detParamsByPosition.end()) {
-            ret = CRocDataPacket::VETO_INVALID_POSITION;
-            pixel = CRocDataPacket::VETO_INVALID_POSITION;
-        } else {
-            ret = calculatePixel(inEvent, it->second, pulseId, pixel);
+    const Event::CROC::Raw *first = reinterpret_cast<const Event::CROC::Raw *>(srcEvents);
+    SortingNetwork::Lanes<BATCH_SIZE> y[7];
+    SortingNetwork::Lanes<BATCH_SIZE> x[11];
+    SortingNetwork::Lanes<BATCH_SIZE> g[14];
+
+    SortingNetwork::rankDesc<7>(first->photon_count_y, srcEventSize, nEvents, y);
+    SortingNetwork::rankDesc<11>(first->photon_count_x, srcEventSize, nEvents, x);
+    SortingNetwork::rankDesc<14>(first->photon_count_g, srcEventSize, nEvents, g);
+
+    for (uint32_t i = 0; i < nEvents; i++) {
+        for (int r = 0; r < 3; r++) {
+            ranks[i].y[r] = y[r].key[i];
+            ranks[i].x[r] = x[r].key[i];
+            ranks[i].g[r] = g[r].key[i];
         }
+        ranks[i].xLast = x[10].key[i];
+    }
+}
 
-        if (ret == CRocDataPacket::VETO_NO || m_calcParams.passVetoes) {
-            if (m_calcParams.outExtMode) {
-                CRocDataPacket::ExtendedEvent *outEvent = reinterpret_cast<CRocDataPacket::ExtendedEvent *>(outData);
-                memcpy(outEvent, inEvent, inEventSize);
-                outEvent->pixelid = pixel;
-            } else {
-                CRocDataPacket::NormalEvent *outEvent = reinterpret_cast<CRocDataPacket::NormalEvent *>(outData);
-                outEvent->tof = inEvent->tof;
-                outEvent->pixelid = pixel;
-            }
+void CRocPosCalcPlugin::findPeaks(const uint8_t *srcEvents, uint32_t srcEventSize, uint32_t nEvents, CRocParams * const *params, Peaks *peaks)
+{
+    for (uint32_t i = 0; i < nEvents; i++) {
+        const Event::CROC::Raw *event = reinterpret_cast<const Event::CROC::Raw *>(srcEvents + i*srcEventSize);
+        Peaks &peak = peaks[i];
 
-            outData += outEventSize;
-            nOutEvents++;
-        }
+        if (params[i] == nullptr)
+            continue;
 
-        inData += inEventSize;
+        peak.yFound = findMaxIndex(event->photon_count_y, 7, peak.yMax);
+        peak.xFound = findMaxIndex(event->photon_count_x, 11, peak.xMax);
+        peak.gFound = findMaxIndex(event->photon_count_g, 14, peak.gMax);
 
-        stats.increment(ret);
+        peak.yNoise = (peak.yFound ? calculateNoise(event->photon_count_y, 7, peak.yMax, params[i]->yWeights) : 0.0);
+        peak.xNoise = (peak.xFound ? calculateNoise(event->photon_count_x, 11, peak.xMax, params[i]->xWeights) : 0.0);
+        peak.gNoise = (peak.gFound ? calculateNoise(event->photon_count_g, 14, peak.gMax, params[i]->gWeights) : 0.0);
     }
-    outPacket->payload_length += nOutEvents * outEventSize;
-
-    return stats;
 }
 
 static inline uint32_t diff_unsigned(uint32_t a, uint32_t b)
@@ -426,66 +445,67 @@ static inline uint32_t diff_unsigned(uint32_t a, uint32_t b)
  * pixels. The final encoding is as follows:
  * > pixel id = (0x8FC00000) | ([detector offset] + [xy])
  */
-CRocDataPacket::VetoType CRocPosCalcPlugin::calculatePixel(const CRocDataPacket::RawEvent *event, CRocParams *detParams, uint64_t pulseId, uint32_t &pixel)
+Event::CROC::VetoType CRocPosCalcPlugin::calculatePixel(const Event::CROC::Raw *event, CRocParams *detParams, const Ranks &ranks, const Peaks &peaks, uint64_t pulseId, uint32_t &pixel)
 {
-    CRocDataPacket::VetoType veto = CRocDataPacket::VETO_NO;
-    CRocDataPacket::VetoType tmpVeto = CRocDataPacket::VETO_NO;
-    uint8_t x,y;
+    Event::CROC::VetoType veto = Event::CROC::VETO_NO;
+    Event::CROC::VetoType tmpVeto = Event::CROC::VETO_NO;
+    uint8_t x = 0;
+    uint8_t y = 0;
 
     tmpVeto = checkTimeRange(event, detParams);
-    if (tmpVeto != CRocDataPacket::VETO_NO) {
+    if (tmpVeto != Event::CROC::VETO_NO) {
         if (m_calcParams.passVetoes == false) return tmpVeto;
-        if (veto == CRocDataPacket::VETO_NO) veto = tmpVeto;
+        if (veto == Event::CROC::VETO_NO) veto = tmpVeto;
     }
 
     if (m_calcParams.processModeNew)
-        tmpVeto = calculateYPositionNew(event, detParams, y);
+        tmpVeto = calculateYPositionNew(event, detParams, peaks, y);
     else
-        tmpVeto = calculateYPosition(event, detParams, y);
-    if (tmpVeto != CRocDataPacket::VETO_NO) {
+        tmpVeto = calculateYPosition(event, detParams, ranks, y);
+    if (tmpVeto != Event::CROC::VETO_NO) {
         if (m_calcParams.passVetoes == false) return tmpVeto;
-        if (veto == CRocDataPacket::VETO_NO) veto = tmpVeto;
+        if (veto == Event::CROC::VETO_NO) veto = tmpVeto;
     }
     if (y >= 7) {
-        if (veto == CRocDataPacket::VETO_NO) veto = CRocDataPacket::VETO_OUT_OF_RANGE;
+        if (veto == Event::CROC::VETO_NO) veto = Event::CROC::VETO_OUT_OF_RANGE;
         if (m_calcParams.passVetoes == false) return veto;
         y = 6;
     }
 
     if (m_calcParams.processModeNew)
-        tmpVeto = calculateXPositionNew(event, detParams, x);
+        tmpVeto = calculateXPositionNew(event, detParams, peaks, x);
     else
-        tmpVeto = calculateXPosition(event, detParams, x);
-    if (tmpVeto != CRocDataPacket::VETO_NO) {
+        tmpVeto = calculateXPosition(event, detParams, ranks, x);
+    if (tmpVeto != Event::CROC::VETO_NO) {
         if (m_calcParams.passVetoes == false) return tmpVeto;
-        if (veto == CRocDataPacket::VETO_NO) veto = tmpVeto;
+        if (veto == Event::CROC::VETO_NO) veto = tmpVeto;
     }
     if (x >= 14*11) {
-        if (m_calcParams.passVetoes == false) return CRocDataPacket::VETO_OUT_OF_RANGE;
-        if (veto == CRocDataPacket::VETO_NO) veto = CRocDataPacket::VETO_OUT_OF_RANGE;
+        if (m_calcParams.passVetoes == false) return Event::CROC::VETO_OUT_OF_RANGE;
+        if (veto == Event::CROC::VETO_NO) veto = Event::CROC::VETO_OUT_OF_RANGE;
         x = 14*11 - 1;
     }
 
     pixel = detParams->position + 7*x + y;
-    if (veto == CRocDataPacket::VETO_NO) {
+    if (veto == Event::CROC::VETO_NO) {
         // Reduce the echo events - strong neutrons with light response spanning
         // over multiple acq frames
         if (pulseId == detParams->pulseId && (event->tof - detParams->lastTof) < m_calcParams.echoDeadTime && diff_unsigned(pixel, detParams->lastPixelId) < m_calcParams.echoDeadArea) {
-            veto = CRocDataPacket::VETO_ECHO;
+            veto = Event::CROC::VETO_ECHO;
         } else {
             detParams->lastTof = event->tof;
             detParams->lastPixelId = pixel;
             detParams->pulseId = pulseId;
         }
     }
-    if (veto != CRocDataPacket::VETO_NO) {
+    if (veto != Event::CROC::VETO_NO) {
         pixel |= veto;
     }
 
     return veto;
 }
 
-CRocDataPacket::VetoType CRocPosCalcPlugin::checkTimeRange(const CRocDataPacket::RawEvent *event, const CRocParams *detParams)
+Event::CROC::VetoType CRocPosCalcPlugin::checkTimeRange(const Event::CROC::Raw *event, const CRocParams *detParams)
 {
     uint8_t cnt = 0;
     uint32_t sum = 0;
@@ -496,44 +516,25 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::checkTimeRange(const CRocDataPacket:
         }
     }
     if (sum > m_calcParams.timeRangeSumMax) {
-        return CRocDataPacket::VETO_TIMERANGE_BAD;
+        return Event::CROC::VETO_TIMERANGE_BAD;
     }
     if (cnt < detParams->timeRangeMinCnt) {
-        return CRocDataPacket::VETO_TIMERANGE_BAD;
+        return Event::CROC::VETO_TIMERANGE_BAD;
     }
 
     if (event->time_range[0] < m_calcParams.timeRange1Min && event->time_range[1] < m_calcParams.timeRange2Min) {
         uint32_t delaySum = (event->time_range[1] + event->time_range[2] + event->time_range[3]);
         if (delaySum >= m_calcParams.timeRangeDelayMin) {
-            return CRocDataPacket::VETO_TIMERANGE_DELAYED;
+            return Event::CROC::VETO_TIMERANGE_DELAYED;
         } else {
-            return CRocDataPacket::VETO_TIMERANGE_BAD;
+            return Event::CROC::VETO_TIMERANGE_BAD;
         }
     }
 
-    return CRocDataPacket::VETO_NO;
-}
-
-inline std::vector<uint8_t> CRocPosCalcPlugin::sortIndexesDesc(const uint8_t *values, size_t size) {
-    std::vector<uint8_t> sorted(size);
-
-    for (size_t i=0; i<size; i++) {
-        sorted[i]=i;
-    }
-
-	for (size_t i=0; i<size; i++) {
-		for(size_t j=i+1; j<size; j++) {
-            if (values[sorted[i]] < values[sorted[j]]) {
-                uint8_t tmp = sorted[j];
-				sorted[j] = sorted[i];
-				sorted[i] = tmp;
-			}
-		}
-	}
-    return sorted;
+    return Event::CROC::VETO_NO;
 }
 
-CRocDataPacket::VetoType CRocPosCalcPlugin::calculateYPosition(const CRocDataPacket::RawEvent *event, const CRocParams *detParams, uint8_t &y)
+Event::CROC::VetoType CRocPosCalcPlugin::calculateYPosition(const Event::CROC::Raw *event, const CRocParams *detParams, const Ranks &ranks, uint8_t &y)
 {
     uint8_t totalCnt = 0;
     for (uint8_t i=0; i<7; i++) {
@@ -542,16 +543,16 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateYPosition(const CRocDataPac
         }
     }
     if (totalCnt > detParams->yCntMax)
-        return CRocDataPacket::VETO_Y_HIGH_SIGNAL;
+        return Event::CROC::VETO_Y_HIGH_SIGNAL;
 
-    std::vector<uint8_t> ySorted = sortIndexesDesc(event->photon_count_y, 7);
+    const uint8_t *ySorted = ranks.y;
 
     y = ySorted[0];
     if (event->photon_count_y[ySorted[0]] < detParams->yMin) {
         if (!m_calcParams.efficiencyBoost)
-            return CRocDataPacket::VETO_Y_LOW_SIGNAL;
+            return Event::CROC::VETO_Y_LOW_SIGNAL;
         if ((event->photon_count_y[ySorted[0]] + event->photon_count_y[ySorted[1]]) <= detParams->yMin || diff_unsigned(ySorted[0], ySorted[1]) > 1) {
-            return CRocDataPacket::VETO_Y_LOW_SIGNAL;
+            return Event::CROC::VETO_Y_LOW_SIGNAL;
         }
     }
 
@@ -562,10 +563,10 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateYPosition(const CRocDataPac
         }
     }
 
-    return CRocDataPacket::VETO_NO;
+    return Event::CROC::VETO_NO;
 }
 
-CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPosition(const CRocDataPacket::RawEvent *event, const CRocParams *detParams, uint8_t &x)
+Event::CROC::VetoType CRocPosCalcPlugin::calculateXPosition(const Event::CROC::Raw *event, const CRocParams *detParams, const Ranks &ranks, uint8_t &x)
 {
     uint8_t totalCnt = 0;
     for (uint8_t i=0; i<11; i++) {
@@ -574,10 +575,10 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPosition(const CRocDataPac
         }
     }
     if (totalCnt > detParams->xCntMax)
-        return CRocDataPacket::VETO_X_HIGH_SIGNAL;
+        return Event::CROC::VETO_X_HIGH_SIGNAL;
 
-    std::vector<uint8_t> xSorted = sortIndexesDesc(event->photon_count_x, 11);
-    std::vector<uint8_t> gSorted = sortIndexesDesc(event->photon_count_g, 14);
+    const uint8_t *xSorted = ranks.x;
+    const uint8_t *gSorted = ranks.g;
 
     // Start with the obvious index, encoding might shift it by 1 in either direction
     uint8_t gIndex = gSorted[0];
@@ -586,15 +587,15 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPosition(const CRocDataPac
     // Try the efficiency boost
     if (event->photon_count_x[xIndex] < detParams->xMin) {
         if (!m_calcParams.efficiencyBoost)
-            return CRocDataPacket::VETO_X_LOW_SIGNAL;
+            return Event::CROC::VETO_X_LOW_SIGNAL;
         if ((event->photon_count_x[xSorted[0]] + event->photon_count_x[xSorted[1]]) > detParams->xMin) {
             uint8_t distance = diff_unsigned(xSorted[0], xSorted[1]);
             // X must be adjacent. 0,10 are adjacent to both 1 and 9
             if (distance > 1 && distance < 9) {
-                return CRocDataPacket::VETO_X_LOW_SIGNAL;
+                return Event::CROC::VETO_X_LOW_SIGNAL;
             }
         } else {
-            return CRocDataPacket::VETO_X_LOW_SIGNAL;
+            return Event::CROC::VETO_X_LOW_SIGNAL;
         }
     }
 
@@ -611,35 +612,35 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPosition(const CRocDataPac
         // Reimplemented from dcomserver CROC_CALC_LNEWMGR
         if ((xIndex == 0 || xIndex == 10) && gIndex > 0 && gIndex < 13) {
             if (event->photon_count_g[gSorted[0]] < detParams->gGapMin1) {
-                return CRocDataPacket::VETO_G_LOW_SIGNAL;
+                return Event::CROC::VETO_G_LOW_SIGNAL;
             }
             if (event->photon_count_g[gSorted[1]] < detParams->gGapMin2) {
-                return CRocDataPacket::VETO_G_LOW_SIGNAL;
+                return Event::CROC::VETO_G_LOW_SIGNAL;
             }
             if (diff_unsigned(gSorted[0], gSorted[1]) > 1) {
-                return CRocDataPacket::VETO_G_NON_ADJACENT;
+                return Event::CROC::VETO_G_NON_ADJACENT;
             }
             if ((xIndex == 0  && gSorted[0] < gSorted[1]) || (xIndex == 10 && gSorted[0] > gSorted[1])) {
                 gIndex = gSorted[1];
             }
         } else if ((detParams->g1GapMin != 0 || detParams->x1GapMin != 0) && (xIndex == 1 || xIndex ==9)) {
             if (event->photon_count_g[gSorted[0]] < detParams->g1GapMin) {
-                return CRocDataPacket::VETO_G_LOW_SIGNAL;
+                return Event::CROC::VETO_G_LOW_SIGNAL;
             }
             if (event->photon_count_x[xSorted[0]] < detParams->x1GapMin) {
-                return CRocDataPacket::VETO_X_LOW_SIGNAL;
+                return Event::CROC::VETO_X_LOW_SIGNAL;
             }
             uint8_t gThreshold = m_calcParams.gNongapMaxRatio * event->photon_count_g[gSorted[0]];
             if (event->photon_count_g[gSorted[1]] > gThreshold) {
-                return CRocDataPacket::VETO_G_HIGH_SIGNAL;
+                return Event::CROC::VETO_G_HIGH_SIGNAL;
             }
         } else {
             if (event->photon_count_g[gSorted[0]] < detParams->gMin) {
-                return CRocDataPacket::VETO_G_LOW_SIGNAL;
+                return Event::CROC::VETO_G_LOW_SIGNAL;
             }
             uint8_t gThreshold = m_calcParams.gNongapMaxRatio * event->photon_count_g[gSorted[0]];
             if (event->photon_count_g[gSorted[1]] > gThreshold) {
-                return CRocDataPacket::VETO_G_HIGH_SIGNAL;
+                return Event::CROC::VETO_G_HIGH_SIGNAL;
             }
         }
         break;
@@ -647,10 +648,10 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPosition(const CRocDataPac
         // Reimplemented from dcomserver CROC_CALCP_NENCODE_BALANCE
         if (xIndex > 0 && xIndex < 10) {
             if (event->photon_count_g[gIndex] < detParams->gMin)
-                return CRocDataPacket::VETO_G_LOW_SIGNAL;
+                return Event::CROC::VETO_G_LOW_SIGNAL;
             uint8_t gThreshold = m_calcParams.gNongapMaxRatio * event->photon_count_g[gIndex];
             if (event->photon_count_g[gSorted[1]] > gThreshold)
-                return CRocDataPacket::VETO_G_HIGH_SIGNAL;
+                return Event::CROC::VETO_G_HIGH_SIGNAL;
         } else if (xIndex == 1 || xIndex == 9) {
             uint8_t xThreshold = 0.65 * event->photon_count_x[xIndex];
             if (detParams->xMin >= xThreshold) {
@@ -661,13 +662,13 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPosition(const CRocDataPac
                     if ((xSorted[1] == 1 && xSorted[0] == 10) || (xSorted[1] == 9 && xSorted[0] == 0)) {
                         xIndex = xSorted[1];
                     } else {
-                        return CRocDataPacket::VETO_G_GHOST;
+                        return Event::CROC::VETO_G_GHOST;
                     }
                 } else {
-                    if ((xSorted[1] == 1 && xSorted[0] == 0)  || (xSorted[1] == 9 && xSorted[10] == 0)) {
+                    if ((xSorted[1] == 1 && xSorted[0] == 0)  || (xSorted[1] == 9 && ranks.xLast == 0)) {
                         xIndex = xSorted[1];
                     } else {
-                        return CRocDataPacket::VETO_G_GHOST;
+                        return Event::CROC::VETO_G_GHOST;
                     }
                 }
             }
@@ -676,35 +677,35 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPosition(const CRocDataPac
         // Second round - xIndex might be already be altered
         if (xIndex == 0 || xIndex == 10) {
             if (event->photon_count_g[gSorted[0]] < detParams->gMin)
-                return CRocDataPacket::VETO_G_LOW_SIGNAL;
+                return Event::CROC::VETO_G_LOW_SIGNAL;
 
             if ((gIndex % 2) == 1) {
                 xIndex = (xIndex == 10 ? 0 : 10);
             }
             if (diff_unsigned(gSorted[0], gSorted[1]) > 1) {
                 if (event->photon_count_g[gSorted[1]] > detParams->gGapMin1)
-                    return CRocDataPacket::VETO_G_GHOST;
+                    return Event::CROC::VETO_G_GHOST;
             } else {
                 if ((event->photon_count_g[gSorted[0]] + event->photon_count_g[gSorted[1]]) < detParams->gMin)
-                    return CRocDataPacket::VETO_G_LOW_SIGNAL;
+                    return Event::CROC::VETO_G_LOW_SIGNAL;
             }
         }
         break;
     default:
-        return CRocDataPacket::VETO_INVALID_CALC;
+        return Event::CROC::VETO_INVALID_CALC;
     }
 
     x = 11*gIndex + xIndex;
-    return CRocDataPacket::VETO_NO;
+    return Event::CROC::VETO_NO;
 }
 
-inline double CRocPosCalcPlugin::calculateNoise(const uint8_t *values, size_t size, uint8_t maxIndex, const uint8_t *weights)
+inline float CRocPosCalcPlugin::calculateNoise(const uint8_t *values, size_t size, uint8_t maxIndex, const uint8_t *weights)
 {
     uint32_t noise = 0;
     for (uint8_t i=0; i<size; i++) {
         noise += values[i] * weights[abs(i-maxIndex)];
     }
-    return 1.0*noise/values[maxIndex];
+    return 1.0f*noise/values[maxIndex];
 }
 
 inline bool CRocPosCalcPlugin::findMaxIndex(const uint8_t *values, size_t size, uint8_t &max)
@@ -734,27 +735,27 @@ inline float CRocPosCalcPlugin::findDirection(const uint8_t *values, size_t size
     return (right - left)/center;
 }
 
-CRocDataPacket::VetoType CRocPosCalcPlugin::calculateYPositionNew(const CRocDataPacket::RawEvent *event, const CRocParams *detParams, uint8_t &y)
+Event::CROC::VetoType CRocPosCalcPlugin::calculateYPositionNew(const Event::CROC::Raw *event, const CRocParams *detParams, const Peaks &peaks, uint8_t &y)
 {
-    uint8_t yMaxIndex;
+    uint8_t yMaxIndex = peaks.yMax;
 
-    if (findMaxIndex(event->photon_count_y, 7, yMaxIndex) == false) {
-        return CRocDataPacket::VETO_Y_LOW_SIGNAL;
+    if (peaks.yFound == false) {
+        return Event::CROC::VETO_Y_LOW_SIGNAL;
     }
 
-    double noise = calculateNoise(event->photon_count_y, 7, yMaxIndex, detParams->yWeights);
+    float noise = peaks.yNoise;
     if (noise > detParams->yNoiseThreshold) {
-        return CRocDataPacket::VETO_Y_HIGH_SIGNAL;
+        return Event::CROC::VETO_Y_HIGH_SIGNAL;
     }
 
     if (event->photon_count_y[yMaxIndex] < detParams->yMin) {
         // Allow low signal single channel events when efficiency boost is enabled
         if (!m_calcParams.efficiencyBoost || noise > 1.0) {
-            return CRocDataPacket::VETO_Y_LOW_SIGNAL;
+            return Event::CROC::VETO_Y_LOW_SIGNAL;
         }
     }
     y = yMaxIndex;
-    return CRocDataPacket::VETO_NO;
+    return Event::CROC::VETO_NO;
 }
 
 /**
@@ -792,37 +793,37 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateYPositionNew(const CRocData
  *
  * Similar exercise can be made for G=2 and G=3.
  */
-CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPositionNew(const CRocDataPacket::RawEvent *event, const CRocParams *detParams, uint8_t &x)
+Event::CROC::VetoType CRocPosCalcPlugin::calculateXPositionNew(const Event::CROC::Raw *event, const CRocParams *detParams, const Peaks &peaks, uint8_t &x)
 {
     // G rejection
-    uint8_t gMaxIndex;
-    if (findMaxIndex(event->photon_count_g, 14, gMaxIndex) == false) {
-        return CRocDataPacket::VETO_G_LOW_SIGNAL;
+    uint8_t gMaxIndex = peaks.gMax;
+    if (peaks.gFound == false) {
+        return Event::CROC::VETO_G_LOW_SIGNAL;
     }
-    double gNoise = calculateNoise(event->photon_count_g, 14, gMaxIndex, detParams->gWeights);
+    float gNoise = peaks.gNoise;
     if (gNoise > detParams->gNoiseThreshold) {
-        return CRocDataPacket::VETO_G_HIGH_SIGNAL;
+        return Event::CROC::VETO_G_HIGH_SIGNAL;
     }
     if (event->photon_count_g[gMaxIndex] < detParams->gMin) {
         // Allow low signal single channel events when efficiency boost is enabled
         if (!m_calcParams.efficiencyBoost || gNoise > 1.0) {
-            return CRocDataPacket::VETO_G_LOW_SIGNAL;
+            return Event::CROC::VETO_G_LOW_SIGNAL;
         }
     }
 
     // X rejection
-    uint8_t xMaxIndex;
-    if (findMaxIndex(event->photon_count_x, 11, xMaxIndex) == false) {
-        return CRocDataPacket::VETO_X_LOW_SIGNAL;
+    uint8_t xMaxIndex = peaks.xMax;
+    if (peaks.xFound == false) {
+        return Event::CROC::VETO_X_LOW_SIGNAL;
     }
-    double xNoise = calculateNoise(event->photon_count_x, 11, xMaxIndex, detParams->xWeights);
+    float xNoise = peaks.xNoise;
     if (xNoise > detParams->xNoiseThreshold) {
-        return CRocDataPacket::VETO_X_HIGH_SIGNAL;
+        return Event::CROC::VETO_X_HIGH_SIGNAL;
     }
     if (event->photon_count_x[xMaxIndex] < detParams->xMin) {
         // Allow low signal single channel events when efficiency boost is enabled
         if (!m_calcParams.efficiencyBoost || xNoise > 1.0) {
-            return CRocDataPacket::VETO_X_LOW_SIGNAL;
+            return Event::CROC::VETO_X_LOW_SIGNAL;
         }
     }
 
@@ -835,10 +836,10 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPositionNew(const CRocData
                 assert(gMaxIndex < 13);
                 // Reject ghosts with indipendent discrimination
                 if (event->photon_count_g[gMaxIndex] < detParams->gGapMin1) {
-                    return CRocDataPacket::VETO_G_GHOST;
+                    return Event::CROC::VETO_G_GHOST;
                 }
                 if (event->photon_count_g[gMaxIndex+1] < detParams->gGapMin2) {
-                    return CRocDataPacket::VETO_G_GHOST;
+                    return Event::CROC::VETO_G_GHOST;
                 }
                 if (event->photon_count_x[0] > event->photon_count_x[10]) {
                     gMaxIndex++;
@@ -853,10 +854,10 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPositionNew(const CRocData
                 assert(gMaxIndex > 0);
                 // Reject ghosts with indipendent discrimination
                 if (event->photon_count_g[gMaxIndex] < detParams->gGapMin1) {
-                    return CRocDataPacket::VETO_G_GHOST;
+                    return Event::CROC::VETO_G_GHOST;
                 }
                 if (event->photon_count_g[gMaxIndex-1] < detParams->gGapMin2) {
-                    return CRocDataPacket::VETO_G_GHOST;
+                    return Event::CROC::VETO_G_GHOST;
                 }
                 if (event->photon_count_x[10] > event->photon_count_x[0]) {
                     gMaxIndex--;
@@ -873,20 +874,20 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPositionNew(const CRocData
                 uint8_t rightG = (gMaxIndex < 13 ? event->photon_count_g[gMaxIndex+1] : 0);
                 if (leftG > 0 && rightG > 0) {
                     // Imposible to deduce the location, must reject
-                    return CRocDataPacket::VETO_G_GHOST;
+                    return Event::CROC::VETO_G_GHOST;
                 } else if (leftG == 0 && rightG == 0) {
                     if (event->photon_count_x[0] > detParams->xMin && event->photon_count_x[10] > detParams->xMin) {
                         // Response on both edges of X, but a single G?
-                        return CRocDataPacket::VETO_G_GHOST;
+                        return Event::CROC::VETO_G_GHOST;
                     }
                 }
             }
         } else {
             uint8_t gThreshold = m_calcParams.gNongapMaxRatio * event->photon_count_g[gMaxIndex];
             if (gDirection > 0 && event->photon_count_g[gMaxIndex+1] > gThreshold)
-                return CRocDataPacket::VETO_G_HIGH_SIGNAL;
+                return Event::CROC::VETO_G_HIGH_SIGNAL;
             else if (gDirection < 0 && event->photon_count_g[gMaxIndex-1] > gThreshold)
-                return CRocDataPacket::VETO_G_HIGH_SIGNAL;
+                return Event::CROC::VETO_G_HIGH_SIGNAL;
         }
     } else if (detParams->fiberCoding == CRocParams::FIBER_CODING_V3) {
         if (xMaxIndex == 0 || xMaxIndex == 10) {
@@ -901,7 +902,7 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPositionNew(const CRocData
                     if (event->photon_count_g[gMaxIndex-1] > 0) {
                         // As left neighbour is non zero, right one is non-zero too.
                         // We can't deduce the proper location and must reject.
-                        return CRocDataPacket::VETO_G_GHOST;
+                        return Event::CROC::VETO_G_GHOST;
                     } else {
                         // Left and right neighbours are both zero, yet the
                         // PMTs are swapped. Swap again to make it right.
@@ -917,7 +918,7 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPositionNew(const CRocData
     }
 
     x = 11*gMaxIndex + xMaxIndex;
-    return CRocDataPacket::VETO_NO;
+    return Event::CROC::VETO_NO;
 }
 
 // ============= CRocPosCalcPlugin::Stats class implementation ============= //
@@ -925,12 +926,7 @@ CRocDataPacket::VetoType CRocPosCalcPlugin::calculateXPositionNew(const CRocData
 #define VETO2INT(a) (((a) & ~0x80000000) >> 22)
 CRocPosCalcPlugin::Stats::Stats()
 {
-    reset();
-}
-
-void CRocPosCalcPlugin::Stats::reset()
-{
-    for (size_t i=0; i<sizeof(counters)/sizeof(int32_t); i++) {
+    for (size_t i=0; i<sizeof(counters)/sizeof(uint32_t); i++) {
         counters[i] = 0;
     }
     total = 0;
@@ -938,33 +934,25 @@ void CRocPosCalcPlugin::Stats::reset()
 
 CRocPosCalcPlugin::Stats &CRocPosCalcPlugin::Stats::operator+=(const Stats &rhs)
 {
-    if ((total + rhs.total) > (unsigned)std::numeric_limits<int32_t>::max()) {
-        // This is not good, un-controlled resetting
-        reset();
-    }
-
-    for (size_t i=0; i<sizeof(counters)/sizeof(int32_t); i++) {
+    for (size_t i=0; i<sizeof(counters)/sizeof(uint32_t); i++) {
         counters[i] += rhs.counters[i];
     }
     total += rhs.total;
     return *this;
 }
 
-void CRocPosCalcPlugin::Stats::increment(CRocDataPacket::VetoType type)
+void CRocPosCalcPlugin::Stats::increment(Event::CROC::VetoType type)
 {
-    if (total >= (unsigned)std::numeric_limits<int32_t>::max()) {
-        reset();
-    }
     total++;
     counters[VETO2INT(type)]++;
 }
 
-int32_t CRocPosCalcPlugin::Stats::get(CRocDataPacket::VetoType type) const
+uint32_t CRocPosCalcPlugin::Stats::get(Event::CROC::VetoType type) const
 {
     return counters[VETO2INT(type)];
 }
 
-int32_t CRocPosCalcPlugin::Stats::getTotal() const
+uint32_t CRocPosCalcPlugin::Stats::getTotal() const
 {
-    return (int32_t)total;
+    return total;
 }
@@ -10,25 +10,42 @@
 #ifndef CROC_POS_CALC_PLUGIN_H
 #define CROC_POS_CALC_PLUGIN_H
 
-#include "BaseDispatcherPlugin.h"
-#include "CRocDataPacket.h"
-
-#include <epicsThread.h>
+#include "BasePlugin.h"
+#include "Event.h"
+#include "ObjectPool.h"
 
 #include <limits>
 #include <map>
 #include <unordered_map>
 
 /**
- * Analyze raw CROC data and convert it to tof,pixel format.
+ * Analyze raw CROC data and convert it to CROC diagnostic format.
  *
  * When CROC is in raw data format, it performs no data validation on its own.
  * Software is responsible for validation and bad event rejection. This plugin
- * will rake raw CROC data, evaluate it and convert it to tof,pixel format.
+ * will take raw or verbose CROC data, evaluate it and convert it to
+ * diagnostic format with calculated pixel id. Rejected events are dropped
+ * unless vetoes are passed through, in which case pixel id contains veto
+ * type in upper bits.
+ *
+ * Events are processed in batches. In legacy processing mode first pass
+ * over a batch transposes photon counts into structure of arrays and ranks
+ * all events of the batch at once with fixed-size sorting networks. In new
+ * processing mode first pass finds maximum channels and their noise ratios
+ * event by event. Second pass makes per-event decisions using precomputed
+ * values. Echo rejection depends on previous good event and is always
+ * sequential.
  */
-class CRocPosCalcPlugin : public BaseDispatcherPlugin {
+class CRocPosCalcPlugin : public BasePlugin {
     private: // definitions
 
+        /**
+         * Number of events processed in one batch.
+         *
+         * Precomputed values for a batch live on stack, batch should fit L1 cache.
+         */
+        static const uint32_t BATCH_SIZE = 64;
+
         /**
          * Structure with CROC parameters used in calculation.
          *
@@ -82,9 +99,8 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
          */
         struct CalcParams {
             bool passVetoes;
-            bool inExtMode;
-            bool outExtMode;
             bool processModeNew;
+            bool diagCompact;           //!< Produce events in single precision diagnostic format
 
             float gNongapMaxRatio;  //!< Percentage of the second max G comparing to max in order to qualify
             bool efficiencyBoost;       //!< Ignore min threshold if single channel response
@@ -99,14 +115,54 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
         };
 
         /**
-         * Structure used for returning event counters from processPacket() function.
-         * It's easier to parallelize and more effiecient than passing arguments
-         * by reference.
+         * Photon count channels ranked by counts, legacy processing mode.
+         *
+         * Only the leading indexes are used by the algorithm, plus the X
+         * channel with the least counts.
+         */
+        struct Ranks {
+            uint8_t y[3];           //!< Y indexes of three highest counts
+            uint8_t x[3];           //!< X indexes of three highest counts
+            uint8_t xLast;          //!< X index of lowest count
+            uint8_t g[3];           //!< G indexes of three highest counts
+        };
+
+        /**
+         * Maximum channels and noise ratios, new processing mode.
+         */
+        struct Peaks {
+            uint8_t yMax;           //!< Y index of max counts
+            uint8_t xMax;           //!< X index of max counts
+            uint8_t gMax;           //!< G index of max counts
+            bool yFound;            //!< Some Y counts are non-zero
+            bool xFound;            //!< Some X counts are non-zero
+            bool gFound;            //!< Some G counts are non-zero
+            float yNoise;           //!< Y noise ratio, valid when found
+            float xNoise;           //!< X noise ratio, valid when found
+            float gNoise;           //!< G noise ratio, valid when found
+        };
+
+        /**
+         * Values precomputed for a batch of events.
+         */
+        struct Batch {
+            CRocParams *params[BATCH_SIZE]; //!< Detector of each event, nullptr when unknown position
+            union {
+                Ranks ranks[BATCH_SIZE];
+                Peaks peaks[BATCH_SIZE];
+            };
+        };
+
+        /**
+         * Event counters of processed packets.
+         *
+         * Counted locally while processing and added to plugin counters
+         * once per received list of packets.
          */
         class Stats {
             private:
-                int32_t counters[20];   //!< Array of different veto counters
-                uint64_t total;         //!< All counters combined
+                uint32_t counters[20];  //!< Array of different veto counters
+                uint32_t total;         //!< All counters combined
 
             public:
                 /**
@@ -114,11 +170,6 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
                  */
                 Stats();
 
-                /**
-                 * Reset counters
-                 */
-                void reset();
-
                 /**
                  * Sum counters from two objects
                  */
@@ -127,32 +178,33 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
                 /**
                  * Increase number of particular veto counts by 1
                  */
-                void increment(CRocDataPacket::VetoType type);
+                void increment(Event::CROC::VetoType type);
 
                 /**
                  * Get number of selected vetoed events.
                  */
-                int32_t get(CRocDataPacket::VetoType type) const;
+                uint32_t get(Event::CROC::VetoType type) const;
 
                 /**
                  * Get number of all events combined.
                  */
-                int32_t getTotal() const;
+                uint32_t getTotal() const;
         };
 
-    private: // variables
+        /**
+         * Processes single packet, specialized for each supported input format.
+         */
+        struct ProcessPacket;
 
-        epicsMutex m_paramsMutex;       //!< Mutex protecting detector and calculation parameters structures
+    private: // variables
 
         std::map<std::string, CRocParams*> m_detParamsByName;           //!< Map of per-CROC parameter structures
         std::unordered_map<uint32_t, CRocParams*> m_detParamsByPosition;//!< Fast lookup of the parameter structures based on position
 
         CalcParams m_calcParams;    //!< Parameters common to all CROCs
-
-        uint8_t *m_buffer;          //!< Buffer used to copy OCC data into, modify it and send it on to plugins
-        uint32_t m_bufferSize;      //!< Size of buffer
-        DasPacketList m_packetList; //!< Local list of packets that plugin populates and sends to connected plugins, TODO: get rid of this one
-        Stats m_stats;              //!< Event counters
+        std::map<Event::CROC::VetoType, Counter *> m_vetoCounters;      //!< Event counters by veto type
+        Counter *m_totalCounter;    //!< All events counter
+        ObjectPool<DasDataPacket> m_packetsPool{true};  //!< Pool of allocated data packets to store calculated events
 
     public: // structures and defines
 
@@ -162,10 +214,9 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
          * Constructor will create and populate PVs with default values.
          *
          * @param[in] portName asyn port name.
-         * @param[in] dispatcherPortName Name of the dispatcher asyn port to connect to.
-         * @param[in] bufSize size of the internal buffer for copying packets
+         * @param[in] parentPlugins Name of the plugins to connect to.
          */
-        CRocPosCalcPlugin(const char *portName, const char *dispatcherPortName, int bufSize=0);
+        CRocPosCalcPlugin(const char *portName, const char *parentPlugins);
 
         /**
          * Destructor
@@ -174,38 +225,70 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
          */
         ~CRocPosCalcPlugin();
 
-    protected:
+    private:
+
+        /**
+         * Handle writing integer values.
+         */
+        asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value) override;
 
         /**
-         * Handle writing integer values, including parameters sent from CRocPlugin.
+         * Cache parameters sent from CRocPlugin.
          */
-        asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+        asynStatus recvParam(const std::string &remotePort, const std::string &paramName, epicsInt32 value) override;
 
         /**
-         * Overloaded function to process incoming OCC packets.
+         * Overloaded function to process incoming data packets.
          *
-         * Function receives all packets and invokes processPacket()
-         * function on neutron data packets. All other packets are not
-         * processed. Processed and non-processed packets are then sent to
-         * subscribed plugins.
+         * Packets in CROC raw or verbose format are processed using
+         * processEvents() and replaced with newly allocated packets
+         * in CROC diagnostic format, compact or double precision as selected
+         * by DiagFormat. All other packets are passed thru.
          * Function updates statistical PVs.
          */
-        void processDataUnlocked(const DasPacketList * const packetList);
+        void recvDownstream(const DasDataPacketList &packets) override;
 
         /**
-         * Process single neutron data packet in CROC raw output format.
+         * Calculate pixels for all events in a packet.
+         *
+         * Events are processed in batches of BATCH_SIZE. For each batch,
+         * detector parameters are looked up and either rankEvents() or
+         * findPeaks() precomputes values for all events. Then
+         * calculatePixel() decides on each event one by one. Accepted events, and
+         * vetoed ones when configured so, are written to output.
+         *
+         * The input events are either raw or verbose, both have the same
+         * layout of raw fields.
+         *
+         * @param[in] srcEvents Input events
+         * @param[in] srcEventSize Size of single input event
+         * @param[in] nEvents Number of input events
+         * @param[in] pulseId Unique id of the pulse events belong to
+         * @param[out] destEvents Output events, must hold nEvents events
+         * @param[out] stats Event counters are incremented
+         * @return Number of events written to output
+         */
+        template <typename T>
+        uint32_t processEvents(const uint8_t *srcEvents, uint32_t srcEventSize, uint32_t nEvents, uint64_t pulseId, T *destEvents, Stats &stats);
+
+        /**
+         * Rank photon counts of a batch of events, legacy processing mode.
          *
-         * The input data format is expected to be either raw or extended.
-         * Each raw event is processed using the calculatePixel() function
-         * and converted to extended event (adding pixel to the end of raw).
-         * Depending on the outExtMode parameter, the output is either
-         * tof,pixel event format or extended CROC events.
+         * Counts of all events are transposed into lanes and each
+         * dimension of the whole batch is ranked by a single pass of
+         * sorting network, every compare-exchange works on all events.
+         * No allocation and no data dependent branches.
+         */
+        void rankEvents(const uint8_t *srcEvents, uint32_t srcEventSize, uint32_t nEvents, Ranks *ranks);
+
+        /**
+         * Find maximum channels and noise ratios of a batch of events, new
+         * processing mode.
          *
-         * @param[in] inPacket Original packet to be processed
-         * @param[out] outPacket output packet with all events processed.
-         * @return event counters structure
+         * Events with unknown position are skipped since noise weights
+         * are defined per detector.
          */
-        Stats processPacket(const DasPacket *inPacket, DasPacket *outPacket);
+        void findPeaks(const uint8_t *srcEvents, uint32_t srcEventSize, uint32_t nEvents, CRocParams * const *params, Peaks *peaks);
 
         /**
          * Calculates pixel id from raw event data.
@@ -221,13 +304,15 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
          *
          * @param[in] event input in raw format
          * @param[in] params of the detector
+         * @param[in] ranks precomputed for this event, valid in legacy mode only
+         * @param[in] peaks precomputed for this event, valid in new mode only
          * @param[in] pulseId is unique id of the pulse this event belongs to
          * @param[out] pixel calculated, upper bits describe veto flags
          * @return When event is rejected, the return veto type describes the
          *         reason for rejection. The same type is put in upper bits of
          *         pixel.
          */
-        CRocDataPacket::VetoType calculatePixel(const CRocDataPacket::RawEvent *event, CRocParams *params, uint64_t pulseId, uint32_t &pixel);
+        Event::CROC::VetoType calculatePixel(const Event::CROC::Raw *event, CRocParams *params, const Ranks &ranks, const Peaks &peaks, uint64_t pulseId, uint32_t &pixel);
 
         /**
          * Verify the 4 time ranges of the raw event.
@@ -246,7 +331,7 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
          * @param[in] detParams settings of detector
          * @return Positive number when rejected, 0 otherwise.
          */
-        CRocDataPacket::VetoType checkTimeRange(const CRocDataPacket::RawEvent *event, const CRocParams *detParams);
+        Event::CROC::VetoType checkTimeRange(const Event::CROC::Raw *event, const CRocParams *detParams);
 
         /**
          * Calculate the Y position of the event
@@ -266,17 +351,18 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
          *
          * @param[in] event input in raw format
          * @param[in] detParams settings of detector
+         * @param[in] ranks precomputed channel ranks
          * @param[out] y calculated position
          * @return Positive number when rejected, 0 otherwise.
          */
-        CRocDataPacket::VetoType calculateYPosition(const CRocDataPacket::RawEvent *event, const CRocParams *params, uint8_t &y);
+        Event::CROC::VetoType calculateYPosition(const Event::CROC::Raw *event, const CRocParams *params, const Ranks &ranks, uint8_t &y);
 
         /**
          * Calculate the Y position of the event
          *
          * @todo Work in progress, not used right now due to ghosting.
          */
-        CRocDataPacket::VetoType calculateYPositionNew(const CRocDataPacket::RawEvent *event, const CRocParams *params, uint8_t &y);
+        Event::CROC::VetoType calculateYPositionNew(const Event::CROC::Raw *event, const CRocParams *params, const Peaks &peaks, uint8_t &y);
 
         /**
          * Calculate the X position of the event
@@ -313,19 +399,19 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
          *
          * @param[in] event input in raw format
          * @param[in] detParams settings of detector
+         * @param[in] ranks precomputed channel ranks
          * @param[out] x calculated position
          * @return Positive number when rejected, 0 otherwise.
          */
-        CRocDataPacket::VetoType calculateXPosition(const CRocDataPacket::RawEvent *event, const CRocParams *params, uint8_t &x);
+        Event::CROC::VetoType calculateXPosition(const Event::CROC::Raw *event, const CRocParams *params, const Ranks &ranks, uint8_t &x);
 
         /**
          * Calculate the X position of the event
          *
          * @todo Work in progress, not used right now due to ghosting.
          */
-        CRocDataPacket::VetoType calculateXPositionNew(const CRocDataPacket::RawEvent *event, const CRocParams *params, uint8_t &x);
+        Event::CROC::VetoType calculateXPositionNew(const Event::CROC::Raw *event, const CRocParams *params, const Peaks &peaks, uint8_t &x);
 
-    private:
         /**
          * Return an with of the maximum value or the first one found.
          *
@@ -371,16 +457,7 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
          * @param[in] weights is a table with weights
          * @return noise ratio
          */
-        double calculateNoise(const uint8_t *values, size_t size, uint8_t maxIndex, const uint8_t *weights);
-
-        /**
-         * Values from the input table are sorted in descending order and the list of indeces is returned.
-         *
-         * @param[in] values input table
-         * @param[in] size of the input table
-         * @return a list indeces of the same size as input table
-         */
-        static inline std::vector<uint8_t> sortIndexesDesc(const uint8_t *values, size_t size);
+        float calculateNoise(const uint8_t *values, size_t size, uint8_t maxIndex, const uint8_t *weights);
 
         /**
          * Save a single detector parameter into cache
@@ -390,7 +467,6 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
          * structure.
          * When setting position parameter, function will also connect the found
          * CRocParameter to the lookup-by-position table.
-         * Must be thread protected from the outside.
          *
          * @param[in] detector to which parameter belongs to
          * @param[in] param name of the parameter
@@ -399,12 +475,9 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
         void saveDetectorParam(const std::string &detector, const std::string &param, epicsInt32 value);
 
     protected:
-        #define FIRST_CROCPOSCALCPLUGIN_PARAM ErrMem
         int ErrMem;             //!< Error allocating buffer
-        int CntSplit;           //!< Total number of splited incoming packet lists
         int ResetCnt;           //!< Reset counters
         int CalcEn;             //!< Toggle position calculation
-        int OutExtMode;         //!< Switch to toggle between normal and extended output format
         int PassVetoes;         //!< Allow vetoes in output stream
         int GNongapMaxRatio;    //!< Second max G ratio
         int EfficiencyBoost;    //!< Switch to enable efficiency boost
@@ -415,6 +488,7 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
         int EchoDeadTime;       //!< Time between two events in 100ns
         int EchoDeadArea;       //!< Pixel area for echo detection
         int ProcessMode;        //!< Select event verification algorithm
+        int DiagFormat;         //!< Output events format
 
         int CntTotalEvents;    //!< Number of all events
         int CntGoodEvents;     //!< Number of good events
@@ -431,7 +505,6 @@ class CRocPosCalcPlugin : public BaseDispatcherPlugin {
         int CntVetoEcho;       //!< Event to close to previous
         int CntVetoTimeRange;  //!< Time range bins rejected
         int CntVetoDelayed;    //!< Event delayed based on time range bins
-        #define LAST_CROCPOSCALCPLUGIN_PARAM CntVetoDelayed
 };
 
 #endif // CROC_POS_CALC_PLUGIN_H
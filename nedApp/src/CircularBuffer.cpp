@@ -9,6 +9,7 @@
 
 #include "CircularBuffer.h"
 #include "DasPacket.h"
+#include "HugePages.h"
 
 #include <cantProceed.h>
 #include <stdlib.h>
@@ -37,8 +38,9 @@ CircularBuffer::CircularBuffer(uint32_t size)
     }
 
     // Don't need or want the initialization provided by new operator.
-    // This is fine with C++ as long as we're consistent and use free (not delete) at the end.
-    m_buffer = mallocMustSucceed(size, "Can't allocate CircularBuffer buffer");
+    // Large buffers are backed by huge pages when configured, release with HugePages::release().
+    // Producer thread prefaults them with prefault() so that they're local to its NUMA node.
+    m_buffer = HugePages::allocate(size, "Can't allocate CircularBuffer buffer", false);
     if (!m_buffer)
         return;
 
@@ -52,7 +54,7 @@ CircularBuffer::~CircularBuffer()
     m_event.signal();
 
     if (m_buffer)
-        free(m_buffer);
+        HugePages::release(m_buffer);
     if (m_rollover)
         free(m_rollover);
     m_buffer = NULL;
@@ -66,6 +68,12 @@ void CircularBuffer::clear()
     m_lock.unlock();
 }
 
+void CircularBuffer::prefault()
+{
+    if (m_buffer)
+        HugePages::prefault(m_buffer);
+}
+
 uint32_t CircularBuffer::push(void *data, uint32_t len)
 {
     uint32_t prod, cons;
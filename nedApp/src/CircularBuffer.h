@@ -38,6 +38,15 @@ class CircularBuffer : public BaseCircularBuffer {
          */
         void clear();
 
+        /**
+         * Populate buffer pages from calling thread.
+         *
+         * Producer thread should call it when it starts, before any data
+         * arrives, so that pages are local to its NUMA node and first
+         * push() doesn't stall on page faults.
+         */
+        void prefault();
+
         /**
          * Copy data from memory area data to the circular buffer and wake up consumer.
          *
@@ -0,0 +1,70 @@
+/* ConfigSnapshot.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef CONFIG_SNAPSHOT_H
+#define CONFIG_SNAPSHOT_H
+
+#include <epicsMutex.h>
+
+#include <memory>
+
+/**
+ * Immutable configuration shared between parameter writers and data path.
+ *
+ * Writers build complete configuration from parameters and publish it
+ * as a new snapshot. Data processing takes the latest snapshot once
+ * per batch and uses it without any locking. Snapshot stays valid for
+ * as long as reader holds it, even if new configuration is published
+ * in the mean time.
+ *
+ * Internal mutex is only held while swapping or copying the pointer,
+ * it's never held while configuration is being built or used.
+ */
+template <typename T>
+class ConfigSnapshot {
+    public:
+        typedef std::shared_ptr<const T> Ptr;
+
+        /**
+         * Start with default constructed configuration.
+         */
+        ConfigSnapshot()
+            : m_config(std::make_shared<const T>())
+        {}
+
+        /**
+         * Return latest published configuration.
+         */
+        Ptr get() const
+        {
+            m_mutex.lock();
+            Ptr config = m_config;
+            m_mutex.unlock();
+            return config;
+        }
+
+        /**
+         * Publish new configuration, readers will pick it up with next get().
+         */
+        void publish(const T &config)
+        {
+            Ptr newConfig = std::make_shared<const T>(config);
+            m_mutex.lock();
+            m_config.swap(newConfig);
+            m_mutex.unlock();
+            // Previous configuration is released here, outside the lock,
+            // unless some reader still holds it
+        }
+
+    private:
+        Ptr m_config;
+        mutable epicsMutex m_mutex;
+};
+
+#endif // CONFIG_SNAPSHOT_H
@@ -477,21 +477,25 @@ Packet *DasPacket::convert(uint8_t *buffer, size_t size, DasDataPacket::EventFor
         if (!isCommand())
             return nullptr;
 
-        auto frames = getRtdlFrames();
-        auto t = getTimeStamp();
-        auto hdr = getRtdlHeader();
-        // Remove frames 1-3
-        for (auto it = frames.begin(); it != frames.end(); ) {
-            if (it->id >= 1 && it->id <= 3) {
-                it = frames.erase(it);
-            } else {
-                it++;
-            }
+        const RtdlHeader *hdr = getRtdlHeader();
+        if (!hdr || getPayloadLength() < sizeof(RtdlHeader))
+            return nullptr;
+        epicsTimeStamp t = { hdr->timestamp_sec, hdr->timestamp_nsec };
+
+        // Frames 1-3 encode timestamp in new format, replace original ones
+        RtdlPacket::RtdlFrame frames[RtdlPacket::MAX_FRAMES];
+        frames[0] = RtdlPacket::RtdlFrame{1, (t.secPastEpoch >> 8) & 0xFFFFFF};
+        frames[1] = RtdlPacket::RtdlFrame{2, (t.secPastEpoch & 0xFF) | (hdr->timing_status << 8) | (t.nsec & 0xFF) << 16};
+        frames[2] = RtdlPacket::RtdlFrame{3, (t.nsec >> 8) & 0xFFFFFF};
+        uint32_t nFrames = 3;
+
+        const RtdlPacket::RtdlFrame *src = reinterpret_cast<const RtdlPacket::RtdlFrame *>(getPayload() + sizeof(RtdlHeader)/sizeof(uint32_t));
+        uint32_t nSrc = (getPayloadLength() - sizeof(RtdlHeader)) / sizeof(uint32_t);
+        for (uint32_t i = 0; i < nSrc && nFrames < RtdlPacket::MAX_FRAMES; i++) {
+            if (src[i].id < 1 || src[i].id > 3)
+                frames[nFrames++] = src[i];
         }
-        frames.insert(frames.begin(), RtdlPacket::RtdlFrame{3, (t.nsec >> 8) & 0xFFFFFF});
-        frames.insert(frames.begin(), RtdlPacket::RtdlFrame{2, (t.secPastEpoch & 0xFF) | (hdr->timing_status << 8) | (t.nsec & 0xFF) << 16});
-        frames.insert(frames.begin(), RtdlPacket::RtdlFrame{1, (t.secPastEpoch >> 8) & 0xFFFFFF});
-        return RtdlPacket::init(buffer, size, frames);
+        return RtdlPacket::init(buffer, size, frames, nFrames);
 
     } else if (isCommand()) {
         // Kill TSYNC commands, we don't need them in new system
@@ -538,8 +542,10 @@ Packet *DasPacket::convert(uint8_t *buffer, size_t size, DasDataPacket::EventFor
             const void *data = getData(&bytes);
             bytes *= sizeof(uint32_t);
 
-            uint32_t count = bytes/DasDataPacket::getEventsSize(format);
-            return DasDataPacket::init(buffer, size, format, timestamp, count, data);
+            uint32_t eventSize = DasDataPacket::getEventsSize(format);
+            if (eventSize == 0)
+                return nullptr;
+            return DasDataPacket::init(buffer, size, format, timestamp, bytes/eventSize, data);
         }
     }
 
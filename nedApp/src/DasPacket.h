@@ -531,6 +531,9 @@ struct DasPacket
         /**
          * Convert DasPacket to new packet format.
          *
+         * Converted packet is never longer than original packet, buffer
+         * of getLength() bytes is always sufficient.
+         *
          * @return Converted packet or nullptr.
          */
         Packet *convert(uint8_t *data, size_t size, DasDataPacket::EventFormat eventFormat) const;
@@ -14,31 +14,119 @@
 #include <occlib.h>
 
 #define THREAD_INTERVAL           0.1   // Thread resolution time to exit in seconds
+#define DRAIN_INTERVAL            0.001 // Local buffer poll time while draining in seconds
 
-DmaCopier::DmaCopier(struct occ_handle *occ, uint32_t bufferSize)
+DmaCopier::DmaCopier(struct occ_handle *occ, uint32_t bufferSize, const char *threadName)
     : CircularBuffer(bufferSize)
-    , Thread("DmaCopier", std::bind(&DmaCopier::copyWorker, this, std::placeholders::_1), epicsThreadGetStackSize(epicsThreadStackBig), epicsThreadPriorityHigh)
+    , Thread(threadName, std::bind(&DmaCopier::copyWorker, this, std::placeholders::_1), epicsThreadGetStackSize(epicsThreadStackBig), epicsThreadPriorityHigh)
     , m_occ(occ)
 {
     Thread::start();
 }
 
+void DmaCopier::clear()
+{
+    CircularBuffer::clear();
+    // Copy thread will hand DMA memory back to consumer if backlog is low
+    m_readLocal = true;
+    m_mode = MODE_COPY;
+}
+
+void DmaCopier::setWatermarks(uint32_t highWater, uint32_t lowWater)
+{
+    m_highWater = highWater;
+    m_lowWater = lowWater;
+}
+
+int DmaCopier::wait(void **data, uint32_t *len, double timeout)
+{
+    if (m_readLocal == false) {
+        size_t l = 0;
+        int status = occ_data_wait(m_occ, data, &l, timeout*1000);
+        *len = l;
+        if (status != 0 || l < m_highWater)
+            return status;
+
+        // Processing is falling behind, let copy thread take over DMA memory
+        // before OCC stalls. Anything not consumed yet will be copied.
+        m_readLocal = true;
+        m_mode = MODE_COPY;
+        m_copyEvent.signal();
+    }
+
+    // Copy thread no longer signals new data when draining, don't block
+    int ret = CircularBuffer::wait(data, len, (m_mode == MODE_DRAIN ? DRAIN_INTERVAL : timeout));
+    if (ret == -ETIME && CircularBuffer::empty()) {
+        // Local buffer drained, next wait() picks up from DMA memory,
+        // unless copy thread resumed copying in the mean time
+        Mode drain = MODE_DRAIN;
+        if (m_mode.compare_exchange_strong(drain, MODE_ZERO_COPY))
+            m_readLocal = false;
+    }
+    return ret;
+}
+
+int DmaCopier::consume(uint32_t len)
+{
+    if (m_readLocal)
+        return CircularBuffer::consume(len);
+
+    int ret = occ_data_ack(m_occ, len);
+    if (ret == 0) {
+        (void)BaseCircularBuffer::consume(len);
+        m_zeroCopyBytes += len;
+    }
+    return ret;
+}
+
 void DmaCopier::copyWorker(epicsEvent *shutdown)
 {
+    CircularBuffer::prefault();
+
     while (shutdown->tryWait() == false) {
         void *data;
         size_t len;
         int status;
 
+        if (m_mode == MODE_ZERO_COPY) {
+            m_copyEvent.wait(THREAD_INTERVAL);
+            continue;
+        }
+
+        if (m_mode == MODE_DRAIN) {
+            // Consumer is still busy with local buffer, DMA memory fills up
+            // in the mean time. Only peek at backlog, consumer may take over
+            // DMA memory any time.
+            status = occ_data_wait(m_occ, &data, &len, DRAIN_INTERVAL*1000);
+            if (status == 0 && m_highWater > 0 && len >= m_highWater) {
+                Mode drain = MODE_DRAIN;
+                if (m_mode.compare_exchange_strong(drain, MODE_COPY))
+                    continue;
+            }
+            m_copyEvent.wait(DRAIN_INTERVAL);
+            continue;
+        }
 
         status = occ_data_wait(m_occ, &data, &len, THREAD_INTERVAL*1000);
-        if (status == -ETIME || status == -ECONNRESET || (len == 0 && status == 0))
+        if (status == -ECONNRESET)
             continue;
-        if (status != 0) {
+        if (status == -ETIME)
+            len = 0;
+        else if (status != 0) {
             wakeUpConsumer(status);
             break;
         }
 
+        if (m_highWater > 0 && len <= m_lowWater) {
+            // Backlog is gone, leave the rest of DMA memory to consumer
+            // once it processes what's been copied already
+            m_mode = MODE_DRAIN;
+            wakeUpConsumer(0);
+            continue;
+        }
+        if (len == 0)
+            continue;
+
         // Successful push() will wake up consumer
         len = CircularBuffer::push(data, len);
         if (len == 0) {
@@ -51,5 +139,6 @@ void DmaCopier::copyWorker(epicsEvent *shutdown)
             wakeUpConsumer(status);
             break;
         }
+        m_copiedBytes += len;
     }
 }
@@ -13,23 +13,93 @@
 #include "CircularBuffer.h"
 #include "Thread.h"
 
+#include <atomic>
+
 struct occ_handle;
 
 /**
  * Thread moving data from DMA buffer to circular buffer
+ *
+ * Copying protects OCC from stalling when processing can't keep up, but it
+ * costs a memcpy of all data. Adaptive mode processes data straight from
+ * DMA memory for as long as the DMA backlog stays below high-water mark.
+ * When backlog crosses it, copy thread takes over DMA buffer and consumer
+ * switches to local buffer. When DMA backlog drops below low-water mark,
+ * copy thread stops and consumer switches back to DMA memory as soon as
+ * the local buffer is drained. While draining, copy thread keeps watching
+ * DMA backlog and resumes copying if it reaches high-water mark again.
+ * Data order is preserved since consumer and copy thread never read DMA
+ * memory at the same time.
+ *
+ * With high-water mark 0 all data is copied.
  */
 class DmaCopier : public CircularBuffer, public Thread {
     public:
+        /**
+         * Current data path.
+         */
+        enum Mode {
+            MODE_ZERO_COPY  = 0,    //!< Consumer reads DMA memory directly
+            MODE_COPY       = 1,    //!< Copy thread moves data to local buffer
+            MODE_DRAIN      = 2,    //!< Copying stopped, consumer drains local buffer
+        };
+
         /**
          * Create thread and initialize circular buffer
          *
          * @param[in] occ handle to OCC device
          * @param[in] bufferSize size of circular buffer in bytes
+         * @param[in] threadName name of copy thread
+         */
+        DmaCopier(struct occ_handle *occ, uint32_t bufferSize, const char *threadName);
+
+        /**
+         * Remove data from local buffer and start in initial mode.
+         */
+        void clear();
+
+        /**
+         * Wait for data in DMA memory or local buffer, depending on mode.
+         */
+        int wait(void **data, uint32_t *len, double timeout=0.0);
+
+        /**
+         * Advance consumer index of DMA memory or local buffer.
+         */
+        int consume(uint32_t len);
+
+        /**
+         * Set DMA backlog thresholds for switching modes.
+         *
+         * @param[in] highWater Start copying when DMA backlog reaches this many bytes, 0 always copies
+         * @param[in] lowWater Stop copying when DMA backlog drops below this many bytes
+         */
+        void setWatermarks(uint32_t highWater, uint32_t lowWater);
+
+        /**
+         * Return current data path.
+         */
+        Mode getMode() const { return m_mode; }
+
+        /**
+         * Return number of bytes copied to local buffer.
+         */
+        uint64_t getCopiedBytes() const { return m_copiedBytes; }
+
+        /**
+         * Return number of bytes processed directly from DMA memory.
          */
-        DmaCopier(struct occ_handle *occ, uint32_t bufferSize);
+        uint64_t getZeroCopyBytes() const { return m_zeroCopyBytes; }
 
     private:
         struct occ_handle *m_occ;
+        std::atomic<Mode> m_mode{MODE_COPY};        //!< Current mode, copy until watermarks are set
+        std::atomic<uint32_t> m_highWater{0};       //!< Backlog threshold to start copying
+        std::atomic<uint32_t> m_lowWater{0};        //!< Backlog threshold to stop copying
+        std::atomic<uint64_t> m_copiedBytes{0};     //!< Bytes copied to local buffer
+        std::atomic<uint64_t> m_zeroCopyBytes{0};   //!< Bytes consumed from DMA memory
+        bool m_readLocal{true};                     //!< Consumer reads local buffer, used only by consumer
+        epicsEvent m_copyEvent;                     //!< Wakes up copy thread when copying should start
 
         /**
          * Worker function running in thread.
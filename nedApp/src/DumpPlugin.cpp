@@ -15,11 +15,17 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
+#include <epicsThread.h>
+
 EPICS_REGISTER_PLUGIN(DumpPlugin, 2, "Port name", string, "Parent plugins", string);
 
 DumpPlugin::DumpPlugin(const char *portName, const char *parentPlugins)
     : BasePlugin(portName, 1, asynOctetMask, asynOctetMask)
     , m_parentPlugins(parentPlugins)
+    , m_block(new std::vector<uint8_t>())
+    , m_rawBytes(0)
+    , m_encodedBytes(0)
+    , m_lostPackets(0)
 {
     createParam("Enable",           asynParamInt32, &Enable, 0);         // WRITE - Enable saving data - master switch
     createParam("FilePath",         asynParamOctet, &FilePath);          // WRITE - Path to file where to save all received data
@@ -33,8 +39,22 @@ DumpPlugin::DumpPlugin(const char *portName, const char *parentPlugins)
     createParam("Overwrite",        asynParamInt32, &Overwrite, 0);      // WRITE - Overwrite existing file
     createParam("DataType",         asynParamInt32, &DataType, 0);       // WRITE - Data type packets to save
     createParam("CmdType",          asynParamInt32, &CmdType, 0);        // WRITE - Command type packets to save
+    createParam("Compress",         asynParamInt32, &Compress, 0);       // WRITE - Compress saved packets
+    createParam("CompressRatio",    asynParamFloat64, &CompressRatio, 0.0); // READ - Achieved compression ratio
+    // Never lose data on its way to storage
+    setLosslessQueue();
     callParamCallbacks();
 
+    m_block->reserve(EventCodec::MAX_BLOCK_SIZE);
+
+    std::string threadName = std::string(portName) + "_Writer";
+    m_writerThread = std::unique_ptr<Thread>(new Thread(
+        threadName.c_str(),
+        std::bind(&DumpPlugin::writerThread, this, std::placeholders::_1),
+        epicsThreadGetStackSize(epicsThreadStackMedium),
+        epicsThreadPriorityLow
+    ));
+
     // Let connect the first time, helps diagnose start-up problems
     connect(parentPlugins, {MsgDasData, MsgDasCmd, MsgDasRtdl, MsgError, MsgOldDas});
     disconnect();
@@ -54,7 +74,7 @@ void DumpPlugin::recvDownstream(const DasDataPacketList &packets)
 
         for (const auto& packet: packets) {
             if (dataType == 0 || packet->getEventsFormat() == dataType) {
-                if (writeToFile(packet, packet->getLength()))
+                if (savePacket(packet))
                     saved++;
                 else
                     failed++;
@@ -63,6 +83,7 @@ void DumpPlugin::recvDownstream(const DasDataPacketList &packets)
 
         addIntegerParam(SavedCount, saved);
         addIntegerParam(NotSavedCount, failed);
+        updateBlockStats();
         callParamCallbacks();
     }
 }
@@ -74,12 +95,13 @@ void DumpPlugin::recvDownstream(const RtdlPacketList &packets)
         int total = packets.size();
 
         for (const auto& packet: packets) {
-            if (writeToFile(packet, packet->getLength()))
+            if (savePacket(packet))
                 saved++;
         }
 
         setIntegerParam(SavedCount, getIntegerParam(SavedCount) + saved);
         setIntegerParam(NotSavedCount, getIntegerParam(NotSavedCount) + (total - saved));
+        updateBlockStats();
         callParamCallbacks();
     }
 }
@@ -93,13 +115,14 @@ void DumpPlugin::recvDownstream(const DasCmdPacketList &packets)
 
         for (const auto& packet: packets) {
             if (cmdType == 0 || packet->getCommand() == cmdType) {
-                if (writeToFile(packet, packet->getLength()))
+                if (savePacket(packet))
                     saved++;
             }
         }
 
         setIntegerParam(SavedCount, getIntegerParam(SavedCount) + saved);
         setIntegerParam(NotSavedCount, getIntegerParam(NotSavedCount) + (total - saved));
+        updateBlockStats();
         callParamCallbacks();
     }
 }
@@ -111,12 +134,13 @@ void DumpPlugin::recvDownstream(const ErrorPacketList &packets)
         int total = packets.size();
 
         for (const auto& packet: packets) {
-            if (writeToFile(packet, packet->getLength()))
+            if (savePacket(packet))
                 saved++;
         }
 
         setIntegerParam(SavedCount, getIntegerParam(SavedCount) + saved);
         setIntegerParam(NotSavedCount, getIntegerParam(NotSavedCount) + (total - saved));
+        updateBlockStats();
         callParamCallbacks();
     }
 }
@@ -128,7 +152,8 @@ void DumpPlugin::recvDownstream(const DasPacketList &packets)
         int total = packets.size();
 
         for (const auto& packet: packets) {
-            if (writeToFile(packet, packet->getLength()))
+            // Writer thread owns the file in compressed mode
+            if (!m_compress && writeToFile(packet, packet->getLength()))
                 saved++;
         }
 
@@ -167,6 +192,131 @@ bool DumpPlugin::writeToFile(const void *data, uint32_t len)
     return false;
 }
 
+bool DumpPlugin::savePacket(const Packet *packet)
+{
+    if (!m_compress)
+        return writeToFile(packet, packet->getLength());
+
+    if (m_fd == -1)
+        return false;
+
+    uint32_t len = packet->getLength();
+    if (len > EventCodec::MAX_BLOCK_SIZE) {
+        LOG_WARN("Packet too large to be compressed");
+        return false;
+    }
+    if ((m_block->size() + len) > EventCodec::MAX_BLOCK_SIZE)
+        flushBlock();
+
+    if (m_block->empty())
+        m_blockTime = epicsTime::getCurrent();
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(packet);
+    m_block->insert(m_block->end(), data, data + len);
+    m_blockPackets++;
+    return true;
+}
+
+void DumpPlugin::flushBlock()
+{
+    if (m_block->empty())
+        return;
+
+    if (m_blocks.size() < MAX_QUEUED_BLOCKS) {
+        m_blocks.enqueue(std::move(m_block));
+        m_block.reset(new std::vector<uint8_t>());
+        m_block->reserve(EventCodec::MAX_BLOCK_SIZE);
+    } else {
+        LOG_WARN("Compression queue full, discarding %u packets", m_blockPackets);
+        m_lostPackets += m_blockPackets;
+        m_block->clear();
+    }
+    m_blockPackets = 0;
+}
+
+void DumpPlugin::updateBlockStats()
+{
+    if (!m_compress)
+        return;
+
+    if (!m_block->empty() && (epicsTime::getCurrent() - m_blockTime) > MAX_BLOCK_AGE)
+        flushBlock();
+
+    uint32_t lost = m_lostPackets.exchange(0);
+    if (lost > 0) {
+        setIntegerParam(SavedCount, getIntegerParam(SavedCount) - lost);
+        addIntegerParam(NotSavedCount, lost);
+    }
+
+    uint64_t encodedBytes = m_encodedBytes;
+    if (encodedBytes > 0)
+        setDoubleParam(CompressRatio, 1.0 * m_rawBytes / encodedBytes);
+}
+
+float DumpPlugin::flushTimerCb()
+{
+    this->lock();
+    bool compress = m_compress;
+    if (compress) {
+        updateBlockStats();
+        callParamCallbacks();
+    }
+    this->unlock();
+    return (compress ? MAX_BLOCK_AGE / 2 : 0.0);
+}
+
+void DumpPlugin::writerThread(epicsEvent *shutdown)
+{
+    while (true) {
+        std::shared_ptr<std::vector<uint8_t>> block;
+        if (m_blocks.deque(block, 0.1) == false) {
+            // Only exit when all queued blocks are written
+            if (shutdown->tryWait())
+                break;
+            continue;
+        }
+
+        const Packet *packet = m_codec.encode(block->data(), block->size());
+        const EventCodec::BlockHeader *header = reinterpret_cast<const EventCodec::BlockHeader *>(packet + 1);
+        if (writeAllToFile(packet, packet->getLength())) {
+            m_rawBytes += block->size();
+            m_encodedBytes += packet->getLength();
+        } else {
+            m_lostPackets += header->numPackets;
+        }
+    }
+}
+
+bool DumpPlugin::writeAllToFile(const void *data, uint32_t len)
+{
+    const uint8_t *ptr = reinterpret_cast<const uint8_t *>(data);
+    uint32_t written = 0;
+    double timeout = 5.0;
+
+    while (written < len) {
+        ssize_t ret = write(m_fd, ptr + written, len - written);
+        if (ret > 0) {
+            written += ret;
+        } else if (ret == -1 && (errno == EAGAIN || errno == EINTR) && timeout > 0.0) {
+            // Off the data path, ok to wait for system buffers to drain
+            epicsThreadSleep(0.001);
+            timeout -= 0.001;
+        } else {
+            break;
+        }
+    }
+    if (written == len)
+        return true;
+
+    if (written > 0 && !m_fdIsPipe && lseek(m_fd, -1 * written, SEEK_CUR) == -1) {
+        LOG_ERROR("Wrote %u/%u bytes of compressed block - file is corrupted", written, len);
+    } else if (written > 0 && m_fdIsPipe) {
+        LOG_ERROR("Wrote %u/%u bytes of compressed block to pipe - reader will be confused", written, len);
+    } else {
+        LOG_WARN("Failed to save compressed block to file: %s", strerror(errno));
+    }
+    return false;
+}
+
 asynStatus DumpPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
 {
     if (pasynUser->reason == Enable) {
@@ -185,6 +335,8 @@ asynStatus DumpPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
             if (getStringParam(FilePath, sizeof(path), path) == asynSuccess) {
                 if (!openFile(path, getBooleanParam(Overwrite)))
                     return asynError;
+                if (m_compress && getBooleanParam(OldPktsEn))
+                    LOG_WARN("Old DAS packets are not saved in compressed mode");
                 this->unlock();
                 connect(m_parentPlugins, {MsgDasData, MsgDasCmd, MsgDasRtdl, MsgError, MsgOldDas});
                 this->lock();
@@ -213,12 +365,36 @@ bool DumpPlugin::openFile(const std::string &path, bool overwrite)
 
     m_fdIsPipe = ((statBuf.st_mode & S_IFIFO) == S_IFIFO);
 
+    m_compress = getBooleanParam(Compress);
+    m_rawBytes = 0;
+    m_encodedBytes = 0;
+    m_lostPackets = 0;
+    setDoubleParam(CompressRatio, 0.0);
+    if (m_compress) {
+        m_writerThread->start();
+        std::function<float()> flushCb = std::bind(&DumpPlugin::flushTimerCb, this);
+        m_flushTimer.schedule(flushCb, MAX_BLOCK_AGE / 2);
+    }
+
     LOG_INFO("Switched dump to %s '%s'", (m_fdIsPipe ? "named pipe" : "regular file"), path.c_str());
     return true;
 }
 
 void DumpPlugin::closeFile()
 {
+    if (m_compress) {
+        m_flushTimer.cancel();
+        // Make sure everything gets written before closing the file
+        if (!m_block->empty()) {
+            m_blocks.enqueue(std::move(m_block));
+            m_block.reset(new std::vector<uint8_t>());
+            m_block->reserve(EventCodec::MAX_BLOCK_SIZE);
+            m_blockPackets = 0;
+        }
+        m_writerThread->stop();
+        m_compress = false;
+    }
+
     if (m_fd != -1) {
         (void)close(m_fd);
         m_fd = -1;
@@ -11,8 +11,14 @@
 #define DUMP_PLUGIN_H
 
 #include "BasePlugin.h"
+#include "EventCodec.h"
+#include "Fifo.h"
+#include "Thread.h"
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 /**
  * Dummy dump plugin writes all received OCC data into a file.
@@ -28,12 +34,35 @@
  * transfered to client's side of the pipe. In such case the corruption offset
  * is reported. Saved and not saved packet counter as well as corruption offset
  * are reset when a new file is opened.
+ *
+ * Optionally DAS 2.0 packets can be saved compressed. Packets are collected
+ * into blocks which are encoded by EventCodec and written to file by a
+ * background thread, so that the encoding does not delay receiving data.
+ * Such files are decoded transparently by FileReplayPlugin. Old DAS packets
+ * are not saved in compressed mode. Blocks are handed over to the writer
+ * thread when full or when the oldest packet in block is older than a
+ * second, checked also when no new data is coming in. When writer falls
+ * behind, blocks are dropped and reported as not saved packets.
  */
 class DumpPlugin : public BasePlugin {
     private: // variables
         int m_fd = -1;      //!< File handle for an opened file, or -1
         bool m_fdIsPipe;    //!< true when opened file is a named pipe
         std::string m_parentPlugins;
+        bool m_compress = false;                            //!< Compress packets in opened file
+        std::shared_ptr<std::vector<uint8_t>> m_block;      //!< Block of packets being collected
+        uint32_t m_blockPackets = 0;                        //!< Number of packets in m_block
+        epicsTime m_blockTime;                              //!< Time when first packet was put in m_block
+        Fifo<std::shared_ptr<std::vector<uint8_t>>> m_blocks; //!< Blocks waiting to be written
+        std::unique_ptr<Thread> m_writerThread;             //!< Thread compressing and writing blocks
+        Timer m_flushTimer{true};                           //!< Periodically flushes partial block while file is open
+        EventCodec m_codec;                                 //!< Used by writer thread only
+        std::atomic<uint64_t> m_rawBytes;                   //!< Number of bytes before compression
+        std::atomic<uint64_t> m_encodedBytes;               //!< Number of bytes written to file
+        std::atomic<uint32_t> m_lostPackets;                //!< Accepted packets that failed to be written
+
+        static const uint32_t MAX_QUEUED_BLOCKS = 64;       //!< Writer thread queue limit
+        static constexpr double MAX_BLOCK_AGE = 1.0;        //!< Max time packets wait in m_block, in seconds
 
     public: // functions
         /**
@@ -114,6 +143,47 @@ class DumpPlugin : public BasePlugin {
          */
         bool writeToFile(const void *data, uint32_t len);
 
+        /**
+         * Save packet to file or to current block in compressed mode.
+         *
+         * @return true if packet was saved or accepted for compression
+         */
+        bool savePacket(const Packet *packet);
+
+        /**
+         * Hand over current block to writer thread.
+         */
+        void flushBlock();
+
+        /**
+         * Flush old blocks and update compression related parameters.
+         *
+         * Packets that were accepted but later failed to be written are
+         * moved from SavedCount to NotSavedCount.
+         */
+        void updateBlockStats();
+
+        /**
+         * Timer callback flushing old block when no data is received.
+         *
+         * @return Delay until next invocation, 0 stops timer.
+         */
+        float flushTimerCb();
+
+        /**
+         * Background thread encoding blocks and writing them to file.
+         *
+         * Remaining blocks are written before thread exits.
+         */
+        void writerThread(epicsEvent *shutdown);
+
+        /**
+         * Write all data to file, waiting for file to become writable.
+         *
+         * Only used by writer thread where blocking is allowed.
+         */
+        bool writeAllToFile(const void *data, uint32_t len);
+
     private: // asyn parameters
         int Enable;         //!< Enable saving packets - master switch
         int FilePath;       //!< Path to file where to save all received data
@@ -127,6 +197,8 @@ class DumpPlugin : public BasePlugin {
         int Overwrite;      //!< Overwrite existing file
         int DataType;       //!< Select data type packets to save
         int CmdType;        //!< Select command type packets to save
+        int Compress;       //!< Compress saved packets
+        int CompressRatio;  //!< Achieved compression ratio
 };
 
 #endif // DUMP_PLUGIN_H
@@ -12,6 +12,18 @@
 
 namespace Event {
 
+namespace LPSD {
+    Diag& Diag::operator=(const Raw &raw) {
+        // Use memcpy() for efficiency
+        memcpy(this, &raw, sizeof(Raw));
+        pixelid = 0;
+        pixelid_raw = 0;
+
+        return *this;
+    }
+
+}; // namespace LPSD
+
 namespace BNL {
     Diag& Diag::operator=(const Raw &raw) {
         // Use memcpy() for efficiency
@@ -29,4 +41,33 @@ namespace BNL {
 
 }; // namespace BNL
 
+namespace CROC {
+    Diag& Diag::operator=(const Raw &raw) {
+        // Use memcpy() for efficiency
+        memcpy(this, &raw, sizeof(Raw));
+        pixelid = 0;
+        x = 0;
+        y = 0;
+        corrected_x = -1.0;
+        corrected_y = -1.0;
+        pixelid_raw = 0;
+
+        return *this;
+    }
+
+    DiagCompact& DiagCompact::operator=(const Raw &raw) {
+        // Use memcpy() for efficiency
+        memcpy(this, &raw, sizeof(Raw));
+        pixelid = 0;
+        x = 0;
+        y = 0;
+        corrected_x = -1.0;
+        corrected_y = -1.0;
+        pixelid_raw = 0;
+
+        return *this;
+    }
+
+}; // namespace CROC
+
 }; // namespace Event
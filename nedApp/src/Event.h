@@ -288,6 +288,24 @@ namespace Event {
              */
             Diag& operator=(const Raw &raw);
         };
+
+        /**
+         * Diagnostic mode data packet with single precision fields
+         *
+         * Carries the same information as Diag in 72 rather than 96 bytes.
+         */
+        struct DiagCompact : public Verbose {
+            float x;                // Interpolated X position
+            float y;                // Interpolated Y position
+            float corrected_x;      // Interpolated and corrected X position
+            float corrected_y;      // Interpolated and corrected Y position
+            uint32_t pixelid_raw;   // Mapped pixel id
+
+            /**
+             * Copy fields from Raw event.
+             */
+            DiagCompact& operator=(const Raw &raw);
+        };
     };
 
     /**
@@ -331,6 +349,37 @@ namespace Event {
             uint32_t pixelid;       // Pixel id
             uint32_t pixelid_raw;   // Mapped pixel id
         };
+
+        /**
+         * Diagnostic mode data packet with single precision fields
+         *
+         * Carries the same information as Diag in 44 rather than 72 bytes,
+         * float is also the precision published through PVA. Veto values
+         * are the same as in Diag but stored in a single byte.
+         */
+        struct DiagCompact {
+            enum class Veto : uint8_t {
+                GOOD = 0,
+                UNKNOWN,
+                POSITION,
+                RANGE,
+                PHOTOSUM,
+                MAPPING,
+            };
+
+            uint32_t tof;
+            uint32_t position;
+            uint32_t pixelid;       // Pixel id
+            uint32_t pixelid_raw;   // Mapped pixel id
+            float x;                // Interpolated X position
+            float y;                // Interpolated Y position
+            float photo_sum_x;      // X photo sum
+            float photo_sum_y;      // Y photo sum
+            float corrected_x;      // Interpolated and corrected X position
+            float corrected_y;      // Interpolated and corrected Y position
+            Veto veto;
+            uint8_t _padding[3];    // Always 0
+        };
     };
 
     namespace AROC {
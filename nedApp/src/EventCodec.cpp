@@ -0,0 +1,415 @@
+/* EventCodec.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "Common.h"
+#include "EventCodec.h"
+#include "Event.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+/**
+ * Record tags in the transformed stream.
+ */
+enum RecordTag {
+    TAG_RAW     = 0,    //!< Packet copied verbatim
+    TAG_PIXEL   = 1,    //!< DAS data packet with transformed tof,pixel events
+    TAG_TAIL    = 2,    //!< Non-parsable remainder of the block copied verbatim
+};
+
+static inline uint32_t zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+static inline uint8_t *writeVarint(uint8_t *op, uint32_t value)
+{
+    while (value >= 0x80) {
+        *op++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *op++ = value;
+    return op;
+}
+
+static inline uint32_t readVarint(const uint8_t *data, uint32_t len, uint32_t &ip)
+{
+    uint32_t value = 0;
+    for (uint32_t shift = 0; shift < 35; shift += 7) {
+        if (ip >= len)
+            throw std::runtime_error("Truncated varint");
+        uint8_t byte = data[ip++];
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+    throw std::runtime_error("Invalid varint");
+}
+
+static inline uint32_t read32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint8_t *writeLength(uint8_t *op, uint32_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+static inline uint32_t readLength(const uint8_t *data, uint32_t len, uint32_t &ip)
+{
+    uint32_t value = 0;
+    uint8_t byte;
+    do {
+        if (ip >= len)
+            throw std::runtime_error("Truncated LZ length");
+        byte = data[ip++];
+        value += byte;
+    } while (byte == 255);
+    return value;
+}
+
+EventCodec::EventCodec()
+    : m_hashTable(1 << HASH_BITS)
+{
+    m_stage.reserve(2 * MAX_BLOCK_SIZE);
+    m_output.reserve(2 * MAX_BLOCK_SIZE);
+}
+
+const Packet *EventCodec::encode(const uint8_t *data, uint32_t len)
+{
+    static const uint32_t hdrLen = sizeof(Packet) + sizeof(BlockHeader);
+    uint32_t flags = FLAG_EVENTS;
+
+    uint32_t numPackets = transform(data, len);
+    const uint8_t *stage = m_stage.data();
+    uint32_t stageLen = m_stage.size();
+    if (stageLen >= len) {
+        stage = data;
+        stageLen = len;
+        flags = 0;
+    }
+
+    m_output.resize(hdrLen);
+    compress(stage, stageLen, m_output);
+    if ((m_output.size() - hdrLen) < stageLen) {
+        flags |= FLAG_LZ;
+    } else {
+        m_output.resize(hdrLen);
+        m_output.insert(m_output.end(), stage, stage + stageLen);
+    }
+    uint32_t encodedLen = m_output.size() - hdrLen;
+    m_output.resize(ALIGN_UP(m_output.size(), 4), 0);
+
+    Packet *packet = new (m_output.data()) Packet(BLOCK_VERSION, Packet::TYPE_COMPRESSED, m_output.size());
+    BlockHeader *header = reinterpret_cast<BlockHeader *>(m_output.data() + sizeof(Packet));
+    header->rawLength     = len;
+    header->stageLength   = stageLen;
+    header->encodedLength = encodedLen;
+    header->numPackets    = numPackets;
+    header->flags         = flags;
+    return packet;
+}
+
+const std::vector<uint8_t> &EventCodec::decode(const Packet *packet)
+{
+    static const uint32_t hdrLen = sizeof(Packet) + sizeof(BlockHeader);
+
+    if (!isBlock(packet) || packet->getVersion() != BLOCK_VERSION)
+        throw std::runtime_error("Not an encoded block");
+    if (packet->getLength() < hdrLen)
+        throw std::runtime_error("Encoded block too short");
+
+    const BlockHeader *header = reinterpret_cast<const BlockHeader *>(reinterpret_cast<const uint8_t *>(packet) + sizeof(Packet));
+    const uint8_t *payload = reinterpret_cast<const uint8_t *>(packet) + hdrLen;
+    if (header->encodedLength > (packet->getLength() - hdrLen))
+        throw std::runtime_error("Encoded block length mismatch");
+    if (header->rawLength > 2 * MAX_BLOCK_SIZE || header->stageLength > 4 * MAX_BLOCK_SIZE)
+        throw std::runtime_error("Encoded block too large");
+
+    const uint8_t *stage = payload;
+    uint32_t stageLen = header->encodedLength;
+    if (header->flags & FLAG_LZ) {
+        m_stage.resize(header->stageLength);
+        decompress(payload, header->encodedLength, m_stage);
+        stage = m_stage.data();
+        stageLen = m_stage.size();
+    } else if (stageLen != header->stageLength) {
+        throw std::runtime_error("Encoded block length mismatch");
+    }
+
+    if (header->flags & FLAG_EVENTS) {
+        untransform(stage, stageLen, m_output);
+    } else {
+        m_output.assign(stage, stage + stageLen);
+    }
+
+    if (m_output.size() != header->rawLength)
+        throw std::runtime_error("Decoded block length mismatch");
+
+    return m_output;
+}
+
+uint32_t EventCodec::transform(const uint8_t *data, uint32_t len)
+{
+    uint32_t numPackets = 0;
+    uint32_t ip = 0;
+
+    m_dict.fill(0xFFFFFFFF);
+
+    // Worst case is every pixel escaped and tof using 5 bytes
+    m_stage.resize(2 * len + 16);
+    uint8_t *op = m_stage.data();
+
+    while (ip < len) {
+        const Packet *packet;
+        try {
+            packet = Packet::cast(data + ip, len - ip);
+            if (packet->getLength() < sizeof(Packet))
+                throw std::runtime_error("Invalid packet length");
+        } catch (...) {
+            *op++ = TAG_TAIL;
+            memcpy(op, data + ip, len - ip);
+            op += len - ip;
+            break;
+        }
+
+        bool pixels = false;
+        const DasDataPacket *dataPacket = nullptr;
+        if (packet->getType() == Packet::TYPE_DAS_DATA) {
+            dataPacket = DasDataPacket::cast(packet);
+            switch (dataPacket->getEventsFormat()) {
+            case DasDataPacket::EVENT_FMT_META:
+            case DasDataPacket::EVENT_FMT_PIXEL:
+            case DasDataPacket::EVENT_FMT_TIME_CALIB:
+                pixels = dataPacket->checkIntegrity();
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (pixels) {
+            *op++ = TAG_PIXEL;
+            memcpy(op, dataPacket, sizeof(DasDataPacket));
+            op += sizeof(DasDataPacket);
+
+            const Event::Pixel *events = dataPacket->getEvents<Event::Pixel>();
+            uint32_t nEvents = dataPacket->getNumEvents();
+            uint32_t prevTof = 0;
+            for (uint32_t i = 0; i < nEvents; i++) {
+                op = writeVarint(op, zigzag(static_cast<int32_t>(events[i].tof - prevTof)));
+                prevTof = events[i].tof;
+
+                uint32_t bank = events[i].pixelid >> BANK_SHIFT;
+                uint32_t slot = bank % DICT_SIZE;
+                if (m_dict[slot] == bank) {
+                    *op++ = slot;
+                } else {
+                    *op++ = DICT_SIZE;
+                    op = writeVarint(op, bank);
+                    m_dict[slot] = bank;
+                }
+                *op++ = events[i].pixelid & 0xFF;
+            }
+        } else {
+            *op++ = TAG_RAW;
+            memcpy(op, packet, packet->getLength());
+            op += packet->getLength();
+        }
+
+        ip += packet->getLength();
+        numPackets++;
+    }
+
+    m_stage.resize(op - m_stage.data());
+    return numPackets;
+}
+
+void EventCodec::untransform(const uint8_t *data, uint32_t len, std::vector<uint8_t> &out)
+{
+    uint32_t ip = 0;
+
+    m_dict.fill(0xFFFFFFFF);
+    out.clear();
+
+    while (ip < len) {
+        uint8_t tag = data[ip++];
+
+        if (tag == TAG_TAIL) {
+            out.insert(out.end(), data + ip, data + len);
+            break;
+        }
+
+        // Only copy header and let Packet describe it, output buffer is aligned
+        uint32_t hdrLen = (tag == TAG_PIXEL ? sizeof(DasDataPacket) : sizeof(Packet));
+        if (tag != TAG_RAW && tag != TAG_PIXEL)
+            throw std::runtime_error("Invalid record tag");
+        if ((len - ip) < hdrLen)
+            throw std::runtime_error("Truncated packet header");
+
+        size_t offset = out.size();
+        out.insert(out.end(), data + ip, data + ip + hdrLen);
+        ip += hdrLen;
+        uint32_t pktLen = reinterpret_cast<const Packet *>(out.data() + offset)->getLength();
+        if (pktLen < hdrLen || pktLen > 0xFFFFFF)
+            throw std::runtime_error("Invalid packet length");
+
+        if (tag == TAG_RAW) {
+            if ((len - ip) < (pktLen - hdrLen))
+                throw std::runtime_error("Truncated packet");
+            out.insert(out.end(), data + ip, data + ip + (pktLen - hdrLen));
+            ip += pktLen - hdrLen;
+            continue;
+        }
+
+        const DasDataPacket *packet = reinterpret_cast<const DasDataPacket *>(out.data() + offset);
+        uint32_t nEvents = packet->getNumEvents();
+        if (pktLen != sizeof(DasDataPacket) + nEvents * sizeof(Event::Pixel))
+            throw std::runtime_error("Invalid data packet length");
+
+        out.resize(offset + pktLen);
+        Event::Pixel *events = reinterpret_cast<Event::Pixel *>(out.data() + offset + sizeof(DasDataPacket));
+        uint32_t prevTof = 0;
+        for (uint32_t i = 0; i < nEvents; i++) {
+            events[i].tof = prevTof + unzigzag(readVarint(data, len, ip));
+            prevTof = events[i].tof;
+
+            if (ip >= len)
+                throw std::runtime_error("Truncated pixel id");
+            uint32_t slot = data[ip++];
+            uint32_t bank;
+            if (slot == DICT_SIZE) {
+                bank = readVarint(data, len, ip);
+                m_dict[bank % DICT_SIZE] = bank;
+            } else {
+                bank = m_dict[slot];
+            }
+
+            if (ip >= len)
+                throw std::runtime_error("Truncated pixel id");
+            events[i].pixelid = (bank << BANK_SHIFT) | data[ip++];
+        }
+    }
+}
+
+void EventCodec::compress(const uint8_t *data, uint32_t len, std::vector<uint8_t> &out)
+{
+    size_t offset = out.size();
+    out.resize(offset + len + len / 255 + 16);
+    uint8_t *op = out.data() + offset;
+
+    // Positions are stored +1, 0 means empty slot
+    std::fill(m_hashTable.begin(), m_hashTable.end(), 0);
+
+    uint32_t anchor = 0;
+    uint32_t ip = 0;
+    while (ip + MIN_MATCH <= len) {
+        uint32_t sequence = read32(data + ip);
+        uint32_t hash = (sequence * 2654435761U) >> (32 - HASH_BITS);
+        uint32_t candidate = m_hashTable[hash];
+        m_hashTable[hash] = ip + 1;
+
+        if (candidate == 0 || (ip - (candidate - 1)) > 0xFFFF || read32(data + candidate - 1) != sequence) {
+            ip++;
+            continue;
+        }
+
+        uint32_t ref = candidate - 1;
+        uint32_t matchLen = MIN_MATCH;
+        while (ip + matchLen < len && data[ref + matchLen] == data[ip + matchLen])
+            matchLen++;
+
+        uint32_t litLen = ip - anchor;
+        uint32_t extLen = matchLen - MIN_MATCH;
+        *op++ = (std::min(litLen, 15U) << 4) | std::min(extLen, 15U);
+        if (litLen >= 15)
+            op = writeLength(op, litLen - 15);
+        memcpy(op, data + anchor, litLen);
+        op += litLen;
+        uint32_t distance = ip - ref;
+        *op++ = distance & 0xFF;
+        *op++ = (distance >> 8) & 0xFF;
+        if (extLen >= 15)
+            op = writeLength(op, extLen - 15);
+
+        ip += matchLen;
+        anchor = ip;
+    }
+
+    // Last sequence has literals only
+    uint32_t litLen = len - anchor;
+    *op++ = (std::min(litLen, 15U) << 4);
+    if (litLen >= 15)
+        op = writeLength(op, litLen - 15);
+    memcpy(op, data + anchor, litLen);
+    op += litLen;
+
+    out.resize(op - out.data());
+}
+
+void EventCodec::decompress(const uint8_t *data, uint32_t len, std::vector<uint8_t> &out)
+{
+    uint32_t ip = 0;
+    uint32_t op = 0;
+    uint32_t outLen = out.size();
+
+    while (ip < len) {
+        uint8_t token = data[ip++];
+
+        uint32_t litLen = token >> 4;
+        if (litLen == 15)
+            litLen += readLength(data, len, ip);
+        if ((len - ip) < litLen || (outLen - op) < litLen)
+            throw std::runtime_error("LZ literals out of range");
+        memcpy(out.data() + op, data + ip, litLen);
+        ip += litLen;
+        op += litLen;
+
+        if (ip == len)
+            break;
+
+        if ((len - ip) < 2)
+            throw std::runtime_error("Truncated LZ offset");
+        uint32_t distance = data[ip] | (data[ip + 1] << 8);
+        ip += 2;
+
+        uint32_t matchLen = (token & 0xF);
+        if (matchLen == 15)
+            matchLen += readLength(data, len, ip);
+        matchLen += MIN_MATCH;
+
+        if (distance == 0 || distance > op || (outLen - op) < matchLen)
+            throw std::runtime_error("LZ match out of range");
+
+        // Byte by byte to support overlapping matches
+        uint8_t *dst = out.data() + op;
+        const uint8_t *src = dst - distance;
+        for (uint32_t i = 0; i < matchLen; i++)
+            dst[i] = src[i];
+        op += matchLen;
+    }
+
+    if (op != outLen)
+        throw std::runtime_error("LZ decoded length mismatch");
+}
@@ -0,0 +1,133 @@
+/* EventCodec.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef EVENT_CODEC_H
+#define EVENT_CODEC_H
+
+#include "Packet.h"
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Event aware encoder and decoder for dump files.
+ *
+ * A block of consecutive DAS 2.0 packets is encoded into a single software
+ * only packet of type Packet::TYPE_COMPRESSED. Encoding is done in two stages:
+ * - DAS data packets with tof,pixel events get their events transformed,
+ *   time of flight is delta encoded within the packet and written as
+ *   zig-zag varint, pixel ids are split into bank part which is looked up in
+ *   a dictionary shared by the entire block and a verbatim low byte.
+ *   All other packets are copied verbatim.
+ * - The transformed stream is compressed with a fast LZ77 block compressor.
+ * Each stage is only applied when it actually reduces the size, so that
+ * encoded block is never much larger than the original data.
+ *
+ * Since encoded block is a valid Packet, files with compressed and
+ * non-compressed packets can be mixed and are parsed by existing tools
+ * which skip unknown packet types.
+ */
+class EventCodec {
+    public:
+        /**
+         * Header of every encoded block, follows Packet header.
+         */
+        struct __attribute__ ((__packed__)) BlockHeader {
+            uint32_t rawLength;         //!< Number of bytes of original packets
+            uint32_t stageLength;       //!< Number of bytes after events transform
+            uint32_t encodedLength;     //!< Number of encoded bytes following header, excluding padding
+            uint32_t numPackets;        //!< Number of original packets
+            uint32_t flags;             //!< Encoding stages applied, see FLAG_*
+        };
+
+        static const uint32_t FLAG_EVENTS   = 0x1;  //!< Events transformation applied
+        static const uint32_t FLAG_LZ       = 0x2;  //!< Block compression applied
+
+        static const uint8_t BLOCK_VERSION  = 1;    //!< Version of the encoded block packet
+
+        /**
+         * Maximum number of original bytes in single block.
+         *
+         * Encoded block must fit the FileCircularBuffer read buffer and
+         * LZ match offsets are limited to 16 bits.
+         */
+        static const uint32_t MAX_BLOCK_SIZE = 65536;
+
+    private:
+        static const uint32_t DICT_SIZE     = 255;  //!< Number of bank dictionary entries, 255 is escape code
+        static const uint32_t BANK_SHIFT    = 8;    //!< Pixel id bits stored verbatim
+        static const uint32_t HASH_BITS     = 14;   //!< LZ hash table size in bits
+        static const uint32_t MIN_MATCH     = 4;    //!< Minimum LZ match length
+
+        std::array<uint32_t, DICT_SIZE> m_dict;     //!< Pixel bank dictionary
+        std::vector<uint32_t> m_hashTable;          //!< LZ hash table, positions in input
+        std::vector<uint8_t> m_stage;               //!< Intermediate transformation buffer
+        std::vector<uint8_t> m_output;              //!< Output buffer
+
+    public:
+        /**
+         * Constructor pre-allocates internal buffers.
+         */
+        EventCodec();
+
+        /**
+         * Encode a number of consecutive DAS 2.0 packets into one block packet.
+         *
+         * Packets in data must be complete and not exceed MAX_BLOCK_SIZE
+         * bytes total.
+         *
+         * @param data of consecutive packets
+         * @param len number of bytes in data
+         * @return Encoded packet, valid until next call to any EventCodec function.
+         */
+        const Packet *encode(const uint8_t *data, uint32_t len);
+
+        /**
+         * Decode block packet into original packets.
+         *
+         * @param packet Encoded block packet
+         * @return Buffer of original packets, valid until next call to any EventCodec function.
+         * @throw std::runtime_error when block is corrupted
+         */
+        const std::vector<uint8_t> &decode(const Packet *packet);
+
+        /**
+         * Check whether packet is an encoded block.
+         */
+        static bool isBlock(const Packet *packet)
+        {
+            return (packet->getType() == Packet::TYPE_COMPRESSED);
+        }
+
+    private:
+        /**
+         * Transform events of all packets in data to m_stage buffer.
+         *
+         * @return Number of packets in data.
+         */
+        uint32_t transform(const uint8_t *data, uint32_t len);
+
+        /**
+         * Reverse transformation of events.
+         */
+        void untransform(const uint8_t *data, uint32_t len, std::vector<uint8_t> &out);
+
+        /**
+         * Append LZ compressed data to out buffer.
+         */
+        void compress(const uint8_t *data, uint32_t len, std::vector<uint8_t> &out);
+
+        /**
+         * Decompress LZ data into out buffer which must be sized to exact original length.
+         */
+        static void decompress(const uint8_t *data, uint32_t len, std::vector<uint8_t> &out);
+};
+
+#endif // EVENT_CODEC_H
@@ -0,0 +1,171 @@
+/* EventHistogram.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "EventHistogram.h"
+#include "EventTraits.h"
+
+#include <algorithm>
+
+/**
+ * Formats with tof,pixelid events.
+ */
+typedef EventFormats<
+    DasDataPacket::EVENT_FMT_PIXEL,
+    DasDataPacket::EVENT_FMT_LPSD_VERBOSE,
+    DasDataPacket::EVENT_FMT_LPSD_DIAG,
+    DasDataPacket::EVENT_FMT_BNL_VERBOSE,
+    DasDataPacket::EVENT_FMT_BNL_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT,
+    DasDataPacket::EVENT_FMT_CROC_VERBOSE,
+    DasDataPacket::EVENT_FMT_CROC_DIAG,
+    DasDataPacket::EVENT_FMT_CROC_DIAG_COMPACT
+> HistogramFormats;
+
+EventHistogram::EventHistogram(unsigned nShards)
+    : m_shards(std::max(nShards, 1U))
+{
+    configure(m_config);
+}
+
+bool EventHistogram::configure(const Config &config)
+{
+    if (config.pixelBin == 0 || config.tofBin == 0)
+        return false;
+    if (config.pixelMax < config.pixelMin || config.tofMax < config.tofMin)
+        return false;
+
+    uint64_t nPixelBins = (config.pixelMax - config.pixelMin) / config.pixelBin + 1ULL;
+    uint64_t nTofBins = (config.tofMax - config.tofMin) / config.tofBin + 1ULL;
+    if (nPixelBins > MAX_BINS || nTofBins > MAX_BINS)
+        return false;
+    if (config.pixelTof && (nPixelBins * nTofBins) > MAX_BINS)
+        return false;
+
+    m_config = config;
+    m_nPixelBins = nPixelBins;
+    m_nTofBins = nTofBins;
+
+    for (auto &shard: m_shards) {
+        shard.pixel.assign(m_nPixelBins, 0);
+        shard.tof.assign(m_nTofBins, 0);
+        shard.pixelTof.assign(m_config.pixelTof ? m_nPixelBins * m_nTofBins : 0, 0);
+        shard.pixelTof.shrink_to_fit();
+    }
+    // Merged histograms are only cleared by merge(), sized here once
+    m_pixel.assign(m_nPixelBins, 0);
+    m_tof.assign(m_nTofBins, 0);
+    m_pixelTof.assign(m_config.pixelTof ? m_nPixelBins * m_nTofBins : 0, 0);
+    m_pixelTof.shrink_to_fit();
+    reset();
+    return true;
+}
+
+bool EventHistogram::isSupported(DasDataPacket::EventFormat format)
+{
+    return HistogramFormats::contains(format);
+}
+
+struct EventHistogram::AddPacket {
+    EventHistogram *histogram;
+    Shard &shard;
+    const DasDataPacket *packet;
+
+    template <typename Traits>
+    void operator()(const Traits &)
+    {
+        histogram->add<Traits>(shard, Traits::events(packet), packet->getNumEvents());
+    }
+};
+
+bool EventHistogram::add(unsigned shard, const DasDataPacket *packet)
+{
+    Shard &s = m_shards[shard % m_shards.size()];
+    return HistogramFormats::dispatch(packet->getEventsFormat(), AddPacket{this, s, packet});
+}
+
+template <typename Traits>
+void EventHistogram::add(Shard &shard, const typename Traits::Type *events, uint32_t nEvents)
+{
+    // Local copies let compiler keep them in registers
+    const uint32_t pixelMin = m_config.pixelMin;
+    const uint32_t pixelRange = m_config.pixelMax - m_config.pixelMin;
+    const uint32_t pixelBin = m_config.pixelBin;
+    const uint32_t tofMin = m_config.tofMin;
+    const uint32_t tofRange = m_config.tofMax - m_config.tofMin;
+    const uint32_t tofBin = m_config.tofBin;
+    const uint32_t nTofBins = m_nTofBins;
+    uint32_t *pixelCounts = shard.pixel.data();
+    uint32_t *tofCounts = shard.tof.data();
+    uint32_t *pixelTofCounts = (shard.pixelTof.empty() ? nullptr : shard.pixelTof.data());
+    uint64_t nOutside = 0;
+    uint64_t nVetos = 0;
+
+    for (uint32_t i = 0; i < nEvents; i++) {
+        uint32_t pixelid = Traits::pixelid(events[i]);
+        if ((pixelid & Event::Pixel::VETO_MASK) || Event::Pixel::getType(pixelid) != Event::Pixel::Type::NEUTRON) {
+            nVetos++;
+            continue;
+        }
+
+        // Unsigned arithmetic wraps values below min above range
+        uint32_t pixel = pixelid - pixelMin;
+        uint32_t tof = Traits::tof(events[i]) - tofMin;
+        if (pixel > pixelRange || tof > tofRange) {
+            nOutside++;
+            continue;
+        }
+
+        uint32_t pixelIdx = pixel / pixelBin;
+        uint32_t tofIdx = tof / tofBin;
+        pixelCounts[pixelIdx]++;
+        tofCounts[tofIdx]++;
+        if (pixelTofCounts)
+            pixelTofCounts[pixelIdx * nTofBins + tofIdx]++;
+    }
+
+    shard.nEvents += nEvents - nOutside - nVetos;
+    shard.nOutside += nOutside;
+    shard.nVetos += nVetos;
+}
+
+void EventHistogram::merge()
+{
+    std::fill(m_pixel.begin(), m_pixel.end(), 0);
+    std::fill(m_tof.begin(), m_tof.end(), 0);
+    std::fill(m_pixelTof.begin(), m_pixelTof.end(), 0);
+    m_nEvents = 0;
+    m_nOutside = 0;
+    m_nVetos = 0;
+
+    for (const auto &shard: m_shards) {
+        for (size_t i = 0; i < m_pixel.size(); i++)
+            m_pixel[i] += shard.pixel[i];
+        for (size_t i = 0; i < m_tof.size(); i++)
+            m_tof[i] += shard.tof[i];
+        for (size_t i = 0; i < m_pixelTof.size(); i++)
+            m_pixelTof[i] += shard.pixelTof[i];
+        m_nEvents += shard.nEvents;
+        m_nOutside += shard.nOutside;
+        m_nVetos += shard.nVetos;
+    }
+}
+
+void EventHistogram::reset()
+{
+    for (auto &shard: m_shards) {
+        std::fill(shard.pixel.begin(), shard.pixel.end(), 0);
+        std::fill(shard.tof.begin(), shard.tof.end(), 0);
+        std::fill(shard.pixelTof.begin(), shard.pixelTof.end(), 0);
+        shard.nEvents = 0;
+        shard.nOutside = 0;
+        shard.nVetos = 0;
+    }
+    merge();
+}
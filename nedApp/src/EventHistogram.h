@@ -0,0 +1,159 @@
+/* EventHistogram.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef EVENT_HISTOGRAM_H
+#define EVENT_HISTOGRAM_H
+
+#include "Event.h"
+#include "Packet.h"
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Pixel and time of flight histograms of neutron events.
+ *
+ * Histogram accumulates pixel counts, time of flight spectrum and optionally
+ * a 2D pixel x time of flight histogram of events inside region of interest.
+ * Events are accumulated into independent shards, each shard must only be
+ * updated from single thread at a time so that no locking or atomic
+ * operations are needed in the hot path. Shards are summed into published
+ * histograms by merge().
+ */
+class EventHistogram {
+    public:
+        /**
+         * Histogram binning and region of interest.
+         *
+         * Both min and max are inclusive. Number of bins is rounded up so
+         * that last bin may cover values above max, but those are discarded.
+         */
+        struct Config {
+            uint32_t pixelMin   = 0;        //!< Lowest pixel id in ROI
+            uint32_t pixelMax   = 1023;     //!< Highest pixel id in ROI
+            uint32_t pixelBin   = 1;        //!< Number of pixels per bin
+            uint32_t tofMin     = 0;        //!< Lowest time of flight in ROI, in 100ns
+            uint32_t tofMax     = 166666;   //!< Highest time of flight in ROI, in 100ns
+            uint32_t tofBin     = 100;      //!< Time of flight bin width, in 100ns
+            bool pixelTof       = false;    //!< Accumulate 2D pixel x time of flight histogram
+        };
+
+        static const uint32_t MAX_BINS = 16*1024*1024; //!< Max number of 2D bins per shard
+
+    private:
+        /**
+         * Counters updated by single thread.
+         */
+        struct Shard {
+            std::vector<uint32_t> pixel;
+            std::vector<uint32_t> tof;
+            std::vector<uint32_t> pixelTof;
+            uint64_t nEvents;
+            uint64_t nOutside;
+            uint64_t nVetos;
+        };
+
+        Config m_config;
+        uint32_t m_nPixelBins = 0;
+        uint32_t m_nTofBins = 0;
+        std::vector<Shard> m_shards;
+        std::vector<uint32_t> m_pixel;      //!< Merged pixel counts
+        std::vector<uint32_t> m_tof;        //!< Merged time of flight spectrum
+        std::vector<uint32_t> m_pixelTof;   //!< Merged 2D histogram, time of flight is the fast axis
+        uint64_t m_nEvents = 0;
+        uint64_t m_nOutside = 0;
+        uint64_t m_nVetos = 0;
+
+    public:
+        /**
+         * Constructor
+         *
+         * @param[in] nShards Number of independent accumulation shards
+         */
+        EventHistogram(unsigned nShards=1);
+
+        /**
+         * Apply new binning and clear all counts.
+         *
+         * Must not be called while any shard is being updated.
+         *
+         * @return false when configuration is not valid.
+         */
+        bool configure(const Config &config);
+
+        /**
+         * Return active configuration.
+         */
+        const Config &getConfig() const
+        {
+            return m_config;
+        }
+
+        /**
+         * Return true when events format can be histogrammed.
+         */
+        static bool isSupported(DasDataPacket::EventFormat format);
+
+        /**
+         * Add events from data packet to selected shard.
+         *
+         * @return false when packet format is not supported.
+         */
+        bool add(unsigned shard, const DasDataPacket *packet);
+
+        /**
+         * Sum all shards into published histograms.
+         *
+         * Must not be called while any shard is being updated.
+         */
+        void merge();
+
+        /**
+         * Clear all counts.
+         *
+         * Must not be called while any shard is being updated.
+         */
+        void reset();
+
+        /**
+         * Return number of shards.
+         */
+        unsigned getNumShards() const
+        {
+            return m_shards.size();
+        }
+
+        uint32_t getNumPixelBins() const    { return m_nPixelBins; }
+        uint32_t getNumTofBins() const      { return m_nTofBins; }
+
+        /**
+         * Return merged histograms, valid after merge().
+         */
+        const std::vector<uint32_t> &getPixelCounts() const     { return m_pixel; }
+        const std::vector<uint32_t> &getTofCounts() const       { return m_tof; }
+        const std::vector<uint32_t> &getPixelTofCounts() const  { return m_pixelTof; }
+
+        /**
+         * Return merged counters, valid after merge().
+         */
+        uint64_t getNumEvents() const       { return m_nEvents; }
+        uint64_t getNumOutside() const      { return m_nOutside; }
+        uint64_t getNumVetos() const        { return m_nVetos; }
+
+    private:
+        /**
+         * Selects add() specialization for packet events format at compile time.
+         */
+        struct AddPacket;
+
+        template <typename Traits>
+        void add(Shard &shard, const typename Traits::Type *events, uint32_t nEvents);
+};
+
+#endif // EVENT_HISTOGRAM_H
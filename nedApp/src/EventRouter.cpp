@@ -0,0 +1,72 @@
+/* EventRouter.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "EventRouter.h"
+#include "likely.h"
+
+void EventRouter::addBank(uint32_t firstPixel, uint32_t lastPixel)
+{
+    m_banks.push_back(Bank{firstPixel, lastPixel});
+}
+
+void EventRouter::classify(const Event::Pixel *events, uint32_t nEvents, uint32_t *counts)
+{
+    if (m_classes.size() < nEvents)
+        m_classes.resize(nEvents);
+    classifyEvents(events, nEvents, m_classes.data(), counts);
+}
+
+NED_VECTORIZE
+void EventRouter::classifyEvents(const Event::Pixel *__restrict events, uint32_t nEvents, uint8_t *__restrict classes, uint32_t *counts)
+{
+    // Type and veto flag are the 4 most significant pixel id bits
+    for (uint32_t i = 0; i < nEvents; i++)
+        classes[i] = events[i].pixelid >> 28;
+
+    uint32_t nNeutrons = 0;
+    uint32_t nMonitors = 0;
+    uint32_t nVetoed = 0;
+    for (uint32_t i = 0; i < nEvents; i++) {
+        uint8_t neutron = (classes[i] == static_cast<uint8_t>(Event::Pixel::Type::NEUTRON));
+        uint8_t monitor = (classes[i] == static_cast<uint8_t>(Event::Pixel::Type::BEAM_MONITOR));
+        uint8_t vetoed = (classes[i] >> 3);
+        classes[i] = (vetoed ? ROUTE_VETOED : (neutron ? ROUTE_NEUTRONS : (monitor ? ROUTE_MONITORS : ROUTE_META)));
+        nNeutrons += neutron;
+        nMonitors += monitor;
+        nVetoed += vetoed;
+    }
+
+    counts[ROUTE_NEUTRONS] = nNeutrons;
+    counts[ROUTE_MONITORS] = nMonitors;
+    counts[ROUTE_META] = nEvents - nNeutrons - nMonitors - nVetoed;
+    counts[ROUTE_VETOED] = nVetoed;
+}
+
+void EventRouter::route(const Event::Pixel *events, uint32_t nEvents, Event::Pixel * const *outs, uint32_t *fills) const
+{
+    const uint8_t *classes = m_classes.data();
+    size_t nBanks = m_banks.size();
+
+    for (size_t r = 0; r < getNumRoutes(); r++)
+        fills[r] = 0;
+
+    for (uint32_t i = 0; i < nEvents; i++) {
+        uint8_t r = classes[i];
+        outs[r][fills[r]++] = events[i];
+        if (r == ROUTE_NEUTRONS) {
+            uint32_t pixel = events[i].pixelid;
+            for (size_t b = 0; b < nBanks; b++) {
+                if (pixel >= m_banks[b].firstPixel && pixel <= m_banks[b].lastPixel) {
+                    size_t br = ROUTE_BANKS + b;
+                    outs[br][fills[br]++] = events[i];
+                }
+            }
+        }
+    }
+}
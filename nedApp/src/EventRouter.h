@@ -0,0 +1,89 @@
+/* EventRouter.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef EVENT_ROUTER_H
+#define EVENT_ROUTER_H
+
+#include "Event.h"
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Splits tof,pixel events to routes by their type, veto flag and pixel id.
+ *
+ * Events are first classified into one of the fixed routes, non-vetoed
+ * neutrons are then also copied to all bank routes with matching pixel
+ * range. This is the data path of EventRouterPlugin, kept separate so it
+ * can be tested without asyn ports.
+ */
+class EventRouter {
+    public:
+        /**
+         * Fixed routes, bank routes follow in order added.
+         */
+        enum {
+            ROUTE_NEUTRONS  = 0,    //!< Non-vetoed neutron events
+            ROUTE_MONITORS  = 1,    //!< Non-vetoed beam monitor events
+            ROUTE_META      = 2,    //!< All other non-vetoed events
+            ROUTE_VETOED    = 3,    //!< Events with veto flag set
+            ROUTE_BANKS     = 4,    //!< First bank route
+        };
+
+        /**
+         * Add bank route, ranges of different banks may overlap.
+         *
+         * @param[in] firstPixel First pixel id of the bank
+         * @param[in] lastPixel Last pixel id of the bank, inclusive
+         */
+        void addBank(uint32_t firstPixel, uint32_t lastPixel);
+
+        /**
+         * Return number of all routes, fixed and bank ones.
+         */
+        size_t getNumRoutes() const { return ROUTE_BANKS + m_banks.size(); }
+
+        /**
+         * Select fixed route of every event.
+         *
+         * Bank routes can take at most counts[ROUTE_NEUTRONS] events.
+         *
+         * @param[in] events Events to be routed
+         * @param[in] nEvents Number of events
+         * @param[out] counts Number of events for each fixed route, ROUTE_BANKS elements
+         */
+        void classify(const Event::Pixel *events, uint32_t nEvents, uint32_t *counts);
+
+        /**
+         * Copy events classified by last classify() call to their routes.
+         *
+         * @param[in] events Same events as passed to classify()
+         * @param[in] nEvents Number of events
+         * @param[in] outs Output buffer of every route, large enough for events counted by classify()
+         * @param[out] fills Number of events written to every route
+         */
+        void route(const Event::Pixel *events, uint32_t nEvents, Event::Pixel * const *outs, uint32_t *fills) const;
+
+    private:
+        struct Bank {
+            uint32_t firstPixel;
+            uint32_t lastPixel;
+        };
+
+        std::vector<Bank> m_banks;          //!< Bank routes pixel ranges
+        std::vector<uint8_t> m_classes;     //!< Fixed route of every event being routed
+
+        /**
+         * Branch free part of classify(), vectorized by compiler.
+         */
+        static void classifyEvents(const Event::Pixel *__restrict events, uint32_t nEvents, uint8_t *__restrict classes, uint32_t *counts);
+};
+
+#endif // EVENT_ROUTER_H
@@ -0,0 +1,186 @@
+/* EventRouterPlugin.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "Common.h"
+#include "EventRouterPlugin.h"
+#include "Log.h"
+
+EPICS_REGISTER_PLUGIN(EventRouterPlugin, 3, "Port name", string, "Parent plugins", string, "Bank routes", string);
+
+EventRouterPlugin::EventRouterPlugin(const char *portName, const char *parentPlugins, const char *bankRoutes)
+    : BasePlugin(portName)
+{
+    createParam("CntNeutrons",  asynParamInt32, &CntNeutrons, 0);   // READ - Number of events sent to neutrons route
+    createParam("CntMonitors",  asynParamInt32, &CntMonitors, 0);   // READ - Number of events sent to monitors route
+    createParam("CntMeta",      asynParamInt32, &CntMeta, 0);       // READ - Number of events sent to meta route
+    createParam("CntVetoed",    asynParamInt32, &CntVetoed, 0);     // READ - Number of events sent to vetoed route
+    createParam("CntBanks",     asynParamInt32, &CntBanks, 0);      // READ - Number of events sent to all bank routes
+    createParam("CntUnrouted",  asynParamInt32, &CntUnrouted, 0);   // READ - Number of packets in formats that can't be routed
+    createParam("ResetCnt",     asynParamInt32, &ResetCnt);         // WRITE - Reset counters
+    callParamCallbacks();
+
+    const std::pair<const char *, int> fixedRoutes[] = {
+        { "Neutrons",   CntNeutrons },
+        { "Monitors",   CntMonitors },
+        { "Meta",       CntMeta },
+        { "Vetoed",     CntVetoed },
+    };
+    for (const auto &fixed: fixedRoutes) {
+        Route route;
+        route.port.reset(new RoutePort(std::string(portName) + "_" + fixed.first));
+        route.counter = createCounter(fixed.second);
+        m_routes.push_back(std::move(route));
+    }
+    if (!createBankRoutes(bankRoutes))
+        LOG_ERROR("Invalid bank routes '%s', expecting name:first-last[,name:first-last...]", bankRoutes);
+    m_outs.resize(m_routes.size());
+    m_fills.resize(m_routes.size());
+
+    m_cntUnrouted = createCounter(CntUnrouted);
+
+    BasePlugin::connect(parentPlugins, MsgDasData);
+}
+
+bool EventRouterPlugin::createBankRoutes(const std::string &bankRoutes)
+{
+    Counter *counter = createCounter(CntBanks);
+    bool valid = true;
+
+    for (auto &entry: Common::split(bankRoutes, ',')) {
+        if (entry.empty())
+            continue;
+
+        char name[64];
+        uint32_t first, last;
+        if (sscanf(entry.c_str(), "%63[^:]:%u-%u", name, &first, &last) != 3 || first > last) {
+            valid = false;
+            continue;
+        }
+
+        Route route;
+        route.port.reset(new RoutePort(std::string(portName) + "_" + name));
+        route.counter = counter;
+        m_routes.push_back(std::move(route));
+        m_router.addBank(first, last);
+    }
+    return valid;
+}
+
+asynStatus EventRouterPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    if (pasynUser->reason == ResetCnt) {
+        if (value > 0) {
+            for (size_t i = 0; i < ROUTE_BANKS; i++)
+                resetCounter(m_routes[i].counter);
+            if (m_routes.size() > ROUTE_BANKS)
+                resetCounter(m_routes[ROUTE_BANKS].counter);
+            resetCounter(m_cntUnrouted);
+        }
+        return asynSuccess;
+    } else if (pasynUser->reason == FanOut) {
+        // Route ports have no records, they follow router
+        asynStatus status = BasePlugin::writeInt32(pasynUser, value);
+        if (status == asynSuccess) {
+            for (auto &route: m_routes)
+                route.port->setParallelFanOut(value == 1);
+        }
+        return status;
+    }
+    return BasePlugin::writeInt32(pasynUser, value);
+}
+
+void EventRouterPlugin::routePacket(const DasDataPacket *packet)
+{
+    uint32_t nEvents = packet->getNumEvents();
+    if (nEvents == 0)
+        return;
+    const Event::Pixel *events = packet->getEvents<Event::Pixel>();
+
+    if (m_discard.size() < nEvents)
+        m_discard.resize(nEvents);
+
+    uint32_t counts[ROUTE_BANKS];
+    m_router.classify(events, nEvents, counts);
+
+    // Output packet of every route with events, bank routes can take at most all neutrons
+    for (size_t r = 0; r < m_routes.size(); r++) {
+        Route &route = m_routes[r];
+        uint32_t capacity = (r < ROUTE_BANKS ? counts[r] : counts[ROUTE_NEUTRONS]);
+        route.dest = nullptr;
+        m_outs[r] = m_discard.data();
+        if (capacity > 0) {
+            route.dest = m_packetsPool.get(DasDataPacket::getLength(packet->getEventsFormat(), capacity));
+            if (route.dest == nullptr) {
+                LOG_ERROR_RATELIMIT("Failed to allocate output packet");
+                continue;
+            }
+            m_outs[r] = route.dest->getEvents<Event::Pixel>();
+        }
+    }
+
+    // Routes without packet write to discard buffer
+    m_router.route(events, nEvents, m_outs.data(), m_fills.data());
+
+    for (size_t r = 0; r < m_routes.size(); r++) {
+        Route &route = m_routes[r];
+        uint32_t fill = m_fills[r];
+        if (route.dest == nullptr)
+            continue;
+        if (fill == 0) {
+            m_packetsPool.put(route.dest);
+            continue;
+        }
+        // Events are already in place, init() only sets header
+        route.dest->init(packet->getEventsFormat(), packet->getTimeStamp(), fill);
+        route.dest->setEventsMapped(packet->getEventsMapped());
+        route.dest->setEventsCorrected(packet->getEventsCorrected());
+        route.packets.push_back(route.dest);
+        m_allocated.push_back(route.dest);
+        *route.counter += fill;
+    }
+}
+
+void EventRouterPlugin::recvDownstream(const DasDataPacketList &packets)
+{
+    DasDataPacketList unrouted;
+
+    for (const auto &packet: packets) {
+        switch (packet->getEventsFormat()) {
+        case DasDataPacket::EVENT_FMT_META:
+        case DasDataPacket::EVENT_FMT_PIXEL:
+        case DasDataPacket::EVENT_FMT_PIXEL_MAPPED:
+            routePacket(packet);
+            break;
+        default:
+            unrouted.push_back(packet);
+            break;
+        }
+    }
+
+    // Publish all routes, with parallel FanOut subscribers process them concurrently ..
+    uint64_t sendStart = LatencyHistogram::now();
+    std::vector< std::unique_ptr<PluginMessage> > messages;
+    for (auto &route: m_routes) {
+        if (!route.packets.empty())
+            messages.push_back(route.port->sendDownstream(route.packets, false, true));
+    }
+    if (!unrouted.empty()) {
+        messages.push_back(sendDownstream(unrouted, false, true));
+        *m_cntUnrouted += unrouted.size();
+    }
+
+    // .. and wait for all of them to get released
+    waitAllReleased(messages, sendStart);
+
+    for (auto &route: m_routes)
+        route.packets.clear();
+    for (auto packet: m_allocated)
+        m_packetsPool.put(packet);
+    m_allocated.clear();
+}
@@ -0,0 +1,140 @@
+/* EventRouterPlugin.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef EVENT_ROUTER_PLUGIN_H
+#define EVENT_ROUTER_PLUGIN_H
+
+#include "BasePlugin.h"
+#include "Event.h"
+#include "EventRouter.h"
+#include "ObjectPool.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Splits tof,pixel events into separate streams in a single pass.
+ *
+ * Every route is published through its own asyn port which other plugins
+ * connect to like to any other parent plugin. Routes are:
+ * - <port>_Neutrons non-vetoed neutron events
+ * - <port>_Monitors beam monitor events
+ * - <port>_Meta signal, ADC, chopper and other non-neutron events
+ * - <port>_Vetoed all events with veto flag set
+ * - <port>_<bank> non-vetoed neutron events within configured pixel range,
+ *   one port per range given in constructor
+ *
+ * Events are classified once per packet by EventRouter, each route gets
+ * a new packet with only its events. Neutron events go to the neutrons route and to
+ * all bank routes with matching pixel range. Output packets retain source
+ * format, timestamp and mapped and corrected flags, packets without any
+ * events for a route are not sent. Consumers like AdaraPlugin or
+ * StatPlugin can subscribe to only the slice they need instead of
+ * filtering all events themselves.
+ *
+ * Only tof,pixel formats are routed. Packets in other formats are sent
+ * intact through router's own port.
+ */
+class EventRouterPlugin : public BasePlugin {
+    public: // functions
+        /**
+         * Constructor
+         *
+         * Bank routes are defined as comma separated list of name:first-last
+         * entries, ie. "bank1:0-1023,bank2:1024-2047". Pixel ranges are
+         * inclusive and may overlap.
+         *
+         * @param[in] portName asyn port name.
+         * @param[in] parentPlugins is a comma separated list of plugins to connect to
+         * @param[in] bankRoutes Pixel range routes, can be empty
+         */
+        EventRouterPlugin(const char *portName, const char *parentPlugins, const char *bankRoutes);
+
+        /**
+         * Overloaded function to handle counters reset and apply fan-out
+         * mode to route ports.
+         */
+        asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value) override;
+
+        /**
+         * Overloaded function to receive data packets.
+         */
+        void recvDownstream(const DasDataPacketList &packets) override;
+
+    private: // types
+        /**
+         * Port publishing events of single route.
+         */
+        class RoutePort : public BasePlugin {
+            public:
+                RoutePort(const std::string &portName)
+                    : BasePlugin(portName.c_str())
+                {}
+
+                using BasePlugin::setParallelFanOut;
+        };
+
+        /**
+         * Output stream and its statistics.
+         */
+        struct Route {
+            std::unique_ptr<RoutePort> port;    //!< Port publishing route packets
+            Counter *counter;                   //!< Number of routed events, bank routes share one
+            DasDataPacketList packets;          //!< Packets being prepared for sending
+            DasDataPacket *dest;                //!< Packet being filled by routePacket()
+        };
+
+        /**
+         * Fixed routes, their index in m_routes.
+         */
+        enum {
+            ROUTE_NEUTRONS  = EventRouter::ROUTE_NEUTRONS,
+            ROUTE_MONITORS  = EventRouter::ROUTE_MONITORS,
+            ROUTE_META      = EventRouter::ROUTE_META,
+            ROUTE_VETOED    = EventRouter::ROUTE_VETOED,
+            ROUTE_BANKS     = EventRouter::ROUTE_BANKS,    //!< First bank route
+        };
+
+    private: // functions
+        /**
+         * Parse bank routes and create their ports.
+         *
+         * @return false on syntax error, valid routes are still created
+         */
+        bool createBankRoutes(const std::string &bankRoutes);
+
+        /**
+         * Split events of single packet to routes.
+         *
+         * Allocated packets are appended to m_allocated.
+         */
+        void routePacket(const DasDataPacket *packet);
+
+    private: // variables
+        std::vector<Route> m_routes;                    //!< All routes, fixed ones first
+        EventRouter m_router;                           //!< Classifies events and copies them to routes
+        std::vector<Event::Pixel *> m_outs;             //!< Events of route's dest packet or discard buffer
+        std::vector<uint32_t> m_fills;                  //!< Number of events written to every route
+        std::vector<Event::Pixel> m_discard;            //!< Sink for events of routes without packet
+        std::vector<DasDataPacket *> m_allocated;       //!< Packets to be returned to pool after sending
+        ObjectPool<DasDataPacket> m_packetsPool{false}; //!< Pool of packets for routed events
+        Counter *m_cntUnrouted;                         //!< Number of packets not routed, published to CntUnrouted
+
+    private: // asyn parameters
+        int CntNeutrons;    //!< Number of events sent to neutrons route
+        int CntMonitors;    //!< Number of events sent to monitors route
+        int CntMeta;        //!< Number of events sent to meta route
+        int CntVetoed;      //!< Number of events sent to vetoed route
+        int CntBanks;       //!< Number of events sent to all bank routes
+        int CntUnrouted;    //!< Number of packets in formats that can't be routed
+        int ResetCnt;       //!< Reset counters
+};
+
+#endif // EVENT_ROUTER_PLUGIN_H
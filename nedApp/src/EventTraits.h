@@ -0,0 +1,189 @@
+/* EventTraits.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef EVENT_TRAITS_H
+#define EVENT_TRAITS_H
+
+#include "Event.h"
+#include "Packet.h"
+
+#include <utility>
+
+/**
+ * Common part of all event format traits.
+ *
+ * tof() and pixelid() accessors compile to a load from fixed offset
+ * within event structure. pixelid() can only be used with formats
+ * that have pixel id field, using it with any other format fails
+ * to compile.
+ */
+template <DasDataPacket::EventFormat Format, typename T, bool HasPixel, DasDataPacket::EventFormat DiagFormat>
+struct EventTraitsBase {
+    typedef T Type;                                                     //!< Event structure
+    static constexpr DasDataPacket::EventFormat format = Format;        //!< Format described by these traits
+    static constexpr uint32_t size = sizeof(T);                         //!< Size of single event in bytes
+    static constexpr bool hasPixel = HasPixel;                          //!< Event has pixelid field
+    static constexpr DasDataPacket::EventFormat diagFormat = DiagFormat;//!< Software diagnostic format this format expands to, EVENT_FMT_INVALID if none
+    static constexpr bool isDiag = (Format == DiagFormat);              //!< Format is diagnostic format itself, also has pixelid_raw field
+
+    static const T *events(const DasDataPacket *packet) { return packet->getEvents<T>(); }
+    static T *events(DasDataPacket *packet) { return packet->getEvents<T>(); }
+
+    static uint32_t tof(const T &event) { return event.tof; }
+
+    static uint32_t pixelid(const T &event)
+    {
+        static_assert(HasPixel, "Event format has no pixel id");
+        return event.pixelid;
+    }
+    static uint32_t &pixelid(T &event)
+    {
+        static_assert(HasPixel, "Event format has no pixel id");
+        return event.pixelid;
+    }
+};
+
+/**
+ * Compile-time description of event format.
+ *
+ * Only formats with known event structure are specialized, using
+ * any other format is a compile-time error.
+ */
+template <DasDataPacket::EventFormat Format>
+struct EventTraits;
+
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_META>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_META,            Event::Pixel,           true,  DasDataPacket::EVENT_FMT_INVALID> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_PIXEL>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_PIXEL,           Event::Pixel,           true,  DasDataPacket::EVENT_FMT_INVALID> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_PIXEL_MAPPED>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_PIXEL_MAPPED,    Event::Pixel,           true,  DasDataPacket::EVENT_FMT_INVALID> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_TIME_CALIB>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_TIME_CALIB,      Event::Pixel,           true,  DasDataPacket::EVENT_FMT_INVALID> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_LPSD_RAW>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_LPSD_RAW,        Event::LPSD::Raw,       false, DasDataPacket::EVENT_FMT_LPSD_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_LPSD_VERBOSE>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_LPSD_VERBOSE,    Event::LPSD::Verbose,   true,  DasDataPacket::EVENT_FMT_LPSD_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_LPSD_DIAG>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_LPSD_DIAG,       Event::LPSD::Diag,      true,  DasDataPacket::EVENT_FMT_LPSD_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_ACPC_XY_PS>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_ACPC_XY_PS,      Event::ACPC::Normal,    false, DasDataPacket::EVENT_FMT_ACPC_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_ACPC_DIAG>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_ACPC_DIAG,       Event::ACPC::Diag,      true,  DasDataPacket::EVENT_FMT_ACPC_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT, Event::ACPC::DiagCompact, true, DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_AROC_RAW>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_AROC_RAW,        Event::AROC::Raw,       false, DasDataPacket::EVENT_FMT_INVALID> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_BNL_RAW>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_BNL_RAW,         Event::BNL::Raw,        false, DasDataPacket::EVENT_FMT_BNL_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_BNL_VERBOSE>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_BNL_VERBOSE,     Event::BNL::Verbose,    true,  DasDataPacket::EVENT_FMT_BNL_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_BNL_DIAG>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_BNL_DIAG,        Event::BNL::Diag,       true,  DasDataPacket::EVENT_FMT_BNL_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_CROC_RAW>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_CROC_RAW,        Event::CROC::Raw,       false, DasDataPacket::EVENT_FMT_CROC_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_CROC_VERBOSE>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_CROC_VERBOSE,    Event::CROC::Verbose,   true,  DasDataPacket::EVENT_FMT_CROC_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_CROC_DIAG>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_CROC_DIAG,       Event::CROC::Diag,      true,  DasDataPacket::EVENT_FMT_CROC_DIAG> {};
+template <> struct EventTraits<DasDataPacket::EVENT_FMT_CROC_DIAG_COMPACT>
+    : EventTraitsBase<DasDataPacket::EVENT_FMT_CROC_DIAG_COMPACT, Event::CROC::DiagCompact, true, DasDataPacket::EVENT_FMT_CROC_DIAG_COMPACT> {};
+
+/**
+ * List of event formats with runtime to compile-time dispatcher.
+ *
+ * Plugins define the list of formats they support and implement
+ * processing as a functor with templated operator() taking traits
+ * of a single format. Dispatcher instantiates one specialized and
+ * fully inlined kernel per format in the list:
+ *
+ * struct Count {
+ *     const DasDataPacket *packet;
+ *     uint32_t &count;
+ *     template <typename Traits>
+ *     void operator()(const Traits &) {
+ *         for (uint32_t i = 0; i < packet->getNumEvents(); i++)
+ *             count += (Traits::pixelid(Traits::events(packet)[i]) != 0);
+ *     }
+ * };
+ * EventFormats<EVENT_FMT_PIXEL, EVENT_FMT_BNL_DIAG>::dispatch(packet->getEventsFormat(), Count{packet, count});
+ *
+ * Listing a format without traits, or a format without pixel id when
+ * kernel uses it, is a compile-time error.
+ */
+template <DasDataPacket::EventFormat... Formats>
+struct EventFormats;
+
+template <>
+struct EventFormats<> {
+    template <typename Func>
+    static bool dispatch(DasDataPacket::EventFormat, Func &&) { return false; }
+    static constexpr bool contains(DasDataPacket::EventFormat) { return false; }
+    static constexpr uint32_t sizeOf(DasDataPacket::EventFormat) { return 0; }
+};
+
+template <DasDataPacket::EventFormat First, DasDataPacket::EventFormat... Rest>
+struct EventFormats<First, Rest...> {
+    /**
+     * Invoke functor with traits of selected format.
+     *
+     * @return false when format is not in the list, functor is not called then.
+     */
+    template <typename Func>
+    static bool dispatch(DasDataPacket::EventFormat format, Func &&func)
+    {
+        if (format == First) {
+            func(EventTraits<First>());
+            return true;
+        }
+        return EventFormats<Rest...>::dispatch(format, std::forward<Func>(func));
+    }
+
+    /**
+     * Is format in the list?
+     */
+    static constexpr bool contains(DasDataPacket::EventFormat format)
+    {
+        return (format == First || EventFormats<Rest...>::contains(format));
+    }
+
+    /**
+     * Return size of single event in selected format, 0 when format is not in the list.
+     */
+    static constexpr uint32_t sizeOf(DasDataPacket::EventFormat format)
+    {
+        return (format == First ? EventTraits<First>::size : EventFormats<Rest...>::sizeOf(format));
+    }
+};
+
+/**
+ * All formats with known event structure.
+ */
+typedef EventFormats<
+    DasDataPacket::EVENT_FMT_META,
+    DasDataPacket::EVENT_FMT_PIXEL,
+    DasDataPacket::EVENT_FMT_PIXEL_MAPPED,
+    DasDataPacket::EVENT_FMT_TIME_CALIB,
+    DasDataPacket::EVENT_FMT_LPSD_RAW,
+    DasDataPacket::EVENT_FMT_LPSD_VERBOSE,
+    DasDataPacket::EVENT_FMT_LPSD_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_XY_PS,
+    DasDataPacket::EVENT_FMT_ACPC_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT,
+    DasDataPacket::EVENT_FMT_AROC_RAW,
+    DasDataPacket::EVENT_FMT_BNL_RAW,
+    DasDataPacket::EVENT_FMT_BNL_VERBOSE,
+    DasDataPacket::EVENT_FMT_BNL_DIAG,
+    DasDataPacket::EVENT_FMT_CROC_RAW,
+    DasDataPacket::EVENT_FMT_CROC_VERBOSE,
+    DasDataPacket::EVENT_FMT_CROC_DIAG,
+    DasDataPacket::EVENT_FMT_CROC_DIAG_COMPACT
+> AllEventFormats;
+
+#endif // EVENT_TRAITS_H
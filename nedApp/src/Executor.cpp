@@ -0,0 +1,326 @@
+/* Executor.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "Executor.h"
+
+#include <epicsExport.h>
+#include <epicsThread.h>
+#include <iocsh.h>
+
+#include <algorithm>
+
+namespace {
+
+/**
+ * IOC wide executor and its configuration.
+ */
+struct Shared {
+    epicsMutex mutex;
+    Executor *executor{nullptr};
+    bool created{false};
+    unsigned nWorkers{0};   //!< 0 disables executor
+};
+
+Shared &shared()
+{
+    static Shared s;
+    return s;
+}
+
+} // namespace
+
+thread_local Executor::Worker *Executor::m_currentWorker = nullptr;
+
+Executor::Executor(unsigned nWorkers, const std::string &name)
+    : m_name(name)
+{
+    nWorkers = std::max(nWorkers, 1U);
+    for (unsigned i = 0; i < nWorkers; i++) {
+        Worker *worker = new Worker;
+        worker->executor = this;
+        worker->index = i;
+        m_workers.emplace_back(worker);
+    }
+
+    // Start threads only when all workers exist, they steal from each other
+    for (auto &worker: m_workers) {
+        std::string threadName = name + "_" + std::to_string(worker->index + 1);
+        worker->thread.reset(new Thread(
+            threadName.c_str(),
+            std::bind(&Executor::workerThread, this, worker.get()),
+            epicsThreadGetStackSize(epicsThreadStackBig),
+            epicsThreadPriorityMedium
+        ));
+        worker->thread->start();
+    }
+}
+
+Executor::~Executor()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    lock.unlock();
+    m_wakeup.notify_all();
+    m_spareWakeup.notify_all();
+
+    // Thread::stop() returns once worker function exited
+    for (auto &spare: m_spares)
+        spare->thread->stop();
+    m_spares.clear();
+
+    for (auto &worker: m_workers)
+        worker->thread->stop();
+    m_workers.clear();
+}
+
+void Executor::submit(Job job)
+{
+    Worker *worker = m_currentWorker;
+    if (worker == nullptr || worker->executor != this || worker->spare)
+        worker = m_workers[m_nextWorker++ % m_workers.size()].get();
+
+    worker->mutex.lock();
+    worker->jobs.push_back(std::move(job));
+    worker->mutex.unlock();
+
+    // Counted only once queued, worker claiming it will find it
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_nPending++;
+    lock.unlock();
+    m_wakeup.notify_one();
+}
+
+void Executor::takeJob(Worker *worker, Job &job)
+{
+    while (true) {
+        // Oldest job from own queue, job resubmitting itself doesn't starve others
+        worker->mutex.lock();
+        if (!worker->jobs.empty()) {
+            job = std::move(worker->jobs.front());
+            worker->jobs.pop_front();
+            worker->mutex.unlock();
+            return;
+        }
+        worker->mutex.unlock();
+
+        // Oldest job from other workers, spares steal from all of them
+        for (size_t i = (worker->spare ? 0 : 1); i < m_workers.size(); i++) {
+            Worker *victim = m_workers[(worker->index + i) % m_workers.size()].get();
+            victim->mutex.lock();
+            if (!victim->jobs.empty()) {
+                job = std::move(victim->jobs.front());
+                victim->jobs.pop_front();
+                victim->mutex.unlock();
+                worker->nStolen++;
+                return;
+            }
+            victim->mutex.unlock();
+        }
+
+        // Claimed job was taken from queue behind us by another worker
+        // that claimed later, one queued after we passed is ours now
+        epicsThreadSleep(0.0);
+    }
+}
+
+void Executor::runJob(Worker *worker, Job &job)
+{
+    job();
+    job = Job();
+    worker->nExecuted++;
+}
+
+void Executor::workerThread(Worker *worker)
+{
+    m_currentWorker = worker;
+
+    Job job;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wakeup.wait(lock, [this]() { return (m_nPending > 0 || m_stopping); });
+        if (m_stopping)
+            break;
+        m_nPending--;
+        lock.unlock();
+
+        takeJob(worker, job);
+        runJob(worker, job);
+
+        lock.lock();
+    }
+
+    m_currentWorker = nullptr;
+}
+
+void Executor::spareThread(Worker *worker)
+{
+    m_currentWorker = worker;
+
+    // Created active for the worker that just blocked
+    bool active = true;
+    Job job;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        if (active && m_nActiveSpares > m_nBlocked) {
+            m_nActiveSpares--;
+            active = false;
+            // Might have consumed wakeup meant for regular worker
+            if (m_nPending > 0)
+                m_wakeup.notify_one();
+        } else if (!active && m_nActiveSpares < m_nBlocked) {
+            m_nActiveSpares++;
+            active = true;
+        }
+
+        if (!active) {
+            m_spareWakeup.wait(lock);
+        } else if (m_nPending == 0) {
+            // Woken for new job or to park when blocked worker resumes
+            m_wakeup.wait(lock);
+        } else {
+            m_nPending--;
+            lock.unlock();
+
+            takeJob(worker, job);
+            runJob(worker, job);
+
+            lock.lock();
+        }
+    }
+
+    m_currentWorker = nullptr;
+}
+
+void Executor::beginBlocking()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_nBlocked++;
+    if (m_nActiveSpares < m_nBlocked) {
+        if (m_spares.size() > m_nActiveSpares) {
+            // Some spare is parked, it will activate itself
+            m_spareWakeup.notify_one();
+        } else {
+            Worker *spare = new Worker;
+            spare->executor = this;
+            spare->index = m_spares.size();
+            spare->spare = true;
+            std::string threadName = m_name + "_S" + std::to_string(spare->index + 1);
+            spare->thread.reset(new Thread(
+                threadName.c_str(),
+                std::bind(&Executor::spareThread, this, spare),
+                epicsThreadGetStackSize(epicsThreadStackBig),
+                epicsThreadPriorityMedium
+            ));
+            m_spares.emplace_back(spare);
+            m_nActiveSpares++;
+            spare->thread->start();
+        }
+    }
+}
+
+void Executor::endBlocking()
+{
+    // Active spare parks itself after completing current job, idle one
+    // when woken up next
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_nBlocked--;
+}
+
+void Executor::blockingWait(epicsEvent &event)
+{
+    Worker *worker = m_currentWorker;
+    if (worker == nullptr) {
+        event.wait();
+        return;
+    }
+    if (event.tryWait())
+        return;
+
+    worker->executor->beginBlocking();
+    event.wait();
+    worker->executor->endBlocking();
+}
+
+void Executor::report(FILE *fp)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    fprintf(fp, "Executor: %zu workers, %u jobs pending, %u workers blocked, %u of %zu spares active\n",
+            m_workers.size(), m_nPending, m_nBlocked, m_nActiveSpares, m_spares.size());
+    for (auto &worker: m_workers) {
+        worker->mutex.lock();
+        size_t queued = worker->jobs.size();
+        worker->mutex.unlock();
+        fprintf(fp, "  %-24s queued %zu, executed %llu, stolen %llu\n",
+                worker->thread->getName().c_str(), queued,
+                (unsigned long long)worker->nExecuted.load(),
+                (unsigned long long)worker->nStolen.load());
+    }
+    for (auto &spare: m_spares) {
+        fprintf(fp, "  %-24s executed %llu\n", spare->thread->getName().c_str(),
+                (unsigned long long)spare->nExecuted.load());
+    }
+}
+
+Executor *Executor::get()
+{
+    Shared &s = shared();
+    s.mutex.lock();
+    if (!s.created) {
+        if (s.nWorkers > 0)
+            s.executor = new Executor(s.nWorkers);
+        s.created = true;
+    }
+    Executor *executor = s.executor;
+    s.mutex.unlock();
+    return executor;
+}
+
+bool Executor::configure(unsigned nWorkers)
+{
+    Shared &s = shared();
+    s.mutex.lock();
+    bool created = s.created;
+    if (!created)
+        s.nWorkers = nWorkers;
+    s.mutex.unlock();
+    return !created;
+}
+
+static const iocshArg executorConfigArg0 = { "Number of workers", iocshArgInt };
+static const iocshArg * const executorConfigArgs[] = { &executorConfigArg0 };
+static const iocshFuncDef executorConfigFuncDef = { "nedExecutorConfig", 1, executorConfigArgs };
+
+extern "C" {
+    /**
+     * Configure number of workers processing plugin messages.
+     *
+     * Must be called before any plugin is created. Defaults to 0 which
+     * gives each plugin its own thread, ie. to use a worker per CPU:
+     * nedExecutorConfig(8)
+     * Once plugins are created it prints workers statistics.
+     */
+    int nedExecutorConfig(int nWorkers)
+    {
+        if (nWorkers < 0) {
+            printf("Usage: nedExecutorConfig <number of workers>\n");
+            return -1;
+        }
+        if (!Executor::configure(nWorkers)) {
+            Executor *executor = Executor::get();
+            if (executor)
+                executor->report(stdout);
+            printf("Executor already in use, must be configured before plugins are created\n");
+            return -1;
+        }
+        return 0;
+    }
+    static void executorConfigCallFunc(const iocshArgBuf *args) { nedExecutorConfig(args[0].ival); }
+    static void registerExecutorConfig(void) { iocshRegister(&executorConfigFuncDef, executorConfigCallFunc); }
+    epicsExportRegistrar(registerExecutorConfig);
+}
@@ -0,0 +1,190 @@
+/* Executor.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef NED_EXECUTOR_H
+#define NED_EXECUTOR_H
+
+#include "Thread.h"
+
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Pool of worker threads running short jobs.
+ *
+ * Every worker has its own queue of jobs. Jobs submitted from a worker
+ * go to its own queue, so a child plugin often runs on the same CPU soon
+ * after its parent produced data. Queues are processed in order, a job
+ * resubmitting itself waits behind jobs submitted before it. Idle workers
+ * steal the oldest jobs from other workers' queues. Jobs submitted from
+ * other threads are distributed to workers round-robin.
+ *
+ * Jobs may block, ie. waiting for subscribers to process data they sent.
+ * Blocking waits go through blockingWait() which never runs other jobs
+ * nested in the waiting one. Instead executor activates a spare worker
+ * for every blocked one, spare workers only steal jobs from regular
+ * workers and park again once the blocked worker resumes. Spare threads
+ * are created on demand and kept for reuse.
+ *
+ * Executor doesn't order jobs, users needing serial execution must not
+ * submit next job before previous one completes. BasePlugin does that
+ * by having at most one job per plugin submitted at any time.
+ *
+ * A single executor is shared by all plugins in the IOC, the number of
+ * workers is selected with nedExecutorConfig before plugins are created.
+ * Worker threads are named Executor_<n> and spare ones Executor_S<n>,
+ * both can be configured with nedThreadConfig like any other thread.
+ */
+class Executor {
+    public:
+        typedef std::function<void()> Job;
+
+        /**
+         * Create executor and start its worker threads.
+         *
+         * @param[in] nWorkers Number of worker threads, at least 1
+         * @param[in] name Prefix of worker threads' names
+         */
+        Executor(unsigned nWorkers, const std::string &name="Executor");
+
+        /**
+         * Stop worker threads and wait for them to exit, discards jobs
+         * not yet started.
+         */
+        ~Executor();
+
+        /**
+         * Queue a job to be run by one of the workers.
+         */
+        void submit(Job job);
+
+        /**
+         * Return number of worker threads.
+         */
+        unsigned getNumWorkers() const { return m_workers.size(); }
+
+        /**
+         * Print per worker statistics.
+         */
+        void report(FILE *fp);
+
+        /**
+         * Return IOC wide executor, created on first use.
+         *
+         * @return Shared executor or nullptr when disabled.
+         */
+        static Executor *get();
+
+        /**
+         * Select number of workers of IOC wide executor.
+         *
+         * Must be called before shared executor is created. With
+         * 0 workers, which is the default, get() returns nullptr and
+         * plugins create their own threads.
+         *
+         * @param[in] nWorkers Number of worker threads
+         * @return false if shared executor already exists.
+         */
+        static bool configure(unsigned nWorkers);
+
+        /**
+         * Wait for event to be signaled.
+         *
+         * When called from worker thread, a spare worker takes over
+         * pending jobs while this one is blocked. Worker waiting for other
+         * plugins to process data would otherwise hold up the very jobs it's
+         * waiting for. Running those jobs in the waiting worker instead
+         * could deadlock, the outer job can't continue before the nested
+         * one completes.
+         */
+        static void blockingWait(epicsEvent &event);
+
+    private:
+        /**
+         * Worker thread and its queue of jobs.
+         */
+        struct Worker {
+            Executor *executor;                 //!< Executor this worker belongs to
+            unsigned index;                     //!< Position in executor workers or spares list
+            bool spare{false};                  //!< Spare worker has no jobs of its own
+            epicsMutex mutex;                   //!< Protects jobs queue
+            std::deque<Job> jobs;               //!< Queued jobs
+            std::unique_ptr<Thread> thread;     //!< Worker thread
+            std::atomic<uint64_t> nExecuted{0}; //!< Number of jobs run by this worker
+            std::atomic<uint64_t> nStolen{0};   //!< Number of jobs taken from other workers
+        };
+
+        static thread_local Worker *m_currentWorker;    //!< Worker running in current thread, nullptr for other threads
+        std::vector<std::unique_ptr<Worker>> m_workers; //!< All workers
+        std::atomic<unsigned> m_nextWorker{0};  //!< Round-robin selection for external submits
+        const std::string m_name;               //!< Prefix of worker threads' names
+
+        std::mutex m_mutex;                     //!< Protects members below
+        unsigned m_nPending{0};                 //!< Number of queued jobs not yet claimed by any worker
+        bool m_stopping{false};                 //!< Tells all workers to exit
+        std::condition_variable m_wakeup;       //!< Signals idle workers there's new job
+        std::vector<std::unique_ptr<Worker>> m_spares; //!< Spare workers, created on demand
+        unsigned m_nBlocked{0};                 //!< Number of workers in blockingWait()
+        unsigned m_nActiveSpares{0};            //!< Number of spare workers not parked
+        std::condition_variable m_spareWakeup;  //!< Signals parked spares a worker blocked
+
+        /**
+         * Worker thread main function.
+         *
+         * Exits when executor is stopping, Thread's shutdown event is
+         * not used.
+         */
+        void workerThread(Worker *worker);
+
+        /**
+         * Spare worker thread main function.
+         *
+         * Runs jobs only while there are more blocked workers than
+         * active spares, otherwise parked.
+         */
+        void spareThread(Worker *worker);
+
+        /**
+         * Account worker entering blockingWait(), activate or create spare.
+         */
+        void beginBlocking();
+
+        /**
+         * Account worker leaving blockingWait().
+         */
+        void endBlocking();
+
+        /**
+         * Take oldest job from own queue or steal one from other workers.
+         *
+         * Caller must have claimed a job by decrementing m_nPending.
+         * Jobs are queued before they're counted, so a claimed job is
+         * always queued somewhere, but a pass over queues can miss it
+         * when racing other workers. Retries until it gets one.
+         */
+        void takeJob(Worker *worker, Job &job);
+
+        /**
+         * Run one job taken by takeJob().
+         */
+        void runJob(Worker *worker, Job &job);
+};
+
+#endif // NED_EXECUTOR_H
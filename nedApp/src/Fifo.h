@@ -19,8 +19,17 @@ class Fifo : private std::deque<T> {
         epicsEvent m_event;
 
     public:
-        using std::deque<T>::size;
-    
+        /**
+         * Return number of elements in FIFO.
+         */
+        size_t size()
+        {
+            m_mutex.lock();
+            size_t n = std::deque<T>::size();
+            m_mutex.unlock();
+            return n;
+        }
+
         /**
          * Push array of elements to FIFO.
          */
@@ -28,6 +28,8 @@ bool FileCircularBuffer::open(const std::string &path, std::string &error)
     }
     m_timeDiff = std::numeric_limits<double>::min();
     m_reading = false;
+    m_decoded.clear();
+    m_decodedOffset = 0;
     return (m_fd != -1);
 }
 
@@ -38,6 +40,8 @@ void FileCircularBuffer::close()
         m_fd = -1;
         m_offset = 0;
     }
+    m_decoded.clear();
+    m_decodedOffset = 0;
 }
 
 void FileCircularBuffer::start()
@@ -59,6 +63,8 @@ void FileCircularBuffer::reset()
     if (m_fd != -1) {
         ::lseek(m_fd, 0, SEEK_SET);
     }
+    m_decoded.clear();
+    m_decodedOffset = 0;
     m_timeDiff = std::numeric_limits<double>::min();
     m_startTime = epicsTime::getCurrent();
 }
@@ -124,7 +130,9 @@ int FileCircularBuffer::consume(uint32_t len)
 {
     len = std::min(len, m_offset);
     if (len < m_offset) {
-        ::lseek(m_fd, -1*(m_offset - len), SEEK_CUR);
+        // Data might come from decoded block and can't be re-read from
+        // file, keep the remaining packets in buffer instead
+        memmove(m_buffer.data(), m_buffer.data() + len, m_offset - len);
     }
     m_offset -= len;
 
@@ -179,6 +187,9 @@ bool readHeader(int fd, uint8_t *buffer, uint32_t len, uint32_t &hdrLen, uint32_
 
 bool FileCircularBuffer::readPacket(epicsTime &maxTime)
 {
+    if (m_decodedOffset < m_decoded.size())
+        return readDecodedPacket(maxTime);
+
     if (m_fd == -1)
         return false;
 
@@ -212,6 +223,18 @@ bool FileCircularBuffer::readPacket(epicsTime &maxTime)
         return false;
     }
 
+    if (!m_oldPackets && EventCodec::isBlock(reinterpret_cast<Packet *>(buffer))) {
+        try {
+            const std::vector<uint8_t> &decoded = m_codec.decode(reinterpret_cast<Packet *>(buffer));
+            m_decoded.assign(decoded.begin(), decoded.end());
+            m_decodedOffset = 0;
+        } catch (...) {
+            close();
+            return false;
+        }
+        return readPacket(maxTime);
+    }
+
     epicsTime packetTime;
     if (m_oldPackets) {
         packetTime = getPacketTimeStamp(reinterpret_cast<DasPacket *>(buffer));
@@ -227,3 +250,34 @@ bool FileCircularBuffer::readPacket(epicsTime &maxTime)
     m_offset += hdrLen + payloadLen;
     return true;
 }
+
+bool FileCircularBuffer::readDecodedPacket(epicsTime &maxTime)
+{
+    const Packet *packet;
+    try {
+        packet = Packet::cast(m_decoded.data() + m_decodedOffset, m_decoded.size() - m_decodedOffset);
+    } catch (...) {
+        packet = nullptr;
+    }
+    if (packet == nullptr || packet->getLength() < sizeof(Packet)) {
+        // Drop the rest of the block, can't recover from here
+        m_decoded.clear();
+        m_decodedOffset = 0;
+        return false;
+    }
+
+    uint32_t len = packet->getLength();
+    if (len > (m_buffer.size() - m_offset))
+        return false;
+
+    epicsTime packetTime = getPacketTimeStamp(packet);
+    if (packetTime > maxTime && maxTime != epicsTimeStamp{0, 0}) {
+        return false;
+    }
+    maxTime = packetTime;
+
+    memcpy(m_buffer.data() + m_offset, packet, len);
+    m_offset += len;
+    m_decodedOffset += len;
+    return true;
+}
@@ -8,10 +8,12 @@
  */
 
 #include "BaseCircularBuffer.h"
+#include "EventCodec.h"
 
 #include <array>
 #include <epicsTime.h>
 #include <limits>
+#include <vector>
 
 class FileCircularBuffer : public BaseCircularBuffer {
     private:
@@ -24,6 +26,9 @@ class FileCircularBuffer : public BaseCircularBuffer {
         bool m_oldPackets = false;
         uint32_t m_maxPackets = 100;
         float m_speed = 1.0;
+        EventCodec m_codec;
+        std::vector<uint8_t> m_decoded;     //!< Packets decoded from last compressed block
+        uint32_t m_decodedOffset = 0;       //!< Offset of next packet in m_decoded
 
     public:
         /**
@@ -140,6 +145,17 @@ class FileCircularBuffer : public BaseCircularBuffer {
          * does not change (so the next read will overwrite the m_buffer[m_offset].
          * Depending on the failure, the underlaying file descriptor might
          * get invalidated.
+         *
+         * Compressed blocks written by DumpPlugin are decoded transparently,
+         * packets from the block are returned one by one before reading
+         * the file again.
          */
         bool readPacket(epicsTime &maxTime);
+
+        /**
+         * Copy next packet from last decoded block into m_buffer.
+         *
+         * Same semantics as readPacket().
+         */
+        bool readDecodedPacket(epicsTime &maxTime);
 };
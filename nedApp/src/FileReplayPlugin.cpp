@@ -63,7 +63,7 @@ asynStatus FileReplayPlugin::writeOctet(asynUser *pasynUser, const char *value,
             return asynSuccess;
         }
     }
-    return BasePlugin::writeOctet(pasynUser, value, nChars, nActual);
+    return BasePortPlugin::writeOctet(pasynUser, value, nChars, nActual);
 }
 
 asynStatus FileReplayPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
@@ -82,7 +82,7 @@ asynStatus FileReplayPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
         callParamCallbacks();
         return asynSuccess;
     }
-    return asynPortDriver::writeInt32(pasynUser, value);
+    return BasePortPlugin::writeInt32(pasynUser, value);
 }
 
 asynStatus FileReplayPlugin::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
@@ -91,7 +91,7 @@ asynStatus FileReplayPlugin::writeFloat64(asynUser *pasynUser, epicsFloat64 valu
         m_file.setSpeed(value);
         return asynSuccess;
     }
-    return asynPortDriver::writeFloat64(pasynUser, value);
+    return BasePortPlugin::writeFloat64(pasynUser, value);
 }
 
 bool FileReplayPlugin::send(const uint8_t *data, size_t len)
@@ -10,6 +10,7 @@
 #include "Bits.h"
 #include "Common.h"
 #include "Event.h"
+#include "EventTraits.h"
 #include "FlatFieldPlugin.h"
 #include "FlatFieldTable.h"
 #include "likely.h"
@@ -20,7 +21,6 @@
 #include <cstring> // strerror()
 
 #include <fstream>
-#include <limits>
 #include <string>
 #include <sstream>
 
@@ -30,6 +30,14 @@
 #   define PATH_SEPARATOR '/'
 #endif
 
+/**
+ * Formats with X,Y position that can be corrected.
+ */
+typedef EventFormats<
+    DasDataPacket::EVENT_FMT_BNL_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_XY_PS
+> CorrectedFormats;
+
 EPICS_REGISTER_PLUGIN(FlatFieldPlugin, 3, "Port name", string, "Parent plugins", string, "Positions", string);
 
 FlatFieldPlugin::FlatFieldPlugin(const char *portName, const char *parentPlugins, const char *positions)
@@ -59,6 +67,7 @@ FlatFieldPlugin::FlatFieldPlugin(const char *portName, const char *parentPlugins
     createParam("TablesSizeX",  asynParamInt32, &TablesSizeX, 0);       // READ - All tables X size
     createParam("TablesSizeY",  asynParamInt32, &TablesSizeY, 0);       // READ - All tables Y size
     createParam("EnableCorr",   asynParamInt32, &EnableCorr, 1);        // WRITE - Enable flat-field and photosum correction
+    createParam("DiagFormat",   asynParamInt32, &DiagFormat, 0);        // WRITE - ACPC output event format (0=compact,1=double precision)
 
     std::vector<std::string> positions_ = Common::split(positions, ',');
     for (auto it=positions_.begin(); it!=positions_.end(); it++) {
@@ -96,6 +105,16 @@ FlatFieldPlugin::FlatFieldPlugin(const char *portName, const char *parentPlugins
     setIntegerParam(NumPositions, positions_.size());
     callParamCallbacks();
 
+    m_vetoCounters[VETO_NO]             = createCounter(CntGoodEvents);
+    m_vetoCounters[VETO_INHERITED]      = createCounter(CntInhVetos);
+    m_vetoCounters[VETO_POSITION]       = createCounter(CntPosVetos);
+    m_vetoCounters[VETO_RANGE]          = createCounter(CntRangeVetos);
+    m_vetoCounters[VETO_POSITION_CFG]   = createCounter(CntPosCfgVetos);
+    m_vetoCounters[VETO_PHOTOSUM]       = createCounter(CntPsVetos);
+
+    updateConfig();
+    setUnlockedProcessing();
+
     BasePlugin::connect(parentPlugins, MsgDasData);
 }
 
@@ -103,13 +122,9 @@ asynStatus FlatFieldPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
 {
     if (pasynUser->reason == ResetCnt) {
         if (value > 0) {
-            setIntegerParam(CntGoodEvents, 0);
-            setIntegerParam(CntPosVetos, 0);
-            setIntegerParam(CntRangeVetos, 0);
-            setIntegerParam(CntPosCfgVetos, 0);
-            setIntegerParam(CntPsVetos, 0);
+            for (auto &counter: m_vetoCounters)
+                resetCounter(counter.second);
             callParamCallbacks();
-            m_counters.reset();
         }
         return asynSuccess;
     } else if (pasynUser->reason == XyFractWidth) {
@@ -122,7 +137,11 @@ asynStatus FlatFieldPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
         if (value < 1 || value >= 1024)
             return asynError;
     }
-    return BasePlugin::writeInt32(pasynUser, value);
+
+    asynStatus status = BasePlugin::writeInt32(pasynUser, value);
+    if (status == asynSuccess)
+        updateConfig();
+    return status;
 }
 
 asynStatus FlatFieldPlugin::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
@@ -132,7 +151,10 @@ asynStatus FlatFieldPlugin::writeFloat64(asynUser *pasynUser, epicsFloat64 value
             return asynError;
     }
 
-    return BasePlugin::writeFloat64(pasynUser, value);
+    asynStatus status = BasePlugin::writeFloat64(pasynUser, value);
+    if (status == asynSuccess)
+        updateConfig();
+    return status;
 }
 
 asynStatus FlatFieldPlugin::readOctet(asynUser *pasynUser, char *value, size_t nChars, size_t *nActual, int *eomReason)
@@ -195,51 +217,58 @@ asynStatus FlatFieldPlugin::writeOctet(asynUser *pasynUser, const char *value, s
     return BasePlugin::writeOctet(pasynUser, value, nChars, nActual);
 }
 
+void FlatFieldPlugin::updateConfig()
+{
+    int xyFractWidth = getIntegerParam(XyFractWidth);
+    int psFractWidth = getIntegerParam(PsFractWidth);
+    double xMaxIn    = getDoubleParam(XMaxIn);
+    double yMaxIn    = getDoubleParam(YMaxIn);
+    int xMaxOut      = getIntegerParam(XMaxOut);
+    int yMaxOut      = getIntegerParam(YMaxOut);
+
+    Config config;
+    config.psScale = 1.0 / (1 << psFractWidth);
+    config.xScaleIn = 1.0 / (1 << xyFractWidth);
+    config.yScaleIn = 1.0 / (1 << xyFractWidth);
+    config.xScaleTable = (m_tableSizeX - 1) / xMaxIn;
+    config.yScaleTable = (m_tableSizeY - 1) / yMaxIn;
+    config.xScaleOut = 1.0 * Bits::roundUpPower2(yMaxOut) * xMaxOut / xMaxIn;
+    config.yScaleOut = 1.0 *                                yMaxOut / yMaxIn;
+    config.xMaskOut = (Bits::roundUpPower2(xMaxOut) - 1) * Bits::roundUpPower2(yMaxOut);
+    config.yMaskOut = (Bits::roundUpPower2(yMaxOut) - 1);
+    config.corrEn = getBooleanParam(EnableCorr);
+    config.diagCompact = (getIntegerParam(DiagFormat) == 0);
+    config.tables = m_tables;
+
+    m_config.publish(config);
+}
+
+struct FlatFieldPlugin::ProcessPacket {
+    FlatFieldPlugin *plugin;
+    const Config &config;
+    const DasDataPacket *packet;
+    std::pair<DasDataPacket *, Counters> &res;
+
+    // Only formats with processEvents() overload compile
+    template <typename Traits>
+    void operator()(const Traits &)
+    {
+        res = plugin->processEvents(config, packet->getTimeStamp(), Traits::events(packet), packet->getNumEvents());
+    }
+};
+
 void FlatFieldPlugin::recvDownstream(const DasDataPacketList &packets)
 {
-    double xMaxIn, yMaxIn;
-    int xMaxOut, yMaxOut;
-    bool corrEn = true;
-
-    // Parametrise calculating algorithms based on detector.
-    int xyFractWidth = 0;
-    int psFractWidth = 0;
-
-    getIntegerParam(XyFractWidth,   &xyFractWidth);
-    getIntegerParam(PsFractWidth,   &psFractWidth);
-    getDoubleParam(XMaxIn,          &xMaxIn);
-    getDoubleParam(YMaxIn,          &yMaxIn);
-    getIntegerParam(XMaxOut,        &xMaxOut);
-    getIntegerParam(YMaxOut,        &yMaxOut);
-    getBooleanParam(EnableCorr,     corrEn);
-
-    // This is a trick to avoid locking access to member variables. Since
-    // plugin design ensures a single instance of processDataUnlocked()
-    // function at any time, we read in values and store them as class members.
-    // This makes member variables const for the duration of this function.
-    m_psScale = 1.0 / (1 << psFractWidth);
-    m_xScaleIn = 1.0 / (1 << xyFractWidth);
-    m_yScaleIn = 1.0 / (1 << xyFractWidth);
-    m_xScaleTable = (m_tableSizeX - 1) / xMaxIn;
-    m_yScaleTable = (m_tableSizeY - 1) / yMaxIn;
-    m_xScaleOut = 1.0 * Bits::roundUpPower2(yMaxOut) * xMaxOut / xMaxIn;
-    m_yScaleOut = 1.0 *                                yMaxOut / yMaxIn;
-    m_xMaskOut = (Bits::roundUpPower2(xMaxOut) - 1) * Bits::roundUpPower2(yMaxOut);
-    m_yMaskOut = (Bits::roundUpPower2(yMaxOut) - 1);
+    // Same configuration is used for the whole batch, changes apply to next one
+    ConfigSnapshot<Config>::Ptr config = m_config.get();
 
     DasDataPacketList outPackets;
     std::vector<DasDataPacket *> pooledPackets;
+    Counters counters;
 
     for (const auto &packet: packets) {
-        epicsTimeStamp timestamp = packet->getTimeStamp();
-        uint32_t nEvents = packet->getNumEvents();
-
         std::pair<DasDataPacket*, Counters> res;
-        if (packet->getEventsFormat() == DasDataPacket::EVENT_FMT_BNL_DIAG) {
-            res = processEvents(timestamp, packet->getEvents<Event::BNL::Diag>(), nEvents, corrEn);
-        } else if (packet->getEventsFormat() == DasDataPacket::EVENT_FMT_ACPC_XY_PS) {
-            res = processEvents(timestamp, packet->getEvents<Event::ACPC::Normal>(), nEvents, corrEn);
-        } else {
+        if (!CorrectedFormats::dispatch(packet->getEventsFormat(), ProcessPacket{this, *config, packet, res})) {
             res = std::make_pair(const_cast<DasDataPacket*>(packet), Counters());
         }
 
@@ -250,7 +279,7 @@ void FlatFieldPlugin::recvDownstream(const DasDataPacketList &packets)
             // We got a newly allocated packet with modified events in it
             outPackets.push_back(res.first);
             pooledPackets.push_back(res.first);
-            m_counters += res.second;
+            counters += res.second;
         } else {
             // Can't allocate packet
             LOG_ERROR("Failed to allocate packet from pool");
@@ -265,30 +294,17 @@ void FlatFieldPlugin::recvDownstream(const DasDataPacketList &packets)
         m_packetsPool.put(packet);
     }
 
-    setIntegerParam(CntGoodEvents,  m_counters[VETO_NO]           % std::numeric_limits<int32_t>::max());
-    setIntegerParam(CntInhVetos,    m_counters[VETO_INHERITED]    % std::numeric_limits<int32_t>::max());
-    setIntegerParam(CntPosVetos,    m_counters[VETO_POSITION]     % std::numeric_limits<int32_t>::max());
-    setIntegerParam(CntRangeVetos,  m_counters[VETO_RANGE]        % std::numeric_limits<int32_t>::max());
-    setIntegerParam(CntPosCfgVetos, m_counters[VETO_POSITION_CFG] % std::numeric_limits<int32_t>::max());
-    setIntegerParam(CntPsVetos,     m_counters[VETO_PHOTOSUM]     % std::numeric_limits<int32_t>::max());
-
-    // Reduce the rate at which counters are updated through asyn
-    // There tends to be 'ring buffer overflow' messages coming
-    // from asyn otherwise and maybe we can save some performance
-    // by not doing it that often. It's for informational purposes
-    // only anyway.
-    callParamCallbacksRatelimit();
+    for (auto &counter: m_vetoCounters)
+        *counter.second += counters[counter.first];
 }
 
-// Only implement processEvents() for known input events.
-// This could be solved with constexpr from std=c++17
 
-std::pair<DasDataPacket *, FlatFieldPlugin::Counters> FlatFieldPlugin::processEvents(const epicsTimeStamp &timestamp, const Event::BNL::Diag *srcEvents, uint32_t nEvents, bool corrEn) {
+std::pair<DasDataPacket *, FlatFieldPlugin::Counters> FlatFieldPlugin::processEvents(const Config &config, const epicsTimeStamp &timestamp, const Event::BNL::Diag *srcEvents, uint32_t nEvents) {
     Counters counters;
     DasDataPacket *packet = m_packetsPool.get(DasDataPacket::getLength(DasDataPacket::EVENT_FMT_BNL_DIAG, nEvents));
     if (packet != nullptr) {
         packet->init(DasDataPacket::EVENT_FMT_BNL_DIAG, timestamp, nEvents, srcEvents);
-        packet->setEventsCorrected(corrEn);
+        packet->setEventsCorrected(config.corrEn);
         Event::BNL::Diag *events = packet->getEvents<Event::BNL::Diag>();
 
         while (nEvents-- > 0) {
@@ -301,14 +317,14 @@ std::pair<DasDataPacket *, FlatFieldPlugin::Counters> FlatFieldPlugin::processEv
             if (events->pixelid & Event::Pixel::VETO_MASK) {
                 veto = VETO_INHERITED;
             } else {
-                events->corrected_x = srcEvents->x * m_xScaleIn;
-                events->corrected_y = srcEvents->y * m_yScaleIn;
+                events->corrected_x = srcEvents->x * config.xScaleIn;
+                events->corrected_y = srcEvents->y * config.yScaleIn;
 
-                if (corrEn)
-                    veto = correctPosition(events->corrected_x, events->corrected_y, srcEvents->position);
+                if (config.corrEn)
+                    veto = correctPosition(config, events->corrected_x, events->corrected_y, srcEvents->position);
 
-                events->pixelid |= (std::lround(events->corrected_x * m_xScaleOut) & m_xMaskOut);
-                events->pixelid |= (std::lround(events->corrected_y * m_yScaleOut) & m_yMaskOut);
+                events->pixelid |= (std::lround(events->corrected_x * config.xScaleOut) & config.xMaskOut);
+                events->pixelid |= (std::lround(events->corrected_y * config.yScaleOut) & config.yMaskOut);
             }
             counters[veto]++;
 
@@ -325,29 +341,35 @@ std::pair<DasDataPacket *, FlatFieldPlugin::Counters> FlatFieldPlugin::processEv
     return std::make_pair(packet, std::move(counters));
 }
 
-std::pair<DasDataPacket *, FlatFieldPlugin::Counters> FlatFieldPlugin::processEvents(const epicsTimeStamp &timestamp, const Event::ACPC::Normal *srcEvents, uint32_t nEvents, bool corrEn) {
+std::pair<DasDataPacket *, FlatFieldPlugin::Counters> FlatFieldPlugin::processEvents(const Config &config, const epicsTimeStamp &timestamp, const Event::ACPC::Normal *srcEvents, uint32_t nEvents) {
+    if (config.diagCompact)
+        return processAcpcEvents<Event::ACPC::DiagCompact>(config, timestamp, srcEvents, nEvents, DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT);
+    else
+        return processAcpcEvents<Event::ACPC::Diag>(config, timestamp, srcEvents, nEvents, DasDataPacket::EVENT_FMT_ACPC_DIAG);
+}
+
+template <typename T>
+std::pair<DasDataPacket *, FlatFieldPlugin::Counters> FlatFieldPlugin::processAcpcEvents(const Config &config, const epicsTimeStamp &timestamp, const Event::ACPC::Normal *srcEvents, uint32_t nEvents, DasDataPacket::EventFormat format) {
     Counters counters;
-    DasDataPacket *packet = m_packetsPool.get(DasDataPacket::getLength(DasDataPacket::EVENT_FMT_ACPC_DIAG, nEvents));
+    DasDataPacket *packet = m_packetsPool.get(DasDataPacket::getLength(format, nEvents));
     if (packet != nullptr) {
-        packet->init(DasDataPacket::EVENT_FMT_ACPC_DIAG, timestamp, nEvents);
-        packet->setEventsCorrected(corrEn);
-        Event::ACPC::Diag *events = packet->getEvents<Event::ACPC::Diag>();
+        packet->init(format, timestamp, nEvents);
+        packet->setEventsCorrected(config.corrEn);
+        T *events = packet->getEvents<T>();
 
         while (nEvents-- > 0) {
-            events->tof = srcEvents->tof;
-            events->position = srcEvents->position;
-            events->veto = Event::ACPC::Diag::Veto::GOOD;
-            events->x = srcEvents->x * m_xScaleIn;
-            events->y = srcEvents->y * m_yScaleIn;
-            events->photo_sum_x = srcEvents->photo_sum_x * m_psScale;
-            events->photo_sum_y = srcEvents->photo_sum_y * m_psScale;
-            events->corrected_x = events->x;
-            events->corrected_y = events->y;
+            // Calculate in double precision regardless of output format
+            double x = srcEvents->x * config.xScaleIn;
+            double y = srcEvents->y * config.yScaleIn;
+            double photoSumX = srcEvents->photo_sum_x * config.psScale;
+            double photoSumY = srcEvents->photo_sum_y * config.psScale;
+            double correctedX = x;
+            double correctedY = y;
 
             VetoType veto = VETO_NO;
-            if (corrEn) {
-                VetoType psVeto = checkPhotoSumLimits(events->x, events->y, events->photo_sum_x, events->position);
-                VetoType ffVeto = correctPosition(events->corrected_x, events->corrected_y, events->position);
+            if (config.corrEn) {
+                VetoType psVeto = checkPhotoSumLimits(config, x, y, photoSumX, srcEvents->position);
+                VetoType ffVeto = correctPosition(config, correctedX, correctedY, srcEvents->position);
 
                 if (psVeto != VETO_NO)
                     veto = psVeto;
@@ -356,17 +378,29 @@ std::pair<DasDataPacket *, FlatFieldPlugin::Counters> FlatFieldPlugin::processEv
             }
             counters[veto]++;
 
+            // Value-init clears padding so that no stale bytes leave the IOC
+            *events = T();
+            events->tof = srcEvents->tof;
+            events->position = srcEvents->position;
+            events->veto = T::Veto::GOOD;
+            events->x = x;
+            events->y = y;
+            events->photo_sum_x = photoSumX;
+            events->photo_sum_y = photoSumY;
+            events->corrected_x = correctedX;
+            events->corrected_y = correctedY;
 
             // Calculate pixelid
             events->pixelid  = srcEvents->position;
-            events->pixelid |= (std::lround(events->corrected_x * m_xScaleOut) & m_xMaskOut);
-            events->pixelid |= (std::lround(events->corrected_y * m_yScaleOut) & m_yMaskOut);
+            events->pixelid |= (std::lround(correctedX * config.xScaleOut) & config.xMaskOut);
+            events->pixelid |= (std::lround(correctedY * config.yScaleOut) & config.yMaskOut);
+            events->pixelid_raw = 0;
             if (veto != VETO_NO) {
                 events->pixelid |= Event::Pixel::VETO_MASK;
-                if (veto == VETO_POSITION)      events->veto = Event::ACPC::Diag::Veto::POSITION;
-                else if (veto == VETO_RANGE)    events->veto = Event::ACPC::Diag::Veto::RANGE;
-                else if (veto == VETO_PHOTOSUM) events->veto = Event::ACPC::Diag::Veto::PHOTOSUM;
-                else                            events->veto = Event::ACPC::Diag::Veto::UNKNOWN;
+                if (veto == VETO_POSITION)      events->veto = T::Veto::POSITION;
+                else if (veto == VETO_RANGE)    events->veto = T::Veto::RANGE;
+                else if (veto == VETO_PHOTOSUM) events->veto = T::Veto::PHOTOSUM;
+                else                            events->veto = T::Veto::UNKNOWN;
             }
 
             srcEvents++;
@@ -376,21 +410,24 @@ std::pair<DasDataPacket *, FlatFieldPlugin::Counters> FlatFieldPlugin::processEv
     return std::make_pair(packet, counters);
 }
 
-FlatFieldPlugin::VetoType FlatFieldPlugin::correctPosition(double &x, double &y, uint32_t position)
+FlatFieldPlugin::VetoType FlatFieldPlugin::correctPosition(const Config &config, double &x, double &y, uint32_t position)
 {
-    std::shared_ptr<FlatFieldTable> xtable = m_tables[position].corrX;
-    std::shared_ptr<FlatFieldTable> ytable = m_tables[position].corrY;
-    if (!xtable || !ytable || m_tables[position].enabled == false)
+    auto it = config.tables.find(position);
+    if (it == config.tables.end() || it->second.enabled == false)
+        return VETO_POSITION;
+    const FlatFieldTable *xtable = it->second.corrX.get();
+    const FlatFieldTable *ytable = it->second.corrY.get();
+    if (!xtable || !ytable)
         return VETO_POSITION;
 
-    x *= m_xScaleTable;
-    y *= m_yScaleTable;
+    x *= config.xScaleTable;
+    y *= config.yScaleTable;
     unsigned xp = x;
     unsigned yp = y;
 
     if (x < 0.0 || xp >= (xtable->sizeX-1) || y < 0.0 || yp >= (xtable->sizeY-1)) {
-        x /= m_xScaleTable;
-        y /= m_yScaleTable;
+        x /= config.xScaleTable;
+        y /= config.yScaleTable;
         return VETO_RANGE;
     }
 
@@ -401,21 +438,24 @@ FlatFieldPlugin::VetoType FlatFieldPlugin::correctPosition(double &x, double &y,
     x -= (dx * xtable->data[xp+1][yp]) + ((1 - dx) * xtable->data[xp][yp]);
     y -= (dy * ytable->data[xp][yp+1]) + ((1 - dy) * ytable->data[xp][yp]);
 
-    x /= m_xScaleTable;
-    y /= m_yScaleTable;
+    x /= config.xScaleTable;
+    y /= config.yScaleTable;
 
     return VETO_NO;
 }
 
-FlatFieldPlugin::VetoType FlatFieldPlugin::checkPhotoSumLimits(double x, double y, double photosum_x, uint32_t position)
+FlatFieldPlugin::VetoType FlatFieldPlugin::checkPhotoSumLimits(const Config &config, double x, double y, double photosum_x, uint32_t position)
 {
-    std::shared_ptr<FlatFieldTable> upperLimits = m_tables[position].psUpX;
-    std::shared_ptr<FlatFieldTable> lowerLimits = m_tables[position].psLowX;
-    if (!upperLimits || !lowerLimits || m_tables[position].enabled == false)
+    auto it = config.tables.find(position);
+    if (it == config.tables.end() || it->second.enabled == false)
+        return VETO_POSITION;
+    const FlatFieldTable *upperLimits = it->second.psUpX.get();
+    const FlatFieldTable *lowerLimits = it->second.psLowX.get();
+    if (!upperLimits || !lowerLimits)
         return VETO_POSITION;
 
-    unsigned xp = nearbyint(x * m_xScaleTable);
-    unsigned yp = nearbyint(y * m_yScaleTable);
+    unsigned xp = nearbyint(x * config.xScaleTable);
+    unsigned yp = nearbyint(y * config.yScaleTable);
 
     if (x < 0.0 || xp >= (upperLimits->sizeX-1) || y < 0.0 || yp >= (upperLimits->sizeY-1))
         return VETO_RANGE;
@@ -609,6 +649,8 @@ void FlatFieldPlugin::importFiles(const std::string &path_)
     setIntegerParam(TablesSizeX, (int)m_tableSizeX);
     setIntegerParam(TablesSizeY, (int)m_tableSizeY);
     callParamCallbacks();
+
+    updateConfig();
 }
 
 std::string FlatFieldPlugin::generatePositionsReport()
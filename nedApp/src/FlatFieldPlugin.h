@@ -11,6 +11,7 @@
 #define FLAT_FIELD_PLUGIN_H
 
 #include "BasePlugin.h"
+#include "ConfigSnapshot.h"
 #include "ObjectPool.h"
 #include "Timer.h"
 
@@ -62,6 +63,10 @@ class FlatFieldTable;
  * - In convert only mode it doesn't apply flat-field correction or phhoto sum
  *   elimination, it only converts X,Y event into TOF,pixel id format that many
  *   other plugins understand.
+ *
+ * Events are processed without holding the port lock. Parameter handlers
+ * and tables import publish new FlatFieldPlugin::Config snapshot which is
+ * picked up with next batch of packets.
  */
 class FlatFieldPlugin : public BasePlugin {
     private: // structures & typedefs
@@ -119,6 +124,24 @@ class FlatFieldPlugin : public BasePlugin {
                 uint32_t &operator[](VetoType index);
         };
 
+        /**
+         * Immutable processing configuration derived from parameters and tables.
+         */
+        struct Config {
+            double xScaleIn{1.0};       //!< Scaling factor to transform raw X to floating point
+            double yScaleIn{1.0};       //!< Scaling factor to transform raw Y to floating point
+            double xScaleOut{1.0};      //!< Scaling factor to convert X to pixel id format
+            double yScaleOut{1.0};      //!< Scaling factor to convert Y to pixel id format
+            double xScaleTable{0.0};    //!< Scaling factor to convert X to tables dimensions
+            double yScaleTable{0.0};    //!< Scaling factor to convert Y to tables dimensions
+            uint32_t xMaskOut{0};       //!< Mask to be applied to X when converting to pixel id format
+            uint32_t yMaskOut{0};       //!< Mask to be applied to Y when converting to pixel id format
+            double psScale{1.0};        //!< Scaling factor to convert unsigned UQm.n 32 bit value into double
+            bool corrEn{false};         //!< Toggle flat-field & photosum correction
+            bool diagCompact{true};     //!< Produce ACPC events in compact format
+            std::map<uint32_t, PositionTables> tables; //!< Tables by position, shares table data with m_tables
+        };
+
     public: // structures and defines
         /**
          * Constructor for FlatFieldPlugin
@@ -179,16 +202,13 @@ class FlatFieldPlugin : public BasePlugin {
          * calculated and added to event. Any errors are accounted for in
          * counters structure returned along the new packet.
          *
-         * This function is not thread safe as it uses class member variables
-         * as correction parameters.
-         *
+         * @param config Processing configuration snapshot
          * @param timestamp to be put in the newly allocated packet
          * @param srcEvents to be corrected
          * @param nEvents of events
-         * @param corrEn Toggle flat-field & photosum correction
          * @return Newly allocated packet (or null on alloc error) and the counters.
          */
-        std::pair<DasDataPacket *, Counters> processEvents(const epicsTimeStamp &timestamp, const Event::BNL::Diag *srcEvents, uint32_t nEvents, bool corrEn);
+        std::pair<DasDataPacket *, Counters> processEvents(const Config &config, const epicsTimeStamp &timestamp, const Event::BNL::Diag *srcEvents, uint32_t nEvents);
 
         /**
          * Apply photo-sum rejection and flat-field correction to all ACPC events.
@@ -200,28 +220,48 @@ class FlatFieldPlugin : public BasePlugin {
          * outlier events are vetoed. Any errors are accounted for in
          * counters structure returned along the new packet.
          *
-         * This function is not thread safe as it uses class member variables
-         * as correction parameters.
+         * @param config Processing configuration snapshot
+         * @param timestamp to be put in the newly allocated packet
+         * @param srcEvents to be corrected
+         * @param nEvents of events
+         * @return Newly allocated packet (or null on alloc error) and the counters.
+         */
+        std::pair<DasDataPacket *, Counters> processEvents(const Config &config, const epicsTimeStamp &timestamp, const Event::ACPC::Normal *srcEvents, uint32_t nEvents);
+
+        /**
+         * Correct ACPC events into selected diagnostic format.
+         *
+         * Compact format is used by default, it halves the memory
+         * bandwidth for all downstream plugins. Calculation is always
+         * done in double precision.
          *
+         * @param config Processing configuration snapshot
          * @param timestamp to be put in the newly allocated packet
          * @param srcEvents to be corrected
          * @param nEvents of events
-         * @param corrEn Toggle flat-field & photosum correction
+         * @param format Output events format, must match T
          * @return Newly allocated packet (or null on alloc error) and the counters.
          */
-        std::pair<DasDataPacket *, Counters> processEvents(const epicsTimeStamp &timestamp, const Event::ACPC::Normal *srcEvents, uint32_t nEvents, bool corrEn);
+        template <typename T>
+        std::pair<DasDataPacket *, Counters> processAcpcEvents(const Config &config, const epicsTimeStamp &timestamp, const Event::ACPC::Normal *srcEvents, uint32_t nEvents, DasDataPacket::EventFormat format);
+
+        /**
+         * Selects processEvents() overload for packet events format at compile time.
+         */
+        struct ProcessPacket;
 
         /**
          * Apply flat field correction on X,Y event
          *
          * Use X and Y correction tables to adjust x and y parameters.
          *
+         * @param[in] config Processing configuration snapshot
          * @param[in] x value to be corrected, in range [0.0 .. m_tableSizeX)
          * @param[in] y value to be corrected, in range [0.0 .. m_tableSizeY)
          * @param[in] position Detector position id to find corresponding correction tables.
          * @return VetoType
          */
-        VetoType correctPosition(double &x, double &y, uint32_t position);
+        VetoType correctPosition(const Config &config, double &x, double &y, uint32_t position);
 
         /**
          * Determine whether the X,Y position is within photo sum limits.
@@ -229,13 +269,21 @@ class FlatFieldPlugin : public BasePlugin {
          * For now only uses X photosum table, according to Miljko both X and Y
          * should be used.
          *
+         * @param[in] config Processing configuration snapshot
          * @param[in] x Calculate position X, in range [0.0 .. X table size)
          * @param[in] y Calculate position Y, in range [0.0 .. X table size)
          * @param[in] photosum_x Photo sum X value
          * @param[in] position Detector position id to find corresponding correction tables.
          * @return VetoType
          */
-        VetoType checkPhotoSumLimits(double x, double y, double photosum_x, uint32_t position);
+        VetoType checkPhotoSumLimits(const Config &config, double x, double y, double photosum_x, uint32_t position);
+
+        /**
+         * Build new configuration from parameters and tables and publish it.
+         *
+         * Port must be locked.
+         */
+        void updateConfig();
 
         /**
          * Try to import all files in given directory.
@@ -288,17 +336,9 @@ class FlatFieldPlugin : public BasePlugin {
         Timer m_importTimer{false}; //!< Timer is used as a worker thread for importing files
         epicsTime m_lastCountersTime;
 
-        // Following member variables must be carefully set since they're used un-locked
-        double m_xScaleIn;          //!< Scaling factor to transform raw X to floating point
-        double m_yScaleIn;          //!< Scaling factor to transform raw Y to floating point
-        double m_xScaleOut;         //!< Scaling factor to convert X to pixel id format
-        double m_yScaleOut;         //!< Scaling factor to convert Y to pixel id format
-        double m_xScaleTable;       //!< Scaling factor to convert X to tables dimensions
-        double m_yScaleTable;       //!< Scaling factor to convert Y to tables dimensions
-        uint32_t m_xMaskOut;        //!< Mask to be applied to X when converting to pixel id format
-        uint32_t m_yMaskOut;        //!< Mask to be applied to Y when converting to pixel id format
-        double m_psScale;           //!< Scaling factor to convert unsigned UQm.n 32 bit value into double
-        Counters m_counters;        //!< Global event counters
+        // Following member variables are used un-locked
+        ConfigSnapshot<Config> m_config;                //!< Latest processing configuration
+        std::map<VetoType, Counter *> m_vetoCounters;   //!< Global event counters
         ObjectPool<DasDataPacket> m_packetsPool{true};  //!< Pool of allocated data packets to store modified data
         std::string m_parentPlugins;//!< Parent plugins to connect to
 
@@ -323,6 +363,7 @@ class FlatFieldPlugin : public BasePlugin {
         int TablesSizeX;    //!< All tables size X
         int TablesSizeY;    //!< All tables size Y
         int EnableCorr;     //!< Enable flat-field and photosum correction
+        int DiagFormat;     //!< ACPC output events format
 
         std::map<uint32_t, int> PosEnable;
         std::map<uint32_t, int> PosId;
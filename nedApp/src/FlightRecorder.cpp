@@ -0,0 +1,267 @@
+/* FlightRecorder.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "FlightRecorder.h"
+#include "HugePages.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <unistd.h>
+
+FlightRecorder::FlightRecorder(const std::string &name, SavedCb savedCb)
+    : m_name(name)
+    , m_savedCb(savedCb)
+    , m_entries(new Entry[MAX_ENTRIES])
+{
+    m_thread.reset(new Thread(
+        (name + "_FlightRec").c_str(),
+        std::bind(&FlightRecorder::saveThread, this, std::placeholders::_1),
+        epicsThreadGetStackSize(epicsThreadStackMedium),
+        epicsThreadPriorityLow
+    ));
+    m_thread->start();
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    m_thread->stop();
+    if (m_ring)
+        HugePages::release(m_ring);
+}
+
+void FlightRecorder::resize(size_t size)
+{
+    m_resizeMutex.lock();
+    // Stop recording first, allocation may take a while
+    m_maxRecord = 0;
+    m_resizeSize = size;
+    m_resizePending = true;
+    m_event.signal();
+    m_resizeDone.wait();
+    m_resizeMutex.unlock();
+}
+
+void FlightRecorder::reallocate(size_t size)
+{
+    m_saveMutex.lock();
+    m_mutex.lock();
+    uint8_t *old = m_ring;
+    m_ring = nullptr;
+    m_size = 0;
+    m_mutex.unlock();
+
+    if (old)
+        HugePages::release(old);
+    uint8_t *ring = (size > 0 ? reinterpret_cast<uint8_t *>(HugePages::allocate(size, "flight recorder")) : nullptr);
+
+    m_mutex.lock();
+    m_ring = ring;
+    m_size = size;
+    m_writePos = 0;
+    m_nRecords = 0;
+    m_mutex.unlock();
+    m_saveMutex.unlock();
+
+    m_maxRecord = std::min(size / 8, (size_t)std::numeric_limits<uint32_t>::max());
+}
+
+void FlightRecorder::setDirectory(const std::string &dir)
+{
+    m_saveMutex.lock();
+    m_dir = dir;
+    m_saveMutex.unlock();
+}
+
+void FlightRecorder::setMaxAge(double seconds)
+{
+    m_saveMutex.lock();
+    m_maxAge = seconds;
+    m_saveMutex.unlock();
+}
+
+void FlightRecorder::record(const void *data, uint32_t len)
+{
+    size_t maxRecord = m_maxRecord;
+    if (maxRecord == 0)
+        return;
+    if (len > maxRecord) {
+        m_nSkipped++;
+        return;
+    }
+
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+
+    m_mutex.lock();
+    // Ring might have been resized since m_maxRecord was checked
+    if (m_ring == nullptr || m_frozen || len > m_size) {
+        m_mutex.unlock();
+        m_nSkipped++;
+        return;
+    }
+
+    // Records are contiguous, skip the end of ring when it doesn't fit
+    uint64_t pos = m_writePos;
+    size_t offset = pos % m_size;
+    if (offset + len > m_size) {
+        pos += m_size - offset;
+        offset = 0;
+    }
+    memcpy(m_ring + offset, data, len);
+
+    Entry &entry = m_entries[m_nRecords % MAX_ENTRIES];
+    entry.pos = pos;
+    entry.len = len;
+    entry.time = now;
+    m_nRecords++;
+    m_writePos = pos + len;
+    m_mutex.unlock();
+}
+
+bool FlightRecorder::trigger(Trigger reason)
+{
+    if ((m_triggers & reason) == 0 || m_maxRecord == 0)
+        return false;
+
+    if (reason != TRIG_MANUAL) {
+        epicsTimeStamp now;
+        epicsTimeGetCurrent(&now);
+        if (now.secPastEpoch < m_holdoffEnd)
+            return false;
+    }
+
+    if (m_pending.exchange(true) == true)
+        return false;
+
+    m_reason = reason;
+    m_event.signal();
+    return true;
+}
+
+void FlightRecorder::saveThread(epicsEvent *shutdown)
+{
+    while (shutdown->tryWait() == false) {
+        if (m_event.wait(1.0) == false)
+            continue;
+
+        if (m_resizePending) {
+            reallocate(m_resizeSize);
+            m_resizePending = false;
+            m_resizeDone.signal();
+        }
+        if (m_pending == false)
+            continue;
+
+        epicsTime triggerTime = epicsTime::getCurrent();
+        uint32_t reason = m_reason;
+
+        m_saveMutex.lock();
+        std::string path;
+        int error = 0;
+        if (!m_dir.empty()) {
+            char timeStr[32];
+            triggerTime.strftime(timeStr, sizeof(timeStr), "%Y%m%d_%H%M%S");
+            path = m_dir + "/" + m_name + "_" + timeStr + "_" + triggerName(reason) + ".dat";
+            error = save(path, triggerTime);
+            if (error == 0)
+                m_nSaved++;
+        }
+        m_saveMutex.unlock();
+
+        m_holdoffEnd = epicsTimeStamp(epicsTime::getCurrent()).secPastEpoch + HOLDOFF;
+        m_pending = false;
+
+        if (!path.empty())
+            m_savedCb(path, error);
+    }
+}
+
+int FlightRecorder::save(const std::string &path, const epicsTime &triggerTime)
+{
+    // Freeze ring so that records don't change while being written
+    m_mutex.lock();
+    if (m_ring == nullptr) {
+        m_mutex.unlock();
+        return ENOMEM;
+    }
+    m_frozen = true;
+    uint64_t writePos = m_writePos;
+    uint64_t nRecords = m_nRecords;
+    m_mutex.unlock();
+
+    int error = 0;
+    int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+    if (fd == -1) {
+        error = errno;
+    } else {
+        uint64_t first = (nRecords > MAX_ENTRIES ? nRecords - MAX_ENTRIES : 0);
+        for (uint64_t i = first; i < nRecords && error == 0; i++) {
+            const Entry &entry = m_entries[i % MAX_ENTRIES];
+
+            // Overwritten by newer records
+            if (entry.pos + m_size < writePos)
+                continue;
+            if (m_maxAge > 0.0 && (triggerTime - epicsTime(entry.time)) > m_maxAge)
+                continue;
+
+            const uint8_t *ptr = m_ring + (entry.pos % m_size);
+            uint32_t written = 0;
+            while (written < entry.len) {
+                ssize_t ret = write(fd, ptr + written, entry.len - written);
+                if (ret > 0) {
+                    written += ret;
+                } else if (ret == -1 && errno == EINTR) {
+                    continue;
+                } else {
+                    error = (ret == -1 ? errno : EIO);
+                    break;
+                }
+            }
+        }
+        if (close(fd) != 0 && error == 0)
+            error = errno;
+    }
+
+    m_mutex.lock();
+    m_frozen = false;
+    m_mutex.unlock();
+
+    return error;
+}
+
+const char *FlightRecorder::triggerName(uint32_t reason)
+{
+    switch (reason) {
+    case TRIG_MANUAL:       return "manual";
+    case TRIG_ERROR:        return "error";
+    case TRIG_SEQUENCE:     return "sequence";
+    case TRIG_INTEGRITY:    return "integrity";
+    default:                return "unknown";
+    }
+}
+
+void FlightRecorder::report(FILE *fp)
+{
+    m_mutex.lock();
+    size_t size = m_size;
+    uint64_t nRecords = m_nRecords;
+    uint64_t writePos = m_writePos;
+    m_mutex.unlock();
+
+    if (size == 0) {
+        fprintf(fp, "Flight recorder: disabled\n");
+        return;
+    }
+    fprintf(fp, "Flight recorder: %zu MB ring, %llu records (%llu MB) recorded, %llu skipped, %u files saved%s\n",
+            size / (1024*1024), (unsigned long long)nRecords, (unsigned long long)(writePos / (1024*1024)),
+            (unsigned long long)m_nSkipped.load(), m_nSaved.load(), (m_pending ? ", save pending" : ""));
+}
@@ -0,0 +1,210 @@
+/* FlightRecorder.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include "Thread.h"
+
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+/**
+ * Always-on recorder of most recent raw data received by port plugin.
+ *
+ * Incoming data is copied into a preallocated in-memory ring, keeping
+ * last N MB of data. Data is never written to disk unless triggered;
+ * manually, on receive error or when sequence gap or integrity failure
+ * is detected in data. Recording is cheap enough to be enabled all the
+ * time, trigger only signals the recorder's own thread which writes the
+ * ring to a file. Data path never waits for disk.
+ *
+ * Records are stored in the ring contiguously, together with index entry
+ * describing their position and time of recording. Positions grow
+ * monotonically, records older than one ring size are implicitly
+ * overwritten. While the ring is being saved, new data is not recorded.
+ *
+ * Saved file contains raw data as received and can be replayed with
+ * FileReplayPlugin. Recording should be done in chunks of whole packets,
+ * except for the last chunk before error when it's the broken data that
+ * is of interest.
+ */
+class FlightRecorder {
+    public:
+        /**
+         * Reasons for saving ring to file, also used as trigger enable mask.
+         */
+        enum Trigger {
+            TRIG_MANUAL     = 0x1,  //!< Requested by user
+            TRIG_ERROR      = 0x2,  //!< Error receiving data, processing stopped
+            TRIG_SEQUENCE   = 0x4,  //!< Packet sequence number gap
+            TRIG_INTEGRITY  = 0x8,  //!< Packet failed integrity check
+        };
+
+        /**
+         * Function called from recorder thread after ring was saved.
+         *
+         * @param[in] path Full path of the file
+         * @param[in] error 0 on success or errno
+         */
+        typedef std::function<void(const std::string &path, int error)> SavedCb;
+
+        /**
+         * Create disabled recorder and start its thread.
+         *
+         * @param[in] name Used for thread name and as saved files prefix
+         * @param[in] savedCb Function to be called after every save attempt
+         */
+        FlightRecorder(const std::string &name, SavedCb savedCb);
+
+        /**
+         * Stop thread and release ring.
+         */
+        ~FlightRecorder();
+
+        FlightRecorder(const FlightRecorder &) = delete;
+        FlightRecorder &operator=(const FlightRecorder &) = delete;
+
+        /**
+         * Allocate new ring, recorded data is discarded.
+         *
+         * Allocating large ring takes time, not to be called from data
+         * path. Ring is allocated and prefaulted by recorder thread, so
+         * record() never faults pages in and pinning recorder thread next
+         * to data thread keeps ring on the same NUMA node. Waits for save
+         * in progress and new ring to complete.
+         *
+         * @param[in] size Ring size in bytes, 0 disables recording
+         */
+        void resize(size_t size);
+
+        /**
+         * Select directory where to save files, empty disables saving.
+         */
+        void setDirectory(const std::string &dir);
+
+        /**
+         * Select how old data to save, 0 saves entire ring.
+         */
+        void setMaxAge(double seconds);
+
+        /**
+         * Select which triggers cause ring to be saved.
+         *
+         * @param[in] mask Combination of Trigger values
+         */
+        void setTriggers(uint32_t mask) { m_triggers = mask; }
+
+        /**
+         * Copy data to ring.
+         *
+         * Called from data path. Data larger than maxRecordSize() is not
+         * recorded.
+         */
+        void record(const void *data, uint32_t len);
+
+        /**
+         * Request ring to be saved to file.
+         *
+         * Only signals recorder thread, never blocks. Triggers are ignored
+         * while previous save is pending or in progress. Automatic triggers
+         * are also ignored for a while after last save so that a burst of
+         * bad data doesn't fill the disk.
+         *
+         * @return true if save was scheduled.
+         */
+        bool trigger(Trigger reason);
+
+        /**
+         * Return largest single record that fits in the ring.
+         *
+         * Callers should split their data in records no larger than this,
+         * since larger records would push out too much history.
+         */
+        size_t maxRecordSize() const { return m_maxRecord; }
+
+        /**
+         * Print ring status.
+         */
+        void report(FILE *fp);
+
+    private:
+        /**
+         * Index entry of single record in ring.
+         */
+        struct Entry {
+            uint64_t pos;           //!< Monotonic position of record start
+            uint32_t len;           //!< Length of recorded data
+            epicsTimeStamp time;    //!< Time when record was recorded
+        };
+
+        static const uint32_t MAX_ENTRIES = 64*1024;    //!< Number of index entries, must be power of 2
+        static const uint32_t HOLDOFF = 10;             //!< Min time between automatic saves, in seconds
+
+        const std::string m_name;
+        SavedCb m_savedCb;
+
+        epicsMutex m_mutex;                 //!< Protects ring between data path and recorder thread
+        uint8_t *m_ring{nullptr};           //!< Recorded data
+        size_t m_size{0};                   //!< Size of m_ring
+        std::unique_ptr<Entry[]> m_entries; //!< Index of records, MAX_ENTRIES long
+        uint64_t m_writePos{0};             //!< Monotonic position of next record
+        uint64_t m_nRecords{0};             //!< Number of all records
+        bool m_frozen{false};               //!< Ring is being saved, don't record
+        std::atomic<size_t> m_maxRecord{0}; //!< Largest record accepted
+        std::atomic<uint64_t> m_nSkipped{0};//!< Records not recorded, either too big or ring frozen
+
+        epicsMutex m_saveMutex;             //!< Serializes saving and resizing, protects configuration
+        std::string m_dir;                  //!< Directory where to save files
+        double m_maxAge{0.0};               //!< How much history to save, in seconds
+
+        std::atomic<uint32_t> m_triggers{0};//!< Enabled triggers
+        std::atomic<bool> m_pending{false}; //!< Save was triggered but not yet completed
+        std::atomic<uint32_t> m_reason{0};  //!< Trigger of pending save
+        std::atomic<uint32_t> m_holdoffEnd{0};  //!< Seconds past EPICS epoch when automatic triggers are accepted again
+        epicsEvent m_event;                 //!< Signals recorder thread to save or resize ring
+        epicsMutex m_resizeMutex;           //!< Serializes resize() calls
+        size_t m_resizeSize{0};             //!< Requested ring size
+        std::atomic<bool> m_resizePending{false}; //!< Recorder thread should reallocate ring
+        epicsEvent m_resizeDone;            //!< Signals new ring is in place
+        std::atomic<uint32_t> m_nSaved{0};  //!< Number of files saved
+        std::unique_ptr<Thread> m_thread;   //!< Thread saving ring
+
+        /**
+         * Recorder thread waiting for triggers.
+         */
+        void saveThread(epicsEvent *shutdown);
+
+        /**
+         * Replace ring with newly allocated one, called from recorder thread.
+         */
+        void reallocate(size_t size);
+
+        /**
+         * Save valid records to a new file.
+         *
+         * @return 0 on success or errno
+         */
+        int save(const std::string &path, const epicsTime &triggerTime);
+
+        /**
+         * Return short text describing trigger, used in file names.
+         */
+        static const char *triggerName(uint32_t reason);
+};
+
+#endif // FLIGHT_RECORDER_H
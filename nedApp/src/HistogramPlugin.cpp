@@ -0,0 +1,344 @@
+/* HistogramPlugin.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "HistogramPlugin.h"
+#include "Log.h"
+
+#include <alarm.h>
+#include <pv/sharedVector.h>
+
+#include <algorithm>
+#include <limits>
+
+#define MAX_THREADS 16
+
+EPICS_REGISTER_PLUGIN(HistogramPlugin, 4, "Port name", string, "Parent plugins", string, "PVA record name", string, "Number of threads", int);
+
+HistogramPlugin::HistogramPlugin(const char *portName, const char *parentPlugins, const char *pvName, int numThreads)
+    : BasePlugin(portName, 1, asynOctetMask | asynFloat64Mask, asynOctetMask | asynFloat64Mask)
+    , m_histogram(std::min(std::max(numThreads, 1), MAX_THREADS))
+    , m_lastPublish(epicsTime::getCurrent())
+{
+    EventHistogram::Config config;
+
+    createParam("Enable",       asynParamInt32,     &Enable, 0);                    // WRITE - Enable accumulating events
+    createParam("Reset",        asynParamInt32,     &Reset);                        // WRITE - Clear histograms
+    createParam("PublishRate",  asynParamFloat64,   &PublishRate, 1.0);             // WRITE - Number of PVA updates per second
+    createParam("PvaName",      asynParamOctet,     &PvaName, pvName);              // READ - PVA record name
+    createParam("NumThreads",   asynParamInt32,     &NumThreads, (int)m_histogram.getNumShards()); // READ - Number of accumulating threads
+    createParam("PixelMin",     asynParamInt32,     &PixelMin, (int)config.pixelMin); // WRITE - Lowest pixel id in ROI
+    createParam("PixelMax",     asynParamInt32,     &PixelMax, (int)config.pixelMax); // WRITE - Highest pixel id in ROI
+    createParam("PixelBin",     asynParamInt32,     &PixelBin, (int)config.pixelBin); // WRITE - Number of pixels per bin
+    createParam("TofMin",       asynParamInt32,     &TofMin, (int)config.tofMin);   // WRITE - Lowest time of flight in ROI, in 100ns
+    createParam("TofMax",       asynParamInt32,     &TofMax, (int)config.tofMax);   // WRITE - Highest time of flight in ROI, in 100ns
+    createParam("TofBin",       asynParamInt32,     &TofBin, (int)config.tofBin);   // WRITE - Time of flight bin width, in 100ns
+    createParam("PixelTofEn",   asynParamInt32,     &PixelTofEn, 0);                // WRITE - Enable 2D pixel x time of flight histogram
+    createParam("PixelBins",    asynParamInt32,     &PixelBins, (int)m_histogram.getNumPixelBins()); // READ - Number of pixel bins
+    createParam("TofBins",      asynParamInt32,     &TofBins, (int)m_histogram.getNumTofBins()); // READ - Number of time of flight bins
+    createParam("CntEvents",    asynParamInt32,     &CntEvents, 0);                 // READ - Number of events in histograms
+    createParam("CntOutside",   asynParamInt32,     &CntOutside, 0);                // READ - Number of events outside ROI
+    createParam("CntVetos",     asynParamInt32,     &CntVetos, 0);                  // READ - Number of vetoed and non-neutron events
+    createParam("CntIgnored",   asynParamInt32,     &CntIgnored, 0);                // READ - Number of packets in unsupported format
+
+    if (pvName && strlen(pvName) > 0) {
+        m_record = PvaRecord::create(pvName);
+        if (!m_record) {
+            LOG_ERROR("Failed to create PVA record '%s'", pvName);
+            setParamAlarmStatus(PvaName, epicsAlarmUDF);
+            setParamAlarmSeverity(PvaName, epicsSevMinor);
+        } else if (epics::pvDatabase::PVDatabase::getMaster()->addRecord(m_record) == false) {
+            LOG_ERROR("Failed to register PVA record '%s'", pvName);
+            setParamAlarmStatus(PvaName, epicsAlarmUDF);
+            setParamAlarmSeverity(PvaName, epicsSevMinor);
+            m_record.reset();
+        }
+    }
+    callParamCallbacks();
+
+    // Shard 0 is processed by plugin thread, others by dedicated workers
+    for (unsigned shard = 1; shard < m_histogram.getNumShards(); shard++)
+        m_wakeups.emplace_back(new epicsEvent());
+    for (unsigned shard = 1; shard < m_histogram.getNumShards(); shard++) {
+        std::string threadName = std::string(portName) + "_Worker" + std::to_string(shard);
+        m_workers.emplace_back(new Thread(
+            threadName.c_str(),
+            std::bind(&HistogramPlugin::workerThread, this, std::placeholders::_1, shard),
+            epicsThreadGetStackSize(epicsThreadStackMedium),
+            epicsThreadPriorityMedium
+        ));
+        m_workers.back()->start();
+    }
+
+    BasePlugin::connect(parentPlugins, MsgDasData);
+}
+
+HistogramPlugin::~HistogramPlugin()
+{
+    for (auto &worker: m_workers)
+        worker->stop();
+}
+
+asynStatus HistogramPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    if (pasynUser->reason == Reset) {
+        if (value > 0) {
+            m_histogram.reset();
+            m_nIgnored = 0;
+            publish();
+        }
+        return asynSuccess;
+    }
+    if (pasynUser->reason == PixelMin || pasynUser->reason == PixelMax || pasynUser->reason == PixelBin ||
+        pasynUser->reason == TofMin || pasynUser->reason == TofMax || pasynUser->reason == TofBin ||
+        pasynUser->reason == PixelTofEn) {
+
+        int oldValue = getIntegerParam(pasynUser->reason);
+        setIntegerParam(pasynUser->reason, value);
+        if (!configure()) {
+            LOG_ERROR("Invalid histogram binning, %s=%d rejected", getParamName(pasynUser->reason).c_str(), value);
+            setIntegerParam(pasynUser->reason, oldValue);
+            callParamCallbacks();
+            return asynError;
+        }
+        publish();
+        return asynSuccess;
+    }
+    return BasePlugin::writeInt32(pasynUser, value);
+}
+
+asynStatus HistogramPlugin::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
+{
+    if (pasynUser->reason == PublishRate) {
+        if (value <= 0.0)
+            return asynError;
+        setDoubleParam(PublishRate, value);
+        callParamCallbacks();
+        return asynSuccess;
+    }
+    return BasePlugin::writeFloat64(pasynUser, value);
+}
+
+bool HistogramPlugin::configure()
+{
+    EventHistogram::Config config;
+    config.pixelMin = getIntegerParam(PixelMin);
+    config.pixelMax = getIntegerParam(PixelMax);
+    config.pixelBin = getIntegerParam(PixelBin);
+    config.tofMin   = getIntegerParam(TofMin);
+    config.tofMax   = getIntegerParam(TofMax);
+    config.tofBin   = getIntegerParam(TofBin);
+    config.pixelTof = getBooleanParam(PixelTofEn);
+    if (!m_histogram.configure(config))
+        return false;
+
+    m_nIgnored = 0;
+    setIntegerParam(PixelBins, m_histogram.getNumPixelBins());
+    setIntegerParam(TofBins, m_histogram.getNumTofBins());
+    return true;
+}
+
+void HistogramPlugin::recvDownstream(const DasDataPacketList &packets)
+{
+    if (getBooleanParam(Enable) == false)
+        return;
+
+    m_packets.clear();
+    for (const auto &packet: packets) {
+        if (EventHistogram::isSupported(packet->getEventsFormat())) {
+            m_packets.push_back(packet);
+            m_lastTimeStamp = packet->getTimeStamp();
+        } else if (packet->getEventsFormat() != DasDataPacket::EVENT_FMT_TIME_CALIB) {
+            m_nIgnored++;
+        }
+    }
+
+    // Don't bother waking up workers for a single packet
+    unsigned nWorkers = std::min(m_workers.size(), m_packets.size() - std::min(m_packets.size(), (size_t)1));
+    m_pending = nWorkers;
+    for (unsigned i = 0; i < nWorkers; i++)
+        m_wakeups[i]->signal();
+
+    accumulate(0);
+
+    while (m_pending > 0)
+        m_done.wait();
+
+    epicsTime now = epicsTime::getCurrent();
+    if ((now - m_lastPublish) >= (1.0 / getDoubleParam(PublishRate))) {
+        m_lastPublish = now;
+        publish();
+    }
+}
+
+void HistogramPlugin::workerThread(epicsEvent *shutdown, unsigned shard)
+{
+    epicsEvent *wakeup = m_wakeups[shard - 1].get();
+
+    while (shutdown->tryWait() == false) {
+        if (wakeup->wait(0.1) == false)
+            continue;
+
+        accumulate(shard);
+
+        if (--m_pending == 0)
+            m_done.signal();
+    }
+}
+
+void HistogramPlugin::accumulate(unsigned shard)
+{
+    // Packets are interleaved across active shards, they are roughly
+    // the same size so each thread gets about the same amount of work
+    size_t stride = std::min((size_t)m_histogram.getNumShards(), std::max(m_packets.size(), (size_t)1));
+    for (size_t i = shard; i < m_packets.size(); i += stride)
+        m_histogram.add(shard, m_packets[i]);
+}
+
+void HistogramPlugin::publish()
+{
+    m_histogram.merge();
+
+    if (m_record) {
+        if (m_record->update(m_lastTimeStamp, m_histogram) == false) {
+            LOG_ERROR("Failed to send PVA update");
+            setParamAlarmStatus(PvaName, epicsAlarmComm);
+            setParamAlarmSeverity(PvaName, epicsSevMinor);
+        } else {
+            setParamAlarmStatus(PvaName, epicsAlarmNone);
+            setParamAlarmSeverity(PvaName, epicsSevNone);
+        }
+    }
+
+    setIntegerParam(CntEvents, m_histogram.getNumEvents() % std::numeric_limits<int32_t>::max());
+    setIntegerParam(CntOutside, m_histogram.getNumOutside() % std::numeric_limits<int32_t>::max());
+    setIntegerParam(CntVetos, m_histogram.getNumVetos() % std::numeric_limits<int32_t>::max());
+    setIntegerParam(CntIgnored, m_nIgnored);
+    callParamCallbacks();
+}
+
+/* *** PvaRecord implementation follows *** */
+
+HistogramPlugin::PvaRecord::PvaRecord(const std::string &recordName, const epics::pvData::PVStructurePtr &pvStructure)
+    : epics::pvDatabase::PVRecord(recordName, pvStructure)
+    , m_sequence(0)
+{}
+
+HistogramPlugin::PvaRecord::shared_pointer HistogramPlugin::PvaRecord::create(const std::string &recordName)
+{
+    using namespace epics::pvData;
+
+    StandardFieldPtr standardField = getStandardField();
+    FieldCreatePtr fieldCreate     = getFieldCreate();
+    PVDataCreatePtr pvDataCreate   = getPVDataCreate();
+
+    PVStructurePtr pvStructure = pvDataCreate->createPVStructure(
+        fieldCreate->createFieldBuilder()->
+            add("timeStamp",      standardField->timeStamp())->
+            add("num_events",     standardField->scalar(pvULong, ""))->
+            add("pixel_min",      standardField->scalar(pvUInt, ""))->
+            add("pixel_bin",      standardField->scalar(pvUInt, ""))->
+            add("tof_min",        standardField->scalar(pvUInt, ""))->
+            add("tof_bin",        standardField->scalar(pvUInt, ""))->
+            add("pixel",          standardField->scalarArray(pvUInt, ""))->
+            add("time_of_flight", standardField->scalarArray(pvUInt, ""))->
+            add("pixel_tof",      standardField->scalarArray(pvUInt, ""))->
+            createStructure()
+    );
+
+    PvaRecord::shared_pointer pvRecord(new PvaRecord(recordName, pvStructure));
+    if (pvRecord && !pvRecord->init()) {
+        pvRecord.reset();
+    }
+
+    return pvRecord;
+}
+
+bool HistogramPlugin::PvaRecord::init()
+{
+    initPVRecord();
+
+    if (!pvTimeStamp.attach(getPVStructure()->getSubField("timeStamp")))
+        return false;
+
+    pvNumEvents = getPVStructure()->getSubField<epics::pvData::PVULong>("num_events.value");
+    if (pvNumEvents.get() == NULL)
+        return false;
+
+    pvPixelMin = getPVStructure()->getSubField<epics::pvData::PVUInt>("pixel_min.value");
+    if (pvPixelMin.get() == NULL)
+        return false;
+
+    pvPixelBin = getPVStructure()->getSubField<epics::pvData::PVUInt>("pixel_bin.value");
+    if (pvPixelBin.get() == NULL)
+        return false;
+
+    pvTofMin = getPVStructure()->getSubField<epics::pvData::PVUInt>("tof_min.value");
+    if (pvTofMin.get() == NULL)
+        return false;
+
+    pvTofBin = getPVStructure()->getSubField<epics::pvData::PVUInt>("tof_bin.value");
+    if (pvTofBin.get() == NULL)
+        return false;
+
+    pvPixel = getPVStructure()->getSubField<epics::pvData::PVUIntArray>("pixel.value");
+    if (pvPixel.get() == NULL)
+        return false;
+
+    pvTimeOfFlight = getPVStructure()->getSubField<epics::pvData::PVUIntArray>("time_of_flight.value");
+    if (pvTimeOfFlight.get() == NULL)
+        return false;
+
+    pvPixelTof = getPVStructure()->getSubField<epics::pvData::PVUIntArray>("pixel_tof.value");
+    if (pvPixelTof.get() == NULL)
+        return false;
+
+    return true;
+}
+
+/**
+ * Copy histogram into a new array owned by PVA, clients may still hold previous ones.
+ */
+static epics::pvData::PVUIntArray::const_svector copyCounts(const std::vector<uint32_t> &counts)
+{
+    epics::pvData::PVUIntArray::svector array(counts.size());
+    std::copy(counts.begin(), counts.end(), array.begin());
+    return epics::pvData::freeze(array);
+}
+
+bool HistogramPlugin::PvaRecord::update(const epicsTimeStamp &timestamp_, const EventHistogram &histogram)
+{
+    bool posted = true;
+    const EventHistogram::Config &config = histogram.getConfig();
+
+    epics::pvData::TimeStamp timestamp(
+        epics::pvData::posixEpochAtEpicsEpoch + timestamp_.secPastEpoch,
+        timestamp_.nsec,
+        m_sequence++ % 0x7FFFFFFF
+    );
+
+    lock();
+    try {
+        beginGroupPut();
+        pvTimeStamp.set(timestamp);
+        pvNumEvents->put(histogram.getNumEvents());
+        pvPixelMin->put(config.pixelMin);
+        pvPixelBin->put(config.pixelBin);
+        pvTofMin->put(config.tofMin);
+        pvTofBin->put(config.tofBin);
+        pvPixel->replace(copyCounts(histogram.getPixelCounts()));
+        pvTimeOfFlight->replace(copyCounts(histogram.getTofCounts()));
+        pvPixelTof->replace(copyCounts(histogram.getPixelTofCounts()));
+        endGroupPut();
+    } catch (...) {
+        posted = false;
+    }
+    unlock();
+
+    return posted;
+}
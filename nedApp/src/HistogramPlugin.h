@@ -0,0 +1,166 @@
+/* HistogramPlugin.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef HISTOGRAM_PLUGIN_H
+#define HISTOGRAM_PLUGIN_H
+
+#include "BasePlugin.h"
+#include "EventHistogram.h"
+#include "Thread.h"
+
+#include <pv/pvDatabase.h>
+#include <pv/pvTimeStamp.h>
+#include <pv/standardPVField.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/**
+ * Accumulate pixel and time of flight histograms and publish them over PVA.
+ *
+ * Instead of sending every event to live display clients, plugin counts
+ * events into pixel, time of flight and optionally 2D pixel x time of flight
+ * histograms inside configurable region of interest. Histograms are
+ * published as PVA arrays at configurable rate so that network bandwidth
+ * doesn't depend on event rate.
+ *
+ * Incoming packets can be spread across several worker threads, each
+ * thread counting into its own histogram shard. Shards are merged only
+ * when histograms are published.
+ *
+ * Supported formats are pixel, verbose and diagnostic formats that carry
+ * mapped pixel id. Other packets are ignored.
+ */
+class HistogramPlugin : public BasePlugin {
+    public:
+        /**
+         * Constructor
+         *
+         * @param[in] portName asyn port name.
+         * @param[in] parentPlugins List of plugins to get data packets from.
+         * @param[in] pvName Name of PVA record to publish histograms to.
+         * @param[in] numThreads Number of threads accumulating histograms.
+         */
+        HistogramPlugin(const char *portName, const char *parentPlugins, const char *pvName, int numThreads);
+
+        /**
+         * Destructor stops worker threads.
+         */
+        ~HistogramPlugin();
+
+        /**
+         * Overloaded function to handle configuration changes.
+         */
+        asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value) override;
+
+        /**
+         * Overloaded function to handle publish rate.
+         */
+        asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value) override;
+
+        /**
+         * Accumulate events from packets and publish histograms when due.
+         */
+        void recvDownstream(const DasDataPacketList &packets) override;
+
+    private:
+        /**
+         * PVAccess PV record.
+         */
+        class PvaRecord : public epics::pvDatabase::PVRecord {
+            public:
+                POINTER_DEFINITIONS(PvaRecord);
+
+                /**
+                 * Allocate and initialize PvaRecord.
+                 */
+                static PvaRecord::shared_pointer create(const std::string &recordName);
+
+                /**
+                 * Attach all PV structures.
+                 */
+                bool init();
+
+                /**
+                 * Publish a single atomic update of the PV with merged histograms.
+                 */
+                bool update(const epicsTimeStamp &timestamp, const EventHistogram &histogram);
+
+            private:
+                uint32_t m_sequence;
+                epics::pvData::PVTimeStamp      pvTimeStamp;
+                epics::pvData::PVULongPtr       pvNumEvents;    //!< Number of events in histograms
+                epics::pvData::PVUIntPtr        pvPixelMin;     //!< First pixel in ROI
+                epics::pvData::PVUIntPtr        pvPixelBin;     //!< Number of pixels per bin
+                epics::pvData::PVUIntPtr        pvTofMin;       //!< First time of flight in ROI
+                epics::pvData::PVUIntPtr        pvTofBin;       //!< Time of flight bin width
+                epics::pvData::PVUIntArrayPtr   pvPixel;        //!< Pixel counts
+                epics::pvData::PVUIntArrayPtr   pvTimeOfFlight; //!< Time of flight spectrum
+                epics::pvData::PVUIntArrayPtr   pvPixelTof;     //!< Pixel x time of flight, time of flight is the fast axis
+
+                /**
+                 * C'tor.
+                 */
+                PvaRecord(const std::string &recordName, const epics::pvData::PVStructurePtr &pvStructure);
+        };
+
+        EventHistogram m_histogram;
+        PvaRecord::shared_pointer m_record;
+        std::vector<std::unique_ptr<Thread>> m_workers;     //!< Threads for shards 1 and up
+        std::vector<std::unique_ptr<epicsEvent>> m_wakeups; //!< Per-worker signal that work is ready
+        epicsEvent m_done;                                  //!< Signals last worker finished
+        std::atomic<unsigned> m_pending{0};                 //!< Number of workers still processing
+        DasDataPacketList m_packets;                        //!< Supported packets being processed
+        epicsTime m_lastPublish;                            //!< Time of last PVA update
+        epicsTimeStamp m_lastTimeStamp{0, 0};               //!< Timestamp of last processed packet
+        uint32_t m_nIgnored = 0;                            //!< Number of packets in unsupported format
+
+        /**
+         * Worker thread accumulating events into its shard.
+         */
+        void workerThread(epicsEvent *shutdown, unsigned shard);
+
+        /**
+         * Count every n-th packet from m_packets into selected shard.
+         */
+        void accumulate(unsigned shard);
+
+        /**
+         * Apply binning parameters to histogram, clears all counts.
+         */
+        bool configure();
+
+        /**
+         * Merge shards, publish PVA record and update counters.
+         */
+        void publish();
+
+    private:
+        int Enable;
+        int Reset;
+        int PublishRate;
+        int PvaName;
+        int NumThreads;
+        int PixelMin;
+        int PixelMax;
+        int PixelBin;
+        int TofMin;
+        int TofMax;
+        int TofBin;
+        int PixelTofEn;
+        int PixelBins;
+        int TofBins;
+        int CntEvents;
+        int CntOutside;
+        int CntVetos;
+        int CntIgnored;
+};
+
+#endif // HISTOGRAM_PLUGIN_H
@@ -0,0 +1,316 @@
+/* HugePages.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "HugePages.h"
+
+#include <cantProceed.h>
+#include <epicsExport.h>
+#include <epicsMutex.h>
+#include <errlog.h>
+#include <iocsh.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <fstream>
+#include <map>
+
+#if defined(__linux__)
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+namespace {
+
+enum Mode {
+    MODE_NONE,      //!< Regular malloc
+    MODE_THP,       //!< Transparent huge pages
+    MODE_HUGETLB,   //!< Explicit huge pages, fallback to THP
+};
+
+/**
+ * Kind of memory single buffer got.
+ */
+enum Kind {
+    KIND_HUGETLB,   //!< Explicit huge pages
+    KIND_THP,       //!< Aligned and advised for transparent huge pages
+};
+
+/**
+ * Mapping backing single buffer.
+ */
+struct Block {
+    Kind kind;
+    void *base;     //!< Start of mapping and buffer
+    size_t length;  //!< Length of mapping
+    size_t size;    //!< Requested size
+    bool prefaulted;//!< All pages were touched
+};
+
+struct State {
+    epicsMutex mutex;
+    Mode mode{MODE_NONE};
+    bool locked{false};
+    std::map<void *, Block> blocks;
+    size_t nSmall{0};   //!< Number of allocations below huge page size
+};
+
+State &state()
+{
+    static State s;
+    return s;
+}
+
+/**
+ * Read value in kB from /proc style file, return 0 when not found.
+ */
+size_t readProcKb(const char *path, const std::string &key)
+{
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == ':')
+            return strtoull(line.c_str() + key.size() + 1, nullptr, 10);
+    }
+    return 0;
+}
+
+size_t hugePageSize()
+{
+    static size_t size = 0;
+    if (size == 0) {
+        size = readProcKb("/proc/meminfo", "Hugepagesize") * 1024;
+        if (size == 0)
+            size = 2 * 1024 * 1024;
+    }
+    return size;
+}
+
+/**
+ * Touch every page so that kernel populates mapping now rather than in data path.
+ */
+void touchPages(void *ptr, size_t size)
+{
+    volatile char *p = static_cast<volatile char *>(ptr);
+    for (size_t i = 0; i < size; i += 4096)
+        p[i] = 0;
+    if (size > 0)
+        p[size - 1] = 0;
+}
+
+#if defined(__linux__)
+bool mapHugetlb(size_t size, Block &block)
+{
+    size_t length = (size + hugePageSize() - 1) & ~(hugePageSize() - 1);
+    void *ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr == MAP_FAILED)
+        return false;
+    block = { KIND_HUGETLB, ptr, length, size, false };
+    return true;
+}
+
+bool mapThp(size_t size, Block &block)
+{
+    size_t pageSize = hugePageSize();
+    size_t length = (size + pageSize - 1) & ~(pageSize - 1);
+    // Over-allocate to align start to huge page and trim the excess
+    void *ptr = mmap(nullptr, length + pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        return false;
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+    uintptr_t aligned = (addr + pageSize - 1) & ~(pageSize - 1);
+    if (aligned > addr)
+        munmap(ptr, aligned - addr);
+    if (aligned + length < addr + length + pageSize)
+        munmap(reinterpret_cast<void *>(aligned + length), addr + pageSize - aligned);
+    ptr = reinterpret_cast<void *>(aligned);
+    madvise(ptr, length, MADV_HUGEPAGE);
+    block = { KIND_THP, ptr, length, size, false };
+    return true;
+}
+#endif // __linux__
+
+} // namespace
+
+bool HugePages::configure(const std::string &mode, bool lock)
+{
+    Mode mode_;
+    if (mode == "none") {
+        mode_ = MODE_NONE;
+    } else if (mode == "thp") {
+        mode_ = MODE_THP;
+    } else if (mode == "hugetlb") {
+        mode_ = MODE_HUGETLB;
+    } else {
+        errlogPrintf("ERROR: Invalid huge pages mode '%s'\n", mode.c_str());
+        return false;
+    }
+
+    State &s = state();
+    s.mutex.lock();
+    s.mode = mode_;
+    s.mutex.unlock();
+
+#if defined(__linux__)
+    if (lock && !s.locked) {
+        int flags = MCL_CURRENT | MCL_FUTURE;
+#ifdef MCL_ONFAULT
+        // Don't populate new mappings right away, buffers are prefaulted
+        // by threads using them
+        flags |= MCL_ONFAULT;
+#endif
+        if (mlockall(flags) != 0) {
+            errlogPrintf("ERROR: Failed to lock memory: %s\n", strerror(errno));
+            return false;
+        }
+        s.locked = true;
+    } else if (!lock && s.locked) {
+        munlockall();
+        s.locked = false;
+    }
+#else
+    if (mode_ != MODE_NONE || lock) {
+        errlogPrintf("ERROR: Huge pages not supported on this platform\n");
+        return false;
+    }
+#endif
+    return true;
+}
+
+void *HugePages::allocate(size_t size, const char *what, bool prefault)
+{
+    State &s = state();
+    s.mutex.lock();
+    Mode mode = s.mode;
+    if (mode == MODE_NONE || size < hugePageSize()) {
+        s.nSmall++;
+        s.mutex.unlock();
+        return mallocMustSucceed(size, what);
+    }
+    s.mutex.unlock();
+
+    Block block;
+    bool mapped = false;
+#if defined(__linux__)
+    if (mode == MODE_HUGETLB)
+        mapped = mapHugetlb(size, block);
+    if (!mapped)
+        mapped = mapThp(size, block);
+#endif
+    if (!mapped) {
+        s.mutex.lock();
+        s.nSmall++;
+        s.mutex.unlock();
+        return mallocMustSucceed(size, what);
+    }
+
+    if (prefault) {
+        touchPages(block.base, block.length);
+        block.prefaulted = true;
+    }
+
+    s.mutex.lock();
+    s.blocks[block.base] = block;
+    s.mutex.unlock();
+    return block.base;
+}
+
+void HugePages::prefault(void *ptr)
+{
+    State &s = state();
+    s.mutex.lock();
+    auto it = s.blocks.find(ptr);
+    if (it == s.blocks.end() || it->second.prefaulted) {
+        s.mutex.unlock();
+        return;
+    }
+    it->second.prefaulted = true;
+    Block block = it->second;
+    s.mutex.unlock();
+
+    touchPages(block.base, block.length);
+}
+
+void HugePages::release(void *ptr)
+{
+    if (ptr == nullptr)
+        return;
+
+    State &s = state();
+    s.mutex.lock();
+    auto it = s.blocks.find(ptr);
+    if (it == s.blocks.end()) {
+        s.mutex.unlock();
+        free(ptr);
+        return;
+    }
+    Block block = it->second;
+    s.blocks.erase(it);
+    s.mutex.unlock();
+
+#if defined(__linux__)
+    munmap(block.base, block.length);
+#endif
+}
+
+void HugePages::report(FILE *fp)
+{
+    static const char *modes[] = { "none", "thp", "hugetlb" };
+    State &s = state();
+    size_t hugetlb = 0;
+    size_t thp = 0;
+    s.mutex.lock();
+    for (auto &it: s.blocks) {
+        if (it.second.kind == KIND_HUGETLB)
+            hugetlb += it.second.length;
+        else
+            thp += it.second.length;
+    }
+    fprintf(fp, "Memory: mode %s, %s\n", modes[s.mode], s.locked ? "locked" : "not locked");
+    fprintf(fp, "  large buffers: %zu explicit huge pages %zu kB, %zu advised for THP %zu kB, small buffers %zu\n",
+            hugetlb / hugePageSize(), hugetlb / 1024, thp / hugePageSize(), thp / 1024, s.nSmall);
+    s.mutex.unlock();
+
+    // What kernel actually provided, THP is best effort
+    fprintf(fp, "  process: AnonHugePages %zu kB, VmLck %zu kB\n",
+            readProcKb("/proc/self/smaps_rollup", "AnonHugePages"),
+            readProcKb("/proc/self/status", "VmLck"));
+    fprintf(fp, "  system: HugePages_Total %zu, HugePages_Free %zu, Hugepagesize %zu kB\n",
+            readProcKb("/proc/meminfo", "HugePages_Total"),
+            readProcKb("/proc/meminfo", "HugePages_Free"),
+            hugePageSize() / 1024);
+}
+
+static const iocshArg memoryConfigArg0 = { "Mode", iocshArgString };
+static const iocshArg memoryConfigArg1 = { "Lock", iocshArgInt };
+static const iocshArg * const memoryConfigArgs[] = { &memoryConfigArg0, &memoryConfigArg1 };
+static const iocshFuncDef memoryConfigFuncDef = { "nedMemoryConfig", 2, memoryConfigArgs };
+
+extern "C" {
+    /**
+     * Select huge pages mode and memory locking from IOC shell.
+     *
+     * Must be called before any plugin is created, ie.
+     * nedMemoryConfig("hugetlb", 1)
+     * Called without mode it prints current memory usage.
+     */
+    int nedMemoryConfig(const char *mode, int lock)
+    {
+        if (mode == nullptr || *mode == 0) {
+            HugePages::report(stdout);
+            return 0;
+        }
+        return (HugePages::configure(mode, lock != 0) ? 0 : -1);
+    }
+    static void memoryConfigCallFunc(const iocshArgBuf *args) { nedMemoryConfig(args[0].sval, args[1].ival); }
+    static void registerMemoryConfig(void) { iocshRegister(&memoryConfigFuncDef, memoryConfigCallFunc); }
+    epicsExportRegistrar(registerMemoryConfig);
+}
@@ -0,0 +1,90 @@
+/* HugePages.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+/**
+ * Allocator for large, long-lived buffers backed by huge pages.
+ *
+ * Circular buffers and packet pools are accessed sequentially over
+ * hundreds of MB, with regular 4kB pages that means a TLB miss every
+ * few packets. Buffers of at least one huge page are allocated according
+ * to configured mode:
+ * - hugetlb: explicit huge pages reserved by the system administrator
+ *   through vm.nr_hugepages, falls back to thp when none are available
+ * - thp: huge page aligned anonymous memory advised for transparent
+ *   huge pages, falls back to regular pages when kernel doesn't comply
+ * - none: regular malloc
+ *
+ * Huge page buffers are prefaulted so that there are no page faults in
+ * steady state. Linux places pages on the NUMA node of the thread that
+ * first touches them. By default buffer is prefaulted by the allocating
+ * thread, buffers allocated from IOC shell but used by data threads
+ * should instead be prefaulted by the thread using them with prefault().
+ * Smaller requests always use malloc. With memory locking enabled all
+ * current and future process memory is locked in RAM, including small
+ * buffers, pages of new buffers are still only populated when touched
+ * where kernel supports it.
+ *
+ * Mode must be selected from IOC startup script with nedMemoryConfig
+ * command before plugins are created. Default mode is none.
+ */
+namespace HugePages {
+
+/**
+ * Select allocation mode and memory locking.
+ *
+ * @param[in] mode One of "none", "thp" or "hugetlb"
+ * @param[in] lock Lock all process memory in RAM
+ * @return true on success, false on invalid mode or when locking failed.
+ */
+bool configure(const std::string &mode, bool lock);
+
+/**
+ * Allocate buffer, never returns nullptr.
+ *
+ * Like mallocMustSucceed() suspends calling thread when even regular
+ * allocation fails.
+ *
+ * @param[in] size Requested size in bytes
+ * @param[in] what Description used in error message
+ * @param[in] prefault Touch all pages from calling thread, when false
+ *                     caller should call prefault() from thread using buffer
+ */
+void *allocate(size_t size, const char *what, bool prefault=true);
+
+/**
+ * Touch all pages of buffer from calling thread.
+ *
+ * Does nothing when buffer was already prefaulted or was not allocated
+ * as huge pages. Takes a while for large buffers, should be called before
+ * data starts flowing or once at the start of data.
+ */
+void prefault(void *ptr);
+
+/**
+ * Release buffer allocated with allocate().
+ *
+ * Memory not allocated by allocate() is released with free().
+ */
+void release(void *ptr);
+
+/**
+ * Print what kind of memory large buffers got and system huge page usage.
+ */
+void report(FILE *fp);
+
+}; // namespace HugePages
+
+#endif // HUGE_PAGES_H
@@ -0,0 +1,141 @@
+/* LatencyHistogram.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Low overhead histogram of time intervals.
+ *
+ * Buckets are logarithmic with 4 sub-buckets for every power of 2, which
+ * gives percentiles with at most 25% error. Adding a sample is a couple of
+ * relaxed atomic operations, so the histogram can be updated from any
+ * thread without locking and is cheap enough to be always enabled.
+ * Samples are accumulated until collected, collecting resets the histogram
+ * to start a new interval.
+ */
+class LatencyHistogram {
+    public:
+        /**
+         * Percentiles of the collected interval, all times in micro-seconds.
+         */
+        struct Summary {
+            double p50;         //!< Median
+            double p99;         //!< 99th percentile
+            double max;         //!< Maximum sample
+            uint64_t count;     //!< Number of samples
+        };
+
+    private:
+        static const unsigned SUB_BITS = 2;
+        static const unsigned NUM_BUCKETS = 64 << SUB_BITS;
+
+        std::array<std::atomic<uint32_t>, NUM_BUCKETS> m_buckets;
+        std::atomic<uint64_t> m_max;
+
+    public:
+        /**
+         * Constructor, clears all buckets.
+         */
+        LatencyHistogram()
+        {
+            for (auto &bucket: m_buckets)
+                bucket.store(0, std::memory_order_relaxed);
+            m_max.store(0, std::memory_order_relaxed);
+        }
+
+        /**
+         * Add one sample in nano-seconds.
+         */
+        void add(uint64_t ns)
+        {
+            m_buckets[index(ns)].fetch_add(1, std::memory_order_relaxed);
+            uint64_t max = m_max.load(std::memory_order_relaxed);
+            while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+        }
+
+        /**
+         * Calculate percentiles of all samples since last collect and reset histogram.
+         */
+        Summary collect()
+        {
+            std::array<uint32_t, NUM_BUCKETS> counts;
+            Summary summary{0.0, 0.0, 0.0, 0};
+
+            for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+                counts[i] = m_buckets[i].exchange(0, std::memory_order_relaxed);
+                summary.count += counts[i];
+            }
+            uint64_t max = m_max.exchange(0, std::memory_order_relaxed);
+            summary.max = max / 1000.0;
+
+            uint64_t p50 = (summary.count + 1) / 2;
+            uint64_t p99 = summary.count - summary.count / 100;
+            uint64_t sum = 0;
+            for (unsigned i = 0; i < NUM_BUCKETS && sum < p99; i++) {
+                if (counts[i] == 0)
+                    continue;
+                sum += counts[i];
+                // Upper bound of the bucket, but never above actual max
+                double value = std::min(upperBound(i), max) / 1000.0;
+                if (sum >= p50 && summary.p50 == 0.0)
+                    summary.p50 = value;
+                if (sum >= p99)
+                    summary.p99 = value;
+            }
+            return summary;
+        }
+
+        /**
+         * Return monotonic time in nano-seconds.
+         */
+        static uint64_t now()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        }
+
+        /**
+         * Return CPU time consumed by calling thread in nano-seconds.
+         */
+        static uint64_t threadCpuTime()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        }
+
+    private:
+        static unsigned index(uint64_t value)
+        {
+            if (value < (1 << SUB_BITS))
+                return value;
+            unsigned msb = 63 - __builtin_clzll(value);
+            unsigned sub = (value >> (msb - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+            return ((msb - SUB_BITS + 1) << SUB_BITS) + sub;
+        }
+
+        static uint64_t upperBound(unsigned index)
+        {
+            if (index < (1 << SUB_BITS))
+                return index;
+            unsigned msb = (index >> SUB_BITS) + SUB_BITS - 1;
+            uint64_t sub = index & ((1 << SUB_BITS) - 1);
+            return (((1ULL << SUB_BITS) + sub + 1) << (msb - SUB_BITS)) - 1;
+        }
+};
+
+#endif // LATENCY_HISTOGRAM_H
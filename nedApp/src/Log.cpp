@@ -0,0 +1,329 @@
+/* Log.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "LatencyHistogram.h"
+#include "Log.h"
+#include "Thread.h"
+
+#include <errlog.h>
+
+#include <cstdarg>
+#include <cstdio>
+
+#define RING_SIZE       256     //!< Number of messages in ring, must be power of 2
+#define MAX_TEXT_LEN    512     //!< Max length of single formatted message
+#define FLUSH_PERIOD    0.05    //!< How often logging thread writes out messages, in seconds
+
+namespace {
+
+/**
+ * Bounded lock-free queue of formatted messages.
+ *
+ * Multiple producers reserve slots with compare-and-swap on tail,
+ * one consumer at a time writes them out. Every slot has a sequence
+ * number telling whether it's free, being written or ready.
+ */
+class Ring {
+    public:
+        Ring()
+        {
+            for (uint64_t i = 0; i < RING_SIZE; i++)
+                m_entries[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        /**
+         * Format message into next free slot.
+         *
+         * @return false when ring is full.
+         */
+        bool push(asynUser *pasynUser, int reason, const char *format, va_list args)
+        {
+            Entry *entry;
+            uint64_t pos = m_tail.load(std::memory_order_relaxed);
+            while (true) {
+                entry = &m_entries[pos & (RING_SIZE - 1)];
+                uint64_t seq = entry->seq.load(std::memory_order_acquire);
+                int64_t diff = (int64_t)seq - (int64_t)pos;
+                if (diff == 0) {
+                    if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                } else if (diff < 0) {
+                    m_nDropped++;
+                    return false;
+                } else {
+                    pos = m_tail.load(std::memory_order_relaxed);
+                }
+            }
+
+            entry->pasynUser = pasynUser;
+            entry->reason = reason;
+            vsnprintf(entry->text, sizeof(entry->text), format, args);
+            entry->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Format message into next free slot.
+         *
+         * @return false when ring is full.
+         */
+        bool print(asynUser *pasynUser, int reason, const char *format, ...) __attribute__((format(printf, 4, 5)))
+        {
+            va_list args;
+            va_start(args, format);
+            bool pushed = push(pasynUser, reason, format, args);
+            va_end(args);
+            return pushed;
+        }
+
+        /**
+         * Write out all ready messages, callers are serialized by Logger.
+         */
+        void flush()
+        {
+            while (true) {
+                Entry *entry = &m_entries[m_head & (RING_SIZE - 1)];
+                if (entry->seq.load(std::memory_order_acquire) != m_head + 1)
+                    break;
+                asynPrint(entry->pasynUser, entry->reason, "%s", entry->text);
+                entry->seq.store(m_head + RING_SIZE, std::memory_order_release);
+                m_head++;
+            }
+
+            uint32_t nDropped = m_nDropped.exchange(0);
+            if (nDropped > 0)
+                errlogPrintf("WARN: Log buffer full, dropped %u messages\n", nDropped);
+        }
+
+        /**
+         * Write out all messages reserved so far, callers are serialized by Logger.
+         *
+         * Waits for producers still formatting their messages.
+         */
+        void drain()
+        {
+            uint64_t tail = m_tail.load();
+            while (true) {
+                flush();
+                if ((int64_t)(m_head - tail) >= 0)
+                    break;
+                epicsThreadSleep(0.0);
+            }
+        }
+
+    private:
+        struct Entry {
+            std::atomic<uint64_t> seq;
+            asynUser *pasynUser;
+            int reason;
+            char text[MAX_TEXT_LEN];
+        };
+
+        Entry m_entries[RING_SIZE];
+        std::atomic<uint64_t> m_tail{0};    //!< Next slot to be reserved by producers
+        uint64_t m_head{0};                 //!< Next slot to be written out by consumer
+        std::atomic<uint32_t> m_nDropped{0};//!< Messages dropped due to full ring
+};
+
+/**
+ * Ring of messages and logging thread writing them out.
+ */
+class Logger {
+    public:
+        Logger()
+            : m_thread("nedLog", std::bind(&Logger::logThread, this, std::placeholders::_1),
+                       epicsThreadGetStackSize(epicsThreadStackSmall), epicsThreadPriorityLow)
+        {
+            m_thread.start();
+        }
+
+        Ring ring;
+        std::atomic<Log::Site *> sites{nullptr};   //!< Sites with suppressed messages
+
+        /**
+         * Write out pending messages and free sites of destroyed plugin instance.
+         *
+         * Stands in for logging thread, messages in ring and summaries
+         * refer to instance's asynUser.
+         *
+         * @param[in] first First site of instance, others linked through Site::sibling
+         */
+        void release(Log::Site *first)
+        {
+            m_mutex.lock();
+            ring.drain();
+            for (Log::Site *site = first; site != nullptr; ) {
+                Log::Site *sibling = site->sibling;
+                if (site->listed.load()) {
+                    // Don't wait for period to expire, report all suppressed
+                    report(site, site->takeExpired(UINT64_MAX));
+                    unlink(site);
+                }
+                delete site;
+                site = sibling;
+            }
+            m_mutex.unlock();
+        }
+
+    private:
+        epicsMutex m_mutex; //!< Serializes logging thread and release(), they both write out and unlink sites
+        Thread m_thread;
+
+        void logThread(epicsEvent *shutdown)
+        {
+            while (shutdown->wait(FLUSH_PERIOD) == false) {
+                m_mutex.lock();
+                ring.flush();
+                summarize();
+                m_mutex.unlock();
+            }
+            m_mutex.lock();
+            ring.flush();
+            m_mutex.unlock();
+        }
+
+        /**
+         * Report suppressed messages of sites that went quiet.
+         */
+        void summarize()
+        {
+            uint64_t now = LatencyHistogram::now();
+            for (Log::Site *site = sites.load(); site != nullptr; site = site->next.load())
+                report(site, site->takeExpired(now));
+        }
+
+        void report(Log::Site *site, uint32_t suppressed)
+        {
+            if (suppressed > 0) {
+                const Log::Location &loc = site->location;
+                asynPrint(site->pasynUser, loc.reason, "%s:%d(%s) %s: previous message repeated %u times\n",
+                          loc.function, loc.line, site->portName, loc.level, suppressed);
+            }
+        }
+
+        /**
+         * Remove site from list of sites with suppressed messages.
+         *
+         * Producers only ever push to the head of the list, sites further
+         * down are only changed here with m_mutex locked.
+         */
+        void unlink(Log::Site *site)
+        {
+            Log::Site *head = site;
+            if (sites.compare_exchange_strong(head, site->next.load()))
+                return;
+            for (Log::Site *prev = head; prev != nullptr; prev = prev->next.load()) {
+                if (prev->next.load() == site) {
+                    prev->next.store(site->next.load());
+                    return;
+                }
+            }
+        }
+};
+
+Logger &logger()
+{
+    static Logger l;
+    return l;
+}
+
+} // namespace
+
+namespace Log {
+
+Site::Site(const Location &location_, asynUser *pasynUser_, const char *portName_)
+    : location(location_)
+    , pasynUser(pasynUser_)
+    , portName(portName_)
+{
+}
+
+Sites::~Sites()
+{
+    Site *head = m_head.load();
+    if (head != nullptr)
+        logger().release(head);
+}
+
+Site &Sites::get(const Location &location, asynUser *pasynUser, const char *portName)
+{
+    Site *head = m_head.load();
+    while (true) {
+        for (Site *site = head; site != nullptr; site = site->sibling) {
+            if (&site->location == &location)
+                return *site;
+        }
+
+        // First message from this call site, other thread may add it concurrently
+        Site *site = new Site(location, pasynUser, portName);
+        site->sibling = head;
+        if (m_head.compare_exchange_strong(head, site))
+            return *site;
+        delete site;
+    }
+}
+
+bool Site::allow(uint64_t now, uint32_t &suppressed)
+{
+    uint64_t start = m_periodStart.load(std::memory_order_relaxed);
+    if (now - start > PERIOD) {
+        // Only one thread starts new period
+        if (m_periodStart.compare_exchange_strong(start, now))
+            m_nLogged.store(0);
+    }
+
+    if (m_nLogged.fetch_add(1) < BURST) {
+        suppressed = m_nSuppressed.exchange(0);
+        return true;
+    }
+    m_nSuppressed++;
+    return false;
+}
+
+uint32_t Site::takeExpired(uint64_t now)
+{
+    if (m_nSuppressed.load() == 0 || now - m_periodStart.load() <= PERIOD)
+        return 0;
+    return m_nSuppressed.exchange(0);
+}
+
+void deferred(Site &site, const char *format, ...)
+{
+    asynUser *pasynUser = site.pasynUser;
+    int reason = site.location.reason;
+    if ((pasynTrace->getTraceMask(pasynUser) & reason) == 0)
+        return;
+
+    Logger &l = logger();
+    uint32_t suppressed = 0;
+    bool allowed = site.allow(LatencyHistogram::now(), suppressed);
+
+    if (!allowed) {
+        // Register site so that logging thread reports suppressed messages
+        if (site.listed.exchange(true) == false) {
+            Site *head = l.sites.load();
+            do {
+                site.next = head;
+            } while (!l.sites.compare_exchange_weak(head, &site));
+        }
+        return;
+    }
+
+    if (suppressed > 0) {
+        l.ring.print(pasynUser, reason, "%s:%d(%s) %s: previous message repeated %u times\n",
+                     site.location.function, site.location.line, site.portName, site.location.level, suppressed);
+    }
+
+    va_list args;
+    va_start(args, format);
+    l.ring.push(pasynUser, reason, format, args);
+    va_end(args);
+}
+
+} // namespace Log
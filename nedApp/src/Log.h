@@ -12,6 +12,9 @@
 
 #include <asynDriver.h>
 
+#include <atomic>
+#include <stdint.h>
+
 // Define new levels that can be filtered out using asynSetTraceMask
 #define ASYN_TRACE_INFO  0x0040
 #define ASYN_TRACE_DEBUG 0x0080
@@ -24,4 +27,122 @@
 #define LOG_INFO(text, ...)  asynPrint(this->pasynUserSelf, ASYN_TRACE_INFO, "%s:%d(%s) INFO: " text "\n", __PRETTY_FUNCTION__, __LINE__, this->portName, ##__VA_ARGS__)
 #define LOG_DEBUG(text, ...) asynPrint(this->pasynUserSelf, ASYN_TRACE_DEBUG, "%s:%d(%s) DEBUG: " text "\n", __PRETTY_FUNCTION__, __LINE__, this->portName, ##__VA_ARGS__)
 
+/*
+ * Rate limited variants for data path, where a burst of bad data would
+ * otherwise turn into a logging storm. Every call site of every plugin
+ * instance logs at most Log::Site::BURST messages per Log::Site::PERIOD
+ * seconds, others are only counted and summarized later. Messages are
+ * written to log by a background thread, caller only formats text into
+ * in-memory ring. Must be used from BasePlugin derived class which holds
+ * rate limiting state in its m_logSites.
+ */
+#define LOG_ERROR_RATELIMIT(text, ...) do { static const Log::Location _logLocation{__PRETTY_FUNCTION__, __LINE__, "ERROR", ASYN_TRACE_ERROR}; \
+    Log::deferred(this->m_logSites.get(_logLocation, this->pasynUserSelf, this->portName), "%s:%d(%s) ERROR: " text "\n", __PRETTY_FUNCTION__, __LINE__, this->portName, ##__VA_ARGS__); } while (0)
+#define LOG_WARN_RATELIMIT(text, ...) do { static const Log::Location _logLocation{__PRETTY_FUNCTION__, __LINE__, "WARN", ASYN_TRACE_WARNING}; \
+    Log::deferred(this->m_logSites.get(_logLocation, this->pasynUserSelf, this->portName), "%s:%d(%s) WARN: " text "\n", __PRETTY_FUNCTION__, __LINE__, this->portName, ##__VA_ARGS__); } while (0)
+
+namespace Log {
+
+/**
+ * Logging call site, static object created by LOG_*_RATELIMIT macros.
+ */
+struct Location {
+    const char *function;       //!< Name of the function logging
+    int line;                   //!< Line number of log statement
+    const char *level;          //!< Log level text
+    int reason;                 //!< asyn trace reason of this site
+};
+
+/**
+ * Rate limiting state of single logging call site in one plugin instance.
+ *
+ * Sites are created by Sites::get() on first use and freed together with
+ * Sites of the plugin instance. All members are atomic, checking whether
+ * message is allowed never blocks.
+ */
+class Site {
+    public:
+        static const uint32_t BURST = 10;   //!< Max messages logged in one period
+        static const uint64_t PERIOD = 1000000000ULL; //!< Rate limiting period in ns
+
+        /**
+         * Constructor.
+         *
+         * @param[in] location Call site
+         * @param[in] pasynUser asynUser of plugin instance logging
+         * @param[in] portName Name of plugin instance logging
+         */
+        Site(const Location &location, asynUser *pasynUser, const char *portName);
+
+        /**
+         * Check whether message should be logged now.
+         *
+         * @param[in] now Current monotonic time in ns
+         * @param[out] suppressed Number of messages suppressed since last logged one
+         * @return true when message should be logged, false if it was suppressed.
+         */
+        bool allow(uint64_t now, uint32_t &suppressed);
+
+        /**
+         * Take number of suppressed messages when period expired.
+         *
+         * Called from logging thread to summarize suppressed messages
+         * when call site goes quiet.
+         */
+        uint32_t takeExpired(uint64_t now);
+
+        const Location &location;   //!< Call site
+        asynUser * const pasynUser; //!< asynUser of plugin instance logging
+        const char * const portName;//!< Name of plugin instance logging
+        Site *sibling{nullptr};     //!< Next site of the same plugin instance
+        std::atomic<Site *> next{nullptr};  //!< Next site in list of sites with suppressed messages
+        std::atomic<bool> listed{false};    //!< Site is in list of sites with suppressed messages
+
+    private:
+        std::atomic<uint64_t> m_periodStart{0}; //!< Start of current rate limiting period
+        std::atomic<uint32_t> m_nLogged{0};     //!< Number of messages in current period
+        std::atomic<uint32_t> m_nSuppressed{0}; //!< Number of suppressed messages not yet reported
+};
+
+/**
+ * Rate limiting state of all call sites of one plugin instance.
+ */
+class Sites {
+    public:
+        Sites() {}
+        Sites(const Sites &) = delete;
+        Sites &operator=(const Sites &) = delete;
+
+        /**
+         * Write out pending messages and free all sites.
+         *
+         * Called when plugin instance is destroyed, after it stopped
+         * logging but while its asynUser is still valid.
+         */
+        ~Sites();
+
+        /**
+         * Return state of call site, create it on first use.
+         *
+         * Lookup is lock-free, plugin has only a handful of call sites.
+         */
+        Site &get(const Location &location, asynUser *pasynUser, const char *portName);
+
+    private:
+        std::atomic<Site *> m_head{nullptr};    //!< Sites of this instance linked through Site::sibling
+};
+
+/**
+ * Log message from data path.
+ *
+ * Message is formatted only if it passes call site rate limiting and
+ * asyn trace mask. It's then put to lock-free in-memory ring and
+ * written out by logging thread. When ring is full, message is dropped
+ * and counted.
+ */
+void deferred(Site &site, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+} // namespace Log
+
 #endif // NED_LOG_H
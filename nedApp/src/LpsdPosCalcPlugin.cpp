@@ -0,0 +1,297 @@
+/* LpsdPosCalcPlugin.cpp
+ *
+ * Copyright (c) 2017 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "LpsdPosCalcPlugin.h"
+#include "EventTraits.h"
+#include "Log.h"
+#include "likely.h"
+
+#include <algorithm>
+
+EPICS_REGISTER_PLUGIN(LpsdPosCalcPlugin, 3, "Port name", string, "Parent plugins", string, "Number of tubes", int);
+
+#define POS_SPECIAL     (1 << 30)
+
+/**
+ * Input formats, both have the same raw fields layout.
+ */
+typedef EventFormats<
+    DasDataPacket::EVENT_FMT_LPSD_RAW,
+    DasDataPacket::EVENT_FMT_LPSD_VERBOSE
+> LpsdInputFormats;
+
+LpsdPosCalcPlugin::LpsdPosCalcPlugin(const char *portName, const char *parentPlugins, int nTubes)
+    : BasePlugin(portName, 1)
+    , m_tubes((nTubes > 0 ? nTubes : 0) + 1)
+    , GainsA(m_tubes.size() - 1)
+    , GainsB(m_tubes.size() - 1)
+    , OffsetsA(m_tubes.size() - 1)
+    , OffsetsB(m_tubes.size() - 1)
+{
+    // Last entry catches positions outside configured tubes
+    m_tubes.back().gainA = 0.0;
+    m_tubes.back().gainB = 0.0;
+    m_vetoMask = VETO_OVERFLOW | VETO_BAD_CONFIG | VETO_LOW_CHARGE | VETO_EDGE;
+
+    createParam("ErrMem",           asynParamInt32, &ErrMem, 0);                // READ - Buffer allocation error
+    createParam("ResetCnt",         asynParamInt32, &ResetCnt);                 // WRITE - Reset counters
+    createParam("CalcEn",           asynParamInt32, &CalcEn, 0);                // WRITE - Toggle position calculation
+    createParam("NTubes",           asynParamInt32, &NTubes, (int)GainsA.size()); // READ - Number of configured tubes
+    createParam("PixelsPerTube",    asynParamInt32, &PixelsPerTube, 128);     // WRITE - Number of pixels along the tube
+    createParam("MaxSample",        asynParamInt32, &MaxSample, 0xFFF);          // WRITE - Max ADC sample value, flags overflow
+    createParam("MinCharge",        asynParamInt32, &MinCharge, 0);             // WRITE - Low charge threshold
+    createParam("LowChargeVetoEn",  asynParamInt32, &LowChargeVetoEn, 1);       // WRITE - Toggle low charge vetoes
+    createParam("EdgeVetoEn",       asynParamInt32, &EdgeVetoEn, 1);            // WRITE - Toggle edge vetoes
+    createParam("OverflowVetoEn",   asynParamInt32, &OverflowVetoEn, 1);        // WRITE - Toggle overflow vetoes
+    createParam("CntTotalEvents",   asynParamInt32, &CntTotalEvents, 0);        // READ - Number of all events
+    createParam("CntGoodEvents",    asynParamInt32, &CntGoodEvents, 0);         // READ - Number of good events
+    createParam("CntOverflowVetos", asynParamInt32, &CntOverflowVetos, 0);      // READ - Number of overflow vetoes
+    createParam("CntBadConfigVetos",asynParamInt32, &CntBadConfigVetos, 0);     // READ - Number of events from unconfigured tubes
+    createParam("CntLowChargeVetos",asynParamInt32, &CntLowChargeVetos, 0);     // READ - Number of low charge vetoes
+    createParam("CntEdgeVetos",     asynParamInt32, &CntEdgeVetos, 0);          // READ - Number of edge vetoes
+
+    for (size_t i = 0; i < GainsA.size(); i++) {
+        createParam("Tube" + std::to_string(i+1) + "GainA",   asynParamInt32, &GainsA[i], 1000);  // WRITE - A end gain in 1/1000
+        createParam("Tube" + std::to_string(i+1) + "GainB",   asynParamInt32, &GainsB[i], 1000);  // WRITE - B end gain in 1/1000
+        createParam("Tube" + std::to_string(i+1) + "OffsetA", asynParamInt32, &OffsetsA[i], 0);   // WRITE - A end offset in ADC counts
+        createParam("Tube" + std::to_string(i+1) + "OffsetB", asynParamInt32, &OffsetsB[i], 0);   // WRITE - B end offset in ADC counts
+    }
+    callParamCallbacks();
+
+    m_cntTotalEvents    = createCounter(CntTotalEvents);
+    m_cntGoodEvents     = createCounter(CntGoodEvents);
+    m_cntOverflowVetos  = createCounter(CntOverflowVetos);
+    m_cntBadConfigVetos = createCounter(CntBadConfigVetos);
+    m_cntLowChargeVetos = createCounter(CntLowChargeVetos);
+    m_cntEdgeVetos      = createCounter(CntEdgeVetos);
+
+    BasePlugin::connect(parentPlugins, {MsgDasData});
+}
+
+asynStatus LpsdPosCalcPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    if (pasynUser->reason == ResetCnt) {
+        resetCounter(m_cntTotalEvents);
+        resetCounter(m_cntGoodEvents);
+        resetCounter(m_cntOverflowVetos);
+        resetCounter(m_cntBadConfigVetos);
+        resetCounter(m_cntLowChargeVetos);
+        resetCounter(m_cntEdgeVetos);
+        callParamCallbacks();
+        return asynSuccess;
+    } else if (pasynUser->reason == PixelsPerTube) {
+        if (value <= 0)
+            return asynError;
+        m_pixelsPerTube = value;
+    } else if (pasynUser->reason == MaxSample) {
+        m_maxSample = value;
+    } else if (pasynUser->reason == MinCharge) {
+        m_minCharge = value;
+    } else if (pasynUser->reason == LowChargeVetoEn) {
+        m_vetoMask = (value > 0 ? m_vetoMask | VETO_LOW_CHARGE : m_vetoMask & ~VETO_LOW_CHARGE);
+    } else if (pasynUser->reason == EdgeVetoEn) {
+        m_vetoMask = (value > 0 ? m_vetoMask | VETO_EDGE : m_vetoMask & ~VETO_EDGE);
+    } else if (pasynUser->reason == OverflowVetoEn) {
+        m_vetoMask = (value > 0 ? m_vetoMask | VETO_OVERFLOW : m_vetoMask & ~VETO_OVERFLOW);
+    } else {
+        for (size_t i = 0; i < GainsA.size(); i++) {
+            if (pasynUser->reason == GainsA[i]) {
+                m_tubes[i].gainA = value / 1000.0;
+                break;
+            } else if (pasynUser->reason == GainsB[i]) {
+                m_tubes[i].gainB = value / 1000.0;
+                break;
+            } else if (pasynUser->reason == OffsetsA[i]) {
+                m_tubes[i].offsetA = value;
+                break;
+            } else if (pasynUser->reason == OffsetsB[i]) {
+                m_tubes[i].offsetB = value;
+                break;
+            }
+        }
+    }
+    return BasePlugin::writeInt32(pasynUser, value);
+}
+
+asynStatus LpsdPosCalcPlugin::recvParam(const std::string &remotePort, const std::string &paramName, epicsInt32 value)
+{
+    asynUser a;
+    asynStatus ret = asynPortDriver::findParam(paramName.c_str(), &a.reason);
+    if (ret == asynSuccess) {
+        ret = writeInt32(&a, value);
+        if (ret == asynSuccess) {
+            // For the read-write asyn mechanism to pick up new values
+            setIntegerParam(a.reason, value);
+            callParamCallbacks();
+        }
+    }
+    return ret;
+}
+
+/**
+ * Functor to process packets of any LPSD raw format.
+ */
+struct LpsdPosCalcPlugin::ProcessPacket {
+    LpsdPosCalcPlugin *plugin;
+    const DasDataPacket *srcPacket;
+    DasDataPacket *&destPacket;
+    Stats &stats;
+
+    template <typename Traits>
+    void operator()(const Traits &)
+    {
+        static_assert(Traits::diagFormat == DasDataPacket::EVENT_FMT_LPSD_DIAG, "LPSD format expected");
+
+        uint32_t nEvents = srcPacket->getNumEvents();
+        destPacket = plugin->m_packetsPool.get(DasDataPacket::getLength(Traits::diagFormat, nEvents));
+        if (destPacket) {
+            destPacket->init(Traits::diagFormat, srcPacket->getTimeStamp(), nEvents);
+            const uint8_t *srcEvents = reinterpret_cast<const uint8_t *>(Traits::events(srcPacket));
+            auto *destEvents = destPacket->getEvents<Event::LPSD::Diag>();
+            stats = plugin->processEvents(srcEvents, Traits::size, nEvents, destEvents);
+        }
+    }
+};
+
+void LpsdPosCalcPlugin::recvDownstream(const DasDataPacketList &packets)
+{
+    DasDataPacketList outPackets;
+    std::vector<DasDataPacket *> pooledPackets;
+    Stats counters;
+
+    if (getBooleanParam(CalcEn) == false) {
+        // Optimize pass-thru
+        sendDownstream(packets);
+        return;
+    }
+
+    for (const auto &packet: packets) {
+        DasDataPacket *destPacket = nullptr;
+        Stats stats;
+        if (!LpsdInputFormats::dispatch(packet->getEventsFormat(), ProcessPacket{this, packet, destPacket, stats})) {
+            // Not in right data format for this plugin
+            outPackets.push_back(packet);
+        } else if (destPacket != nullptr) {
+            outPackets.push_back(destPacket);
+            pooledPackets.push_back(destPacket);
+            counters += stats;
+        } else {
+            // Can't allocate packet
+            addIntegerParam(ErrMem, 1);
+        }
+    }
+
+    // Send to subscribed plugins and wait they complete processing
+    sendDownstream(outPackets);
+
+    for (auto &packet: pooledPackets) {
+        m_packetsPool.put(packet);
+    }
+
+    *m_cntTotalEvents    += counters.nTotal;
+    *m_cntGoodEvents     += counters.nGood;
+    *m_cntOverflowVetos  += counters.nOverflow;
+    *m_cntBadConfigVetos += counters.nBadConfig;
+    *m_cntLowChargeVetos += counters.nLowCharge;
+    *m_cntEdgeVetos      += counters.nEdge;
+    callParamCallbacksRatelimit();
+}
+
+LpsdPosCalcPlugin::Stats LpsdPosCalcPlugin::processEvents(const uint8_t *srcEvents, uint32_t srcEventSize, uint32_t nEvents, Event::LPSD::Diag *destEvents)
+{
+    Stats stats;
+    Batch batch;
+    const uint32_t nTubes = m_tubes.size() - 1;
+    const uint32_t vetoMask = m_vetoMask | VETO_SPECIAL;
+
+    for (uint32_t start = 0; start < nEvents; start += BATCH_SIZE) {
+        uint32_t n = std::min(nEvents - start, BATCH_SIZE);
+
+        // Gather samples and tube parameters into arrays
+        for (uint32_t i = 0; i < n; i++) {
+            const auto *event = reinterpret_cast<const Event::LPSD::Raw *>(srcEvents + (start + i)*srcEventSize);
+            uint32_t vetoes = 0;
+            uint32_t tube = event->position;
+            if (tube >= nTubes) {
+                vetoes |= (event->position & POS_SPECIAL) ? VETO_SPECIAL : VETO_BAD_CONFIG;
+                tube = nTubes;
+            }
+            if (std::max(std::max(event->sample_a1, event->sample_a2), std::max(event->sample_b1, event->sample_b2)) >= m_maxSample)
+                vetoes |= VETO_OVERFLOW;
+
+            const TubeParams &params = m_tubes[tube];
+            batch.sampleA[i]    = static_cast<int32_t>(event->sample_a2) - event->sample_a1;
+            batch.sampleB[i]    = static_cast<int32_t>(event->sample_b2) - event->sample_b1;
+            batch.gainA[i]      = params.gainA;
+            batch.gainB[i]      = params.gainB;
+            batch.offsetA[i]    = params.offsetA;
+            batch.offsetB[i]    = params.offsetB;
+            batch.firstPixel[i] = (tube < nTubes ? tube * m_pixelsPerTube : 0);
+            batch.vetoes[i]     = vetoes;
+        }
+
+        calculateBatch(batch, n, m_minCharge, m_pixelsPerTube);
+
+        // Write out events and count vetoes
+        for (uint32_t i = 0; i < n; i++) {
+            const auto *event = reinterpret_cast<const Event::LPSD::Raw *>(srcEvents + (start + i)*srcEventSize);
+            Event::LPSD::Diag &dest = destEvents[start + i];
+            dest = *event;
+
+            uint32_t vetoes = batch.vetoes[i] & vetoMask;
+            if (vetoes & VETO_SPECIAL) {
+                continue;
+            }
+
+            stats.nTotal++;
+            dest.pixelid = batch.pixelid[i];
+            if (vetoes == 0) {
+                stats.nGood++;
+            } else {
+                dest.pixelid |= Event::Pixel::VETO_MASK;
+                if (vetoes & VETO_OVERFLOW)
+                    stats.nOverflow++;
+                else if (vetoes & VETO_BAD_CONFIG)
+                    stats.nBadConfig++;
+                else if (vetoes & VETO_LOW_CHARGE)
+                    stats.nLowCharge++;
+                else
+                    stats.nEdge++;
+            }
+            dest.pixelid_raw = dest.pixelid;
+        }
+    }
+
+    return stats;
+}
+
+NED_VECTORIZE
+void LpsdPosCalcPlugin::calculateBatch(Batch &batch, uint32_t nEvents, float minCharge, uint32_t pixelsPerTube)
+{
+    const float nPixels = pixelsPerTube;
+    const float maxPixel = pixelsPerTube - 1;
+
+    for (uint32_t i = 0; i < nEvents; i++) {
+        float a = batch.gainA[i] * (batch.sampleA[i] - batch.offsetA[i]);
+        float b = batch.gainB[i] * (batch.sampleB[i] - batch.offsetB[i]);
+        float charge = a + b;
+        float position = b / (charge > 0.0f ? charge : 1.0f);
+
+        // Bitwise operators rather than logical ones keep the loop branch free
+        uint32_t lowCharge = (charge <= 0.0f) | (charge < minCharge);
+        uint32_t edge = (position < 0.0f) | (position >= 1.0f);
+        batch.vetoes[i] |= (lowCharge * VETO_LOW_CHARGE) | (edge * VETO_EDGE);
+
+        // Clamp to the tube when edge veto is disabled
+        float pixel = position * nPixels;
+        pixel = (pixel < 0.0f ? 0.0f : pixel);
+        pixel = (pixel > maxPixel ? maxPixel : pixel);
+        batch.pixelid[i] = batch.firstPixel[i] + static_cast<int32_t>(pixel);
+    }
+}
@@ -0,0 +1,198 @@
+/* LpsdPosCalcPlugin.h
+ *
+ * Copyright (c) 2017 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef LPSD_POS_CALC_PLUGIN_H
+#define LPSD_POS_CALC_PLUGIN_H
+
+#include "BasePlugin.h"
+#include "Event.h"
+#include "ObjectPool.h"
+
+#include <vector>
+
+/**
+ * LpsdPosCalcPlugin converts LPSD raw data into LPSD diagnostic data.
+ *
+ * LPSD tubes are read out on both ends, A and B. Each end is sampled
+ * twice, first sample is the baseline before the pulse and the second
+ * one is taken at the pulse peak. Position along the tube is calculated
+ * using charge division:
+ *
+ *   A = gainA * (a2 - a1 - offsetA)
+ *   B = gainB * (b2 - b1 - offsetB)
+ *   position = B / (A + B)
+ *
+ * Gain and offset are configured for each tube end. Position index from
+ * the event selects the tube. Pixel id is calculated as
+ * tube * PixelsPerTube + position * PixelsPerTube and can be further
+ * translated with PixelMapPlugin.
+ *
+ * Events are processed in batches. Samples and tube parameters are first
+ * gathered into arrays, then positions and vetoes are calculated for the
+ * whole batch with a branch-free loop which compiler vectorizes, and
+ * finally events are written to output packet. This allows to run full
+ * size LPSD instruments in raw mode.
+ *
+ * Vetoed events have pixel id marked with Event::Pixel::VETO_MASK.
+ */
+class LpsdPosCalcPlugin : public BasePlugin {
+    private: // definitions
+        static const uint32_t BATCH_SIZE = 64;  //!< Number of events calculated together
+
+        /**
+         * Veto flags, when more than one is set first one in this order is counted.
+         */
+        enum {
+            VETO_OVERFLOW       = 1 << 0,   //!< At least one sample has max value
+            VETO_BAD_CONFIG     = 1 << 1,   //!< Position index outside configured tubes
+            VETO_LOW_CHARGE     = 1 << 2,   //!< Event charge below threshold
+            VETO_EDGE           = 1 << 3,   //!< Calculated position outside tube
+            VETO_SPECIAL        = 1 << 4,   //!< Special event, passed thru without calculation
+        };
+
+        /**
+         * Event counters of processed packets, added to plugin counters
+         * once per received list of packets.
+         */
+        class Stats {
+            public:
+                uint32_t nTotal{0};     //!< Total number of events
+                uint32_t nGood{0};      //!< Number of good events
+                uint32_t nOverflow{0};  //!< Number of over-flow flagged events - vetoed
+                uint32_t nBadConfig{0}; //!< Number of events with unconfigured tube - vetoed
+                uint32_t nLowCharge{0}; //!< Number of events with low charge - vetoed
+                uint32_t nEdge{0};      //!< Number of events outside tube - vetoed
+
+                Stats &operator+=(const Stats &rhs)
+                {
+                    nTotal += rhs.nTotal;
+                    nGood += rhs.nGood;
+                    nOverflow += rhs.nOverflow;
+                    nBadConfig += rhs.nBadConfig;
+                    nLowCharge += rhs.nLowCharge;
+                    nEdge += rhs.nEdge;
+                    return *this;
+                }
+        };
+
+        /**
+         * Calculation parameters of a single tube.
+         */
+        struct TubeParams {
+            float gainA{1.0};
+            float gainB{1.0};
+            float offsetA{0.0};
+            float offsetB{0.0};
+        };
+
+        /**
+         * Events being calculated, stored as arrays for vectorization.
+         */
+        struct Batch {
+            float sampleA[BATCH_SIZE];      //!< Peak minus baseline on A end
+            float sampleB[BATCH_SIZE];      //!< Peak minus baseline on B end
+            float gainA[BATCH_SIZE];        //!< Tube A end gain
+            float gainB[BATCH_SIZE];        //!< Tube B end gain
+            float offsetA[BATCH_SIZE];      //!< Tube A end offset
+            float offsetB[BATCH_SIZE];      //!< Tube B end offset
+            uint32_t firstPixel[BATCH_SIZE];//!< First pixel id of the tube
+            uint32_t vetoes[BATCH_SIZE];    //!< Veto flags
+            uint32_t pixelid[BATCH_SIZE];   //!< Calculated pixel id
+        };
+
+        struct ProcessPacket;
+
+    private: // variables
+        std::vector<TubeParams> m_tubes;    //!< Per tube parameters, extra last entry for invalid positions
+        uint32_t m_pixelsPerTube{128};      //!< Number of pixels along the tube
+        uint32_t m_maxSample{0xFFF};        //!< Max ADC sample value, flags overflow
+        float m_minCharge{0.0};             //!< Low charge threshold
+        uint32_t m_vetoMask{0};             //!< Enabled vetoes
+        Counter *m_cntTotalEvents;          //!< Number of all events
+        Counter *m_cntGoodEvents;           //!< Number of good events
+        Counter *m_cntOverflowVetos;        //!< Number of overflow vetoes
+        Counter *m_cntBadConfigVetos;       //!< Number of events from unconfigured tubes
+        Counter *m_cntLowChargeVetos;       //!< Number of low charge vetoes
+        Counter *m_cntEdgeVetos;            //!< Number of edge vetoes
+        ObjectPool<DasDataPacket> m_packetsPool{true};  //!< Pool of allocated data packets to store modified data
+
+    public:
+        /**
+         * Constructor for LpsdPosCalcPlugin
+         *
+         * Constructor will create and populate PVs with default values.
+         *
+         * @param[in] portName asyn port name.
+         * @param[in] parentPlugins Name of the plugins to connect to.
+         * @param[in] nTubes Number of tubes to be configured.
+         */
+        LpsdPosCalcPlugin(const char *portName, const char *parentPlugins, int nTubes);
+
+    private:
+        /**
+         * Handle writing integer values.
+         */
+        asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value) override;
+
+        /**
+         * Handle inter-plugin params.
+         */
+        asynStatus recvParam(const std::string &remotePort, const std::string &paramName, epicsInt32 value) override;
+
+        /**
+         * Overloaded function to process incoming data packets.
+         */
+        void recvDownstream(const DasDataPacketList &packets) override;
+
+        /**
+         * Calculate events and write them to destination events.
+         *
+         * Source events can be either raw or verbose, they're accessed
+         * through the common raw fields only.
+         *
+         * @param[in] srcEvents First source event
+         * @param[in] srcEventSize Size of single source event in bytes
+         * @param[in] nEvents Number of events to process
+         * @param[out] destEvents Output events, must have room for nEvents
+         * @return Event counters
+         */
+        Stats processEvents(const uint8_t *srcEvents, uint32_t srcEventSize, uint32_t nEvents, Event::LPSD::Diag *destEvents);
+
+        /**
+         * Calculate pixel ids and vetoes for all events in a batch.
+         *
+         * Function has no branches in the loop body and is expected
+         * to be vectorized.
+         */
+        static void calculateBatch(Batch &batch, uint32_t nEvents, float minCharge, uint32_t pixelsPerTube);
+
+    protected:
+        int ErrMem;             //!< Error allocating buffer
+        int ResetCnt;           //!< Reset counters
+        int CalcEn;             //!< Toggle position calculation
+        int NTubes;             //!< Number of configured tubes
+        int PixelsPerTube;      //!< Number of pixels along the tube
+        int MaxSample;          //!< Max ADC sample value
+        int MinCharge;          //!< Low charge threshold
+        int LowChargeVetoEn;    //!< Toggle low charge vetoes
+        int EdgeVetoEn;         //!< Toggle edge vetoes
+        int OverflowVetoEn;     //!< Toggle overflow vetoes
+        int CntTotalEvents;     //!< Number of all events
+        int CntGoodEvents;      //!< Number of good events
+        int CntOverflowVetos;   //!< Number of overflow vetoes
+        int CntBadConfigVetos;  //!< Number of events from unconfigured tubes
+        int CntLowChargeVetos;  //!< Number of low charge vetoes
+        int CntEdgeVetos;       //!< Number of edge vetoes
+        std::vector<int> GainsA;    //!< Tube A end gain
+        std::vector<int> GainsB;    //!< Tube B end gain
+        std::vector<int> OffsetsA;  //!< Tube A end offset
+        std::vector<int> OffsetsB;  //!< Tube B end offset
+};
+
+#endif // LPSD_POS_CALC_PLUGIN_H
@@ -10,7 +10,8 @@
 #ifndef OBJECT_POOL_H
 #define OBJECT_POOL_H
 
-#include <cantProceed.h>
+#include "HugePages.h"
+
 #include <epicsMutex.h>
 
 #include <functional>
@@ -25,6 +26,9 @@
  * When object is no longer needed, it can be returned to pool using put().
  * Alternatively use getPtr() which returns shared_ptr object which is returned
  * to pool as soon as shared_ptrs' reference drops to 0.
+ *
+ * Objects are allocated through HugePages, large objects are backed by
+ * huge pages when configured.
  */
 template <typename T>
 class ObjectPool {
@@ -38,13 +42,13 @@ class ObjectPool {
             m_mutex.lock();
             while (!m_ready.empty()) {
                 Object &obj = m_ready.front();
+                HugePages::release(obj.mem);
                 m_ready.pop_front();
-                free(obj.mem);
             }
             while (!m_used.empty()) {
-                Object &obj = m_ready.front();
-                m_ready.pop_front();
-                free(obj.mem);
+                Object &obj = m_used.front();
+                HugePages::release(obj.mem);
+                m_used.pop_front();
             }
             m_mutex.unlock();
         }
@@ -73,7 +77,7 @@ class ObjectPool {
                         m_used.push_back(obj);
                         break;
                     }
-                    free(obj.mem);
+                    HugePages::release(obj.mem);
                 }
             } else {
                 for (auto it=m_ready.begin(); it!=m_ready.end(); it++) {
@@ -89,7 +93,7 @@ class ObjectPool {
 
             if (mem == 0) {
                 // Not found any suitable element, must allocate
-                mem = mallocMustSucceed(minSize, "Can't allocate pool object");
+                mem = HugePages::allocate(minSize, "Can't allocate pool object");
 
                 Object obj = { mem, minSize };
                 m_mutex.lock();
@@ -136,7 +140,7 @@ class ObjectPool {
             m_mutex.unlock();
 
             if (!returned)
-                free(mem);
+                HugePages::release(mem);
         }
 
         /**
@@ -59,6 +59,11 @@ OccPlugin::OccPlugin(const char *portName, const char *devfile, uint32_t localBu
     createParam("ErrPktEn",         asynParamInt32,     &ErrPktEn);                 // WRITE - Error packets output switch   (0=disable,1=enable)
     createParam("ErrPktEnRb",       asynParamInt32,     &ErrPktEnRb);               // READ - Error packets enabled         (0=disabled,1=enabled)
     createParam("ReportFile",       asynParamOctet,     &ReportFile, "");           // WRITE - Filename to save OCC info when processing thread stops
+    createParam("CopyHighWater",    asynParamInt32,     &CopyHighWater, 0);         // WRITE - Start copying at this DMA usage in %, 0 always copies
+    createParam("CopyLowWater",     asynParamInt32,     &CopyLowWater,  5);         // WRITE - Stop copying below this DMA usage in %
+    createParam("CopyMode",         asynParamInt32,     &CopyMode,      0);         // READ - Current data path      (0=zero-copy,1=copy,2=drain)
+    createParam("CopiedBytes",      asynParamFloat64,   &CopiedBytes,   0.0);       // READ - Bytes copied to local buffer
+    createParam("ZeroCopyBytes",    asynParamFloat64,   &ZeroCopyBytes, 0.0);       // READ - Bytes processed directly from DMA memory
 
     occ_interface_type occtype = OCC_INTERFACE_OPTICAL;
     if (strchr(devfile, ':') != 0)
@@ -78,7 +83,7 @@ OccPlugin::OccPlugin(const char *portName, const char *devfile, uint32_t localBu
     if (m_occ != nullptr) {
         // Start DMA copy thread or use DMA buffer directly
         if (localBufferSize > 0)
-            m_circularBuffer = new DmaCopier(m_occ, localBufferSize);
+            m_circularBuffer = new DmaCopier(m_occ, localBufferSize, (std::string(portName) + "_DmaCopier").c_str());
         else
             m_circularBuffer = new DmaCircularBuffer(m_occ);
         if (!m_circularBuffer) {
@@ -90,7 +95,7 @@ OccPlugin::OccPlugin(const char *portName, const char *devfile, uint32_t localBu
         refreshOccStatus(false);
 
         m_occStatusRefreshThread = std::unique_ptr<Thread>(new Thread(
-            "OCC status",
+            (std::string(portName) + "_Status").c_str(),
             std::bind(&OccPlugin::refreshOccStatusThread, this, std::placeholders::_1),
             epicsThreadGetStackSize(epicsThreadStackSmall),
             epicsThreadPriorityLow
@@ -199,6 +204,16 @@ void OccPlugin::refreshOccStatus(bool basic_status)
         setIntegerParam(DmaSize,        m_occStatusCache.dma_size);
         setIntegerParam(RecvRate,       m_occStatusCache.rx_rate);
 
+        DmaCopier *dmaCopier = dynamic_cast<DmaCopier *>(m_circularBuffer);
+        if (dmaCopier) {
+            uint64_t dmaSize = m_occStatusCache.dma_size;
+            dmaCopier->setWatermarks(dmaSize * getIntegerParam(CopyHighWater) / 100,
+                                     dmaSize * getIntegerParam(CopyLowWater) / 100);
+            setIntegerParam(CopyMode,   dmaCopier->getMode());
+            setDoubleParam(CopiedBytes, dmaCopier->getCopiedBytes());
+            setDoubleParam(ZeroCopyBytes, dmaCopier->getZeroCopyBytes());
+        }
+
         if (m_occStatusCache.stalled)
             setIntegerParam(Status,     STAT_OCC_STALL);
         else if (m_occStatusCache.overflowed)
@@ -257,8 +272,22 @@ asynStatus OccPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
             callParamCallbacks();
             return asynError;
         }
+    } else if (pasynUser->reason == CopyHighWater || pasynUser->reason == CopyLowWater) {
+        if (value < 0 || value > 100)
+            return asynError;
+
+        // High watermark 0 always copies, otherwise copying must stop below where it starts
+        int high = (pasynUser->reason == CopyHighWater ? value : getIntegerParam(CopyHighWater));
+        int low  = (pasynUser->reason == CopyLowWater  ? value : getIntegerParam(CopyLowWater));
+        if (high != 0 && low >= high) {
+            LOG_ERROR("Copy low watermark %d%% must be below high watermark %d%%", low, high);
+            return asynError;
+        }
+
+        // Status thread applies new watermarks
+        m_statusEvent.signal();
     }
-    return asynPortDriver::writeInt32(pasynUser, value);
+    return BasePortPlugin::writeInt32(pasynUser, value);
 }
 
 bool OccPlugin::send(const uint8_t *data, size_t len)
@@ -152,6 +152,11 @@ class epicsShareFunc OccPlugin : public BasePortPlugin {
         int ErrPktEn;
         int ErrPktEnRb;
         int ReportFile;
+        int CopyHighWater;
+        int CopyLowWater;
+        int CopyMode;
+        int CopiedBytes;
+        int ZeroCopyBytes;
 };
 
 #endif // OCC_PLUGIN_H
@@ -9,6 +9,7 @@
 
 #include "Common.h"
 #include "Event.h"
+#include "EventTraits.h"
 #include "Packet.h"
 
 #include <string.h>
@@ -60,12 +61,17 @@ const Packet *Packet::cast(const uint8_t *data, size_t size)
 /* ******************************* */
 
 RtdlPacket *RtdlPacket::init(uint8_t *buffer, size_t size, const std::vector<RtdlFrame> &frames)
+{
+    return init(buffer, size, frames.data(), frames.size());
+}
+
+RtdlPacket *RtdlPacket::init(uint8_t *buffer, size_t size, const RtdlFrame *frames, uint32_t nFrames)
 {
     RtdlPacket *packet = nullptr;
-    uint32_t length = sizeof(RtdlPacket) + (frames.size() * sizeof(RtdlFrame));
-    if (size >= length) {
+    uint32_t length = sizeof(RtdlPacket) + (nFrames * sizeof(RtdlFrame));
+    if (size >= length && nFrames <= MAX_FRAMES) {
         packet = reinterpret_cast<RtdlPacket *>(buffer);
-        packet->init(frames);
+        packet->init(frames, nFrames);
     }
 
     return packet;
@@ -73,16 +79,19 @@ RtdlPacket *RtdlPacket::init(uint8_t *buffer, size_t size, const std::vector<Rtd
 
 void RtdlPacket::init(const std::vector<RtdlFrame> &frames)
 {
-    memset(this, 0, (sizeof(RtdlPacket) + frames.size()*sizeof(RtdlFrame)));
+    init(frames.data(), frames.size());
+}
+
+void RtdlPacket::init(const RtdlFrame *frames, uint32_t nFrames)
+{
+    memset(this, 0, sizeof(RtdlPacket));
 
     this->version = 0x1;
     this->type = TYPE_RTDL;
-    this->length = sizeof(RtdlPacket) + frames.size()*sizeof(RtdlFrame);
+    this->length = sizeof(RtdlPacket) + nFrames*sizeof(RtdlFrame);
 
-    this->num_frames = frames.size();
-    for (size_t i = 0; i < frames.size(); i++) {
-        this->frames[i].raw = frames[i].raw;
-    }
+    this->num_frames = nFrames;
+    memcpy(this->frames, frames, nFrames*sizeof(RtdlFrame));
 }
 
 bool RtdlPacket::checkIntegrity() const
@@ -350,6 +359,8 @@ bool DasDataPacket::checkIntegrity() const
 {
     if (this->length < sizeof(DasDataPacket))
         return false;
+    if (getEventsSize(event_format) == 0)
+        return false;
     if (this->length != DasDataPacket::getLength(event_format, num_events))
         return false;
     if (this->getTimeStamp().nsec > 1000000000)
@@ -359,19 +370,5 @@ bool DasDataPacket::checkIntegrity() const
 
 uint32_t DasDataPacket::getEventsSize(DasDataPacket::EventFormat format)
 {
-    switch (format) {
-        case EVENT_FMT_META:         return sizeof(Event::Pixel);
-        case EVENT_FMT_PIXEL:        return sizeof(Event::Pixel);
-        case EVENT_FMT_BNL_RAW:      return sizeof(Event::BNL::Raw);
-        case EVENT_FMT_BNL_VERBOSE:  return sizeof(Event::BNL::Verbose);
-        case EVENT_FMT_BNL_DIAG:     return sizeof(Event::BNL::Diag);
-        case EVENT_FMT_ACPC_XY_PS:   return sizeof(Event::ACPC::Normal);
-        case EVENT_FMT_ACPC_DIAG:    return sizeof(Event::ACPC::Diag);
-        case EVENT_FMT_TIME_CALIB:   return sizeof(Event::Pixel);
-        case EVENT_FMT_AROC_RAW:     return sizeof(Event::AROC::Raw);
-        case EVENT_FMT_LPSD_RAW:     return sizeof(Event::LPSD::Raw);
-        case EVENT_FMT_LPSD_VERBOSE: return sizeof(Event::LPSD::Verbose);
-        default:
-            throw std::runtime_error("Packet::getEventsSize() not implemented for requested format");
-    }
+    return AllEventFormats::sizeOf(format);
 }
@@ -31,6 +31,7 @@ class Packet {
             TYPE_DAS_DATA   = 0x7,
             TYPE_DAS_CMD    = 0x8,
             TYPE_ACC_TIME   = 0x10,
+            TYPE_COMPRESSED = 0xFE, // Software only, block of encoded packets in dump files
             TYPE_OLD_RTDL   = 0xFF, // Software only, hopefully such packet doesn't get defined
         } Type;
 
@@ -221,6 +222,8 @@ class DasDataPacket : public Packet {
             EVENT_FMT_ACPC_DIAG      = 102,  //!< ACPC verbose mode + flat-field corrected x,y and mapped pixel
             EVENT_FMT_BNL_DIAG       = 103,  //!< BNL verbose mode + flat-field corrected x,y and mapped pixel
             EVENT_FMT_CROC_DIAG      = 104,  //!< CROC verbose mode + mapped pixel
+            EVENT_FMT_ACPC_DIAG_COMPACT = 105, //!< Same as EVENT_FMT_ACPC_DIAG with single precision fields
+            EVENT_FMT_CROC_DIAG_COMPACT = 106, //!< Same as EVENT_FMT_CROC_DIAG with single precision fields
         } EventFormat;
 
     protected:
@@ -275,6 +278,7 @@ class DasDataPacket : public Packet {
          *
          * Function performs following checks:
          * - minimum packet length
+         * - known events format
          * - all events fit in packet
          * - decoded timestamp is valid
          *
@@ -361,8 +365,8 @@ class DasDataPacket : public Packet {
         /**
          * Return events size based on format.
          *
-         * In case of DATA_FMT_RESERVED the event size used is 8 bytes.
-         * For unknown event format the returned value is 1.
+         * Size is taken from EventTraits, formats without known event
+         * structure return 0.
          */
         static uint32_t getEventsSize(DasDataPacket::EventFormat format);
 
@@ -424,6 +428,7 @@ class RtdlPacket : public Packet {
                 };
                 uint32_t raw;                       //!< Non decoded RTDL frame
             };
+            RtdlFrame() {}
             RtdlFrame(uint32_t raw_)
             : raw(raw_) {}
             RtdlFrame(uint8_t id_, uint32_t data_)
@@ -431,6 +436,8 @@ class RtdlPacket : public Packet {
             , id(id_) {}
         };
 
+        static const uint32_t MAX_FRAMES = 255; //!< Limited by num_frames field
+
     protected: /* Variables */
 
         struct __attribute__ ((__packed__)) {
@@ -451,6 +458,17 @@ class RtdlPacket : public Packet {
          */
         static RtdlPacket *init(uint8_t *buffer, size_t size, const std::vector<RtdlFrame> &frames);
 
+        /**
+         * Use buffer as storage for new RTDL packet, populate fields from frames array.
+         *
+         * @param buffer to be used to stora new packet
+         * @param size of buffer
+         * @param frames RTDL frames data
+         * @param nFrames Number of frames, up to MAX_FRAMES
+         * @return Returns a newly created packet or nullptr on error.
+         */
+        static RtdlPacket *init(uint8_t *buffer, size_t size, const RtdlFrame *frames, uint32_t nFrames);
+
         /**
          * Populate fields.
          *
@@ -459,6 +477,14 @@ class RtdlPacket : public Packet {
          */
         void init(const std::vector<RtdlFrame> &frames);
 
+        /**
+         * Populate fields from frames array.
+         *
+         * @param frames RTDL frames data
+         * @param nFrames Number of frames, up to MAX_FRAMES
+         */
+        void init(const RtdlFrame *frames, uint32_t nFrames);
+
         /**
          * Check packet data integrity.
          *
@@ -0,0 +1,63 @@
+/* PacketArena.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "HugePages.h"
+#include "PacketArena.h"
+
+#include <cassert>
+
+PacketArena::PacketArena(size_t blockSize)
+    : m_blockSize(blockSize)
+{}
+
+PacketArena::~PacketArena()
+{
+    for (auto &block: m_blocks)
+        HugePages::release(block.mem);
+}
+
+uint8_t *PacketArena::reserve(size_t size)
+{
+    // Find first block from the current one that has enough space left
+    while (m_current < m_blocks.size()) {
+        if (m_blocks[m_current].size - m_used >= size)
+            return m_blocks[m_current].mem + m_used;
+        m_current++;
+        m_used = 0;
+    }
+
+    Block block;
+    block.size = (size > m_blockSize ? size : m_blockSize);
+    block.mem = static_cast<uint8_t *>(HugePages::allocate(block.size, "Can't allocate packet arena block"));
+    m_blocks.push_back(block);
+    return block.mem;
+}
+
+void PacketArena::commit(size_t size)
+{
+    assert(m_current < m_blocks.size() && m_used + size <= m_blocks[m_current].size);
+    // Keep packets 4-byte aligned
+    m_used += (size + 3) & ~3;
+    if (m_used > m_blocks[m_current].size)
+        m_used = m_blocks[m_current].size;
+}
+
+void PacketArena::reset()
+{
+    m_current = 0;
+    m_used = 0;
+}
+
+size_t PacketArena::capacity() const
+{
+    size_t size = 0;
+    for (auto &block: m_blocks)
+        size += block.size;
+    return size;
+}
@@ -0,0 +1,76 @@
+/* PacketArena.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef PACKET_ARENA_H
+#define PACKET_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Bump allocator for packets that live only while one chunk of data is processed.
+ *
+ * Packets are placed back to back in large blocks. Blocks are allocated
+ * on demand and kept until arena is destroyed, so after warm-up there
+ * are no allocations in steady state. All packets are released at once
+ * with reset(), previously returned pointers stay valid until then.
+ *
+ * Not thread safe, meant to be used by single processing thread.
+ */
+class PacketArena {
+    public:
+        /**
+         * Create empty arena, no memory is allocated until first reserve().
+         *
+         * @param[in] blockSize Size of each block, requests larger than this get dedicated block
+         */
+        PacketArena(size_t blockSize=2*1024*1024);
+
+        ~PacketArena();
+
+        PacketArena(const PacketArena &) = delete;
+        PacketArena &operator=(const PacketArena &) = delete;
+
+        /**
+         * Return memory for writing up to size bytes.
+         *
+         * Memory is not taken from arena until commit() is called, next
+         * reserve() without commit() returns the same memory.
+         */
+        uint8_t *reserve(size_t size);
+
+        /**
+         * Take size bytes of last reserved memory, must not exceed reserved size.
+         */
+        void commit(size_t size);
+
+        /**
+         * Release all packets, keep memory for reuse.
+         */
+        void reset();
+
+        /**
+         * Return number of bytes allocated by arena.
+         */
+        size_t capacity() const;
+
+    private:
+        struct Block {
+            uint8_t *mem;
+            size_t size;
+        };
+
+        size_t m_blockSize;
+        std::vector<Block> m_blocks;
+        size_t m_current{0};    //!< Index of block being filled
+        size_t m_used{0};       //!< Bytes used in current block
+};
+
+#endif // PACKET_ARENA_H
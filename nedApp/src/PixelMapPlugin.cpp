@@ -8,11 +8,25 @@
  */
 
 #include "Event.h"
+#include "EventTraits.h"
 #include "PixelMapPlugin.h"
 #include "Log.h"
 
 #include <fstream>
 
+/**
+ * Formats with pixel id that can be mapped.
+ */
+typedef EventFormats<
+    DasDataPacket::EVENT_FMT_PIXEL,
+    DasDataPacket::EVENT_FMT_LPSD_DIAG,
+    DasDataPacket::EVENT_FMT_BNL_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT,
+    DasDataPacket::EVENT_FMT_CROC_DIAG,
+    DasDataPacket::EVENT_FMT_CROC_DIAG_COMPACT
+> MappedFormats;
+
 EPICS_REGISTER_PLUGIN(PixelMapPlugin, 3, "Port name", string, "Parent plugins", string, "PixelMap file", string);
 
 PixelMapPlugin::PixelMapPlugin(const char *portName, const char *parentPlugins, const char *pixelMapFile)
@@ -27,6 +41,8 @@ PixelMapPlugin::PixelMapPlugin(const char *portName, const char *parentPlugins,
     createParam("MapEn",        asynParamInt32, &MapEn, 0);       // Toggle pixel mapping
     callParamCallbacks();
 
+    m_cntUnmap = createCounter(CntUnmap);
+
     BasePlugin::connect(parentPlugins, MsgDasData);
 }
 
@@ -34,8 +50,7 @@ asynStatus PixelMapPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
 {
     if (pasynUser->reason == ResetCnt) {
         if (value > 0) {
-            setIntegerParam(CntUnmap, 0);
-            callParamCallbacks();
+            resetCounter(m_cntUnmap);
         }
         return asynSuccess;
     }
@@ -94,12 +109,30 @@ uint32_t PixelMapPlugin::eventsMap(Event::Pixel *events, uint32_t nEvents)
     return nUnmapped;
 }
 
+struct PixelMapPlugin::MapPacket {
+    PixelMapPlugin *plugin;
+    const DasDataPacket *srcPacket;
+    DasDataPacket *&destPacket;
+    int &errors;
+
+    template <typename Traits>
+    void operator()(const Traits &)
+    {
+        uint32_t nEvents = srcPacket->getNumEvents();
+        destPacket = plugin->m_packetsPool.get(DasDataPacket::getLength(Traits::format, nEvents));
+        if (destPacket) {
+            destPacket->init(Traits::format, srcPacket->getTimeStamp(), nEvents, Traits::events(srcPacket));
+            errors += plugin->eventsMap(Traits::events(destPacket), nEvents);
+            destPacket->setEventsMapped(true);
+        }
+    }
+};
+
 void PixelMapPlugin::recvDownstream(const DasDataPacketList &packets)
 {
     bool mapEn = getBooleanParam(MapEn);
     int errors = 0;
 
-    getIntegerParam(CntUnmap, &errors);
     if (m_map.empty())
         mapEn = false;
 
@@ -112,44 +145,15 @@ void PixelMapPlugin::recvDownstream(const DasDataPacketList &packets)
 
         for (auto it = packets.cbegin(); it != packets.cend(); it++) {
             const DasDataPacket *srcPacket = *it;
-            uint32_t nEvents = srcPacket->getNumEvents();
 
             DasDataPacket *destPacket = nullptr;
-            if (srcPacket->getEventsFormat() == DasDataPacket::EVENT_FMT_PIXEL) {
-                uint32_t destPacketLen = sizeof(DasDataPacket) + nEvents*sizeof(Event::Pixel);
-                destPacket = m_packetsPool.get(destPacketLen);
-                if (!destPacket) {
-                    LOG_ERROR("Failed to allocate output packet");
-                    continue;
-                }
-                allocatedPackets.push_back(destPacket);
-                destPacket->init(DasDataPacket::EVENT_FMT_PIXEL, srcPacket->getTimeStamp(), nEvents, srcPacket->getEvents<Event::Pixel>());
-                errors += eventsMap(destPacket->getEvents<Event::Pixel>(), nEvents);
-                destPacket->setEventsMapped(true);
-                outPackets.push_back(destPacket);
-            } else if (srcPacket->getEventsFormat() == DasDataPacket::EVENT_FMT_BNL_DIAG) {
-                uint32_t destPacketLen = sizeof(DasDataPacket) + nEvents*sizeof(Event::BNL::Diag);
-                destPacket = m_packetsPool.get(destPacketLen);
-                if (!destPacket) {
-                    LOG_ERROR("Failed to allocate output packet");
-                    continue;
-                }
-                allocatedPackets.push_back(destPacket);
-                destPacket->init(DasDataPacket::EVENT_FMT_BNL_DIAG, srcPacket->getTimeStamp(), nEvents, srcPacket->getEvents<Event::BNL::Diag>());
-                errors += eventsMap(destPacket->getEvents<Event::BNL::Diag>(), nEvents);
-                destPacket->setEventsMapped(true);
-                outPackets.push_back(destPacket);
-            } else if (srcPacket->getEventsFormat() == DasDataPacket::EVENT_FMT_ACPC_DIAG) {
-                uint32_t destPacketLen = sizeof(DasDataPacket) + nEvents*sizeof(Event::ACPC::Diag);
-                destPacket = m_packetsPool.get(destPacketLen);
+            bool supported = MappedFormats::dispatch(srcPacket->getEventsFormat(), MapPacket{this, srcPacket, destPacket, errors});
+            if (supported) {
                 if (!destPacket) {
                     LOG_ERROR("Failed to allocate output packet");
                     continue;
                 }
                 allocatedPackets.push_back(destPacket);
-                destPacket->init(DasDataPacket::EVENT_FMT_ACPC_DIAG, srcPacket->getTimeStamp(), nEvents, srcPacket->getEvents<Event::ACPC::Diag>());
-                errors += eventsMap(destPacket->getEvents<Event::ACPC::Diag>(), nEvents);
-                destPacket->setEventsMapped(true);
                 outPackets.push_back(destPacket);
             } else {
                 static bool logged = false;
@@ -170,8 +174,8 @@ void PixelMapPlugin::recvDownstream(const DasDataPacketList &packets)
         }
     }
 
-    setIntegerParam(CntUnmap, errors);
-    callParamCallbacksRatelimit();
+    // Parameter is updated by counters thread
+    *m_cntUnmap += errors;
 }
 
 PixelMapPlugin::ImportError PixelMapPlugin::importPixelMapFile(const char *filepath)
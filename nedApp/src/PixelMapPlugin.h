@@ -82,6 +82,11 @@ class PixelMapPlugin : public BasePlugin {
         template <typename T>
         uint32_t eventsMap(T *events, uint32_t nEvents);
 
+        /**
+         * Copies packet to a new one from pool and maps its events, specialized for each format.
+         */
+        struct MapPacket;
+
         /**
          * Read mapping table from a file.
          *
@@ -93,6 +98,7 @@ class PixelMapPlugin : public BasePlugin {
     private:
         std::vector<uint32_t> m_map; //!< Pixel mapping, index is raw pixel id, value is translated pixel id
         ObjectPool<DasDataPacket> m_packetsPool{false}; //!< Pool of packets to be used for modified data
+        Counter *m_cntUnmap;         //!< Number of unmapped pixels, published to CntUnmap
 
     private: // asyn parameters
         int FilePath;       //!< Absolute path to pixel map file
@@ -7,6 +7,7 @@
  * @author Klemen Vodopivec
  */
 
+#include "Executor.h"
 #include "PluginMessage.h"
 
 PluginMessage::PluginMessage(const void *msg)
@@ -42,8 +43,10 @@ void PluginMessage::release()
 
 void PluginMessage::waitAllReleased()
 {
+    // Executor replaces blocked worker with a spare one,
+    // subscribers may be waiting for a worker themselves
     while (!released())
-        m_event.wait();
+        Executor::blockingWait(m_event);
 }
 
 bool PluginMessage::released()
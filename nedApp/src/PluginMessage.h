@@ -58,7 +58,8 @@ class PluginMessage
          * Wait for all consumers to release the object.
          *
          * After the function returns, reference counter is guaranteed to be 0 and
-         * object can not be claim()ed again.
+         * object can not be claim()ed again. When called from executor
+         * worker, spare worker runs other jobs while this one waits.
          */
         void waitAllReleased();
 
@@ -76,7 +77,21 @@ class PluginMessage
             return reinterpret_cast<T*>(m_msg);
         };
 
+        /**
+         * Allow subscribers to process message concurrently.
+         *
+         * Only valid when sender waits for all subscribers to release
+         * message, which keeps messages from one sender in order.
+         */
+        void setParallel(bool parallel) { m_parallel = parallel; }
+
+        /**
+         * Return true if subscribers may process message concurrently.
+         */
+        bool isParallel() const { return m_parallel; }
+
     private:
+        bool m_parallel{false};
         unsigned long m_refcount;
         mutable epicsMutex m_lock;
         mutable epicsEvent m_event;
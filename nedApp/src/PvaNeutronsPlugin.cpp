@@ -8,6 +8,7 @@
  */
 
 #include "Event.h"
+#include "EventTraits.h"
 #include "Log.h"
 #include "PvaNeutronsPlugin.h"
 
@@ -19,6 +20,32 @@
 #include <pv/pvTimeStamp.h>
 #include <pv/standardPVField.h>
 
+/**
+ * Neutron formats with tof,pixelid events, these go to Neutrons and filtered channels.
+ */
+typedef EventFormats<
+    DasDataPacket::EVENT_FMT_PIXEL,
+    DasDataPacket::EVENT_FMT_LPSD_VERBOSE,
+    DasDataPacket::EVENT_FMT_LPSD_DIAG,
+    DasDataPacket::EVENT_FMT_BNL_VERBOSE,
+    DasDataPacket::EVENT_FMT_BNL_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT
+> NeutronFormats;
+
+/**
+ * All formats PvaRecordPixel can publish, includes metadata.
+ */
+typedef EventFormats<
+    DasDataPacket::EVENT_FMT_PIXEL,
+    DasDataPacket::EVENT_FMT_META,
+    DasDataPacket::EVENT_FMT_LPSD_VERBOSE,
+    DasDataPacket::EVENT_FMT_LPSD_DIAG,
+    DasDataPacket::EVENT_FMT_BNL_VERBOSE,
+    DasDataPacket::EVENT_FMT_BNL_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_DIAG,
+    DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT
+> TofPixelFormats;
 
 /**
  * PVRecord for Neutrons channel.
@@ -33,20 +60,29 @@ class PvaNeutronsPlugin::PvaRecordPixel : public epics::pvDatabase::PVRecord {
             , m_sequence(0)
         {}
 
-        template <typename T>
-        void getTofPixels(const DasDataPacket *packet, std::vector<unsigned>& tofs, std::vector<unsigned>& pixels)
-        {
-            uint32_t nEvents = packet->getNumEvents();
-            const T *events = packet->getEvents<T>();
-
-            size_t start = tofs.size();
-            tofs.resize(start+nEvents);
-            pixels.resize(start+nEvents);
-            for (uint32_t i = 0; i < nEvents; i++) {
-                tofs[start+i]   = events[i].tof;
-                pixels[start+i] = events[i].pixelid;
+        /**
+         * Append tof,pixel pairs from packet, specialized for each format.
+         */
+        struct GetTofPixels {
+            const DasDataPacket *packet;
+            std::vector<unsigned> &tofs;
+            std::vector<unsigned> &pixels;
+
+            template <typename Traits>
+            void operator()(const Traits &)
+            {
+                uint32_t nEvents = packet->getNumEvents();
+                const typename Traits::Type *events = Traits::events(packet);
+
+                size_t start = tofs.size();
+                tofs.resize(start+nEvents);
+                pixels.resize(start+nEvents);
+                for (uint32_t i = 0; i < nEvents; i++) {
+                    tofs[start+i]   = Traits::tof(events[i]);
+                    pixels[start+i] = Traits::pixelid(events[i]);
+                }
             }
-        }
+        };
 
     public:
         POINTER_DEFINITIONS(PvaRecordPixel);
@@ -108,15 +144,17 @@ class PvaNeutronsPlugin::PvaRecordPixel : public epics::pvDatabase::PVRecord {
         }
 
         /**
-         * Publish a single atomic update of the PV, take values from packet.
+         * Publish a single atomic update of the PV when packet starts new pulse.
+         *
+         * Events accumulated from previous packets are sent and internal
+         * buffers are cleared.
+         *
+         * @param[in] nEvents Value of num_events field
          */
-        bool update(const DasDataPacket *packet, uint32_t &nEvents, double pCharge)
+        void publish(const DasDataPacket *packet, uint32_t nEvents, double pCharge)
         {
             epicsTimeStamp timeStamp = packet->getTimeStamp();
-
-            // Now extract events from packet
             bool mapped = packet->getEventsMapped();
-            nEvents = packet->getNumEvents();
 
             // Send an update only if timestamp change is detected -- this would not work for mixed
             // `mapped` flags.
@@ -151,35 +189,39 @@ class PvaNeutronsPlugin::PvaRecordPixel : public epics::pvDatabase::PVRecord {
                 tofs.clear();
                 pixels.clear();
             }
+        }
+
+        /**
+         * Return number of events waiting for next update.
+         */
+        uint32_t getNumPending() const
+        {
+            return tofs.size();
+        }
+
+        /**
+         * Add single event to the next update.
+         */
+        void append(uint32_t tof, uint32_t pixel)
+        {
+            tofs.push_back(tof);
+            pixels.push_back(pixel);
+        }
+
+        /**
+         * Publish a single atomic update of the PV, take values from packet.
+         */
+        bool update(const DasDataPacket *packet, uint32_t &nEvents, double pCharge)
+        {
+            nEvents = packet->getNumEvents();
+
+            publish(packet, nEvents, pCharge);
 
-            switch (packet->getEventsFormat()) {
-                case DasDataPacket::EVENT_FMT_PIXEL:
-                    getTofPixels<Event::Pixel>(packet, tofs, pixels);
-                    break;
-                case DasDataPacket::EVENT_FMT_META:
-                    getTofPixels<Event::Pixel>(packet, tofs, pixels);
-                    break;
-                case DasDataPacket::EVENT_FMT_LPSD_VERBOSE:
-                    getTofPixels<Event::LPSD::Verbose>(packet, tofs, pixels);
-                    break;
-                case DasDataPacket::EVENT_FMT_LPSD_DIAG:
-                    getTofPixels<Event::LPSD::Diag>(packet, tofs, pixels);
-                    break;
-                case DasDataPacket::EVENT_FMT_BNL_VERBOSE:
-                    getTofPixels<Event::BNL::Verbose>(packet, tofs, pixels);
-                    break;
-                case DasDataPacket::EVENT_FMT_BNL_DIAG:
-                    getTofPixels<Event::BNL::Diag>(packet, tofs, pixels);
-                    break;
-                case DasDataPacket::EVENT_FMT_ACPC_DIAG:
-                    getTofPixels<Event::ACPC::Diag>(packet, tofs, pixels);
-                    break;
-                case DasDataPacket::EVENT_FMT_TIME_CALIB:
-                    nEvents = 0;
-                    break;
-                default:
-                    nEvents = 0;
-                    return false;
+            if (packet->getEventsFormat() == DasDataPacket::EVENT_FMT_TIME_CALIB) {
+                nEvents = 0;
+            } else if (!TofPixelFormats::dispatch(packet->getEventsFormat(), GetTofPixels{packet, tofs, pixels})) {
+                nEvents = 0;
+                return false;
             }
 
             return true;
@@ -1637,6 +1679,21 @@ class PvaNeutronsPlugin::PvaRecordAcpc : public epics::pvDatabase::PVRecord {
                     photo_sum_x[i]  = events[i].photo_sum_x;
                     photo_sum_y[i]  = events[i].photo_sum_y;
                 }
+            } else if (packet->getEventsFormat() == DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT) {
+                const Event::ACPC::DiagCompact *events = packet->getEvents<Event::ACPC::DiagCompact>();
+                bool mapped = packet->getEventsMapped();
+                for (uint32_t i = 0; i < nEvents; i++) {
+                    tofs[i]         = events[i].tof & 0x000FFFFF;
+                    positions[i]    = events[i].position & 0x7FFFFFFF;
+                    vetos[i]        = static_cast<unsigned>(events[i].veto);
+                    pixels[i]       = (mapped ? events[i].pixelid_raw : events[i].pixelid);
+                    xs[i]           = events[i].x;
+                    ys[i]           = events[i].y;
+                    corrected_xs[i] = events[i].corrected_x;
+                    corrected_ys[i] = events[i].corrected_y;
+                    photo_sum_x[i]  = events[i].photo_sum_x;
+                    photo_sum_y[i]  = events[i].photo_sum_y;
+                }
             } else {
                 nEvents = 0;
                 return false;
@@ -2105,6 +2162,32 @@ PvaNeutronsPlugin::PvaNeutronsPlugin(const char *portName, const char *dataPlugi
             setParamAlarmSeverity(ArocPvaName, epicsSevMajor);
             status = STATUS_INIT_ERROR;
         }
+
+        // Filtered neutrons PVA records
+        for (unsigned i = 0; i < NUM_FILTERS; i++) {
+            std::string name = "Filter" + std::to_string(i + 1);
+            createParam(name + "PvaName", asynParamOctet, &FilterPvaName[i], prefix + name);
+            createParam(name + "CntEvents", asynParamInt32, &FilterCntEvents[i], 0);
+            createParam(name + "Enable", asynParamInt32, &FilterEnable[i], 0);
+            createParam(name + "PixelMin", asynParamInt32, &FilterPixelMin[i], 0);
+            createParam(name + "PixelMax", asynParamInt32, &FilterPixelMax[i], 0x0FFFFFFF);
+            createParam(name + "TofMin", asynParamInt32, &FilterTofMin[i], 0);
+            createParam(name + "TofMax", asynParamInt32, &FilterTofMax[i], 0x7FFFFFFF);
+            createParam(name + "Types", asynParamInt32, &FilterTypes[i], 0x1);
+            m_filters[i].cntEvents = createCounter(FilterCntEvents[i]);
+            m_filters[i].record = PvaRecordPixel::create(prefix + name);
+            if (!m_filters[i].record) {
+                LOG_ERROR("Failed to create filtered PVA record '%s%s'", pvPrefix, name.c_str());
+                setParamAlarmStatus(FilterPvaName[i], epicsAlarmUDF);
+                setParamAlarmSeverity(FilterPvaName[i], epicsSevMajor);
+                status = STATUS_INIT_ERROR;
+            } else if (epics::pvDatabase::PVDatabase::getMaster()->addRecord(m_filters[i].record) == false) {
+                LOG_ERROR("Failed to register filtered PVA record '%s%s'", pvPrefix, name.c_str());
+                setParamAlarmStatus(FilterPvaName[i], epicsAlarmUDF);
+                setParamAlarmSeverity(FilterPvaName[i], epicsSevMajor);
+                status = STATUS_INIT_ERROR;
+            }
+        }
     }
 
     createParam("Status", asynParamInt32, &Status, status);
@@ -2136,11 +2219,38 @@ void PvaNeutronsPlugin::recvDownstream(const DasDataPacketList &packets)
     int nLpsdEvents  = -1;
     int nPixelEvents = -1;
     int nMetaEvents  = -1;
+
+    // Select enabled filters and take their configuration once per batch
+    Filter *filters[NUM_FILTERS];
+    unsigned nFilters = 0;
+    for (unsigned i = 0; i < NUM_FILTERS; i++) {
+        Filter &filter = m_filters[i];
+        if (filter.record && getBooleanParam(FilterEnable[i])) {
+            int pixelMin      = getIntegerParam(FilterPixelMin[i]);
+            int pixelMax      = getIntegerParam(FilterPixelMax[i]);
+            int tofMin        = getIntegerParam(FilterTofMin[i]);
+            int tofMax        = getIntegerParam(FilterTofMax[i]);
+            filter.pixelMin   = pixelMin;
+            filter.pixelRange = pixelMax - pixelMin;
+            filter.tofMin     = tofMin;
+            filter.tofRange   = tofMax - tofMin;
+            filter.typeMask   = getIntegerParam(FilterTypes[i]);
+            filter.nEvents    = 0;
+            // Inverted range would wrap and pass everything, channel is published empty instead
+            if (pixelMax < pixelMin || tofMax < tofMin)
+                filter.typeMask = 0;
+            filters[nFilters++] = &filter;
+        }
+    }
+
     for (const auto &packet: packets) {
         uint32_t nEvents;
         double pCharge = getProtonCharge(packet->getTimeStamp());
+        if (nFilters > 0)
+            updateFilters(packet, pCharge, filters, nFilters);
         switch (packet->getEventsFormat()) {
             case DasDataPacket::EVENT_FMT_ACPC_DIAG:
+            case DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT:
                 if (m_pixelRecord && pixelEn && pixelGood) {
                     pixelGood = m_pixelRecord->update(packet, nEvents, pCharge);
                     nPixelEvents = (nPixelEvents == -1 ? nEvents : nPixelEvents + nEvents);
@@ -2282,9 +2392,52 @@ void PvaNeutronsPlugin::recvDownstream(const DasDataPacketList &packets)
         }
     }
 
+    for (unsigned i = 0; i < nFilters; i++)
+        *filters[i]->cntEvents += filters[i]->nEvents;
+
     callParamCallbacksRatelimit();
 }
 
+struct PvaNeutronsPlugin::FilterEvents {
+    const DasDataPacket *packet;
+    Filter **filters;
+    unsigned nFilters;
+
+    template <typename Traits>
+    void operator()(const Traits &)
+    {
+        uint32_t nEvents = packet->getNumEvents();
+        const typename Traits::Type *events = Traits::events(packet);
+
+        // Single pass over events, each event is checked against all filters
+        // while it's still in cache.
+        for (uint32_t i = 0; i < nEvents; i++) {
+            uint32_t tof = Traits::tof(events[i]);
+            uint32_t pixelid = Traits::pixelid(events[i]);
+            for (unsigned j = 0; j < nFilters; j++) {
+                if (filters[j]->match(tof, pixelid)) {
+                    filters[j]->record->append(tof, pixelid);
+                    filters[j]->nEvents++;
+                }
+            }
+        }
+    }
+};
+
+void PvaNeutronsPlugin::updateFilters(const DasDataPacket *packet, double pCharge, Filter **filters, unsigned nFilters)
+{
+    // Same formats that go to Neutrons channel, including heartbeats
+    DasDataPacket::EventFormat format = packet->getEventsFormat();
+    if (!NeutronFormats::contains(format) && format != DasDataPacket::EVENT_FMT_TIME_CALIB)
+        return;
+
+    // Filtered channels report number of events in published arrays
+    for (unsigned i = 0; i < nFilters; i++)
+        filters[i]->record->publish(packet, filters[i]->record->getNumPending(), pCharge);
+
+    NeutronFormats::dispatch(format, FilterEvents{packet, filters, nFilters});
+}
+
 void PvaNeutronsPlugin::recvDownstream(const RtdlPacketList &packets)
 {
     for (auto &packet: packets) {
@@ -11,6 +11,7 @@
 #define PVA_NEUTRONS_H
 
 #include "BasePlugin.h"
+#include "Event.h"
 #include <pv/sharedVector.h>
 
 /**
@@ -26,6 +27,8 @@ class PvaNeutronsPlugin : public BasePlugin {
             STATUS_SEND_ERROR   = 3,
         };
 
+        static const unsigned NUM_FILTERS = 4; //!< Number of filtered neutron channels
+
         /**
          * Constructor
          *
@@ -72,8 +75,45 @@ class PvaNeutronsPlugin : public BasePlugin {
         std::tr1::shared_ptr<PvaRecordPixel> m_pixelRecord;
         std::tr1::shared_ptr<PvaRecordPixel> m_metaRecord;
 
+        /**
+         * Filtered neutrons channel selecting events by pixel, time of flight and type.
+         */
+        struct Filter {
+            std::tr1::shared_ptr<PvaRecordPixel> record;
+            uint32_t pixelMin;      //!< Lowest pixel id to pass, type and veto bits are ignored
+            uint32_t pixelRange;    //!< Number of pixels to pass minus 1
+            uint32_t tofMin;        //!< Lowest time of flight to pass
+            uint32_t tofRange;      //!< Time of flight window width minus 1
+            uint32_t typeMask;      //!< Bit mask of Event::Pixel::Type to pass, vetoed events are type 8, 0 for inverted ranges
+            uint32_t nEvents;       //!< Number of events passed in current batch
+            Counter *cntEvents;     //!< Number of all events sent on channel
+
+            /**
+             * Check whether event passes all criteria.
+             */
+            bool match(uint32_t tof, uint32_t pixelid) const
+            {
+                uint32_t type = (pixelid & Event::Pixel::VETO_MASK) ? 8 : ((pixelid >> 28) & 0x7);
+                // Unsigned arithmetic wraps values below min above range
+                return ((typeMask >> type) & 0x1) &&
+                       ((pixelid & 0x0FFFFFFF) - pixelMin) <= pixelRange &&
+                       (tof - tofMin) <= tofRange;
+            }
+        };
+        Filter m_filters[NUM_FILTERS];
+
         std::list<std::pair<epicsTime, double>> m_pChargeFifo;
 
+        /**
+         * Populate all enabled filtered channels from a single pass over packet events.
+         */
+        void updateFilters(const DasDataPacket *packet, double pCharge, Filter **filters, unsigned nFilters);
+
+        /**
+         * Matches packet events against filters, specialized for each format.
+         */
+        struct FilterEvents;
+
         // asyn parameters
         int Status;             // See PvaNeutronsPlugin::STATUS_*
         int AcpcPvaName;        // PV name for ACPC diagnostic data
@@ -97,6 +137,14 @@ class PvaNeutronsPlugin : public BasePlugin {
         int MetaPvaName;        // PV name for meta
         int MetaNumEvents;      // Number of events sent on meta channel
         int MetaEnable;         // Enable meta channel
+        int FilterPvaName[NUM_FILTERS];     // PV name for filtered neutrons
+        int FilterCntEvents[NUM_FILTERS];   // Number of all events sent on filtered channel
+        int FilterEnable[NUM_FILTERS];      // Enable filtered channel
+        int FilterPixelMin[NUM_FILTERS];    // Lowest pixel id passed
+        int FilterPixelMax[NUM_FILTERS];    // Highest pixel id passed
+        int FilterTofMin[NUM_FILTERS];      // Lowest time of flight passed
+        int FilterTofMax[NUM_FILTERS];      // Highest time of flight passed
+        int FilterTypes[NUM_FILTERS];       // Bit mask of event types passed
 };
 
 #endif // PVA_NEUTRONS_H
@@ -0,0 +1,202 @@
+/* SocketClient.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "SocketClient.h"
+#include "HugePages.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#define THREAD_INTERVAL_MS      100     // Thread resolution time to exit in milliseconds
+#define EPOLL_TAG_SOCKET        0
+#define EPOLL_TAG_WAKEUP        1
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SocketClient::SocketClient(const std::string &threadName)
+    : m_thread(threadName.c_str(), std::bind(&SocketClient::writer, this, std::placeholders::_1),
+               epicsThreadGetStackSize(epicsThreadStackMedium), epicsThreadPriorityMedium)
+{
+    // Checked in attach()
+    m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+SocketClient::~SocketClient()
+{
+    detach();
+    if (m_wakeup != -1)
+        close(m_wakeup);
+    if (m_queue)
+        HugePages::release(m_queue);
+}
+
+bool SocketClient::attach(int sock, const std::string &ip, uint32_t queueSize, Policy policy)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_attached || m_wakeup == -1)
+        return false;
+
+    if (m_queueSize != queueSize) {
+        if (m_queue)
+            HugePages::release(m_queue);
+        m_queueSize = 0;
+        m_queue = static_cast<uint8_t *>(HugePages::allocate(queueSize, "Can't allocate SocketClient queue"));
+        if (!m_queue)
+            return false;
+        m_queueSize = queueSize;
+    }
+
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll == -1)
+        return false;
+    // Socket is edge triggered, writer only waits for it after write would block
+    struct epoll_event event;
+    event.events = EPOLLOUT | EPOLLET;
+    event.data.u32 = EPOLL_TAG_SOCKET;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, sock, &event) != 0) {
+        close(m_epoll);
+        m_epoll = -1;
+        return false;
+    }
+    event.events = EPOLLIN;
+    event.data.u32 = EPOLL_TAG_WAKEUP;
+    (void)epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &event);
+
+    uint64_t counter;
+    while (read(m_wakeup, &counter, sizeof(counter)) > 0);
+
+    m_sock = sock;
+    m_ip = ip;
+    m_policy = policy;
+    m_produced = 0;
+    m_consumed = 0;
+    m_dropped = 0;
+    m_error = 0;
+    m_lastWrite = now();
+    m_attached = true;
+
+    m_thread.start();
+    return true;
+}
+
+void SocketClient::detach()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_attached)
+            return;
+        // No producer will touch queue from now on
+        m_attached = false;
+    }
+
+    m_thread.stop();
+
+    close(m_epoll);
+    m_epoll = -1;
+    close(m_sock);
+    m_sock = -1;
+}
+
+std::string SocketClient::getIp()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ip;
+}
+
+double SocketClient::getInactive() const
+{
+    if (!m_attached || m_produced == m_consumed)
+        return 0.0;
+    return std::max(0.0, now() - m_lastWrite);
+}
+
+bool SocketClient::push(const void *data, uint32_t length)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_attached || m_error != 0)
+        return false;
+
+    uint64_t produced = m_produced;
+    uint64_t used = produced - m_consumed;
+    if (length > m_queueSize - used) {
+        if (m_policy == POLICY_DROP) {
+            m_dropped++;
+        } else {
+            // Writer notices and exits, plugin detaches client
+            m_error = ENOBUFS;
+            uint64_t one = 1;
+            (void)write(m_wakeup, &one, sizeof(one));
+        }
+        return false;
+    }
+
+    uint32_t offset = produced % m_queueSize;
+    uint32_t head = std::min(length, m_queueSize - offset);
+    memcpy(m_queue + offset, data, head);
+    memcpy(m_queue, static_cast<const uint8_t *>(data) + head, length - head);
+    m_produced = produced + length;
+
+    // Writer only sleeps on wakeup event when it found queue empty
+    if (used == 0) {
+        uint64_t one = 1;
+        (void)write(m_wakeup, &one, sizeof(one));
+    }
+    return true;
+}
+
+void SocketClient::wait(int timeout)
+{
+    struct epoll_event events[2];
+    int n = epoll_wait(m_epoll, events, 2, timeout);
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.u32 == EPOLL_TAG_WAKEUP) {
+            uint64_t counter;
+            (void)read(m_wakeup, &counter, sizeof(counter));
+        }
+    }
+}
+
+void SocketClient::writer(epicsEvent *shutdown)
+{
+    while (shutdown->tryWait() == false && m_error == 0) {
+        uint64_t consumed = m_consumed;
+        uint64_t available = m_produced - consumed;
+        if (available == 0) {
+            m_lastWrite = now();
+            wait(THREAD_INTERVAL_MS);
+            continue;
+        }
+
+        uint32_t offset = consumed % m_queueSize;
+        size_t length = std::min<uint64_t>(available, m_queueSize - offset);
+        ssize_t sent = ::send(m_sock, m_queue + offset, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent > 0) {
+            m_consumed = consumed + sent;
+            m_lastWrite = now();
+        } else if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            wait(THREAD_INTERVAL_MS);
+        } else if (sent == -1 && errno == EINTR) {
+            continue;
+        } else {
+            m_error = (sent == 0 ? ENOSPC : errno);
+        }
+    }
+}
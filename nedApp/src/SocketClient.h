@@ -0,0 +1,160 @@
+/* SocketClient.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef SOCKET_CLIENT_H
+#define SOCKET_CLIENT_H
+
+#include "Thread.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+/**
+ * Client connection slot with its own send queue and writer thread.
+ *
+ * Data is pushed into a bounded queue and written to socket by a
+ * dedicated thread that waits for the socket to become writable using
+ * epoll. Producers never block on the socket, a slow client only
+ * fills its own queue. When the queue can not take the complete
+ * message, policy selects whether message is dropped for this client
+ * or client is marked as failed and must be disconnected. Messages are
+ * never split, client either receives the complete message or nothing.
+ *
+ * Slot object and its thread live for the lifetime of the plugin,
+ * attach() and detach() assign socket to it. push() can be called from
+ * any number of threads concurrently with attach() and detach().
+ */
+class SocketClient {
+    public:
+        /**
+         * Action when message doesn't fit the queue.
+         */
+        enum Policy {
+            POLICY_DISCONNECT   = 0,    //!< Never lose data, fail client when queue is full
+            POLICY_DROP         = 1,    //!< Drop message for this client, keep connection
+        };
+
+        /**
+         * Create slot and writer thread, no socket attached.
+         *
+         * @param[in] threadName Name of writer thread
+         */
+        SocketClient(const std::string &threadName);
+
+        /**
+         * Detach socket and destroy queue.
+         */
+        ~SocketClient();
+
+        /**
+         * Assign connected socket to this slot and start writer thread.
+         *
+         * Queue is reallocated only when its size changes. Statistics
+         * are reset.
+         *
+         * @param[in] sock Connected socket, slot takes ownership
+         * @param[in] ip Client IP address for informational purposes
+         * @param[in] queueSize Send queue size in bytes
+         * @param[in] policy What to do when message doesn't fit queue
+         * @return false when slot is already used or system resources can't
+         *         be allocated, errno describes the error then
+         */
+        bool attach(int sock, const std::string &ip, uint32_t queueSize, Policy policy);
+
+        /**
+         * Stop writer thread and close socket.
+         *
+         * Data still in queue is discarded.
+         */
+        void detach();
+
+        /**
+         * Copy message to send queue, never blocks.
+         *
+         * @return true when message was queued, false when dropped or
+         *         no client is attached.
+         */
+        bool push(const void *data, uint32_t length);
+
+        /**
+         * Is there a socket attached to this slot?
+         */
+        bool isAttached() const { return m_attached; }
+
+        /**
+         * Is socket attached but no longer usable and should be detached?
+         */
+        bool isFailed() const { return (m_error != 0); }
+
+        /**
+         * Return errno describing why client failed, ENOBUFS when queue overflowed.
+         */
+        int getError() const { return m_error; }
+
+        /**
+         * Return socket file descriptor, -1 when not attached.
+         */
+        int getSocket() const { return m_sock; }
+
+        /**
+         * Return IP address of attached client.
+         */
+        std::string getIp();
+
+        /**
+         * Return number of bytes written to socket since attached.
+         */
+        uint64_t getSentBytes() const { return m_consumed; }
+
+        /**
+         * Return number of bytes waiting in queue.
+         */
+        uint32_t getQueuedBytes() const { return (m_produced - m_consumed); }
+
+        /**
+         * Return number of messages not queued due to queue full.
+         */
+        uint32_t getDroppedMessages() const { return m_dropped; }
+
+        /**
+         * Return number of seconds since data was last written to socket
+         * while there was data in queue, 0 when queue is empty.
+         */
+        double getInactive() const;
+
+    private:
+        Thread m_thread;                        //!< Writer thread
+        std::mutex m_mutex;                     //!< Serializes producers with each other and attach/detach
+        int m_sock{-1};                         //!< Socket file descriptor, -1 when not attached
+        int m_epoll{-1};                        //!< Waits for socket writable or new data
+        int m_wakeup{-1};                       //!< Eventfd signaled when data is pushed to empty queue
+        std::string m_ip;                       //!< Client IP address
+        Policy m_policy{POLICY_DISCONNECT};     //!< Queue full policy
+        uint8_t *m_queue{nullptr};              //!< Send queue buffer
+        uint32_t m_queueSize{0};                //!< Send queue size in bytes
+        std::atomic<bool> m_attached{false};    //!< Socket assigned and writer running
+        std::atomic<int> m_error{0};            //!< Non-zero when client failed
+        std::atomic<uint64_t> m_produced{0};    //!< Total bytes pushed to queue, only producers modify
+        std::atomic<uint64_t> m_consumed{0};    //!< Total bytes written to socket, only writer modifies
+        std::atomic<uint32_t> m_dropped{0};     //!< Messages not queued
+        std::atomic<double> m_lastWrite{0.0};   //!< Monotonic time when writer last made progress or found queue empty
+
+        /**
+         * Writer thread function.
+         */
+        void writer(epicsEvent *shutdown);
+
+        /**
+         * Wait for socket to become writable or new data in queue.
+         */
+        void wait(int timeout);
+};
+
+#endif // SOCKET_CLIENT_H
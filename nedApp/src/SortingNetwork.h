@@ -0,0 +1,177 @@
+/* SortingNetwork.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef SORTING_NETWORK_H
+#define SORTING_NETWORK_H
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Fixed-size sorting networks for ranking small arrays of counts.
+ *
+ * Detector raw events carry a handful of photon counts per dimension and
+ * processing needs channel indexes ordered by counts. A sorting network is
+ * a fixed sequence of compare-exchange operations that doesn't depend on
+ * data, it needs no heap, has no data dependent branches and compiler can
+ * keep the whole array in registers.
+ *
+ * Networks are provided for sizes used by detectors, 7, 11 and 14. They
+ * use minimal known number of comparators and were verified with 0-1
+ * principle on all 2^N binary inputs.
+ *
+ * rankDesc() sorts counts in descending order and returns indexes. Count
+ * and index are packed in a single key so that all keys are unique, equal
+ * counts are ordered by ascending index just like a stable sort would.
+ *
+ * Batch variant of rankDesc() ranks many arrays at once. Keys are laid out
+ * as structure of arrays, Lanes holds the same position of all arrays and
+ * every compare-exchange is a loop over lanes that compiler vectorizes.
+ */
+namespace SortingNetwork {
+
+    /**
+     * Compare-exchange, larger value goes to the first position.
+     */
+    template <typename T>
+    inline void cswap(T &a, T &b)
+    {
+        T hi = std::max(a, b);
+        T lo = std::min(a, b);
+        a = hi;
+        b = lo;
+    }
+
+    /**
+     * Same key position of L arrays.
+     */
+    template <size_t L>
+    struct Lanes {
+        uint16_t key[L];
+    };
+
+    /**
+     * Compare-exchange all lanes.
+     */
+    template <size_t L>
+    inline void cswap(Lanes<L> &a, Lanes<L> &b)
+    {
+        for (size_t i = 0; i < L; i++)
+            cswap(a.key[i], b.key[i]);
+    }
+
+    /**
+     * Network of N inputs.
+     *
+     * Only specializations for supported sizes exist.
+     */
+    template <size_t N> struct Network;
+
+    /**
+     * 7 inputs, 16 comparators.
+     */
+    template <> struct Network<7> {
+        template <typename T> static inline void sortDesc(T *k)
+        {
+            cswap(k[0],k[6]); cswap(k[2],k[3]); cswap(k[4],k[5]); cswap(k[0],k[2]); cswap(k[1],k[4]);
+            cswap(k[3],k[6]); cswap(k[0],k[1]); cswap(k[2],k[5]); cswap(k[3],k[4]); cswap(k[1],k[2]);
+            cswap(k[4],k[6]); cswap(k[2],k[3]); cswap(k[4],k[5]); cswap(k[1],k[2]); cswap(k[3],k[4]);
+            cswap(k[5],k[6]);
+        }
+    };
+
+    /**
+     * 11 inputs, 35 comparators.
+     */
+    template <> struct Network<11> {
+        template <typename T> static inline void sortDesc(T *k)
+        {
+            cswap(k[0],k[9]); cswap(k[1],k[6]); cswap(k[2],k[4]); cswap(k[3],k[7]); cswap(k[5],k[8]);
+            cswap(k[0],k[1]); cswap(k[3],k[5]); cswap(k[4],k[10]); cswap(k[6],k[9]); cswap(k[7],k[8]);
+            cswap(k[1],k[3]); cswap(k[2],k[5]); cswap(k[4],k[7]); cswap(k[8],k[10]); cswap(k[0],k[4]);
+            cswap(k[1],k[2]); cswap(k[3],k[7]); cswap(k[5],k[9]); cswap(k[6],k[8]); cswap(k[0],k[1]);
+            cswap(k[2],k[6]); cswap(k[4],k[5]); cswap(k[7],k[8]); cswap(k[9],k[10]); cswap(k[2],k[4]);
+            cswap(k[3],k[6]); cswap(k[5],k[7]); cswap(k[8],k[9]); cswap(k[1],k[2]); cswap(k[3],k[4]);
+            cswap(k[5],k[6]); cswap(k[7],k[8]); cswap(k[2],k[3]); cswap(k[4],k[5]); cswap(k[6],k[7]);
+        }
+    };
+
+    /**
+     * 14 inputs, 51 comparators.
+     */
+    template <> struct Network<14> {
+        template <typename T> static inline void sortDesc(T *k)
+        {
+            cswap(k[0],k[1]); cswap(k[2],k[3]); cswap(k[4],k[5]); cswap(k[6],k[7]); cswap(k[8],k[9]);
+            cswap(k[10],k[11]); cswap(k[12],k[13]); cswap(k[0],k[2]); cswap(k[1],k[3]); cswap(k[4],k[8]);
+            cswap(k[5],k[9]); cswap(k[10],k[12]); cswap(k[11],k[13]); cswap(k[0],k[4]); cswap(k[1],k[2]);
+            cswap(k[3],k[7]); cswap(k[5],k[8]); cswap(k[6],k[10]); cswap(k[9],k[13]); cswap(k[11],k[12]);
+            cswap(k[0],k[6]); cswap(k[1],k[5]); cswap(k[3],k[9]); cswap(k[4],k[10]); cswap(k[7],k[13]);
+            cswap(k[8],k[12]); cswap(k[2],k[10]); cswap(k[3],k[11]); cswap(k[4],k[6]); cswap(k[7],k[9]);
+            cswap(k[1],k[3]); cswap(k[2],k[8]); cswap(k[5],k[11]); cswap(k[6],k[7]); cswap(k[10],k[12]);
+            cswap(k[1],k[4]); cswap(k[2],k[6]); cswap(k[3],k[5]); cswap(k[7],k[11]); cswap(k[8],k[10]);
+            cswap(k[9],k[12]); cswap(k[2],k[4]); cswap(k[3],k[6]); cswap(k[5],k[8]); cswap(k[7],k[10]);
+            cswap(k[9],k[11]); cswap(k[3],k[4]); cswap(k[5],k[6]); cswap(k[7],k[8]); cswap(k[9],k[10]);
+            cswap(k[6],k[7]);
+        }
+    };
+
+    /**
+     * Return indexes of values sorted by value in descending order.
+     *
+     * Equal values are ordered by ascending index.
+     *
+     * @param[in] values Array of N counts
+     * @param[out] indexes Array of N indexes, indexes[0] points to max value
+     */
+    template <size_t N>
+    inline void rankDesc(const uint8_t *values, uint8_t *indexes)
+    {
+        static_assert(N <= 256, "Index must fit in key");
+        uint16_t keys[N];
+        for (size_t i = 0; i < N; i++)
+            keys[i] = (values[i] << 8) | (0xFF - i);
+        Network<N>::sortDesc(keys);
+        for (size_t i = 0; i < N; i++)
+            indexes[i] = 0xFF - (keys[i] & 0xFF);
+    }
+
+    /**
+     * Rank up to L arrays of counts at once, batch variant of rankDesc().
+     *
+     * Arrays are read with given stride, typically counts are fields of
+     * consecutive events. Lanes beyond nArrays are ranked as well but
+     * their results are meaningless.
+     *
+     * @param[in] values First count of the first array
+     * @param[in] stride Distance in bytes between consecutive arrays
+     * @param[in] nArrays Number of arrays, at most L
+     * @param[out] ranks Array of N lanes, ranks[r].key[a] is index of
+     *             r-th largest count of array a
+     */
+    template <size_t N, size_t L>
+    inline void rankDesc(const uint8_t *values, size_t stride, size_t nArrays, Lanes<L> *ranks)
+    {
+        static_assert(N <= 256, "Index must fit in key");
+        for (size_t i = 0; i < N; i++) {
+            for (size_t a = 0; a < nArrays; a++)
+                ranks[i].key[a] = (values[a*stride + i] << 8) | (0xFF - i);
+            for (size_t a = nArrays; a < L; a++)
+                ranks[i].key[a] = 0;
+        }
+        Network<N>::sortDesc(ranks);
+        for (size_t i = 0; i < N; i++) {
+            for (size_t a = 0; a < L; a++)
+                ranks[i].key[a] = 0xFF - (ranks[i].key[a] & 0xFF);
+        }
+    }
+};
+
+#endif // SORTING_NETWORK_H
@@ -8,11 +8,11 @@
  */
 
 #include "Event.h"
+#include "EventTraits.h"
 #include "Log.h"
 #include "StatPlugin.h"
 
 #include <algorithm>
-#include <climits>
 
 EPICS_REGISTER_PLUGIN(StatPlugin, 2, "Port name", string, "Parent ports", string);
 
@@ -35,32 +35,56 @@ StatPlugin::StatPlugin(const char *portName, const char *parentPlugins)
     createParam("PChargeData",  asynParamFloat64, &PChargeData,  0.0); // READ - Proton charge updated with every acquisition frame
     createParam("RtdlCacheSize",asynParamInt32,   &RtdlCacheSize, 10); // WRITE - Number of RTDL data to be cached
 
+    m_cmdPkts       = createCounter(CmdPkts);
+    m_cmdBytes      = createCounter(CmdBytes);
+    m_neutronCnts   = createCounter(NeutronCnts);
+    m_neutronBytes  = createCounter(NeutronBytes);
+    m_acqFrameCnts  = createCounter(AcqFrameCnts);
+    m_metaCnts      = createCounter(MetaCnts);
+    m_metaBytes     = createCounter(MetaBytes);
+    m_errorPkts     = createCounter(ErrorPkts);
+    m_rtdlPkts      = createCounter(RtdlPkts);
+    m_rtdlBytes     = createCounter(RtdlBytes);
+    m_rtdlTimes     = createCounter(RtdlTimes);
+    m_totBytes      = createCounter(TotBytes);
+
     BasePlugin::connect(parentPlugins, {MsgDasData, MsgDasCmd, MsgDasRtdl, MsgError});
 }
 
+struct StatPlugin::CountEvents {
+    StatPlugin *plugin;
+    DataTotals &totals;
+    const DasDataPacket *packet;
+
+    template <typename Traits>
+    void operator()(const Traits &)
+    {
+        uint32_t nEvents = packet->getNumEvents();
+        if (Traits::format == DasDataPacket::EVENT_FMT_META) {
+            totals.metaCnts += nEvents;
+            totals.metaBytes += nEvents * Traits::size;
+        } else if (Traits::format == DasDataPacket::EVENT_FMT_TIME_CALIB) {
+            if (plugin->isTimestampUnique(packet->getTimeStamp(), plugin->m_frameTimes))
+                totals.acqFrameCnts += 1;
+        } else {
+            totals.neutronCnts += nEvents;
+            totals.neutronBytes += nEvents * Traits::size;
+        }
+    }
+};
+
 void StatPlugin::recvDownstream(const DasDataPacketList &packets)
 {
-    uint64_t neutronCnts  = getDoubleParam(NeutronCnts);
-    uint64_t neutronBytes = getDoubleParam(NeutronBytes);
-    uint64_t acqFrameCnts = getDoubleParam(AcqFrameCnts);
-    uint64_t metaCnts     = getDoubleParam(MetaCnts);
-    uint64_t metaBytes    = getDoubleParam(MetaBytes);
-    uint64_t totBytes     = getDoubleParam(TotBytes);
+    DataTotals totals;
+    uint64_t totBytes = 0;
 
     for (const auto &packet: packets) {
-        uint32_t nEvents = packet->getNumEvents();
         totBytes += packet->getLength();
 
-        if (packet->getEventsFormat() == DasDataPacket::EVENT_FMT_META) {
-            metaBytes += nEvents * packet->getEventsSize();
-            metaCnts += nEvents;
-
-        } else if (packet->getEventsFormat() == DasDataPacket::EVENT_FMT_TIME_CALIB) {
-            if (isTimestampUnique(packet->getTimeStamp(), m_frameTimes))
-                acqFrameCnts += 1;
-        } else {
-            neutronBytes += nEvents * packet->getEventsSize();
-            neutronCnts += nEvents;
+        if (!AllEventFormats::dispatch(packet->getEventsFormat(), CountEvents{this, totals, packet})) {
+            // Raw formats without known event structure, count the payload
+            totals.neutronCnts += packet->getNumEvents();
+            totals.neutronBytes += packet->getLength() - sizeof(DasDataPacket);
         }
 
         double pcharge = getDataProtonCharge(packet->getTimeStamp());
@@ -72,42 +96,35 @@ void StatPlugin::recvDownstream(const DasDataPacketList &packets)
         }
     }
 
-    setDoubleParam(NeutronCnts,     neutronCnts % LLONG_MAX);
-    setDoubleParam(NeutronBytes,    neutronBytes % LLONG_MAX);
-    setDoubleParam(AcqFrameCnts,    acqFrameCnts % LLONG_MAX);
-    setDoubleParam(MetaCnts,        metaCnts % LLONG_MAX);
-    setDoubleParam(MetaBytes,       metaBytes % LLONG_MAX);
-    setDoubleParam(TotBytes,        totBytes % LLONG_MAX);
-    callParamCallbacksRatelimit();
+    // Parameters are updated by counters thread
+    *m_neutronCnts  += totals.neutronCnts;
+    *m_neutronBytes += totals.neutronBytes;
+    *m_acqFrameCnts += totals.acqFrameCnts;
+    *m_metaCnts     += totals.metaCnts;
+    *m_metaBytes    += totals.metaBytes;
+    *m_totBytes     += totBytes;
 }
 
 void StatPlugin::recvDownstream(const DasCmdPacketList &packets)
 {
-    uint64_t cmdPkts  = getDoubleParam(CmdPkts) + packets.size();
-    uint64_t cmdBytes = getDoubleParam(CmdBytes);
-    uint64_t totBytes = getDoubleParam(TotBytes);
+    uint64_t cmdBytes = 0;
 
     for (auto it = packets.begin(); it != packets.end(); it++) {
         cmdBytes += (*it)->getLength();
-        totBytes += (*it)->getLength();
     }
 
-    setDoubleParam(CmdPkts,         cmdPkts % LLONG_MAX);
-    setDoubleParam(CmdBytes,        cmdBytes % LLONG_MAX);
-    setDoubleParam(TotBytes,        totBytes % LLONG_MAX);
-    callParamCallbacks();
+    *m_cmdPkts  += packets.size();
+    *m_cmdBytes += cmdBytes;
+    *m_totBytes += cmdBytes;
 }
 
 void StatPlugin::recvDownstream(const RtdlPacketList &packets)
 {
-    uint64_t rtdlTimes  = getDoubleParam(RtdlTimes);
-    uint64_t rtdlBytes  = getDoubleParam(RtdlBytes);
-    uint64_t rtdlPkts   = getDoubleParam(RtdlPkts) + packets.size();
-    uint64_t totBytes   = getDoubleParam(TotBytes);
+    uint64_t rtdlTimes  = 0;
+    uint64_t rtdlBytes  = 0;
 
     for (const auto &packet: packets) {
         rtdlBytes += packet->getLength();
-        totBytes += packet->getLength();
         if (cacheRtdl(packet) == true) {
             rtdlTimes += 1;
         }
@@ -122,25 +139,22 @@ void StatPlugin::recvDownstream(const RtdlPacketList &packets)
 
     }
 
-    setDoubleParam(RtdlTimes,       rtdlTimes % LLONG_MAX);
-    setDoubleParam(RtdlBytes,       rtdlBytes % LLONG_MAX);
-    setDoubleParam(RtdlPkts,        rtdlPkts % LLONG_MAX);
-    setDoubleParam(TotBytes,        totBytes % LLONG_MAX);
-    callParamCallbacks();
+    *m_rtdlTimes += rtdlTimes;
+    *m_rtdlBytes += rtdlBytes;
+    *m_rtdlPkts  += packets.size();
+    *m_totBytes  += rtdlBytes;
 }
 
 void StatPlugin::recvDownstream(const ErrorPacketList &packets)
 {
-    uint64_t errorPkts  = getDoubleParam(ErrorPkts) + packets.size();
-    uint64_t totBytes   = getDoubleParam(TotBytes);
+    uint64_t errorBytes = 0;
 
     for (const auto &packet: packets) {
-        totBytes += packet->getLength();
+        errorBytes += packet->getLength();
     }
 
-    setDoubleParam(ErrorPkts,       errorPkts % LLONG_MAX);
-    setDoubleParam(TotBytes,        totBytes % LLONG_MAX);
-    callParamCallbacks();
+    *m_errorPkts += packets.size();
+    *m_totBytes  += errorBytes;
 }
 
 bool StatPlugin::isTimestampUnique(const epicsTimeStamp &timestamp, std::list<epicsTime> &que)
@@ -191,6 +205,6 @@ double StatPlugin::getDataProtonCharge(const epicsTimeStamp &timestamp)
             return std::get<1>(*it);
         }
     }
-    LOG_WARN("No RTDL information cached for %u.%09u", timestamp.secPastEpoch, timestamp.nsec);
+    LOG_WARN_RATELIMIT("No RTDL information cached for %u.%09u", timestamp.secPastEpoch, timestamp.nsec);
     return -1.0;
 }
@@ -45,6 +45,23 @@ class StatPlugin : public BasePlugin {
          */
         void recvDownstream(const ErrorPacketList &packets);
 
+    private: // types
+        /**
+         * Data packets statistics of single batch.
+         */
+        struct DataTotals {
+            uint64_t neutronCnts{0};
+            uint64_t neutronBytes{0};
+            uint64_t acqFrameCnts{0};
+            uint64_t metaCnts{0};
+            uint64_t metaBytes{0};
+        };
+
+        /**
+         * Adds packet events to totals, category is selected at compile time for each format.
+         */
+        struct CountEvents;
+
     private: // function
 
         /**
@@ -92,6 +109,18 @@ class StatPlugin : public BasePlugin {
     private:
         std::list<std::tuple<epicsTime,double,bool>> m_dataPcharge; //!< Cache of data acq frames pcharge
         std::list<epicsTime> m_frameTimes; //!< Que of unique frame times
+        Counter *m_cmdPkts;
+        Counter *m_cmdBytes;
+        Counter *m_neutronCnts;
+        Counter *m_neutronBytes;
+        Counter *m_acqFrameCnts;
+        Counter *m_metaCnts;
+        Counter *m_metaBytes;
+        Counter *m_errorPkts;
+        Counter *m_rtdlPkts;
+        Counter *m_rtdlBytes;
+        Counter *m_rtdlTimes;
+        Counter *m_totBytes;
 
     private: // asyn parameters
         int CmdPkts;
@@ -18,7 +18,7 @@ EPICS_REGISTER_PLUGIN(StateAnalyzerPlugin, 2, "Port name", string, "Parent plugi
 
 StateAnalyzerPlugin::StateAnalyzerPlugin(const char *portName, const char *parentPlugins)
     : BasePlugin(portName, 1, asynFloat64Mask|asynOctetMask, asynFloat64Mask|asynOctetMask)
-    , m_processThread("StateAnalyzerThread", std::bind(&StateAnalyzerPlugin::processThread, this, std::placeholders::_1))
+    , m_processThread((std::string(portName) + "_Process").c_str(), std::bind(&StateAnalyzerPlugin::processThread, this, std::placeholders::_1))
     , FastDevices(4)
     , SlowDevices(2)
 {
@@ -0,0 +1,287 @@
+/* SyntheticCircularBuffer.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "SyntheticCircularBuffer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <epicsThread.h>
+#include <new>
+
+#define TOF_UNITS_PER_SEC   10000000    //!< Time of flight is in 100ns units
+
+SyntheticCircularBuffer::SyntheticCircularBuffer()
+    : m_buffer(BUFFER_SIZE)
+    , m_rng(0x2545F4914F6CDD1DULL)
+{}
+
+void SyntheticCircularBuffer::setConfig(const Config &config)
+{
+    m_lock.lock();
+    m_config = config;
+    m_config.eventsPerPacket = std::min(std::max(m_config.eventsPerPacket, 1U), 65535U);
+    m_config.pulseRate = std::max(m_config.pulseRate, 0.1);
+    m_config.eventRate = std::max(m_config.eventRate, 0.0);
+    m_config.errorRate = std::min(std::max(m_config.errorRate, 0.0), 1.0);
+    if (m_config.pixelMax < m_config.pixelMin)
+        std::swap(m_config.pixelMin, m_config.pixelMax);
+    m_restart = true;
+    m_lock.unlock();
+}
+
+SyntheticCircularBuffer::Config SyntheticCircularBuffer::getConfig()
+{
+    m_lock.lock();
+    Config config = m_config;
+    m_lock.unlock();
+    return config;
+}
+
+void SyntheticCircularBuffer::start()
+{
+    m_lock.lock();
+    m_running = true;
+    m_restart = true;
+    m_lock.unlock();
+}
+
+void SyntheticCircularBuffer::stop()
+{
+    m_lock.lock();
+    m_running = false;
+    m_lock.unlock();
+}
+
+bool SyntheticCircularBuffer::isRunning()
+{
+    m_lock.lock();
+    bool running = m_running;
+    m_lock.unlock();
+    return running;
+}
+
+void SyntheticCircularBuffer::clear()
+{
+    m_lock.lock();
+    m_restart = true;
+    m_lock.unlock();
+}
+
+int SyntheticCircularBuffer::wait(void **data, uint32_t *len, double timeout)
+{
+    epicsTime start = epicsTime::getCurrent();
+
+    while (true) {
+        double delay = 0.01;
+
+        m_lock.lock();
+        bool running = m_running;
+        if (m_restart) {
+            m_active = m_config;
+            m_restart = false;
+            restart();
+        }
+        m_lock.unlock();
+
+        if (running) {
+            uint32_t used = m_used;
+            delay = generate();
+            BaseCircularBuffer::push(m_buffer.data() + used, m_used - used);
+        }
+
+        if (m_used > 0) {
+            *data = m_buffer.data();
+            *len = m_used;
+            return 0;
+        }
+
+        double remain = timeout - (epicsTime::getCurrent() - start);
+        if (remain <= 0.0)
+            break;
+        epicsThreadSleep(std::min(delay, remain));
+    }
+
+    return -ETIME;
+}
+
+int SyntheticCircularBuffer::consume(uint32_t len)
+{
+    len = std::min(len, m_used);
+    if (len < m_used) {
+        memmove(m_buffer.data(), m_buffer.data() + len, m_used - len);
+    }
+    m_used -= len;
+
+    // Rate-limit update
+    return BaseCircularBuffer::consume(len);
+}
+
+void SyntheticCircularBuffer::restart()
+{
+    // Raw formats carry ADC samples after tof and position, fill them
+    // with plausible 12-bit values once and copy for every event.
+    uint32_t eventSize = DasDataPacket::getEventsSize(m_active.format);
+    m_template.resize(std::max(eventSize, 8U));
+    for (size_t i = 0; i < m_template.size(); i += 2) {
+        uint16_t sample = 200 + random() % 3800;
+        memcpy(&m_template[i], &sample, std::min(sizeof(sample), m_template.size() - i));
+    }
+
+    m_startTime = epicsTime::getCurrent();
+    m_pulseIndex = 0;
+    m_pulseStarted = false;
+    m_pulseEvents = 0;
+    m_eventsFraction = 0.0;
+}
+
+double SyntheticCircularBuffer::generate()
+{
+    while (true) {
+        if (!m_pulseStarted) {
+            if (m_active.realTime) {
+                double due = m_pulseIndex / m_active.pulseRate;
+                double now = epicsTime::getCurrent() - m_startTime;
+                if (now < due)
+                    return (due - now);
+            }
+            if (!startPulse())
+                return 0.0;
+        }
+
+        while (m_pulseEvents > 0) {
+            if (!generateDataPacket())
+                return 0.0;
+        }
+        m_pulseStarted = false;
+    }
+}
+
+bool SyntheticCircularBuffer::startPulse()
+{
+    uint32_t rtdlLen = RtdlPacket::getLength(7);
+    uint32_t calibLen = DasDataPacket::getLength(DasDataPacket::EVENT_FMT_TIME_CALIB, 0);
+    if ((m_buffer.size() - m_used) < (rtdlLen + calibLen))
+        return false;
+
+    m_pulseTime = m_startTime + m_pulseIndex / m_active.pulseRate;
+
+    uint32_t sec = m_pulseTime.secPastEpoch;
+    uint32_t nsec = m_pulseTime.nsec;
+    m_frames.clear();
+    m_frames.emplace_back(1, sec >> 8);
+    m_frames.emplace_back(2, (sec & 0xFF) | ((nsec & 0xFF) << 16));
+    m_frames.emplace_back(3, nsec >> 8);
+    m_frames.emplace_back(17, RtdlHeader::RTDL_FLAVOR_TARGET_1);
+    m_frames.emplace_back(24, 0);
+    m_frames.emplace_back(25, m_pulseIndex % 600);
+    m_frames.emplace_back(35, 1500000);
+    RtdlPacket::init(m_buffer.data() + m_used, m_buffer.size() - m_used, m_frames);
+    m_used += rtdlLen;
+
+    // Timing calibration packet is sent by hardware with every acquisition frame
+    DasDataPacket::init(m_buffer.data() + m_used, m_buffer.size() - m_used, DasDataPacket::EVENT_FMT_TIME_CALIB, m_pulseTime, 0);
+    m_used += calibLen;
+
+    double events = m_active.eventRate / m_active.pulseRate + m_eventsFraction;
+    m_pulseEvents = events;
+    m_eventsFraction = events - m_pulseEvents;
+
+    uint32_t period = TOF_UNITS_PER_SEC / m_active.pulseRate;
+    m_tofStep = std::max(period / std::max(m_pulseEvents, 1U), 1U);
+    m_tof = 0;
+
+    m_pulseStarted = true;
+    m_pulseIndex++;
+    m_nPulses++;
+    return true;
+}
+
+bool SyntheticCircularBuffer::generateDataPacket()
+{
+    uint32_t nEvents = std::min(m_pulseEvents, m_active.eventsPerPacket);
+    uint32_t len = DasDataPacket::getLength(m_active.format, nEvents);
+    if ((m_buffer.size() - m_used) < (len + sizeof(ErrorPacket)))
+        return false;
+
+    epicsTimeStamp timestamp = m_pulseTime;
+    if (m_active.errorRate > 0.0 && random() < m_active.errorRate * 4294967295.0) {
+        m_nErrors++;
+        if (random() & 0x1) {
+            // Report transmission error, data that follows is still valid
+            generateErrorPacket();
+        } else {
+            // Invalid timestamp fails packet integrity check
+            timestamp.nsec = 1000000001;
+        }
+    }
+
+    DasDataPacket *packet = DasDataPacket::init(m_buffer.data() + m_used, m_buffer.size() - m_used, m_active.format, timestamp, nEvents);
+    uint8_t *event = packet->getEvents<uint8_t>();
+    uint32_t eventSize = packet->getEventsSize();
+    uint64_t tofRange = 2 * m_tofStep + 1;
+
+    for (uint32_t i = 0; i < nEvents; i++) {
+        if (eventSize > 8)
+            memcpy(event, m_template.data(), eventSize);
+
+        m_tof += (random() * tofRange) >> 32;
+        uint32_t *fields = reinterpret_cast<uint32_t *>(event);
+        fields[0] = m_tof;
+        fields[1] = nextPixel();
+        event += eventSize;
+    }
+
+    m_used += len;
+    m_pulseEvents -= nEvents;
+    m_nEvents += nEvents;
+    return true;
+}
+
+bool SyntheticCircularBuffer::generateErrorPacket()
+{
+    if ((m_buffer.size() - m_used) < sizeof(ErrorPacket))
+        return false;
+
+    uint8_t *buffer = m_buffer.data() + m_used;
+    memset(buffer, 0, sizeof(ErrorPacket));
+    Packet *packet = new (buffer) Packet(1, Packet::TYPE_ERROR, sizeof(ErrorPacket));
+    ErrorPacket *error = ErrorPacket::cast(packet);
+    error->code = ErrorPacket::TYPE_ERR_CRC;
+    error->crc_count = 1;
+
+    m_used += sizeof(ErrorPacket);
+    return true;
+}
+
+uint32_t SyntheticCircularBuffer::nextPixel()
+{
+    uint64_t range = m_active.pixelMax - m_active.pixelMin + 1ULL;
+
+    switch (m_active.pixelDist) {
+    case DIST_GAUSSIAN:
+    {
+        // Irwin-Hall approximation, sum of 4 uniform samples
+        uint64_t sum = 0;
+        for (int i = 0; i < 4; i++)
+            sum += random();
+        return m_active.pixelMin + ((sum >> 2) * range >> 32);
+    }
+    case DIST_HOTSPOT:
+        if ((random() % 10) != 0) {
+            uint64_t hot = std::max(range / 100, (uint64_t)1);
+            return m_active.pixelMin + ((random() * hot) >> 32);
+        }
+        // fall through
+    case DIST_UNIFORM:
+    default:
+        return m_active.pixelMin + ((random() * range) >> 32);
+    }
+}
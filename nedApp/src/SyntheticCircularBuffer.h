@@ -0,0 +1,232 @@
+/* SyntheticCircularBuffer.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef SYNTHETIC_CIRCULAR_BUFFER_H
+#define SYNTHETIC_CIRCULAR_BUFFER_H
+
+#include "BaseCircularBuffer.h"
+#include "Packet.h"
+
+#include <atomic>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <vector>
+
+/**
+ * Circular buffer generating synthetic detector data.
+ *
+ * Instead of receiving data from hardware, every wait() call produces a
+ * stream of DAS 2.0 packets that look like they came from detectors. Each
+ * neutron pulse starts with RTDL packet and timing calibration packet,
+ * followed by data packets of selected format. Events within a pulse are
+ * sorted by time of flight, pixel ids follow configurable distribution.
+ *
+ * Generator can run in real time where pulses are produced at the
+ * configured pulse rate, or as fast as consumer can take the data which is
+ * useful to find saturation point of the processing pipeline.
+ */
+class SyntheticCircularBuffer : public BaseCircularBuffer {
+    public:
+        /**
+         * Distribution of generated pixel ids.
+         */
+        enum PixelDistribution {
+            DIST_UNIFORM    = 0,    //!< All pixels equally likely
+            DIST_GAUSSIAN   = 1,    //!< Approximately normal around center of range
+            DIST_HOTSPOT    = 2,    //!< 90% of events land in 1% of pixels
+        };
+
+        /**
+         * Generator configuration.
+         */
+        struct Config {
+            DasDataPacket::EventFormat format = DasDataPacket::EVENT_FMT_PIXEL; //!< Events format
+            double eventRate            = 1e6;          //!< Events per second
+            double pulseRate            = 60.0;         //!< Neutron pulses per second
+            uint32_t eventsPerPacket    = 1000;         //!< Max events in single data packet
+            PixelDistribution pixelDist = DIST_UNIFORM; //!< Distribution of pixel ids
+            uint32_t pixelMin           = 0;            //!< Lowest generated pixel id
+            uint32_t pixelMax           = 1023;         //!< Highest generated pixel id
+            double errorRate            = 0.0;          //!< Ratio of corrupted packets, 0 to 1
+            bool realTime               = true;         //!< Produce pulses at pulse rate or as fast as possible
+        };
+
+    private:
+        static const uint32_t BUFFER_SIZE = 8*1024*1024;
+
+        epicsMutex m_lock;                          //!< Protects configuration and run state
+        Config m_config;                            //!< Configuration as set by user
+        bool m_running = false;                     //!< Is generator producing data
+        bool m_restart = true;                      //!< Reset generator state on next wait()
+
+        // Following members are only used from wait() and consume()
+        Config m_active;                            //!< Configuration used by generator
+        std::vector<uint8_t> m_buffer;              //!< Generated packets
+        uint32_t m_used = 0;                        //!< Number of bytes in m_buffer
+        std::vector<uint8_t> m_template;            //!< Event template for current format
+        std::vector<RtdlPacket::RtdlFrame> m_frames;//!< RTDL frames for current pulse
+        uint64_t m_rng;                             //!< Random generator state
+        epicsTime m_startTime;                      //!< Wall time of first pulse
+        epicsTimeStamp m_pulseTime;                 //!< Timestamp of current pulse
+        uint64_t m_pulseIndex = 0;                  //!< Number of pulses started
+        double m_eventsFraction = 0.0;              //!< Fractional events carried to next pulse
+        uint32_t m_pulseEvents = 0;                 //!< Events not yet generated for current pulse
+        uint32_t m_tof = 0;                         //!< Last time of flight in current pulse
+        uint32_t m_tofStep = 1;                     //!< Average time of flight increment
+        bool m_pulseStarted = false;                //!< RTDL for current pulse already generated
+        std::atomic<uint64_t> m_nEvents{0};         //!< Total number of generated events
+        std::atomic<uint64_t> m_nPulses{0};         //!< Total number of generated pulses
+        std::atomic<uint64_t> m_nErrors{0};         //!< Total number of corrupted packets
+
+    public:
+        /**
+         * Constructor allocates buffer.
+         */
+        SyntheticCircularBuffer();
+
+        /**
+         * Replace generator configuration, takes effect on next pulse.
+         */
+        void setConfig(const Config &config);
+
+        /**
+         * Return current configuration.
+         */
+        Config getConfig();
+
+        /**
+         * Allows wait() function to produce data.
+         */
+        void start();
+
+        /**
+         * Stops producing data, wait() will always timeout.
+         */
+        void stop();
+
+        /**
+         * Return true if generator is running.
+         */
+        bool isRunning();
+
+        /**
+         * Overloaded function restarts generator from first pulse.
+         */
+        void clear() override;
+
+        /**
+         * Generate as many packets as allowed by time and buffer size.
+         */
+        int wait(void **data, uint32_t *len, double timeout=0.0) override;
+
+        /**
+         * Acknowledges some amount of data from previous wait().
+         */
+        int consume(uint32_t len) override;
+
+        /**
+         * Return true when no data is available in circular buffer.
+         */
+        bool empty() override
+        {
+            return (m_used == 0);
+        }
+
+        /**
+         * Return buffer used space in bytes.
+         */
+        uint32_t used() override
+        {
+            return m_used;
+        }
+
+        /**
+         * Return buffer size in bytes.
+         */
+        uint32_t size() override
+        {
+            return m_buffer.size();
+        }
+
+        /**
+         * Return total number of generated events.
+         */
+        uint64_t getEventsCount()
+        {
+            return m_nEvents;
+        }
+
+        /**
+         * Return total number of generated neutron pulses.
+         */
+        uint64_t getPulsesCount()
+        {
+            return m_nPulses;
+        }
+
+        /**
+         * Return total number of intentionally corrupted packets.
+         */
+        uint64_t getErrorsCount()
+        {
+            return m_nErrors;
+        }
+
+    private:
+        /**
+         * Fill buffer with packets until buffer is full or next pulse is not due yet.
+         *
+         * @return Seconds until next pulse is due, 0 when buffer is full.
+         */
+        double generate();
+
+        /**
+         * Prepare generator for new configuration and restart pulses.
+         */
+        void restart();
+
+        /**
+         * Start a new pulse, generate RTDL and timing calibration packets.
+         *
+         * @return false when there's not enough space in buffer.
+         */
+        bool startPulse();
+
+        /**
+         * Generate one data packet of the current pulse.
+         *
+         * @return false when there's not enough space in buffer.
+         */
+        bool generateDataPacket();
+
+        /**
+         * Generate error packet as reported by OCC when receiving bad data.
+         *
+         * @return false when there's not enough space in buffer.
+         */
+        bool generateErrorPacket();
+
+        /**
+         * Return next pixel id based on selected distribution.
+         */
+        uint32_t nextPixel();
+
+        /**
+         * Fast xorshift pseudo random generator.
+         */
+        uint32_t random()
+        {
+            m_rng ^= m_rng >> 12;
+            m_rng ^= m_rng << 25;
+            m_rng ^= m_rng >> 27;
+            return (m_rng * 2685821657736338717ULL) >> 32;
+        }
+};
+
+#endif // SYNTHETIC_CIRCULAR_BUFFER_H
@@ -0,0 +1,145 @@
+/* SyntheticSourcePlugin.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#include "Log.h"
+#include "SyntheticSourcePlugin.h"
+
+#include <limits>
+
+EPICS_REGISTER_PLUGIN(SyntheticSourcePlugin, 1, "Port name", string);
+
+SyntheticSourcePlugin::SyntheticSourcePlugin(const char *portName)
+    : BasePortPlugin(portName, 0, asynFloat64Mask|asynOctetMask, asynFloat64Mask|asynOctetMask)
+{
+    SyntheticCircularBuffer::Config config;
+
+    createParam("Enable",       asynParamInt32,     &Enable, 0);                        // WRITE - Start or stop generating data
+    createParam("Running",      asynParamInt32,     &Running, 0);                       // READ - Running status, 0 stopped, 1 running
+    createParam("DataFormat",   asynParamInt32,     &DataFormat, (int)config.format);   // WRITE - Format of generated events
+    createParam("EventRate",    asynParamFloat64,   &EventRate, config.eventRate);      // WRITE - Number of events per second
+    createParam("PulseRate",    asynParamFloat64,   &PulseRate, config.pulseRate);      // WRITE - Number of neutron pulses per second
+    createParam("EventsPerPkt", asynParamInt32,     &EventsPerPkt, (int)config.eventsPerPacket); // WRITE - Max number of events in data packet
+    createParam("PixelDist",    asynParamInt32,     &PixelDist, (int)config.pixelDist); // WRITE - Pixel distribution, 0 uniform, 1 gaussian, 2 hotspot
+    createParam("PixelMin",     asynParamInt32,     &PixelMin, (int)config.pixelMin);   // WRITE - Lowest generated pixel id
+    createParam("PixelMax",     asynParamInt32,     &PixelMax, (int)config.pixelMax);   // WRITE - Highest generated pixel id
+    createParam("ErrorRate",    asynParamFloat64,   &ErrorRate, config.errorRate);      // WRITE - Ratio of corrupted packets, 0 to 1
+    createParam("RealTime",     asynParamInt32,     &RealTime, (int)config.realTime);   // WRITE - Generate pulses at pulse rate or as fast as possible
+    createParam("CntEvents",    asynParamInt32,     &CntEvents, 0);                     // READ - Number of generated events
+    createParam("CntPulses",    asynParamInt32,     &CntPulses, 0);                     // READ - Number of generated pulses
+    createParam("CntErrors",    asynParamInt32,     &CntErrors, 0);                     // READ - Number of corrupted packets
+    callParamCallbacks();
+
+    m_circularBuffer = &m_generator;
+
+    if (!m_processThread) {
+        LOG_ERROR("Failed to create processing thread");
+    } else {
+        m_processThread->start();
+    }
+}
+
+SyntheticSourcePlugin::~SyntheticSourcePlugin()
+{
+    if (m_processThread) m_processThread->stop();
+}
+
+asynStatus SyntheticSourcePlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    if (pasynUser->reason == Enable) {
+        if (value > 0) {
+            configure();
+            m_generator.start();
+        } else {
+            m_generator.stop();
+        }
+        setIntegerParam(Enable, value);
+        setIntegerParam(Running, m_generator.isRunning());
+        callParamCallbacks();
+        return asynSuccess;
+    }
+    if (pasynUser->reason == DataFormat) {
+        switch (value) {
+        case DasDataPacket::EVENT_FMT_PIXEL:
+        case DasDataPacket::EVENT_FMT_BNL_RAW:
+        case DasDataPacket::EVENT_FMT_ACPC_XY_PS:
+        case DasDataPacket::EVENT_FMT_LPSD_RAW:
+        case DasDataPacket::EVENT_FMT_AROC_RAW:
+        case DasDataPacket::EVENT_FMT_CROC_RAW:
+            break;
+        default:
+            LOG_ERROR("Unsupported data format %d", value);
+            return asynError;
+        }
+    }
+    if (pasynUser->reason == PixelDist) {
+        if (value < SyntheticCircularBuffer::DIST_UNIFORM || value > SyntheticCircularBuffer::DIST_HOTSPOT) {
+            LOG_ERROR("Invalid pixel distribution %d", value);
+            return asynError;
+        }
+    }
+    if (pasynUser->reason == DataFormat || pasynUser->reason == EventsPerPkt ||
+        pasynUser->reason == PixelDist || pasynUser->reason == PixelMin ||
+        pasynUser->reason == PixelMax || pasynUser->reason == RealTime) {
+
+        setIntegerParam(pasynUser->reason, value);
+        configure();
+        callParamCallbacks();
+        return asynSuccess;
+    }
+    return BasePortPlugin::writeInt32(pasynUser, value);
+}
+
+asynStatus SyntheticSourcePlugin::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
+{
+    if (pasynUser->reason == EventRate || pasynUser->reason == PulseRate || pasynUser->reason == ErrorRate) {
+        setDoubleParam(pasynUser->reason, value);
+        configure();
+        callParamCallbacks();
+        return asynSuccess;
+    }
+    return BasePortPlugin::writeFloat64(pasynUser, value);
+}
+
+asynStatus SyntheticSourcePlugin::readInt32(asynUser *pasynUser, epicsInt32 *value)
+{
+    if (pasynUser->reason == CntEvents) {
+        *value = m_generator.getEventsCount() % std::numeric_limits<int32_t>::max();
+        return asynSuccess;
+    }
+    if (pasynUser->reason == CntPulses) {
+        *value = m_generator.getPulsesCount() % std::numeric_limits<int32_t>::max();
+        return asynSuccess;
+    }
+    if (pasynUser->reason == CntErrors) {
+        *value = m_generator.getErrorsCount() % std::numeric_limits<int32_t>::max();
+        return asynSuccess;
+    }
+    return BasePortPlugin::readInt32(pasynUser, value);
+}
+
+bool SyntheticSourcePlugin::send(const uint8_t *data, size_t len)
+{
+    // Silently discard outgoing data, there's no hardware to respond
+    return true;
+}
+
+void SyntheticSourcePlugin::configure()
+{
+    SyntheticCircularBuffer::Config config;
+    config.format           = static_cast<DasDataPacket::EventFormat>(getIntegerParam(DataFormat));
+    config.eventRate        = getDoubleParam(EventRate);
+    config.pulseRate        = getDoubleParam(PulseRate);
+    config.eventsPerPacket  = getIntegerParam(EventsPerPkt);
+    config.pixelDist        = static_cast<SyntheticCircularBuffer::PixelDistribution>(getIntegerParam(PixelDist));
+    config.pixelMin         = getIntegerParam(PixelMin);
+    config.pixelMax         = getIntegerParam(PixelMax);
+    config.errorRate        = getDoubleParam(ErrorRate);
+    config.realTime         = getBooleanParam(RealTime);
+    m_generator.setConfig(config);
+}
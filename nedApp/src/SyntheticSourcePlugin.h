@@ -0,0 +1,86 @@
+/* SyntheticSourcePlugin.h
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ */
+
+#ifndef SYNTHETIC_SOURCE_PLUGIN_H
+#define SYNTHETIC_SOURCE_PLUGIN_H
+
+#include "BasePortPlugin.h"
+#include "SyntheticCircularBuffer.h"
+
+/**
+ * Port plugin producing synthetic detector data.
+ *
+ * Plugin is a drop-in replacement for OccPlugin when no hardware is
+ * available. Instead of reading data from OCC board it generates neutron
+ * pulses with RTDL, timing calibration and data packets in any of the raw
+ * detector formats. Event and pulse rate, pixel distribution, packet size
+ * and ratio of corrupted packets are configurable at runtime. With real time
+ * disabled, data is generated as fast as downstream plugins can process it.
+ */
+class epicsShareFunc SyntheticSourcePlugin : public BasePortPlugin {
+    private:
+        SyntheticCircularBuffer m_generator;
+
+    public:
+        /**
+         * Constructor
+         *
+         * @param[in] portName Name of the asyn port to which plugins can connect
+         */
+        SyntheticSourcePlugin(const char *portName);
+
+        /**
+         * Destructor
+         */
+        ~SyntheticSourcePlugin();
+
+    private:
+        /**
+         * Overloaded method.
+         */
+        asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value) override;
+
+        /**
+         * Overloaded method.
+         */
+        asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value) override;
+
+        /**
+         * Overloaded method to provide generator counters.
+         */
+        asynStatus readInt32(asynUser *pasynUser, epicsInt32 *value) override;
+
+        /**
+         * Discard outgoing data.
+         */
+        bool send(const uint8_t *data, size_t len) override;
+
+        /**
+         * Pass configuration from parameters to generator.
+         */
+        void configure();
+
+    private:
+        int Enable;
+        int Running;
+        int DataFormat;
+        int EventRate;
+        int PulseRate;
+        int EventsPerPkt;
+        int PixelDist;
+        int PixelMin;
+        int PixelMax;
+        int ErrorRate;
+        int RealTime;
+        int CntEvents;
+        int CntPulses;
+        int CntErrors;
+};
+
+#endif // SYNTHETIC_SOURCE_PLUGIN_H
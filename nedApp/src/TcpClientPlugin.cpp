@@ -35,7 +35,7 @@ TcpClientPlugin::TcpClientPlugin(const char *portName, uint32_t bufferSize)
         return;
     }
     m_copyThread = std::unique_ptr<Thread>(new Thread(
-        "Copy socket data to buffer",
+        (std::string(portName) + "_Copy").c_str(),
         std::bind(&TcpClientPlugin::copyDataThread, this, std::placeholders::_1),
         epicsThreadGetStackSize(epicsThreadStackMedium),
         epicsThreadPriorityHigh
@@ -142,7 +142,7 @@ asynStatus TcpClientPlugin::writeOctet(asynUser *pasynUser, const char *value, s
         connect();
         return asynSuccess;
     }
-    return BasePlugin::writeOctet(pasynUser, value, nChars, nActual);
+    return BasePortPlugin::writeOctet(pasynUser, value, nChars, nActual);
 }
 
 asynStatus TcpClientPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
@@ -161,7 +161,7 @@ asynStatus TcpClientPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
         connect();
         return asynSuccess;
     }
-    return asynPortDriver::writeInt32(pasynUser, value);
+    return BasePortPlugin::writeInt32(pasynUser, value);
 }
 
 bool TcpClientPlugin::send(const uint8_t *data, size_t len)
@@ -188,6 +188,7 @@ void TcpClientPlugin::copyDataThread(epicsEvent *shutdown)
     buffer.reserve(10 * 1024);
 
     LOG_INFO("Copy thread started");
+    m_circularBuffer->prefault();
 
     while (shutdown->tryWait() == false) {
         this->lock();
@@ -7,20 +7,149 @@
  * @author Klemen Vodopivec
  */
 
-#include <Thread.h>
+#include "Thread.h"
+
+#include <epicsExport.h>
+#include <errlog.h>
+#include <iocsh.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include <fstream>
+#include <list>
+#include <sstream>
+
+#if defined(__linux__)
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
+namespace {
+
+/**
+ * Settings requested through Thread::configure().
+ */
+struct Settings {
+    std::string pattern;
+    std::string cpus;
+    std::string policy;
+    int priority;
+};
+
+/**
+ * All existing threads and settings to be applied to them.
+ */
+struct Registry {
+    epicsMutex mutex;
+    std::list<Thread *> threads;
+    std::list<Settings> settings;
+};
+
+Registry &registry()
+{
+    static Registry r;
+    return r;
+}
+
+#if defined(__linux__)
+/**
+ * Parse CPU list in "0-3,8" format as used by Linux sysfs.
+ */
+bool parseCpuList(const std::string &text, cpu_set_t &cpus)
+{
+    CPU_ZERO(&cpus);
+    std::istringstream is(text);
+    std::string range;
+    bool found = false;
+    while (std::getline(is, range, ',')) {
+        if (range.empty() || range == "\n")
+            continue;
+        char *end;
+        unsigned long first = strtoul(range.c_str(), &end, 10);
+        unsigned long last = first;
+        if (end == range.c_str())
+            return false;
+        if (*end == '-') {
+            const char *start = end + 1;
+            last = strtoul(start, &end, 10);
+            if (end == start)
+                return false;
+        }
+        if (*end != '\0' && *end != '\n')
+            return false;
+        if (last < first || last >= CPU_SETSIZE)
+            return false;
+        for (unsigned long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, &cpus);
+        found = true;
+    }
+    return found;
+}
+
+/**
+ * Format CPU set in "0-3,8" format.
+ */
+std::string formatCpuList(const cpu_set_t &cpus)
+{
+    std::ostringstream os;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &cpus))
+            continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus))
+            last++;
+        if (os.tellp() > 0)
+            os << ",";
+        os << cpu;
+        if (last > cpu)
+            os << "-" << last;
+        cpu = last;
+    }
+    return os.str();
+}
+#endif // __linux__
+
+} // namespace
+
 
 Thread::Thread(const char *name, std::function<void(epicsEvent *)> worker, unsigned int stackSize, unsigned int priority)
-    : m_thread(*this, name, stackSize, priority)
+    : m_name(name)
+    , m_thread(*this, name, stackSize, priority)
     , m_running(false)
     , m_worker(worker)
 {
     m_thread.start();
+
+    Registry &r = registry();
+    r.mutex.lock();
+    r.threads.push_back(this);
+    for (auto &settings: r.settings) {
+        if (matches(settings.pattern)) {
+            if (!settings.cpus.empty())
+                setAffinity(settings.cpus);
+            if (!settings.policy.empty())
+                setScheduling(settings.policy, settings.priority);
+        }
+    }
+    r.mutex.unlock();
 }
 
 Thread::~Thread()
 {
-    // Make sure to stop worker function cleanly, EPICS will kill thread
+    Registry &r = registry();
+    r.mutex.lock();
+    r.threads.remove(this);
+    r.mutex.unlock();
+
+    // Make sure to stop worker function cleanly, then let run() return
     stop();
+
+    m_mutex.lock();
+    m_exit = true;
+    m_mutex.unlock();
+    m_resume.signal();
+    m_thread.exitWait();
 }
 
 void Thread::start()
@@ -61,8 +190,11 @@ void Thread::run()
     while (true) {
         if (m_resume.wait(1.0) == true) {
             m_mutex.lock();
-            m_running = true;
+            bool exit = m_exit;
+            m_running = !exit;
             m_mutex.unlock();
+            if (exit)
+                break;
 
             if (m_worker)
                 m_worker(&m_pause);
@@ -75,3 +207,200 @@ void Thread::run()
         }
     }
 }
+
+bool Thread::matches(const std::string &pattern) const
+{
+    if (m_name == pattern)
+        return true;
+    return (m_name.size() > pattern.size() &&
+            m_name.compare(0, pattern.size(), pattern) == 0 &&
+            m_name[pattern.size()] == '_');
+}
+
+bool Thread::setAffinity(const std::string &cpus)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    if (cpus.empty()) {
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &set);
+    } else if (cpus.compare(0, 4, "node") == 0) {
+        std::ifstream file("/sys/devices/system/node/" + cpus + "/cpulist");
+        std::string list;
+        if (!std::getline(file, list) || !parseCpuList(list, set)) {
+            errlogPrintf("ERROR: Unknown NUMA node '%s'\n", cpus.c_str());
+            return false;
+        }
+    } else if (!parseCpuList(cpus, set)) {
+        errlogPrintf("ERROR: Invalid CPU list '%s'\n", cpus.c_str());
+        return false;
+    }
+
+    pthread_t tid = epicsThreadGetPosixThreadId(m_thread.getId());
+    int ret = pthread_setaffinity_np(tid, sizeof(set), &set);
+    if (ret != 0) {
+        errlogPrintf("ERROR: Failed to set thread '%s' affinity to '%s': %s\n", m_name.c_str(), cpus.c_str(), strerror(ret));
+        return false;
+    }
+
+    m_mutex.lock();
+    m_cpus = cpus;
+    m_mutex.unlock();
+    return true;
+#else
+    errlogPrintf("ERROR: Thread affinity not supported on this platform\n");
+    return false;
+#endif
+}
+
+bool Thread::setScheduling(const std::string &policy, int priority)
+{
+#if defined(__linux__)
+    struct sched_param param;
+    int policy_;
+    if (policy == "fifo") {
+        policy_ = SCHED_FIFO;
+    } else if (policy == "rr") {
+        policy_ = SCHED_RR;
+    } else if (policy == "other") {
+        policy_ = SCHED_OTHER;
+        priority = 0;
+    } else {
+        errlogPrintf("ERROR: Invalid scheduling policy '%s'\n", policy.c_str());
+        return false;
+    }
+    if (priority < sched_get_priority_min(policy_) || priority > sched_get_priority_max(policy_)) {
+        errlogPrintf("ERROR: Invalid priority %d for scheduling policy '%s'\n", priority, policy.c_str());
+        return false;
+    }
+    param.sched_priority = priority;
+
+    pthread_t tid = epicsThreadGetPosixThreadId(m_thread.getId());
+    int ret = pthread_setschedparam(tid, policy_, &param);
+    if (ret != 0) {
+        errlogPrintf("ERROR: Failed to set thread '%s' scheduling to %s/%d: %s\n", m_name.c_str(), policy.c_str(), priority, strerror(ret));
+        return false;
+    }
+
+    m_mutex.lock();
+    m_policy = policy;
+    m_priority = priority;
+    m_mutex.unlock();
+    return true;
+#else
+    errlogPrintf("ERROR: Thread scheduling not supported on this platform\n");
+    return false;
+#endif
+}
+
+void Thread::report(FILE *fp)
+{
+#if defined(__linux__)
+    pthread_t tid = epicsThreadGetPosixThreadId(m_thread.getId());
+
+    cpu_set_t set;
+    std::string cpus = "unknown";
+    if (pthread_getaffinity_np(tid, sizeof(set), &set) == 0)
+        cpus = formatCpuList(set);
+
+    int policy;
+    struct sched_param param;
+    std::string sched = "unknown";
+    if (pthread_getschedparam(tid, &policy, &param) == 0) {
+        if (policy == SCHED_FIFO)
+            sched = "fifo/" + std::to_string(param.sched_priority);
+        else if (policy == SCHED_RR)
+            sched = "rr/" + std::to_string(param.sched_priority);
+        else
+            sched = "other";
+    }
+
+    // Requested settings show how actual ones came to be, ie. node0 for 0-7
+    m_mutex.lock();
+    std::string requested;
+    if (!m_cpus.empty())
+        requested += " cpus " + m_cpus;
+    if (!m_policy.empty())
+        requested += " scheduling " + (m_policy == "other" ? m_policy : m_policy + "/" + std::to_string(m_priority));
+    m_mutex.unlock();
+
+    fprintf(fp, "  %-24s cpus %s, scheduling %s%s%s\n", m_name.c_str(), cpus.c_str(), sched.c_str(),
+            (requested.empty() ? "" : ", requested"), requested.c_str());
+#else
+    fprintf(fp, "  %s\n", m_name.c_str());
+#endif
+}
+
+int Thread::configure(const std::string &pattern, const std::string &cpus, const std::string &policy, int priority)
+{
+    if (pattern.empty())
+        return -1;
+
+    Registry &r = registry();
+    int n = 0;
+    bool ok = true;
+    r.mutex.lock();
+    for (auto &thread: r.threads) {
+        if (!thread->matches(pattern))
+            continue;
+        if (!cpus.empty())
+            ok &= thread->setAffinity(cpus);
+        if (!policy.empty())
+            ok &= thread->setScheduling(policy, priority);
+        n++;
+    }
+    if (ok)
+        r.settings.push_back({ pattern, cpus, policy, priority });
+    r.mutex.unlock();
+    return (ok ? n : -1);
+}
+
+void Thread::report(FILE *fp, const std::string &pattern)
+{
+    Registry &r = registry();
+    r.mutex.lock();
+    for (auto &thread: r.threads) {
+        if (thread->matches(pattern))
+            thread->report(fp);
+    }
+    r.mutex.unlock();
+}
+
+static const iocshArg threadConfigArg0 = { "Thread or port name", iocshArgString };
+static const iocshArg threadConfigArg1 = { "CPUs", iocshArgString };
+static const iocshArg threadConfigArg2 = { "Policy", iocshArgString };
+static const iocshArg threadConfigArg3 = { "Priority", iocshArgInt };
+static const iocshArg * const threadConfigArgs[] = { &threadConfigArg0, &threadConfigArg1, &threadConfigArg2, &threadConfigArg3 };
+static const iocshFuncDef threadConfigFuncDef = { "nedThreadConfig", 4, threadConfigArgs };
+
+extern "C" {
+    /**
+     * Configure affinity and scheduling of threads from IOC shell.
+     *
+     * Example pinning OCC plugin threads next to the card and running
+     * them with real-time priority:
+     * nedThreadConfig("occ1", "node0", "fifo", 50)
+     * Called with only a name it prints current settings.
+     */
+    int nedThreadConfig(const char *name, const char *cpus, const char *policy, int priority)
+    {
+        std::string cpus_(cpus ? cpus : "");
+        std::string policy_(policy ? policy : "");
+        if (name == nullptr) {
+            printf("Usage: nedThreadConfig <thread or port name> [cpus|node<n>] [fifo|rr|other] [priority]\n");
+            return -1;
+        }
+        if (cpus_.empty() && policy_.empty()) {
+            Thread::report(stdout, name);
+            return 0;
+        }
+        int n = Thread::configure(name, cpus_, policy_, priority);
+        if (n == 0)
+            printf("No thread matches '%s' yet, settings will apply when created\n", name);
+        return (n < 0 ? -1 : 0);
+    }
+    static void threadConfigCallFunc(const iocshArgBuf *args) { nedThreadConfig(args[0].sval, args[1].sval, args[2].sval, args[3].ival); }
+    static void registerThreadConfig(void) { iocshRegister(&threadConfigFuncDef, threadConfigCallFunc); }
+    epicsExportRegistrar(registerThreadConfig);
+}
@@ -10,8 +10,13 @@
 #ifndef NED_THREAD_H
 #define NED_THREAD_H
 
+#include <epicsEvent.h>
+#include <epicsMutex.h>
 #include <epicsThread.h>
+
+#include <cstdio>
 #include <functional>
+#include <string>
 
 /**
  * Stoppable thread object
@@ -21,6 +26,24 @@
  * user specified function when started. When stopped, user function is
  * instructed to exit and when it does, the thread goes into waiting state until
  * started again.
+ *
+ * All threads are kept in a process wide registry by name. CPU affinity
+ * and scheduling policy can be changed for any thread at run time, usually
+ * from IOC startup script using nedThreadConfig command. Thread names of
+ * plugin threads start with plugin port name, which allows to configure
+ * all threads of a plugin at once. When Executor is enabled, plugins
+ * processing messages in executor have no thread of their own, executor
+ * workers are configured by their Executor_<n> names instead. Settings are
+ * remembered and applied also to threads created later.
+ *
+ * There's no explicit NUMA memory binding. Linux allocates pages on the
+ * NUMA node of the thread that first touches them. Large buffers are
+ * allocated from IOC shell but prefaulted by a thread of the plugin using
+ * them, outside data path; CircularBuffer by producer thread when it
+ * starts, flight recorder ring by recorder thread when resized.
+ * ObjectPool and PacketArena allocate from the thread that requests
+ * memory. Configuring plugin threads before the plugin is created places
+ * its memory on the node of its threads.
  */
 class Thread : public epicsThreadRunable {
     public:
@@ -39,7 +62,7 @@ class Thread : public epicsThreadRunable {
                unsigned int priority=epicsThreadPriorityMedium);
 
         /**
-         * Stop user function and destroy thread.
+         * Stop user function, let the thread exit and wait for it.
          */
         ~Thread();
 
@@ -53,19 +76,84 @@ class Thread : public epicsThreadRunable {
          */
         void stop();
 
+        /**
+         * Return thread name as passed to constructor.
+         */
+        const std::string &getName() const { return m_name; }
+
+        /**
+         * Restrict thread to selected CPUs.
+         *
+         * @param[in] cpus Comma separated list of CPUs or CPU ranges,
+         *                 ie. "0-3,8", or "node<n>" for all CPUs of
+         *                 NUMA node n. Empty string allows all CPUs.
+         * @return true on success, false on invalid list or when
+         *         system rejected the request.
+         */
+        bool setAffinity(const std::string &cpus);
+
+        /**
+         * Change thread scheduling policy.
+         *
+         * @param[in] policy One of "fifo", "rr" or "other".
+         * @param[in] priority Real-time priority 1-99 for fifo and rr
+         *                     policies, ignored for other.
+         * @return true on success, false on invalid parameters or when
+         *         system rejected the request, usually due to missing
+         *         privileges.
+         */
+        bool setScheduling(const std::string &policy, int priority);
+
+        /**
+         * Print thread affinity and scheduling as reported by system,
+         * followed by settings last requested through this class.
+         */
+        void report(FILE *fp);
+
+        /**
+         * Apply settings to all threads matching pattern and remember them
+         * for threads created later.
+         *
+         * Pattern matches thread with the same name or all threads which
+         * name starts with pattern followed by underscore.
+         *
+         * @param[in] pattern Thread name or plugin port name
+         * @param[in] cpus Affinity as accepted by setAffinity(), not changed when empty
+         * @param[in] policy Scheduling policy as accepted by setScheduling(), not changed when empty
+         * @param[in] priority Real-time priority
+         * @return Number of threads configured, -1 on error.
+         */
+        static int configure(const std::string &pattern, const std::string &cpus, const std::string &policy, int priority);
+
+        /**
+         * Print report of all threads matching pattern.
+         */
+        static void report(FILE *fp, const std::string &pattern);
+
     private:
+        std::string m_name;     //!< Thread name
         epicsThread m_thread;   //!< Thread object
         bool m_running;         //!< Flag when the user function is running
-        epicsMutex m_mutex;     //!< Lock for m_running member
+        bool m_exit{false};     //!< Flag for thread to exit, set when destroyed
+        epicsMutex m_mutex;     //!< Lock for m_running and m_exit members
         epicsEvent m_resume;    //!< Event that triggers starting the thread again
         epicsEvent m_pause;     //!< Event which user function receives
         epicsEvent m_paused;    //!< Event that tells when the user function exited
         std::function<void(epicsEvent *)> m_worker; //!< User function
 
+        std::string m_cpus;     //!< Affinity as last requested
+        std::string m_policy;   //!< Scheduling policy as last requested
+        int m_priority{0};      //!< Real-time priority as last requested
+
         /**
          * Thread main function, encapsulates user worker function.
          */
         void run();
+
+        /**
+         * Check whether thread name matches configuration pattern.
+         */
+        bool matches(const std::string &pattern) const;
 };
 
 #endif // NED_THREAD_H
@@ -8,55 +8,46 @@
  * @date July 13, 2016
  */
 
+#include "EventTraits.h"
 #include "TofCorrectPlugin.h"
 #include "Log.h"
 
 #include <string.h> // memcpy()
 
-#define NUM_TOFCORRECTPLUGIN_PARAMS ((int)(&LAST_TOFCORRECTPLUGIN_PARAM - &FIRST_TOFCORRECTPLUGIN_PARAM + 1))
+#define LOOKUP_MIN_SIZE     16
 
-EPICS_REGISTER_PLUGIN(TofCorrectPlugin, 3, "Port name", string, "Remote port name", string, "Number pixels", int);
-
-TofCorrectPlugin::TofCorrectPlugin(const char *portName, const char *connectPortName, int nPixels)
-    : BaseDispatcherPlugin(portName, connectPortName, /*blocking=*/0, NUM_TOFCORRECTPLUGIN_PARAMS+3*nPixels)
-    , m_nReceived(0)
-    , m_nProcessed(0)
-    , m_corrections(nPixels)
-    , PixelIds(nPixels)
-    , TofOffsets(nPixels)
-    , NCorrected(nPixels)
+/**
+ * Formats with tof,pixel events that can be corrected.
+ */
+typedef EventFormats<
+    DasDataPacket::EVENT_FMT_META,
+    DasDataPacket::EVENT_FMT_PIXEL
+> CorrectedFormats;
+
+EPICS_REGISTER_PLUGIN(TofCorrectPlugin, 3, "Port name", string, "Parent plugins", string, "Number pixels", int);
+
+TofCorrectPlugin::TofCorrectPlugin(const char *portName, const char *parentPlugins, int nPixels)
+    : BasePlugin(portName, 0)
+    , m_corrections(nPixels > 0 ? nPixels : 0)
+    , PixelIds(m_corrections.size())
+    , TofOffsets(m_corrections.size())
+    , NCorrected(m_corrections.size())
 {
     createParam("FrameLen",     asynParamInt32, &FrameLen,    0); // WRITE - Frame length in nsec
     createParam("PoolSize",     asynParamInt32, &PoolSize,    0); // READ - Number of allocated packets
     createParam("NPixels",      asynParamInt32, &NPixels,     nPixels); // READ - Number of pixels to correct
+    createParam("ErrMem",       asynParamInt32, &ErrMem,      0); // READ - Buffer allocation error
 
-    for (int i=0; i<nPixels; i++) {
-        char name[16];
-        int param;
-        snprintf(name, sizeof(name), "TofOffset%d", i+1);
-        createParam(name, asynParamInt32, &param, 0); // WRITE - Full TOF offset to be applied in nsec
-        TofOffsets[i] = param;
-        snprintf(name, sizeof(name), "PixelId%d", i+1);
-        createParam(name, asynParamInt32, &param, 0);   // WRITE - Selected pixel id
-        PixelIds[i] = param;
-        snprintf(name, sizeof(name), "NCorrected%d", i+1);
-        createParam(name, asynParamInt32, &param, 0); // READ - Number of corrected events
-        NCorrected[i] = param;
+    for (size_t i=0; i<m_corrections.size(); i++) {
+        createParam("TofOffset"  + std::to_string(i+1), asynParamInt32, &TofOffsets[i], 0); // WRITE - Full TOF offset to be applied in nsec
+        createParam("PixelId"    + std::to_string(i+1), asynParamInt32, &PixelIds[i],   0); // WRITE - Selected pixel id
+        createParam("NCorrected" + std::to_string(i+1), asynParamInt32, &NCorrected[i], 0); // READ - Number of corrected events
     }
+    callParamCallbacks();
 
-    // Initialize bare minimum, others should be set through PVs
-    for (int i=0; i<nPixels; i++) {
-        m_corrections[i].enabled = false;
-        m_corrections[i].pixelId = 0;
-        m_corrections[i].nEvents = 0;
-    }
-}
+    rebuildLookup();
 
-TofCorrectPlugin::~TofCorrectPlugin()
-{
-    for (auto it=m_pool.begin(); it!=m_pool.end(); it++) {
-        delete it->packet;
-    }
+    BasePlugin::connect(parentPlugins, {MsgDasData});
 }
 
 asynStatus TofCorrectPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
@@ -75,160 +66,139 @@ asynStatus TofCorrectPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
         }
     }
 
-    for (size_t i=0; i<m_corrections.size(); i++) {
-        m_corrections[i].enabled = false;
-        if (m_frameLen > 0 && m_corrections[i].pixelId != 0) {
-            uint32_t frameNum = m_corrections[i].tofOffset / m_frameLen;
-            m_corrections[i].fineOffset = m_corrections[i].tofOffset % m_frameLen;
-            m_corrections[i].coarseOffset = frameNum * m_frameLen;
-            m_corrections[i].enabled = true;
+    if (m_frameLen > 0) {
+        for (auto &correction: m_corrections) {
+            uint32_t tofOffset = correction.tofOffset;
+            uint32_t frameNum = tofOffset / m_frameLen;
+            correction.fineOffset = tofOffset % m_frameLen;
+            correction.coarseOffset = frameNum * m_frameLen;
         }
     }
-    return BaseDispatcherPlugin::writeInt32(pasynUser, value);
+
+    // Rebuilt once before processing next packets, many parameters are
+    // written in a row during initialization
+    m_lookupDirty = true;
+
+    return BasePlugin::writeInt32(pasynUser, value);
 }
 
-void TofCorrectPlugin::processDataUnlocked(const DasPacketList * const packetList)
+void TofCorrectPlugin::rebuildLookup()
 {
-    std::list<DasPacket *> allocPktsList;
-    DasPacketList modifiedPktsList;
-
-    this->lock();
-    bool enabled = false;
-    for (size_t i=0; i<m_corrections.size(); i++) {
-        if (m_corrections[i].enabled == true) {
-            enabled = true;
-            break;
-        }
-    }
-    this->unlock();
-
-    if (enabled == false) {
-        modifiedPktsList.reset(packetList); // reset() automatically reserves
-        sendToPlugins(&modifiedPktsList);
-        modifiedPktsList.release();
-        modifiedPktsList.waitAllReleased();
-        modifiedPktsList.clear();
-    } else {
-        this->lock();
-        for (auto it = packetList->cbegin(); it != packetList->cend(); it++) {
-            const DasPacket *packet = *it;
-
-            if (packet->isMetaData()) {
-                DasPacket *modifiedPacket = allocPacket(packet->getLength());
-                if (!modifiedPacket)
-                    continue;
-                allocPktsList.push_back(modifiedPacket);
-
-                if (packet->copyHeader(modifiedPacket, packet->getLength())) {
-                    uint32_t nDwords;
-                    uint32_t *dstData = modifiedPacket->getData(&nDwords);
-                    const uint32_t *srcData = packet->getData(&nDwords);
-
-                    // memcpy() is fast
-                    memcpy(dstData, srcData, nDwords * 4);
-                    modifiedPacket->payload_length += nDwords * 4;
-
-                    for (uint32_t i=0; (i+1)<nDwords; i+=2) {
-                        int index = -1;
-                        for (size_t j=0; j<m_corrections.size(); j++) {
-                            if (dstData[i+1] == (uint32_t)m_corrections[j].pixelId) {
-                                index = j;
-                                break;
-                            }
-                        }
-                        if (index == -1 || m_corrections[index].enabled == false)
-                            continue;
-
-                        uint32_t tof = dstData[i] & 0x000FFFFF;
-                        // Do the frame correction
-                        if (tof < m_corrections[index].fineOffset) {
-                            // Account for misaligned trigger
-                            tof += m_corrections[index].coarseOffset + m_frameLen;
-                        } else {
-                            tof += m_corrections[index].coarseOffset;
-                        }
-                        dstData[i] = (dstData[i] & 0xFFF00000) | tof;
-
-                        m_corrections[index].nEvents++;
-                    }
-                    modifiedPktsList.push_back(modifiedPacket);
-                }
-            } else {
-                modifiedPktsList.push_back(packet);
-            }
+    uint32_t nEntries = 0;
+    if (m_frameLen > 0) {
+        for (const auto &correction: m_corrections) {
+            if (correction.pixelId != 0)
+                nEntries++;
         }
-        this->unlock();
     }
 
-    // Serialize sending to plugins - can not use asynPortDriver::lock()
-    m_mutex.lock();
-
-    if (!modifiedPktsList.empty()) {
-        modifiedPktsList.reserve();
-        BaseDispatcherPlugin::sendToPlugins(&modifiedPktsList);
-        modifiedPktsList.release();
-        modifiedPktsList.waitAllReleased();
+    uint32_t size = LOOKUP_MIN_SIZE;
+    uint32_t bits = 4;
+    while (size < 2*nEntries) {
+        size *= 2;
+        bits++;
     }
-    // All plugins done with list of packets, put them back to pool
-    for (auto it = allocPktsList.cbegin(); it != allocPktsList.cend(); it++) {
-        freePacket(const_cast<DasPacket *>(*it));
+
+    m_lookupKeys.assign(size, 0);
+    m_lookupValues.assign(size, NOT_FOUND);
+    m_lookupMask = size - 1;
+    m_lookupShift = 32 - bits;
+    m_lookupEntries = 0;
+
+    for (size_t i=0; i<m_corrections.size() && nEntries > 0; i++) {
+        uint32_t pixelId = m_corrections[i].pixelId;
+        if (pixelId == 0)
+            continue;
+
+        uint32_t slot = (pixelId * 2654435761U) >> m_lookupShift;
+        while (m_lookupKeys[slot] != 0 && m_lookupKeys[slot] != pixelId)
+            slot = (slot + 1) & m_lookupMask;
+        if (m_lookupKeys[slot] == 0) {
+            m_lookupKeys[slot] = pixelId;
+            m_lookupValues[slot] = i;
+            m_lookupEntries++;
+        }
     }
 
-    m_mutex.unlock();
+    m_lookupDirty = false;
+}
 
-    // Update parameters
-    this->lock();
-    m_nReceived += packetList->size();
-    setIntegerParam(ProcCount,  m_nProcessed);
-    setIntegerParam(RxCount,    m_nReceived);
-    setIntegerParam(PoolSize,   m_pool.size());
-    for (size_t i=0; i<m_corrections.size(); i++) {
-        setIntegerParam(NCorrected[i], m_corrections[i].nEvents);
+void TofCorrectPlugin::correctEvents(Event::Pixel *events, uint32_t nEvents, uint32_t first)
+{
+    for (uint32_t i=first; i<nEvents; i++) {
+        uint32_t index = findCorrection(events[i].pixelid);
+        if (index == NOT_FOUND)
+            continue;
+
+        CorrectionDesc &correction = m_corrections[index];
+        // Do the frame correction
+        if (events[i].tof < correction.fineOffset) {
+            // Account for misaligned trigger
+            events[i].tof += correction.coarseOffset + m_frameLen;
+        } else {
+            events[i].tof += correction.coarseOffset;
+        }
+        correction.nEvents++;
     }
-    callParamCallbacks();
-    this->unlock();
 }
 
-DasPacket *TofCorrectPlugin::allocPacket(uint32_t size)
+void TofCorrectPlugin::recvDownstream(const DasDataPacketList &packets)
 {
-    DasPacket *packet = reinterpret_cast<DasPacket *>(0);
+    DasDataPacketList outPackets;
+    std::vector<DasDataPacket *> pooledPackets;
 
-    for (auto it=m_pool.begin(); it!=m_pool.end(); it++) {
-        if (it->size >= size && it->inUse == false) {
-            it->inUse = true;
-            packet = it->packet;
-            break;
-        }
+    if (m_lookupDirty)
+        rebuildLookup();
+
+    if (m_lookupEntries == 0) {
+        // Optimize pass-thru
+        sendDownstream(packets);
+        return;
     }
 
-    if (!packet) {
-        packet = DasPacket::alloc(size);
-        if (!packet) {
-            LOG_ERROR("Failed to allocate packet buffer");
-        } else {
-            PoolEntry entry;
-            entry.inUse = true;
-            entry.size = size;
-            entry.packet = packet;
-            m_pool.push_back(entry);
-            LOG_DEBUG("Increased packet pool to %zu", m_pool.size());
+    for (const auto &packet: packets) {
+        if (!CorrectedFormats::contains(packet->getEventsFormat())) {
+            outPackets.push_back(packet);
+            continue;
+        }
+
+        // Most packets have nothing to correct, don't copy those
+        const Event::Pixel *events = packet->getEvents<const Event::Pixel>();
+        uint32_t nEvents = packet->getNumEvents();
+        uint32_t first = 0;
+        while (first < nEvents && findCorrection(events[first].pixelid) == NOT_FOUND)
+            first++;
+        if (first == nEvents) {
+            outPackets.push_back(packet);
+            continue;
+        }
+
+        DasDataPacket *modifiedPacket = m_packetsPool.get(packet->getLength());
+        if (!modifiedPacket) {
+            addIntegerParam(ErrMem, 1);
+            continue;
         }
+        memcpy(modifiedPacket, packet, packet->getLength());
+        correctEvents(modifiedPacket->getEvents<Event::Pixel>(), nEvents, first);
+
+        outPackets.push_back(modifiedPacket);
+        pooledPackets.push_back(modifiedPacket);
     }
 
-    return packet;
-}
+    // Send to subscribed plugins and wait they complete processing
+    sendDownstream(outPackets);
 
-void TofCorrectPlugin::freePacket(DasPacket *packet)
-{
-    for (auto it=m_pool.begin(); it!=m_pool.end(); it++) {
-        if (it->packet == packet) {
-            if (it->inUse == false) {
-                LOG_WARN("Corrupted pool, packet returned twice?");
-            }
-            it->inUse = false;
-            return;
+    for (auto &packet: pooledPackets) {
+        m_packetsPool.put(packet);
+    }
+
+    // Only update counters that changed, there could be thousands
+    for (size_t i=0; i<m_corrections.size(); i++) {
+        if (m_corrections[i].nEvents != m_corrections[i].nPublished) {
+            m_corrections[i].nPublished = m_corrections[i].nEvents;
+            setIntegerParam(NCorrected[i], m_corrections[i].nEvents);
         }
     }
-    LOG_WARN("Packet not found in pool, discarding");
-    delete packet;
+    setIntegerParam(PoolSize, m_packetsPool.size());
+    callParamCallbacksRatelimit();
 }
@@ -11,114 +11,121 @@
 #ifndef TOF_CORRECT_PLUGIN_H
 #define TOF_CORRECT_PLUGIN_H
 
-#include "BaseDispatcherPlugin.h"
+#include "BasePlugin.h"
+#include "Event.h"
+#include "ObjectPool.h"
 
-/**
- * Define a number of pixels to be corrected
- */
-#define TOF_MAX_PIXELS 3
+#include <vector>
 
 /**
  * Plugin to adjust TOF in events.
  *
- * For now the plugin only adjusts selected meta-data events. It's a temporary
- * workaround for missing DSP-T functionality, while that is being in progress.
+ * The plugin adjusts events of selected pixel ids in meta and neutron
+ * data packets. It's a workaround for missing DSP-T functionality.
+ *
+ * Each correction consists of pixel id and TOF offset. Offset is split
+ * into a number of whole frames (coarse offset) and remainder within
+ * the frame (fine offset). Events with TOF below fine offset are assumed
+ * to be triggered one frame late and get additional frame added.
+ *
+ * Pixel id is looked up in an open addressing hash table, so the cost
+ * per event doesn't depend on number of corrections. Packets with no
+ * corrected pixels are passed thru without copying. Otherwise packet is
+ * copied once into a packet from pool which this plugin exclusively owns
+ * and events are corrected in place.
  */
-class TofCorrectPlugin : public BaseDispatcherPlugin {
+class TofCorrectPlugin : public BasePlugin {
     public:
         /**
          * Constructor
+         *
+         * @param[in] portName asyn port name.
+         * @param[in] parentPlugins Name of the plugins to connect to.
+         * @param[in] nPixels Max number of pixels to correct.
          */
-        TofCorrectPlugin(const char *portName, const char *connectPortName, int nPixels);
-
-        /**
-         * Destructor
-         */
-        ~TofCorrectPlugin();
+        TofCorrectPlugin(const char *portName, const char *parentPlugins, int nPixels);
 
     private:
 
-        /**
-         * Describe a single allocated memory block.
-         */
-        typedef struct {
-            DasPacket *packet;          //!< Allocated memory address
-            size_t size;                //!< Allocated memory size
-            bool inUse;                 //!< Currently used by someone
-        } PoolEntry;
-
         /**
          * Structure describing one pixel id correction.
          */
-        typedef struct {
-            bool enabled;
-            int pixelId;
-            int tofOffset;
-            uint32_t coarseOffset;
-            uint32_t fineOffset;
-            int32_t nEvents;
+        struct CorrectionDesc {
+            uint32_t pixelId{0};
+            int32_t tofOffset{0};
+            uint32_t coarseOffset{0};
+            uint32_t fineOffset{0};
+            int32_t nEvents{0};
+            int32_t nPublished{0};  //!< nEvents value last set to NCorrected parameter
+        };
 
-        } CorrectionDesc;
+        std::vector<CorrectionDesc> m_corrections;  //!< Configured corrections, relates to PV hookups
+        std::vector<uint32_t> m_lookupKeys;         //!< Hash table of pixel ids, 0 when slot empty
+        std::vector<uint32_t> m_lookupValues;       //!< Index into m_corrections for each pixel id slot
+        uint32_t m_lookupMask{0};                   //!< Hash table size - 1, size is power of 2
+        uint32_t m_lookupShift{32};                 //!< Shift selecting hash bits, 32 - log2(size)
+        uint32_t m_lookupEntries{0};                //!< Number of pixel ids in hash table
+        bool m_lookupDirty{true};                   //!< Hash table must be rebuilt before use
+        uint32_t m_frameLen{0};                     //!< Frame length in 100ns units
+        ObjectPool<DasDataPacket> m_packetsPool{true}; //!< Pool of packets with corrected events
 
-        uint32_t m_nReceived;           //!< Number of received packets
-        uint32_t m_nProcessed;          //!< Number of modified packets
-        std::list<PoolEntry> m_pool;    //!< Pool of DasPacket allocated objects, all of the same size
-        epicsMutex m_mutex;             //!< Mutex used solely to serialize sending data to plugins
-        std::vector<CorrectionDesc> m_corrections;//!< Limit to 3 pixel ids for now, also relates to PV hookups
-        uint32_t m_frameLen;            //!< Frame length in 100ns units
+        static const uint32_t NOT_FOUND = 0xFFFFFFFF;
 
         /**
          * Handle writing integer pv
          */
-        asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+        asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value) override;
 
         /**
          * Process received packets.
          *
-         * Metadata packets are copied and modified, all other patkes are reused
-         * without modifications. From metadata packets, select events that
-         * match the configured pixel id and apply the TOF correction to those.
-         * The correction includes coarse frame correction as well as fine
-         * correction within the frame.
-         *
-         * @param[in] packetList List of packets to be processed.
+         * Data packets in meta or pixel format which contain at least one
+         * event with configured pixel id are copied and corrected, all
+         * other packets are reused without modifications. The correction
+         * includes coarse frame correction as well as fine correction
+         * within the frame.
          */
-        void processDataUnlocked(const DasPacketList * const packetList);
+        void recvDownstream(const DasDataPacketList &packets) override;
 
         /**
-         * Allocate packet of at least the size requested
-         *
-         * Either from pool or allocate new one if pool exhausted. All packets
-         * are of the same size which simplifies the implementation and
-         * optimizes performance while consuming more memory. Packets are
-         * recycled on regular basis so little actual allocation is expected
-         * after a couple of cycles. Packet returned from this function must
-         * be freed using freePacket() which puts it into the pool for reuse.
+         * Rebuild pixel id hash table from enabled corrections.
          *
-         * Is not safe thread, but as long as it's used solely from processData*()
-         * it's safe not to lock due to program design constraints.
-         *
-         * @param[in] size Size of the packet is checked not to exceed limits.
-         * @return Allocated packet or 0 on error.
+         * Table is sized to at most half full. When several corrections
+         * use the same pixel id, the first one is used.
          */
-        DasPacket *allocPacket(uint32_t size);
+        void rebuildLookup();
 
         /**
-         * Push no longer used packet to the pool for reuse.
+         * Return index of correction for given pixel id or NOT_FOUND.
          *
-         * Is not safe thread, but as long as it's used solely from processData*()
-         * it's safe not to lock due to program design constraints.
+         * Multiplicative hash takes top bits, consecutive pixel ids are
+         * spread accross the table.
+         */
+        uint32_t findCorrection(uint32_t pixelId) const
+        {
+            uint32_t slot = (pixelId * 2654435761U) >> m_lookupShift;
+            while (m_lookupKeys[slot] != 0) {
+                if (m_lookupKeys[slot] == pixelId)
+                    return m_lookupValues[slot];
+                slot = (slot + 1) & m_lookupMask;
+            }
+            return NOT_FOUND;
+        }
+
+        /**
+         * Apply frame correction to events in place.
          *
-         * @param[in] packet Unused packet.
+         * @param[in] events to be corrected
+         * @param[in] nEvents number of events
+         * @param[in] first index of first event to be corrected
          */
-        void freePacket(DasPacket *packet);
+        void correctEvents(Event::Pixel *events, uint32_t nEvents, uint32_t first);
 
     protected:
-        #define FIRST_TOFCORRECTPLUGIN_PARAM FrameLen
         int FrameLen;           //!< Length of a frame in nsec
         int PoolSize;           //!< Number of allocated packets
         int NPixels;            //!< Number of pixels to correct
-        #define LAST_TOFCORRECTPLUGIN_PARAM NPixels
+        int ErrMem;             //!< Error allocating buffer
         std::vector<int> PixelIds;      //!< Selected pixel ids
         std::vector<int> TofOffsets;    //!< Offset to be applied to TOF
         std::vector<int> NCorrected;    //!< Number of corrected events
@@ -0,0 +1,479 @@
+/* benchPipeline.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ *
+ * Measure throughput of a chain of processing plugins without running IOC.
+ *
+ * Usage: benchPipeline [options] <stage>[:<arg>] ...
+ *
+ * Plugins are instantiated in-process and connected in the order given on
+ * command line, first stage receives data from the source port and last
+ * stage is followed by a sink that counts outgoing events. Input is either
+ * a dump file recorded by DumpPlugin or synthetic data, in both cases it's
+ * loaded to memory first and replayed in a loop as fast as the plugins can
+ * process it. Results are printed to stdout as key=value pairs, one per
+ * line, progress and errors go to stderr.
+ */
+
+#include <AdaraPlugin.h>
+#include <BasePortPlugin.h>
+#include <BnlPosCalcPlugin.h>
+#include <DumpPlugin.h>
+#include <FileCircularBuffer.h>
+#include <FlatFieldPlugin.h>
+#include <HistogramPlugin.h>
+#include <PixelMapPlugin.h>
+#include <PvaNeutronsPlugin.h>
+#include <StatPlugin.h>
+#include <SyntheticCircularBuffer.h>
+
+#include <asynFloat64SyncIO.h>
+#include <asynInt32SyncIO.h>
+#include <asynOctetSyncIO.h>
+#include <epicsThread.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/*
+ * Count all C++ heap allocations. Counters are global, allocations from
+ * any thread in the measured interval are accounted.
+ */
+static std::atomic<uint64_t> g_allocCount{0};
+static std::atomic<uint64_t> g_allocBytes{0};
+
+void *operator new(size_t size)
+{
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    g_allocBytes.fetch_add(size, std::memory_order_relaxed);
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+/**
+ * Circular buffer replaying packets from memory in a loop.
+ */
+class ReplayCircularBuffer : public BaseCircularBuffer {
+    private:
+        std::vector<uint8_t> m_data;
+        uint32_t m_chunk;
+        size_t m_offset = 0;
+        std::atomic<bool> m_running{false};
+        std::atomic<uint64_t> m_bytes{0};
+
+    public:
+        ReplayCircularBuffer(std::vector<uint8_t> &&data, uint32_t chunk)
+            : m_data(std::move(data))
+            , m_chunk(chunk)
+        {}
+
+        void start() { m_running = true; }
+        void stop() { m_running = false; }
+        uint64_t getBytes() { return m_bytes; }
+
+        int wait(void **data, uint32_t *len, double timeout) override
+        {
+            if (!m_running || m_data.empty()) {
+                epicsThreadSleep(std::min(timeout, 0.01));
+                return -ETIME;
+            }
+            if (m_offset >= m_data.size())
+                m_offset = 0;
+            *data = m_data.data() + m_offset;
+            *len = std::min(static_cast<size_t>(m_chunk), m_data.size() - m_offset);
+            return 0;
+        }
+
+        int consume(uint32_t len) override
+        {
+            m_offset += len;
+            m_bytes += len;
+            return BaseCircularBuffer::consume(len);
+        }
+
+        bool empty() override { return m_data.empty(); }
+        uint32_t used() override { return m_data.size() - m_offset; }
+        uint32_t size() override { return m_data.size(); }
+};
+
+/**
+ * Port plugin feeding replay buffer to subscribed plugins.
+ */
+class BenchSourcePlugin : public BasePortPlugin {
+    public:
+        BenchSourcePlugin(const char *portName, BaseCircularBuffer *buffer)
+            : BasePortPlugin(portName)
+        {
+            m_circularBuffer = buffer;
+            if (m_processThread)
+                m_processThread->start();
+        }
+
+        void stop()
+        {
+            if (m_processThread)
+                m_processThread->stop();
+        }
+};
+
+/**
+ * Last plugin in chain, counts processed packets and events.
+ */
+class BenchSinkPlugin : public BasePlugin {
+    public:
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> events{0};
+
+        BenchSinkPlugin(const char *portName, const char *parentPlugins)
+            : BasePlugin(portName)
+        {
+            BasePlugin::connect(parentPlugins, MsgDasData);
+        }
+
+        void recvDownstream(const DasDataPacketList &packetList) override
+        {
+            uint64_t nEvents = 0;
+            for (const auto &packet: packetList)
+                nEvents += packet->getNumEvents();
+            packets += packetList.size();
+            events += nEvents;
+        }
+};
+
+/**
+ * Create plugin by its type name.
+ *
+ * @return New plugin or nullptr when type is not supported.
+ */
+static BasePlugin *createStage(const std::string &type, const std::string &arg, const std::string &parent)
+{
+    const char *name = type.c_str();
+    if (type == "PixelMap")
+        return new PixelMapPlugin(name, parent.c_str(), arg.c_str());
+    if (type == "BnlPosCalc")
+        return new BnlPosCalcPlugin(name, parent.c_str());
+    if (type == "FlatField")
+        return new FlatFieldPlugin(name, parent.c_str(), arg.empty() ? "0" : arg.c_str());
+    if (type == "Stat")
+        return new StatPlugin(name, parent.c_str());
+    if (type == "Dump")
+        return new DumpPlugin(name, parent.c_str());
+    if (type == "PvaNeutrons")
+        return new PvaNeutronsPlugin(name, parent.c_str(), "source", arg.empty() ? "bench:neutrons" : arg.c_str());
+    if (type == "Adara")
+        return new AdaraPlugin(name, parent.c_str(), "source");
+    if (type == "Histogram")
+        return new HistogramPlugin(name, parent.c_str(), "bench:histogram", arg.empty() ? 1 : atoi(arg.c_str()));
+    return nullptr;
+}
+
+/**
+ * Write single parameter through asyn interface like a record would.
+ */
+static bool setParam(BasePlugin *plugin, const std::string &param, const std::string &value)
+{
+    int index;
+    asynParamType type;
+    if (plugin->findParam(param.c_str(), &index) != asynSuccess || plugin->getParamType(index, &type) != asynSuccess) {
+        fprintf(stderr, "Unknown parameter %s:%s\n", plugin->getPortName().c_str(), param.c_str());
+        return false;
+    }
+
+    std::string portName = plugin->getPortName();
+    const char *port = portName.c_str();
+    asynUser *user = nullptr;
+    asynStatus status = asynError;
+    if (type == asynParamInt32) {
+        if (pasynInt32SyncIO->connect(port, 0, &user, param.c_str()) == asynSuccess) {
+            status = pasynInt32SyncIO->write(user, strtol(value.c_str(), nullptr, 0), 1.0);
+            pasynInt32SyncIO->disconnect(user);
+        }
+    } else if (type == asynParamFloat64) {
+        if (pasynFloat64SyncIO->connect(port, 0, &user, param.c_str()) == asynSuccess) {
+            status = pasynFloat64SyncIO->write(user, strtod(value.c_str(), nullptr), 1.0);
+            pasynFloat64SyncIO->disconnect(user);
+        }
+    } else if (type == asynParamOctet) {
+        if (pasynOctetSyncIO->connect(port, 0, &user, param.c_str()) == asynSuccess) {
+            size_t written;
+            status = pasynOctetSyncIO->write(user, value.c_str(), value.size(), 1.0, &written);
+            pasynOctetSyncIO->disconnect(user);
+        }
+    }
+    if (status != asynSuccess) {
+        fprintf(stderr, "Failed to set %s:%s=%s\n", port, param.c_str(), value.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Drop trailing incomplete packet so that replay never stalls on it.
+ *
+ * @return Number of packets in buffer.
+ */
+static uint64_t trim(std::vector<uint8_t> &data)
+{
+    uint64_t nPackets = 0;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        try {
+            const Packet *packet = Packet::cast(data.data() + offset, data.size() - offset);
+            if (packet->getLength() < sizeof(Packet))
+                break;
+            offset += packet->getLength();
+            nPackets++;
+        } catch (...) {
+            break;
+        }
+    }
+    data.resize(offset);
+    return nPackets;
+}
+
+static bool load(const std::string &path, std::vector<uint8_t> &data)
+{
+    FileCircularBuffer file;
+    std::string error;
+    if (!file.open(path, error)) {
+        fprintf(stderr, "Can not open '%s' - %s\n", path.c_str(), error.c_str());
+        return false;
+    }
+    file.setMaxPackets(10000);
+    file.setSpeed(1e9);
+    file.start();
+
+    void *ptr;
+    uint32_t len;
+    while (file.wait(&ptr, &len, 0.5) == 0) {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(ptr);
+        data.insert(data.end(), bytes, bytes + len);
+        file.consume(len);
+    }
+    return true;
+}
+
+static void generate(const SyntheticCircularBuffer::Config &config, size_t size, std::vector<uint8_t> &data)
+{
+    SyntheticCircularBuffer generator;
+    generator.setConfig(config);
+    generator.start();
+
+    void *ptr;
+    uint32_t len;
+    while (data.size() < size && generator.wait(&ptr, &len, 1.0) == 0) {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(ptr);
+        data.insert(data.end(), bytes, bytes + len);
+        generator.consume(len);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] <stage>[:<arg>] ...\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Stages are connected in given order:\n");
+    fprintf(stderr, "  PixelMap[:<pixel map file>]\n");
+    fprintf(stderr, "  BnlPosCalc\n");
+    fprintf(stderr, "  FlatField[:<positions>]\n");
+    fprintf(stderr, "  Stat\n");
+    fprintf(stderr, "  Dump\n");
+    fprintf(stderr, "  PvaNeutrons[:<PV prefix>]\n");
+    fprintf(stderr, "  Adara\n");
+    fprintf(stderr, "  Histogram[:<threads>]\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -i <file>       replay dump file instead of synthetic data\n");
+    fprintf(stderr, "  -f <format>     synthetic events format number, default 2 (pixel)\n");
+    fprintf(stderr, "  -e <n>          synthetic events per packet, default 1000\n");
+    fprintf(stderr, "  -x <n>          synthetic max pixel id, default 1023\n");
+    fprintf(stderr, "  -m <MB>         synthetic data size, default 64\n");
+    fprintf(stderr, "  -c <bytes>      bytes passed to source port at once, default 1048576\n");
+    fprintf(stderr, "  -w <seconds>    warm-up time, default 1\n");
+    fprintf(stderr, "  -t <seconds>    measurement time, default 10\n");
+    fprintf(stderr, "  -s <port>:<param>=<value>  set plugin parameter before start\n");
+}
+
+int main(int argc, char **argv)
+{
+    std::string input;
+    SyntheticCircularBuffer::Config config;
+    config.realTime = false;
+    double sizeMB = 64;
+    uint32_t chunk = 1024*1024;
+    double warmup = 1.0;
+    double duration = 10.0;
+    std::vector<std::string> settings;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:f:e:x:m:c:w:t:s:h")) != -1) {
+        switch (opt) {
+        case 'i': input = optarg; break;
+        case 'f': config.format = static_cast<DasDataPacket::EventFormat>(atoi(optarg)); break;
+        case 'e': config.eventsPerPacket = atoi(optarg); break;
+        case 'x': config.pixelMax = atoi(optarg); break;
+        case 'm': sizeMB = atof(optarg); break;
+        case 'c': chunk = atoi(optarg); break;
+        case 'w': warmup = atof(optarg); break;
+        case 't': duration = atof(optarg); break;
+        case 's': settings.push_back(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || duration <= 0.0 || chunk == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> data;
+    if (!input.empty()) {
+        if (!load(input, data))
+            return 1;
+    } else {
+        generate(config, sizeMB * 1024 * 1024, data);
+    }
+    uint64_t nPackets = trim(data);
+    if (data.empty()) {
+        fprintf(stderr, "No input data\n");
+        return 1;
+    }
+    size_t inputBytes = data.size();
+    ReplayCircularBuffer buffer(std::move(data), chunk);
+
+    // Build the graph, sink connects to the last stage
+    std::vector<BasePlugin *> stages;
+    BenchSourcePlugin *source = new BenchSourcePlugin("source", &buffer);
+    stages.push_back(source);
+    std::string parent = "source";
+    for (int i = optind; i < argc; i++) {
+        std::string spec = argv[i];
+        size_t pos = spec.find(':');
+        std::string type = spec.substr(0, pos);
+        std::string arg = (pos == std::string::npos ? "" : spec.substr(pos + 1));
+        BasePlugin *stage = createStage(type, arg, parent);
+        if (stage == nullptr) {
+            fprintf(stderr, "Unsupported stage '%s'\n", type.c_str());
+            return 1;
+        }
+        stages.push_back(stage);
+        parent = stage->getPortName();
+    }
+    BenchSinkPlugin *sink = new BenchSinkPlugin("sink", parent.c_str());
+
+    std::map<std::string, BasePlugin *> ports;
+    for (auto stage: stages)
+        ports[stage->getPortName()] = stage;
+    for (auto &setting: settings) {
+        size_t colon = setting.find(':');
+        size_t equal = setting.find('=');
+        if (colon == std::string::npos || equal == std::string::npos || equal < colon) {
+            fprintf(stderr, "Invalid setting '%s'\n", setting.c_str());
+            return 1;
+        }
+        auto it = ports.find(setting.substr(0, colon));
+        if (it == ports.end()) {
+            fprintf(stderr, "Unknown port in setting '%s'\n", setting.c_str());
+            return 1;
+        }
+        if (!setParam(it->second, setting.substr(colon + 1, equal - colon - 1), setting.substr(equal + 1)))
+            return 1;
+    }
+
+    // Statistics are collected explicitly at the start and end of measurement
+    for (auto stage: stages)
+        setParam(stage, "ParamsUpdateRate", "1e9");
+
+    fprintf(stderr, "Loaded %zu bytes in %llu packets, warming up\n", inputBytes, static_cast<unsigned long long>(nPackets));
+    buffer.start();
+    epicsThreadSleep(warmup);
+
+    for (auto stage: stages)
+        stage->flushStatsParams();
+    uint64_t bytes0 = buffer.getBytes();
+    uint64_t packets0 = sink->packets;
+    uint64_t events0 = sink->events;
+    uint64_t allocCount0 = g_allocCount;
+    uint64_t allocBytes0 = g_allocBytes;
+    auto t0 = std::chrono::steady_clock::now();
+
+    fprintf(stderr, "Measuring for %.1f seconds\n", duration);
+    epicsThreadSleep(duration);
+
+    for (auto stage: stages)
+        stage->flushStatsParams();
+    uint64_t bytes = buffer.getBytes() - bytes0;
+    uint64_t packets = sink->packets - packets0;
+    uint64_t events = sink->events - events0;
+    uint64_t allocCount = g_allocCount - allocCount0;
+    uint64_t allocBytes = g_allocBytes - allocBytes0;
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    buffer.stop();
+    source->stop();
+
+    char hostname[256] = "";
+    gethostname(hostname, sizeof(hostname) - 1);
+
+    printf("host=%s\n", hostname);
+    printf("cpus=%ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("input=%s\n", input.empty() ? "synthetic" : input.c_str());
+    printf("input_bytes=%zu\n", inputBytes);
+    printf("input_packets=%llu\n", static_cast<unsigned long long>(nPackets));
+    printf("duration=%.3f\n", elapsed);
+    printf("bytes_per_sec=%.0f\n", bytes / elapsed);
+    printf("packets_per_sec=%.0f\n", packets / elapsed);
+    printf("events_per_sec=%.0f\n", events / elapsed);
+    printf("allocs_per_sec=%.0f\n", allocCount / elapsed);
+    printf("alloc_bytes_per_sec=%.0f\n", allocBytes / elapsed);
+    printf("allocs_per_packet=%.3f\n", packets > 0 ? 1.0 * allocCount / packets : 0.0);
+    for (auto stage: stages) {
+        std::string portName = stage->getPortName();
+        const char *name = portName.c_str();
+        printf("stage.%s.queue_wait_p50_us=%.1f\n", name, stage->getDoubleParam("QueueWaitP50"));
+        printf("stage.%s.queue_wait_p99_us=%.1f\n", name, stage->getDoubleParam("QueueWaitP99"));
+        printf("stage.%s.queue_wait_max_us=%.1f\n", name, stage->getDoubleParam("QueueWaitMax"));
+        printf("stage.%s.proc_time_p50_us=%.1f\n",  name, stage->getDoubleParam("ProcTimeP50"));
+        printf("stage.%s.proc_time_p99_us=%.1f\n",  name, stage->getDoubleParam("ProcTimeP99"));
+        printf("stage.%s.proc_time_max_us=%.1f\n",  name, stage->getDoubleParam("ProcTimeMax"));
+        printf("stage.%s.send_wait_p50_us=%.1f\n",  name, stage->getDoubleParam("SendWaitP50"));
+        printf("stage.%s.send_wait_p99_us=%.1f\n",  name, stage->getDoubleParam("SendWaitP99"));
+        printf("stage.%s.send_wait_max_us=%.1f\n",  name, stage->getDoubleParam("SendWaitMax"));
+        printf("stage.%s.cpu_load=%.1f\n",          name, stage->getDoubleParam("CpuLoad"));
+        printf("stage.%s.queue_drop_pkts=%d\n",     name, stage->getIntegerParam("QueueDropPkts"));
+    }
+
+    // Plugins are registered with asyn and can't be destroyed
+    return 0;
+}
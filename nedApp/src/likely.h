@@ -18,4 +18,18 @@
     #define unlikely(x) (x)
 #endif
 
+/*
+ * Vectorize loops in the function that follows.
+ *
+ * Until GCC 12 -O2 didn't vectorize at all, since then only with very-cheap
+ * cost model which rejects loops needing runtime checks or epilogue. Float
+ * compares must not trap either, otherwise selects are not if-converted.
+ * Clang vectorizes at -O2 and doesn't support optimize attribute.
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+    #define NED_VECTORIZE __attribute__((optimize("tree-vectorize", "no-trapping-math")))
+#else
+    #define NED_VECTORIZE
+#endif
+
 #endif /* LIKELY_H_ */
@@ -0,0 +1,222 @@
+/* benchDasConvert.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ *
+ * Compare ingest rate of legacy DAS 1.0 packets with native DAS 2.0 packets.
+ *
+ * Usage: benchDasConvert [pulses]
+ *
+ * Synthetic stream of RTDL and pixel data packets is generated in both
+ * formats. Legacy stream is converted the way BasePortPlugin does it,
+ * once with buffer from pool for every packet and once with a single
+ * arena per chunk. Native stream is only verified.
+ */
+
+#include <DasPacket.h>
+#include <ObjectPool.h>
+#include <PacketArena.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define CHUNK_SIZE          (4*1024*1024)
+#define EVENTS_PER_PACKET   1000
+#define PACKETS_PER_PULSE   20
+#define RTDL_FRAMES         26
+
+/**
+ * Append raw DAS 1.0 packet, info field is given raw since test code
+ * doesn't use bitfields.
+ */
+static uint32_t *appendDas1(std::vector<uint8_t> &buffer, uint32_t info, uint32_t payloadLength)
+{
+    size_t offset = buffer.size();
+    buffer.resize(offset + 6*sizeof(uint32_t) + payloadLength);
+    uint32_t *words = reinterpret_cast<uint32_t *>(buffer.data() + offset);
+    words[0] = DasPacket::HWID_SELF;    // destination
+    words[1] = 0x15FA3012;              // source
+    words[2] = info;
+    words[3] = payloadLength;
+    words[4] = 0;
+    words[5] = 0;
+    return &words[6];
+}
+
+static void fillRtdlHeader(uint32_t *words, uint32_t pulse)
+{
+    memset(words, 0, sizeof(RtdlHeader));
+    words[0] = 800000000 + pulse/60;        // timestamp_sec
+    words[1] = (pulse % 60) * 16666666;     // timestamp_nsec
+}
+
+static void generate(std::vector<uint8_t> &das1, std::vector<uint8_t> &das2, uint32_t nPulses)
+{
+    const uint32_t rtdlInfo = 0x80000000 | DasPacket::CMD_RTDL;
+    const uint32_t dataInfo = (DasPacket::DATA_FMT_PIXEL << 24) | (1 << 3); // rtdl_present
+
+    srand(1);
+    std::vector<DasPacket::Event> events(EVENTS_PER_PACKET);
+    for (uint32_t pulse = 0; pulse < nPulses; pulse++) {
+        epicsTimeStamp timestamp = { 800000000 + pulse/60, (pulse % 60) * 16666666 };
+
+        // RTDL
+        uint32_t *payload = appendDas1(das1, rtdlInfo, sizeof(RtdlHeader) + RTDL_FRAMES*sizeof(uint32_t));
+        fillRtdlHeader(payload, pulse);
+        std::vector<RtdlPacket::RtdlFrame> frames;
+        for (uint32_t i = 0; i < RTDL_FRAMES; i++) {
+            payload[sizeof(RtdlHeader)/sizeof(uint32_t) + i] = ((4 + i) << 24) | (rand() & 0xFFFFFF);
+            frames.push_back(RtdlPacket::RtdlFrame(payload[sizeof(RtdlHeader)/sizeof(uint32_t) + i]));
+        }
+        for (uint8_t id = 3; id >= 1; id--)
+            frames.insert(frames.begin(), RtdlPacket::RtdlFrame(id, 0));
+        size_t offset = das2.size();
+        das2.resize(offset + RtdlPacket::getLength(frames.size()));
+        RtdlPacket::init(das2.data() + offset, das2.size() - offset, frames);
+
+        // Neutron data
+        for (uint32_t i = 0; i < PACKETS_PER_PULSE; i++) {
+            uint32_t tof = 0;
+            for (auto &event: events) {
+                tof += rand() % 1600;
+                event.tof = tof;
+                event.pixelid = rand() % (48*1024);
+            }
+
+            uint32_t dataLength = events.size() * sizeof(DasPacket::Event);
+            payload = appendDas1(das1, dataInfo, sizeof(RtdlHeader) + dataLength);
+            fillRtdlHeader(payload, pulse);
+            memcpy(payload + sizeof(RtdlHeader)/sizeof(uint32_t), events.data(), dataLength);
+
+            offset = das2.size();
+            das2.resize(offset + DasDataPacket::getLength(DasDataPacket::EVENT_FMT_PIXEL, events.size()));
+            DasDataPacket::init(das2.data() + offset, das2.size() - offset, DasDataPacket::EVENT_FMT_PIXEL, timestamp, events.size(), events.data());
+        }
+    }
+}
+
+struct Result {
+    uint64_t nPackets{0};
+    uint64_t nEvents{0};
+    double time{0.0};
+};
+
+static void account(const Packet *packet, Result &result)
+{
+    if (packet->getType() == Packet::TYPE_DAS_DATA) {
+        const DasDataPacket *data = reinterpret_cast<const DasDataPacket *>(packet);
+        if (data->checkIntegrity()) {
+            result.nPackets++;
+            result.nEvents += data->getNumEvents();
+        }
+    } else if (packet->getType() == Packet::TYPE_RTDL) {
+        if (reinterpret_cast<const RtdlPacket *>(packet)->checkIntegrity())
+            result.nPackets++;
+    }
+}
+
+static Result native(const std::vector<uint8_t> &das2)
+{
+    Result result;
+    auto t0 = std::chrono::steady_clock::now();
+    const uint8_t *ptr = das2.data();
+    const uint8_t *end = ptr + das2.size();
+    while (ptr < end) {
+        const Packet *packet = Packet::cast(ptr, end - ptr);
+        account(packet, result);
+        ptr += packet->getLength();
+    }
+    result.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return result;
+}
+
+static Result legacyPool(const std::vector<uint8_t> &das1)
+{
+    Result result;
+    ObjectPool<uint8_t> pool(true);
+    auto t0 = std::chrono::steady_clock::now();
+    const uint8_t *ptr = das1.data();
+    const uint8_t *end = ptr + das1.size();
+    while (ptr < end) {
+        // Buffers are released at the end of every chunk
+        std::vector<std::shared_ptr<uint8_t>> fromPool;
+        const uint8_t *chunkEnd = std::min(ptr + CHUNK_SIZE, end);
+        while (ptr < chunkEnd) {
+            const DasPacket *das1Packet = DasPacket::cast(ptr, end - ptr);
+            ptr += das1Packet->getLength();
+            size_t bufsize = 2 * das1Packet->getLength();
+            auto buffer = pool.getPtr(bufsize);
+            fromPool.push_back(buffer);
+            const Packet *packet = das1Packet->convert(buffer.get(), bufsize, DasDataPacket::EVENT_FMT_INVALID);
+            if (packet)
+                account(packet, result);
+        }
+    }
+    result.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return result;
+}
+
+static Result legacyArena(const std::vector<uint8_t> &das1)
+{
+    Result result;
+    PacketArena arena;
+    auto t0 = std::chrono::steady_clock::now();
+    const uint8_t *ptr = das1.data();
+    const uint8_t *end = ptr + das1.size();
+    while (ptr < end) {
+        arena.reset();
+        const uint8_t *chunkEnd = std::min(ptr + CHUNK_SIZE, end);
+        while (ptr < chunkEnd) {
+            const DasPacket *das1Packet = DasPacket::cast(ptr, end - ptr);
+            ptr += das1Packet->getLength();
+            uint8_t *buffer = arena.reserve(das1Packet->getLength());
+            const Packet *packet = das1Packet->convert(buffer, das1Packet->getLength(), DasDataPacket::EVENT_FMT_INVALID);
+            if (packet) {
+                arena.commit(packet->getLength());
+                account(packet, result);
+            }
+        }
+    }
+    result.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return result;
+}
+
+static void print(const char *name, const Result &result, size_t bytes)
+{
+    printf("%s_packets=%llu\n", name, static_cast<unsigned long long>(result.nPackets));
+    printf("%s_mbps=%.1f\n", name, result.time > 0 ? bytes / result.time / 1e6 : 0.0);
+    printf("%s_mpkts=%.3f\n", name, result.time > 0 ? result.nPackets / result.time / 1e6 : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t nPulses = (argc > 1 ? strtoul(argv[1], nullptr, 0) : 600);
+
+    std::vector<uint8_t> das1;
+    std::vector<uint8_t> das2;
+    generate(das1, das2, nPulses);
+
+    Result nativeResult = native(das2);
+    Result poolResult   = legacyPool(das1);
+    Result arenaResult  = legacyArena(das1);
+
+    printf("pulses=%u\n", nPulses);
+    printf("das1_bytes=%zu\n", das1.size());
+    printf("das2_bytes=%zu\n", das2.size());
+    print("native", nativeResult, das2.size());
+    print("legacy_pool", poolResult, das1.size());
+    print("legacy_arena", arenaResult, das1.size());
+
+    bool valid = (nativeResult.nPackets == poolResult.nPackets && nativeResult.nPackets == arenaResult.nPackets &&
+                  nativeResult.nEvents == poolResult.nEvents && nativeResult.nEvents == arenaResult.nEvents);
+    printf("valid=%d\n", valid ? 1 : 0);
+
+    return (valid ? 0 : 1);
+}
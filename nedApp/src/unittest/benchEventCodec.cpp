@@ -0,0 +1,126 @@
+/* benchEventCodec.cpp
+ *
+ * Copyright (c) 2018 Oak Ridge National Laboratory.
+ * All rights reserved.
+ * See file LICENSE that is included with this distribution.
+ *
+ * @author Klemen Vodopivec
+ *
+ * Measure compression ratio and throughput of EventCodec.
+ *
+ * Usage: benchEventCodec [dump file]
+ *
+ * When dump file recorded by DumpPlugin is given, its DAS 2.0 packets are
+ * encoded in blocks the same way DumpPlugin does. Without arguments a
+ * synthetic stream of pixel packets is used.
+ */
+
+#include <EventCodec.h>
+#include <Event.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+static void generate(std::vector<uint8_t> &buffer, uint32_t nPackets)
+{
+    uint32_t nEvents = 1000;
+    srand(1);
+    for (uint32_t i = 0; i < nPackets; i++) {
+        size_t offset = buffer.size();
+        buffer.resize(offset + DasDataPacket::getLength(DasDataPacket::EVENT_FMT_PIXEL, nEvents));
+        DasDataPacket *packet = DasDataPacket::init(buffer.data() + offset, buffer.size() - offset, DasDataPacket::EVENT_FMT_PIXEL, {i/10, (i%10)*1000}, nEvents);
+        Event::Pixel *events = packet->getEvents<Event::Pixel>();
+        uint32_t tof = (i % 10) * 1600000;
+        for (uint32_t j = 0; j < nEvents; j++) {
+            tof += rand() % 1600;
+            events[j].tof = tof;
+            events[j].pixelid = ((rand() % 48) << 10) + (rand() % 1024);
+        }
+    }
+}
+
+/**
+ * Split buffer into blocks on packet boundaries.
+ */
+static std::vector<std::pair<uint32_t, uint32_t>> split(const std::vector<uint8_t> &buffer)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> blocks;
+    uint32_t start = 0;
+    uint32_t offset = 0;
+    while (offset < buffer.size()) {
+        const Packet *packet;
+        try {
+            packet = Packet::cast(buffer.data() + offset, buffer.size() - offset);
+        } catch (...) {
+            break;
+        }
+        if (packet->getLength() < sizeof(Packet))
+            break;
+        if ((offset + packet->getLength() - start) > EventCodec::MAX_BLOCK_SIZE && offset > start) {
+            blocks.push_back(std::make_pair(start, offset - start));
+            start = offset;
+        }
+        offset += packet->getLength();
+    }
+    if (offset > start)
+        blocks.push_back(std::make_pair(start, offset - start));
+    return blocks;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<uint8_t> raw;
+    if (argc > 1) {
+        std::ifstream file(argv[1], std::ios::binary);
+        if (!file) {
+            fprintf(stderr, "Can not open '%s'\n", argv[1]);
+            return 1;
+        }
+        raw.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    } else {
+        generate(raw, 10000);
+    }
+
+    auto blocks = split(raw);
+    uint64_t rawBytes = 0;
+    for (auto &block: blocks)
+        rawBytes += block.second;
+
+    EventCodec codec;
+    std::vector<std::vector<uint8_t>> encoded;
+    encoded.reserve(blocks.size());
+    uint64_t encodedBytes = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (auto &block: blocks) {
+        const Packet *packet = codec.encode(raw.data() + block.first, block.second);
+        const uint8_t *ptr = reinterpret_cast<const uint8_t *>(packet);
+        encoded.emplace_back(ptr, ptr + packet->getLength());
+        encodedBytes += packet->getLength();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    bool valid = true;
+    for (size_t i = 0; i < encoded.size(); i++) {
+        const std::vector<uint8_t> &decoded = codec.decode(reinterpret_cast<const Packet *>(encoded[i].data()));
+        valid &= (decoded.size() == blocks[i].second && memcmp(decoded.data(), raw.data() + blocks[i].first, decoded.size()) == 0);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    double encodeTime = std::chrono::duration<double>(t1 - t0).count();
+    double decodeTime = std::chrono::duration<double>(t2 - t1).count();
+
+    printf("blocks=%zu\n", blocks.size());
+    printf("raw_bytes=%llu\n", static_cast<unsigned long long>(rawBytes));
+    printf("encoded_bytes=%llu\n", static_cast<unsigned long long>(encodedBytes));
+    printf("ratio=%.3f\n", encodedBytes > 0 ? 1.0 * rawBytes / encodedBytes : 0.0);
+    printf("encode_mbps=%.1f\n", encodeTime > 0 ? rawBytes / encodeTime / 1e6 : 0.0);
+    printf("decode_mbps=%.1f\n", decodeTime > 0 ? rawBytes / decodeTime / 1e6 : 0.0);
+    printf("valid=%d\n", valid ? 1 : 0);
+
+    return (valid ? 0 : 1);
+}
@@ -0,0 +1,107 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <epicsThread.h>
+#include <BasePortPlugin.h>
+#include <Event.h>
+#include <Executor.h>
+
+#include <atomic>
+#include <vector>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+/*
+ * Plugins are never destroyed, like in the IOC they live until process exits.
+ */
+
+/**
+ * Port plugin fed directly by test instead of a circular buffer.
+ */
+class TestPort : public BasePortPlugin {
+    public:
+        TestPort(const char *portName)
+            : BasePortPlugin(portName)
+        {}
+
+        using BasePortPlugin::processData;
+        using BasePlugin::setParallelFanOut;
+};
+
+/**
+ * Subscriber without receive thread, processes messages in sender's thread
+ * or in executor.
+ */
+class Subscriber : public BasePlugin {
+    public:
+        Subscriber(const char *portName, const char *parentPlugins, std::atomic<unsigned> &running, std::atomic<unsigned> &maxRunning)
+            : BasePlugin(portName)
+            , m_running(running)
+            , m_maxRunning(maxRunning)
+        {
+            BasePlugin::connect(parentPlugins, MsgDasData);
+        }
+
+        void recvDownstream(const DasDataPacketList &packets) override
+        {
+            unsigned n = ++m_running;
+            unsigned max = m_maxRunning;
+            while (n > max && !m_maxRunning.compare_exchange_weak(max, n));
+            epicsThreadSleep(0.01);
+            nPackets += packets.size();
+            m_running--;
+        }
+
+        std::atomic<unsigned> nPackets{0};
+
+    private:
+        std::atomic<unsigned> &m_running;
+        std::atomic<unsigned> &m_maxRunning;
+};
+
+/**
+ * Feed port with packets and check how many subscribers ran at once.
+ */
+static int FanOut(bool parallel, unsigned expectedMax)
+{
+    static TestPort &port = *new TestPort("TestPort");
+    static std::atomic<unsigned> running{0};
+    static std::atomic<unsigned> maxRunning{0};
+    static std::vector<Subscriber *> subscribers = {
+        new Subscriber("TestSubscriber1", "TestPort", running, maxRunning),
+        new Subscriber("TestSubscriber2", "TestPort", running, maxRunning),
+        new Subscriber("TestSubscriber3", "TestPort", running, maxRunning),
+    };
+
+    Event::Pixel events[2] = { { 1, 10 }, { 2, 20 } };
+    std::vector<uint8_t> buffer(DasDataPacket::getLength(DasDataPacket::EVENT_FMT_PIXEL, 2));
+    epicsTimeStamp timestamp = { 0, 0 };
+    DasDataPacket::init(buffer.data(), buffer.size(), DasDataPacket::EVENT_FMT_PIXEL, timestamp, 2, events);
+
+    port.setParallelFanOut(parallel);
+    maxRunning = 0;
+    for (auto subscriber: subscribers)
+        subscriber->nPackets = 0;
+
+    for (unsigned i = 0; i < 10; i++) {
+        if (port.processData(buffer.data(), buffer.size()) != 0) return TEST_FAIL;
+
+        // All subscribers are done when processData() returns
+        for (auto subscriber: subscribers) {
+            if (subscriber->nPackets != i + 1) return TEST_FAIL;
+        }
+    }
+
+    if (maxRunning != expectedMax) return TEST_FAIL;
+    return TEST_OK;
+}
+
+MAIN(BasePortPluginTest)
+{
+    Executor::configure(4);
+
+    testPlan(2);
+    testOk(FanOut(false, 1) == TEST_OK, "Subscribers process serially");
+    testOk(FanOut(true, 3) == TEST_OK,  "Subscribers process concurrently with parallel fan-out");
+    return testDone();
+}
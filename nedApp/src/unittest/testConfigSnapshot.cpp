@@ -0,0 +1,93 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <epicsThread.h>
+#include <ConfigSnapshot.h>
+
+#include <atomic>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+struct Config {
+    int a{0};
+    int b{0};
+};
+
+static int Defaults()
+{
+    ConfigSnapshot<Config> snapshot;
+    ConfigSnapshot<Config>::Ptr config = snapshot.get();
+    if (!config) return TEST_FAIL;
+    if (config->a != 0 || config->b != 0) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Publish()
+{
+    ConfigSnapshot<Config> snapshot;
+    ConfigSnapshot<Config>::Ptr old = snapshot.get();
+
+    Config config;
+    config.a = 1;
+    config.b = 2;
+    snapshot.publish(config);
+
+    // Previously obtained snapshot must not change
+    if (old->a != 0 || old->b != 0) return TEST_FAIL;
+
+    ConfigSnapshot<Config>::Ptr current = snapshot.get();
+    if (current->a != 1 || current->b != 2) return TEST_FAIL;
+    if (current == old) return TEST_FAIL;
+    return TEST_OK;
+}
+
+struct ReaderArgs {
+    ConfigSnapshot<Config> *snapshot;
+    std::atomic<bool> stop{false};
+    std::atomic<bool> done{false};
+    std::atomic<unsigned> inconsistent{0};
+};
+
+static void reader(void *ptr)
+{
+    ReaderArgs *args = reinterpret_cast<ReaderArgs *>(ptr);
+    while (!args->stop) {
+        ConfigSnapshot<Config>::Ptr config = args->snapshot->get();
+        if (config->a != config->b)
+            args->inconsistent++;
+    }
+    args->done = true;
+}
+
+static int Concurrent()
+{
+    ConfigSnapshot<Config> snapshot;
+    ReaderArgs args;
+    args.snapshot = &snapshot;
+
+    epicsThreadCreate("reader", epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackSmall), reader, &args);
+
+    Config config;
+    for (int i = 1; i <= 100000; i++) {
+        config.a = i;
+        config.b = i;
+        snapshot.publish(config);
+    }
+
+    args.stop = true;
+    while (!args.done)
+        epicsThreadSleep(0.001);
+
+    if (args.inconsistent != 0) return TEST_FAIL;
+    if (snapshot.get()->a != 100000) return TEST_FAIL;
+    return TEST_OK;
+}
+
+MAIN(ConfigSnapshotTest)
+{
+    testPlan(3);
+    testOk(Defaults() == TEST_OK,   "Default configuration");
+    testOk(Publish() == TEST_OK,    "Publishing keeps old snapshots intact");
+    testOk(Concurrent() == TEST_OK, "Concurrent readers see consistent snapshots");
+    return testDone();
+}
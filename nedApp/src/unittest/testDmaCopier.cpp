@@ -0,0 +1,145 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <DmaCopier.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <vector>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+/*
+ * Simulated OCC DMA memory, filled by test and read by DmaCopier through
+ * occlib functions below. Data is a sequence of increasing 4 byte words.
+ */
+static const size_t DMA_SIZE = 64*1024;
+static std::vector<uint32_t> dmaBuffer(DMA_SIZE / 4);
+static size_t dmaProduced = 0;  // Monotonic, in bytes
+static size_t dmaConsumed = 0;  // Monotonic, in bytes
+static uint32_t dmaNext = 0;    // Next word to be produced
+static epicsMutex dmaMutex;
+
+extern "C" int occ_data_wait(struct occ_handle *, void **address, size_t *count, unsigned timeout)
+{
+    for (unsigned i = 0; ; i++) {
+        dmaMutex.lock();
+        size_t backlog = dmaProduced - dmaConsumed;
+        size_t offset = dmaConsumed % DMA_SIZE;
+        dmaMutex.unlock();
+        if (backlog > 0) {
+            // Like OCC, only report contiguous part
+            *address = reinterpret_cast<uint8_t *>(dmaBuffer.data()) + offset;
+            *count = std::min(backlog, DMA_SIZE - offset);
+            return 0;
+        }
+        if (i >= timeout) {
+            *count = 0;
+            return -ETIME;
+        }
+        epicsThreadSleep(0.001);
+    }
+}
+
+extern "C" int occ_data_ack(struct occ_handle *, size_t count)
+{
+    dmaMutex.lock();
+    dmaConsumed += count;
+    dmaMutex.unlock();
+    return 0;
+}
+
+static void dmaProduce(size_t bytes)
+{
+    dmaMutex.lock();
+    for (size_t i = 0; i < bytes; i += 4) {
+        dmaBuffer[(dmaProduced % DMA_SIZE) / 4] = dmaNext++;
+        dmaProduced += 4;
+    }
+    dmaMutex.unlock();
+}
+
+static size_t dmaBacklog()
+{
+    dmaMutex.lock();
+    size_t backlog = dmaProduced - dmaConsumed;
+    dmaMutex.unlock();
+    return backlog;
+}
+
+/**
+ * Wait up to a second for copier to reach mode.
+ */
+static bool waitMode(DmaCopier &copier, DmaCopier::Mode mode)
+{
+    for (int i = 0; i < 1000 && copier.getMode() != mode; i++)
+        epicsThreadSleep(0.001);
+    return (copier.getMode() == mode);
+}
+
+/**
+ * Wait up to a second for copier to copy given number of bytes.
+ */
+static bool waitCopied(DmaCopier &copier, uint64_t bytes)
+{
+    for (int i = 0; i < 1000 && copier.getCopiedBytes() < bytes; i++)
+        epicsThreadSleep(0.001);
+    return (copier.getCopiedBytes() == bytes);
+}
+
+/**
+ * Consume all available data from copier, return false on gap in sequence.
+ */
+static bool consumeAll(DmaCopier &copier, uint32_t &expected)
+{
+    void *data;
+    uint32_t len;
+    while (copier.wait(&data, &len, 0.01) == 0 && len > 0) {
+        const uint32_t *words = reinterpret_cast<const uint32_t *>(data);
+        for (uint32_t i = 0; i < len / 4; i++) {
+            if (words[i] != expected++)
+                return false;
+        }
+        if (copier.consume(len) != 0)
+            return false;
+    }
+    return true;
+}
+
+static int BacklogDuringDrain()
+{
+    // Copier is never destroyed, like in the IOC it lives until process exits
+    DmaCopier &copier = *new DmaCopier(nullptr, 4*DMA_SIZE, "testDmaCopier");
+    copier.setWatermarks(8*1024, 1024);
+    uint32_t expected = 0;
+
+    // Copy thread moves data to local buffer and starts draining when DMA is empty
+    dmaProduce(16*1024);
+    if (!waitCopied(copier, 16*1024)) return TEST_FAIL;
+    if (!waitMode(copier, DmaCopier::MODE_DRAIN)) return TEST_FAIL;
+
+    // Consumer is slow to drain local buffer, DMA backlog grows meanwhile
+    dmaProduce(32*1024);
+    if (!waitCopied(copier, 48*1024)) return TEST_FAIL;
+    if (!waitMode(copier, DmaCopier::MODE_DRAIN)) return TEST_FAIL;
+    if (dmaBacklog() != 0) return TEST_FAIL;
+
+    // Consumer drains local buffer in order and switches to DMA memory
+    if (!consumeAll(copier, expected)) return TEST_FAIL;
+    if (copier.getMode() != DmaCopier::MODE_ZERO_COPY) return TEST_FAIL;
+    dmaProduce(1024);
+    if (!consumeAll(copier, expected)) return TEST_FAIL;
+    if (copier.getZeroCopyBytes() != 1024) return TEST_FAIL;
+    if (expected != 49*1024/4) return TEST_FAIL;
+    return TEST_OK;
+}
+
+MAIN(DmaCopierTest)
+{
+    testPlan(1);
+    testOk(BacklogDuringDrain() == TEST_OK, "Copying resumes when DMA backlog grows while draining");
+    return testDone();
+}
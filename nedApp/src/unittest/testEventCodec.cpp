@@ -0,0 +1,112 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <EventCodec.h>
+#include <Event.h>
+
+#include <cstdlib>
+#include <string.h>
+#include <vector>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+/**
+ * Append DAS data packet with tof,pixel events that resemble single pulse.
+ */
+static void appendPixelPacket(std::vector<uint8_t> &buffer, DasDataPacket::EventFormat format, uint32_t nEvents, uint32_t seed)
+{
+    size_t offset = buffer.size();
+    buffer.resize(offset + DasDataPacket::getLength(format, nEvents));
+    DasDataPacket *packet = DasDataPacket::init(buffer.data() + offset, buffer.size() - offset, format, {seed, 1000*seed}, nEvents);
+    Event::Pixel *events = packet->getEvents<Event::Pixel>();
+    uint32_t tof = 0;
+    srand(seed);
+    for (uint32_t i = 0; i < nEvents; i++) {
+        tof += rand() % 200;
+        events[i].tof = tof;
+        events[i].pixelid = ((rand() % 8) << 10) + (rand() % 1024);
+    }
+}
+
+/**
+ * Append DAS data packet with random non-pixel payload.
+ */
+static void appendRawPacket(std::vector<uint8_t> &buffer, uint32_t nEvents, uint32_t seed)
+{
+    size_t offset = buffer.size();
+    buffer.resize(offset + DasDataPacket::getLength(DasDataPacket::EVENT_FMT_LPSD_RAW, nEvents));
+    DasDataPacket *packet = DasDataPacket::init(buffer.data() + offset, buffer.size() - offset, DasDataPacket::EVENT_FMT_LPSD_RAW, {seed, 0}, nEvents);
+    uint8_t *events = packet->getEvents<uint8_t>();
+    srand(seed);
+    for (uint32_t i = 0; i < nEvents*DasDataPacket::getEventsSize(DasDataPacket::EVENT_FMT_LPSD_RAW); i++) {
+        events[i] = rand();
+    }
+}
+
+static int RoundTrip(const std::vector<uint8_t> &raw, uint32_t maxEncodedLen=0)
+{
+    EventCodec encoder;
+    EventCodec decoder;
+
+    const Packet *block = encoder.encode(raw.data(), raw.size());
+    if (!EventCodec::isBlock(block)) return TEST_FAIL;
+    if (maxEncodedLen > 0 && block->getLength() > maxEncodedLen) return TEST_FAIL;
+
+    const std::vector<uint8_t> &decoded = decoder.decode(block);
+    if (decoded.size() != raw.size()) return TEST_FAIL;
+    if (memcmp(decoded.data(), raw.data(), raw.size()) != 0) return TEST_FAIL;
+
+    return TEST_OK;
+}
+
+static int Corrupted(const std::vector<uint8_t> &raw)
+{
+    EventCodec encoder;
+    EventCodec decoder;
+
+    const Packet *block = encoder.encode(raw.data(), raw.size());
+    std::vector<uint8_t> copy(reinterpret_cast<const uint8_t *>(block), reinterpret_cast<const uint8_t *>(block) + block->getLength());
+    for (size_t i = sizeof(Packet) + sizeof(EventCodec::BlockHeader); i < copy.size(); i += 7)
+        copy[i] ^= 0x5A;
+
+    try {
+        const std::vector<uint8_t> &decoded = decoder.decode(reinterpret_cast<const Packet *>(copy.data()));
+        // Some corruptions are not detectable, but must not produce original data
+        if (decoded.size() == raw.size() && memcmp(decoded.data(), raw.data(), raw.size()) == 0)
+            return TEST_FAIL;
+    } catch (std::runtime_error &) {
+        // expected
+    }
+    return TEST_OK;
+}
+
+MAIN(eventCodecTest)
+{
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> mixed;
+    std::vector<uint8_t> random;
+    std::vector<uint8_t> empty;
+
+    testPlan(7);
+
+    for (uint32_t i = 1; i <= 20; i++)
+        appendPixelPacket(pixels, DasDataPacket::EVENT_FMT_PIXEL, 400, i);
+
+    for (uint32_t i = 1; i <= 10; i++) {
+        appendPixelPacket(mixed, DasDataPacket::EVENT_FMT_PIXEL, 300, i);
+        appendPixelPacket(mixed, DasDataPacket::EVENT_FMT_META, 10, i);
+        appendRawPacket(mixed, 20, i);
+    }
+
+    appendRawPacket(random, 2000, 1);
+
+    testOk(RoundTrip(empty), "Round trip no packets");
+    testOk(RoundTrip(pixels), "Round trip pixel packets");
+    testOk(RoundTrip(pixels, pixels.size() / 2), "Pixel packets compressed at least 2x");
+    testOk(RoundTrip(mixed), "Round trip mixed packets");
+    testOk(RoundTrip(random, random.size() + sizeof(Packet) + sizeof(EventCodec::BlockHeader) + 4), "Incompressible data not expanded");
+    testOk(Corrupted(pixels), "Corrupted pixel block detected");
+    testOk(Corrupted(mixed), "Corrupted mixed block detected");
+
+    return testDone();
+}
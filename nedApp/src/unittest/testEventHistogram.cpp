@@ -0,0 +1,173 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <EventHistogram.h>
+#include <Event.h>
+
+#include <vector>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+/**
+ * Create DAS data packet with given pixel events.
+ */
+static DasDataPacket *createPixelPacket(std::vector<uint8_t> &buffer, const std::vector<Event::Pixel> &events)
+{
+    buffer.resize(DasDataPacket::getLength(DasDataPacket::EVENT_FMT_PIXEL, events.size()));
+    return DasDataPacket::init(buffer.data(), buffer.size(), DasDataPacket::EVENT_FMT_PIXEL, {0, 0}, events.size(), events.data());
+}
+
+static int Binning()
+{
+    EventHistogram histogram;
+    EventHistogram::Config config;
+    config.pixelMin = 10;
+    config.pixelMax = 19;
+    config.pixelBin = 5;
+    config.tofMin = 100;
+    config.tofMax = 399;
+    config.tofBin = 100;
+    if (!histogram.configure(config)) return TEST_FAIL;
+    if (histogram.getNumPixelBins() != 2) return TEST_FAIL;
+    if (histogram.getNumTofBins() != 3) return TEST_FAIL;
+
+    std::vector<uint8_t> buffer;
+    const DasDataPacket *packet = createPixelPacket(buffer, {
+        { 100, 10 }, { 199, 14 }, { 200, 15 }, { 399, 19 },     // inside
+        { 99, 10 }, { 400, 10 }, { 100, 9 }, { 100, 20 },       // outside
+    });
+    if (!histogram.add(0, packet)) return TEST_FAIL;
+    histogram.merge();
+
+    const std::vector<uint32_t> &pixels = histogram.getPixelCounts();
+    if (pixels.size() != 2 || pixels[0] != 2 || pixels[1] != 2) return TEST_FAIL;
+    const std::vector<uint32_t> &tofs = histogram.getTofCounts();
+    if (tofs.size() != 3 || tofs[0] != 2 || tofs[1] != 1 || tofs[2] != 1) return TEST_FAIL;
+    if (!histogram.getPixelTofCounts().empty()) return TEST_FAIL;
+    if (histogram.getNumEvents() != 4) return TEST_FAIL;
+    if (histogram.getNumOutside() != 4) return TEST_FAIL;
+    if (histogram.getNumVetos() != 0) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Vetos()
+{
+    EventHistogram histogram;
+    std::vector<uint8_t> buffer;
+    const DasDataPacket *packet = createPixelPacket(buffer, {
+        { 10, 1 },
+        { 10, 1 | Event::Pixel::VETO_MASK },
+        { 10, 1 | (static_cast<uint32_t>(Event::Pixel::Type::BEAM_MONITOR) << 28) },
+    });
+    histogram.add(0, packet);
+    histogram.merge();
+
+    if (histogram.getPixelCounts()[1] != 1) return TEST_FAIL;
+    if (histogram.getNumEvents() != 1) return TEST_FAIL;
+    if (histogram.getNumVetos() != 2) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int PixelTof()
+{
+    EventHistogram histogram;
+    EventHistogram::Config config;
+    config.pixelMax = 3;
+    config.tofMax = 299;
+    config.tofBin = 100;
+    config.pixelTof = true;
+    if (!histogram.configure(config)) return TEST_FAIL;
+
+    std::vector<uint8_t> buffer;
+    const DasDataPacket *packet = createPixelPacket(buffer, {
+        { 0, 0 }, { 150, 2 }, { 250, 3 }, { 250, 3 },
+    });
+    histogram.add(0, packet);
+    histogram.merge();
+
+    const std::vector<uint32_t> &counts = histogram.getPixelTofCounts();
+    if (counts.size() != 4*3) return TEST_FAIL;
+    if (counts[0*3 + 0] != 1) return TEST_FAIL;
+    if (counts[2*3 + 1] != 1) return TEST_FAIL;
+    if (counts[3*3 + 2] != 2) return TEST_FAIL;
+    uint32_t sum = 0;
+    for (auto count: counts) sum += count;
+    if (sum != 4) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Shards()
+{
+    EventHistogram histogram(4);
+    std::vector<std::vector<uint8_t>> buffers(4);
+    for (unsigned shard = 0; shard < 4; shard++) {
+        std::vector<Event::Pixel> events;
+        for (uint32_t i = 0; i < 100; i++)
+            events.push_back({ i*100, i });
+        histogram.add(shard, createPixelPacket(buffers[shard], events));
+    }
+    histogram.merge();
+
+    if (histogram.getNumEvents() != 400) return TEST_FAIL;
+    for (uint32_t i = 0; i < 100; i++)
+        if (histogram.getPixelCounts()[i] != 4) return TEST_FAIL;
+
+    // Merging again must not double count
+    histogram.merge();
+    if (histogram.getNumEvents() != 400) return TEST_FAIL;
+
+    histogram.reset();
+    if (histogram.getNumEvents() != 0) return TEST_FAIL;
+    if (histogram.getPixelCounts()[0] != 0) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int InvalidConfig()
+{
+    EventHistogram histogram;
+    EventHistogram::Config config;
+
+    config.pixelBin = 0;
+    if (histogram.configure(config)) return TEST_FAIL;
+
+    config = EventHistogram::Config();
+    config.tofMin = 10;
+    config.tofMax = 9;
+    if (histogram.configure(config)) return TEST_FAIL;
+
+    config = EventHistogram::Config();
+    config.pixelMax = 0xFFFFFFFF;
+    if (histogram.configure(config)) return TEST_FAIL;
+
+    config = EventHistogram::Config();
+    config.pixelMax = 1024*1024;
+    config.pixelTof = true;
+    if (histogram.configure(config)) return TEST_FAIL;
+
+    // Previous configuration must remain active
+    if (histogram.getNumPixelBins() != 1024) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Unsupported()
+{
+    EventHistogram histogram;
+    std::vector<uint8_t> buffer(DasDataPacket::getLength(DasDataPacket::EVENT_FMT_LPSD_RAW, 1));
+    const DasDataPacket *packet = DasDataPacket::init(buffer.data(), buffer.size(), DasDataPacket::EVENT_FMT_LPSD_RAW, {0, 0}, 1);
+
+    if (EventHistogram::isSupported(DasDataPacket::EVENT_FMT_LPSD_RAW)) return TEST_FAIL;
+    if (histogram.add(0, packet)) return TEST_FAIL;
+    return TEST_OK;
+}
+
+MAIN(EventHistogramTest)
+{
+    testPlan(6);
+    testOk(Binning() == TEST_OK,        "ROI and binning");
+    testOk(Vetos() == TEST_OK,          "Vetoed and non-neutron events");
+    testOk(PixelTof() == TEST_OK,       "2D pixel x tof histogram");
+    testOk(Shards() == TEST_OK,         "Merging shards");
+    testOk(InvalidConfig() == TEST_OK,  "Invalid configuration rejected");
+    testOk(Unsupported() == TEST_OK,    "Unsupported format");
+    return testDone();
+}
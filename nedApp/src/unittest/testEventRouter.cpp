@@ -0,0 +1,142 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <EventRouter.h>
+#include <Event.h>
+
+#include <vector>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+static uint32_t pixelOfType(Event::Pixel::Type type, uint32_t pixel)
+{
+    return (static_cast<uint32_t>(type) << 28) | pixel;
+}
+
+/**
+ * Classify and route events, return pixel ids of events in every route.
+ */
+static std::vector< std::vector<uint32_t> > routeEvents(EventRouter &router, const std::vector<Event::Pixel> &events, std::vector<uint32_t> &counts)
+{
+    counts.resize(EventRouter::ROUTE_BANKS);
+    router.classify(events.data(), events.size(), counts.data());
+
+    std::vector< std::vector<Event::Pixel> > buffers(router.getNumRoutes());
+    std::vector<Event::Pixel *> outs;
+    for (size_t r = 0; r < buffers.size(); r++) {
+        buffers[r].resize(r < EventRouter::ROUTE_BANKS ? counts[r] : counts[EventRouter::ROUTE_NEUTRONS]);
+        outs.push_back(buffers[r].data());
+    }
+    std::vector<uint32_t> fills(router.getNumRoutes());
+    router.route(events.data(), events.size(), outs.data(), fills.data());
+
+    std::vector< std::vector<uint32_t> > routes(router.getNumRoutes());
+    for (size_t r = 0; r < routes.size(); r++) {
+        for (uint32_t i = 0; i < fills[r]; i++)
+            routes[r].push_back(buffers[r][i].pixelid);
+    }
+    return routes;
+}
+
+static int Types()
+{
+    EventRouter router;
+    std::vector<uint32_t> counts;
+    auto routes = routeEvents(router, {
+        { 1, pixelOfType(Event::Pixel::Type::NEUTRON, 5) },
+        { 2, pixelOfType(Event::Pixel::Type::BEAM_MONITOR, 1) },
+        { 3, pixelOfType(Event::Pixel::Type::SIGNAL, 2) },
+        { 4, pixelOfType(Event::Pixel::Type::ADC, 3) },
+        { 5, pixelOfType(Event::Pixel::Type::CHOPPER, 4) },
+        { 6, pixelOfType(Event::Pixel::Type::UNUSED1, 6) },
+        { 7, pixelOfType(Event::Pixel::Type::NEUTRON, 7) },
+    }, counts);
+
+    if (counts[EventRouter::ROUTE_NEUTRONS] != 2 || counts[EventRouter::ROUTE_MONITORS] != 1) return TEST_FAIL;
+    if (counts[EventRouter::ROUTE_META] != 4 || counts[EventRouter::ROUTE_VETOED] != 0) return TEST_FAIL;
+    if (routes[EventRouter::ROUTE_NEUTRONS] != std::vector<uint32_t>({ 5, 7 })) return TEST_FAIL;
+    if (routes[EventRouter::ROUTE_MONITORS] != std::vector<uint32_t>({ pixelOfType(Event::Pixel::Type::BEAM_MONITOR, 1) })) return TEST_FAIL;
+    if (routes[EventRouter::ROUTE_META].size() != 4) return TEST_FAIL;
+    if (routes[EventRouter::ROUTE_META].back() != pixelOfType(Event::Pixel::Type::UNUSED1, 6)) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Vetos()
+{
+    EventRouter router;
+    router.addBank(0, 100);
+    std::vector<uint32_t> counts;
+    auto routes = routeEvents(router, {
+        { 1, 10 | Event::Pixel::VETO_MASK },
+        { 2, pixelOfType(Event::Pixel::Type::BEAM_MONITOR, 1) | Event::Pixel::VETO_MASK },
+        { 3, pixelOfType(Event::Pixel::Type::ADC, 1) | Event::Pixel::VETO_MASK },
+        { 4, 20 },
+    }, counts);
+
+    // Vetoed events only go to vetoed route, never to banks
+    if (counts[EventRouter::ROUTE_VETOED] != 3 || counts[EventRouter::ROUTE_NEUTRONS] != 1) return TEST_FAIL;
+    if (counts[EventRouter::ROUTE_MONITORS] != 0 || counts[EventRouter::ROUTE_META] != 0) return TEST_FAIL;
+    if (routes[EventRouter::ROUTE_VETOED].size() != 3) return TEST_FAIL;
+    if (routes[EventRouter::ROUTE_VETOED][0] != (10 | Event::Pixel::VETO_MASK)) return TEST_FAIL;
+    if (routes[EventRouter::ROUTE_BANKS] != std::vector<uint32_t>({ 20 })) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int OverlappingBanks()
+{
+    EventRouter router;
+    router.addBank(0, 99);
+    router.addBank(50, 149);
+    router.addBank(150, 150);
+    if (router.getNumRoutes() != EventRouter::ROUTE_BANKS + 3) return TEST_FAIL;
+
+    std::vector<uint32_t> counts;
+    auto routes = routeEvents(router, {
+        { 1, 10 }, { 2, 60 }, { 3, 99 }, { 4, 100 }, { 5, 150 }, { 6, 151 },
+        { 7, pixelOfType(Event::Pixel::Type::BEAM_MONITOR, 60) },
+    }, counts);
+
+    if (routes[EventRouter::ROUTE_NEUTRONS] != std::vector<uint32_t>({ 10, 60, 99, 100, 150, 151 })) return TEST_FAIL;
+    if (routes[EventRouter::ROUTE_BANKS + 0] != std::vector<uint32_t>({ 10, 60, 99 })) return TEST_FAIL;
+    if (routes[EventRouter::ROUTE_BANKS + 1] != std::vector<uint32_t>({ 60, 99, 100 })) return TEST_FAIL;
+    if (routes[EventRouter::ROUTE_BANKS + 2] != std::vector<uint32_t>({ 150 })) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int LargePacket()
+{
+    // Enough events for vectorized loops to run, in every position of the vector
+    EventRouter router;
+    router.addBank(0, 0xFFFFFFF);
+    std::vector<Event::Pixel> events;
+    for (uint32_t i = 0; i < 1001; i++) {
+        uint32_t pixel = (i % 3 == 0 ? pixelOfType(Event::Pixel::Type::BEAM_MONITOR, i) : i);
+        if (i % 5 == 0)
+            pixel |= Event::Pixel::VETO_MASK;
+        events.push_back({ i, pixel });
+    }
+
+    std::vector<uint32_t> counts;
+    auto routes = routeEvents(router, events, counts);
+    uint32_t nVetoed = 0, nMonitors = 0, nNeutrons = 0;
+    for (uint32_t i = 0; i < 1001; i++) {
+        if (i % 5 == 0)         nVetoed++;
+        else if (i % 3 == 0)    nMonitors++;
+        else                    nNeutrons++;
+    }
+    if (counts[EventRouter::ROUTE_VETOED] != nVetoed || routes[EventRouter::ROUTE_VETOED].size() != nVetoed) return TEST_FAIL;
+    if (counts[EventRouter::ROUTE_MONITORS] != nMonitors || routes[EventRouter::ROUTE_MONITORS].size() != nMonitors) return TEST_FAIL;
+    if (counts[EventRouter::ROUTE_NEUTRONS] != nNeutrons || routes[EventRouter::ROUTE_BANKS].size() != nNeutrons) return TEST_FAIL;
+    if (counts[EventRouter::ROUTE_META] != 0) return TEST_FAIL;
+    return TEST_OK;
+}
+
+MAIN(EventRouterTest)
+{
+    testPlan(4);
+    testOk(Types() == TEST_OK,              "Events routed by type");
+    testOk(Vetos() == TEST_OK,              "Vetoed events routed separately");
+    testOk(OverlappingBanks() == TEST_OK,   "Neutrons copied to all matching banks");
+    testOk(LargePacket() == TEST_OK,        "Routing of large packet");
+    return testDone();
+}
@@ -0,0 +1,96 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <EventTraits.h>
+
+#include <cstddef>
+#include <vector>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+static_assert(EventTraits<DasDataPacket::EVENT_FMT_PIXEL>::size == sizeof(Event::Pixel), "Pixel event size");
+static_assert(EventTraits<DasDataPacket::EVENT_FMT_BNL_VERBOSE>::diagFormat == DasDataPacket::EVENT_FMT_BNL_DIAG, "BNL diag format");
+static_assert(EventTraits<DasDataPacket::EVENT_FMT_BNL_DIAG>::isDiag, "BNL diag is diag");
+static_assert(!EventTraits<DasDataPacket::EVENT_FMT_LPSD_RAW>::hasPixel, "LPSD raw has no pixel");
+static_assert(AllEventFormats::sizeOf(DasDataPacket::EVENT_FMT_ACPC_DIAG) == sizeof(Event::ACPC::Diag), "constexpr size");
+static_assert(EventTraits<DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT>::isDiag, "ACPC compact diag is diag");
+static_assert(EventTraits<DasDataPacket::EVENT_FMT_CROC_DIAG_COMPACT>::isDiag, "CROC compact diag is diag");
+static_assert(sizeof(Event::ACPC::Diag::Veto) == 4 && offsetof(Event::ACPC::Diag, x) == 16 && sizeof(Event::ACPC::Diag) == 72, "ACPC diag layout unchanged");
+
+/**
+ * Sums pixel ids and remembers which format was selected.
+ */
+struct SumPixels {
+    const DasDataPacket *packet;
+    DasDataPacket::EventFormat &format;
+    uint64_t &sum;
+
+    template <typename Traits>
+    void operator()(const Traits &)
+    {
+        format = Traits::format;
+        const typename Traits::Type *events = Traits::events(packet);
+        for (uint32_t i = 0; i < packet->getNumEvents(); i++)
+            sum += Traits::pixelid(events[i]);
+    }
+};
+
+typedef EventFormats<
+    DasDataPacket::EVENT_FMT_PIXEL,
+    DasDataPacket::EVENT_FMT_LPSD_VERBOSE,
+    DasDataPacket::EVENT_FMT_LPSD_DIAG
+> TestFormats;
+
+static int Sizes()
+{
+    if (DasDataPacket::getEventsSize(DasDataPacket::EVENT_FMT_META) != sizeof(Event::Pixel)) return TEST_FAIL;
+    if (DasDataPacket::getEventsSize(DasDataPacket::EVENT_FMT_LPSD_DIAG) != sizeof(Event::LPSD::Diag)) return TEST_FAIL;
+    if (DasDataPacket::getEventsSize(DasDataPacket::EVENT_FMT_ACPC_DIAG) != sizeof(Event::ACPC::Diag)) return TEST_FAIL;
+    if (DasDataPacket::getEventsSize(DasDataPacket::EVENT_FMT_ACPC_DIAG_COMPACT) != sizeof(Event::ACPC::DiagCompact)) return TEST_FAIL;
+    if (sizeof(Event::ACPC::DiagCompact) >= sizeof(Event::ACPC::Diag)) return TEST_FAIL;
+    if (DasDataPacket::getEventsSize(DasDataPacket::EVENT_FMT_CROC_DIAG_COMPACT) != sizeof(Event::CROC::DiagCompact)) return TEST_FAIL;
+    if (sizeof(Event::CROC::DiagCompact) != 72 || sizeof(Event::CROC::Diag) != 96) return TEST_FAIL;
+    // Formats without event structure
+    if (DasDataPacket::getEventsSize(DasDataPacket::EVENT_FMT_INVALID) != 0) return TEST_FAIL;
+    if (DasDataPacket::getEventsSize(DasDataPacket::EVENT_FMT_BNL_XY) != 0) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Dispatch()
+{
+    std::vector<uint8_t> buffer(DasDataPacket::getLength(DasDataPacket::EVENT_FMT_LPSD_DIAG, 3));
+    DasDataPacket *packet = DasDataPacket::init(buffer.data(), buffer.size(), DasDataPacket::EVENT_FMT_LPSD_DIAG, {0, 0}, 3);
+    Event::LPSD::Diag *events = packet->getEvents<Event::LPSD::Diag>();
+    events[0].pixelid = 1;
+    events[1].pixelid = 2;
+    events[2].pixelid = 3;
+
+    DasDataPacket::EventFormat format = DasDataPacket::EVENT_FMT_INVALID;
+    uint64_t sum = 0;
+    if (!TestFormats::dispatch(packet->getEventsFormat(), SumPixels{packet, format, sum})) return TEST_FAIL;
+    if (format != DasDataPacket::EVENT_FMT_LPSD_DIAG) return TEST_FAIL;
+    if (sum != 6) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Unsupported()
+{
+    std::vector<uint8_t> buffer(DasDataPacket::getLength(DasDataPacket::EVENT_FMT_LPSD_RAW, 1));
+    DasDataPacket *packet = DasDataPacket::init(buffer.data(), buffer.size(), DasDataPacket::EVENT_FMT_LPSD_RAW, {0, 0}, 1);
+
+    DasDataPacket::EventFormat format = DasDataPacket::EVENT_FMT_INVALID;
+    uint64_t sum = 0;
+    if (TestFormats::contains(DasDataPacket::EVENT_FMT_LPSD_RAW)) return TEST_FAIL;
+    if (TestFormats::dispatch(packet->getEventsFormat(), SumPixels{packet, format, sum})) return TEST_FAIL;
+    if (format != DasDataPacket::EVENT_FMT_INVALID) return TEST_FAIL;
+    return TEST_OK;
+}
+
+MAIN(EventTraitsTest)
+{
+    testPlan(3);
+    testOk(Sizes() == TEST_OK,          "Event sizes from traits");
+    testOk(Dispatch() == TEST_OK,       "Dispatch to format kernel");
+    testOk(Unsupported() == TEST_OK,    "Format not in list");
+    return testDone();
+}
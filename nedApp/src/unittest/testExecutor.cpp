@@ -0,0 +1,249 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <Executor.h>
+#include <PluginMessage.h>
+
+#include <atomic>
+#include <deque>
+#include <set>
+#include <vector>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+/*
+ * Executors are never destroyed, like in the IOC they live until process exits.
+ * Except the one testing destruction.
+ */
+
+/**
+ * Wait for counter to reach value, give up after a couple of seconds.
+ */
+static bool waitCount(const std::atomic<unsigned> &counter, unsigned value)
+{
+    for (int i = 0; i < 5000 && counter < value; i++)
+        epicsThreadSleep(0.001);
+    return (counter == value);
+}
+
+static int RunAll()
+{
+    Executor &executor = *new Executor(4, "TestRunAll");
+    std::atomic<unsigned> count{0};
+
+    for (int i = 0; i < 10000; i++)
+        executor.submit([&count]() { count++; });
+
+    if (!waitCount(count, 10000)) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Steal()
+{
+    Executor &executor = *new Executor(4, "TestSteal");
+    std::atomic<unsigned> count{0};
+    epicsMutex mutex;
+    std::set<epicsThreadId> threads;
+
+    // All jobs land in first worker's queue, others must steal them
+    executor.submit([&]() {
+        for (int i = 0; i < 40; i++) {
+            executor.submit([&]() {
+                mutex.lock();
+                threads.insert(epicsThreadGetIdSelf());
+                mutex.unlock();
+                epicsThreadSleep(0.005);
+                count++;
+            });
+        }
+        count++;
+    });
+
+    if (!waitCount(count, 41)) return TEST_FAIL;
+    if (threads.size() < 2) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Blocking()
+{
+    // Single worker waits for a job submitted by itself
+    Executor &executor = *new Executor(1, "TestBlocking");
+    std::atomic<unsigned> count{0};
+
+    executor.submit([&]() {
+        epicsEvent done;
+        std::atomic<bool> childDone{false};
+        executor.submit([&]() {
+            childDone = true;
+            done.signal();
+        });
+        while (!childDone)
+            Executor::blockingWait(done);
+        count++;
+    });
+
+    if (!waitCount(count, 1)) return TEST_FAIL;
+    return TEST_OK;
+}
+
+/**
+ * Receiving side of a blocking plugin, like BasePlugin with QUEUE_BLOCK policy.
+ *
+ * At most one job processes queued messages, every message is forwarded to
+ * next stage and released only after next stage released it.
+ */
+struct Stage {
+    Executor &executor;
+    Stage *next;
+    epicsMutex mutex;
+    std::deque<PluginMessage *> queue;
+    bool scheduled{false};
+    epicsEvent spaceEvent;
+    std::atomic<unsigned> nProcessed{0};
+
+    Stage(Executor &executor_, Stage *next_)
+        : executor(executor_)
+        , next(next_)
+    {}
+
+    void send(PluginMessage *msg)
+    {
+        bool submit = false;
+        msg->claim();
+        mutex.lock();
+        while (queue.size() >= 2) {
+            mutex.unlock();
+            Executor::blockingWait(spaceEvent);
+            mutex.lock();
+        }
+        queue.push_back(msg);
+        if (queue.size() < 2)
+            spaceEvent.signal();
+        if (!scheduled)
+            submit = scheduled = true;
+        mutex.unlock();
+        if (submit)
+            executor.submit(std::bind(&Stage::job, this));
+    }
+
+    void job()
+    {
+        mutex.lock();
+        PluginMessage *msg = queue.front();
+        queue.pop_front();
+        mutex.unlock();
+        spaceEvent.signal();
+
+        if (next) {
+            PluginMessage forward(msg->get<const void>());
+            next->send(&forward);
+            forward.waitAllReleased();
+        }
+        nProcessed++;
+        msg->release();
+
+        mutex.lock();
+        bool resubmit = !queue.empty();
+        scheduled = resubmit;
+        mutex.unlock();
+        if (resubmit)
+            executor.submit(std::bind(&Stage::job, this));
+    }
+};
+
+static int Chain()
+{
+    // Chain deeper than number of workers, all of them block waiting for subscribers
+    Executor &executor = *new Executor(1, "TestChain");
+    Stage &last = *new Stage(executor, nullptr);
+    Stage &middle = *new Stage(executor, &last);
+    Stage &first = *new Stage(executor, &middle);
+
+    // Source keeps sending without pause, like a port plugin
+    unsigned nSent = 0;
+    for (; nSent < 2000; nSent++) {
+        PluginMessage msg(&nSent);
+        first.send(&msg);
+        for (int i = 0; i < 5000 && !msg.released(); i++)
+            epicsThreadSleep(0.001);
+        if (!msg.released()) return TEST_FAIL;
+    }
+
+    if (first.nProcessed != nSent || middle.nProcessed != nSent || last.nProcessed != nSent) return TEST_FAIL;
+    return TEST_OK;
+}
+
+/**
+ * Job resubmitting itself until other job runs.
+ */
+struct Resubmitting {
+    Executor &executor;
+    std::atomic<bool> &otherDone;
+    std::atomic<unsigned> &count;
+
+    void operator()()
+    {
+        if (++count < 1000 && !otherDone)
+            executor.submit(*this);
+    }
+};
+
+static int Fairness()
+{
+    // Other job queued in the same worker before resubmits must not starve
+    Executor &executor = *new Executor(1, "TestFairness");
+    // Last resubmitted job may still be running when test returns
+    static std::atomic<bool> otherDone{false};
+    static std::atomic<unsigned> count{0};
+    static std::atomic<unsigned> done{0};
+
+    executor.submit([&]() {
+        executor.submit([&]() { otherDone = true; done++; });
+        Resubmitting resubmitting{executor, otherDone, count};
+        resubmitting();
+        done++;
+    });
+
+    if (!waitCount(done, 2)) return TEST_FAIL;
+    epicsThreadSleep(0.1);
+    if (count > 2) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Stop()
+{
+    Executor *executor = new Executor(2, "TestStop");
+    std::atomic<unsigned> started{0};
+    std::atomic<unsigned> done{0};
+
+    // Destructor must wait for running job, spare worker included
+    executor->submit([&]() {
+        epicsEvent event;
+        executor->submit([&]() {
+            started++;
+            epicsThreadSleep(0.05);
+            done++;
+            event.signal();
+        });
+        Executor::blockingWait(event);
+    });
+    if (!waitCount(started, 1)) return TEST_FAIL;
+    delete executor;
+    if (done != 1) return TEST_FAIL;
+    return TEST_OK;
+}
+
+MAIN(ExecutorTest)
+{
+    testPlan(6);
+    testOk(RunAll() == TEST_OK,     "All submitted jobs are run");
+    testOk(Steal() == TEST_OK,      "Idle workers steal jobs");
+    testOk(Blocking() == TEST_OK,   "Spare worker runs jobs while worker is blocked");
+    testOk(Chain() == TEST_OK,      "Chain of blocking stages doesn't deadlock");
+    testOk(Fairness() == TEST_OK,   "Resubmitted job doesn't starve others");
+    testOk(Stop() == TEST_OK,       "Destroyed executor waits for running jobs");
+    return testDone();
+}
@@ -0,0 +1,129 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <FlightRecorder.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+/*
+ * Recorders are never destroyed, like in the IOC they live until process exits.
+ */
+
+/**
+ * Collects result of single save.
+ */
+struct Saved {
+    epicsEvent event;
+    std::string path;
+    int error{-1};
+
+    void cb(const std::string &path_, int error_)
+    {
+        path = path_;
+        error = error_;
+        event.signal();
+    }
+};
+
+static std::vector<uint8_t> readFile(const std::string &path)
+{
+    std::vector<uint8_t> data;
+    FILE *fp = fopen(path.c_str(), "r");
+    if (fp) {
+        int c;
+        while ((c = fgetc(fp)) != EOF)
+            data.push_back(c);
+        fclose(fp);
+    }
+    remove(path.c_str());
+    return data;
+}
+
+static void recordRecords(FlightRecorder &recorder, unsigned first, unsigned n, uint32_t len)
+{
+    for (unsigned i = first; i < first + n; i++) {
+        std::vector<uint8_t> record(len, i);
+        recorder.record(record.data(), record.size());
+    }
+}
+
+static int KeepsNewest()
+{
+    Saved &saved = *new Saved;
+    FlightRecorder &recorder = *new FlightRecorder("testKeepsNewest", std::bind(&Saved::cb, &saved, std::placeholders::_1, std::placeholders::_2));
+    recorder.resize(1024);
+    recorder.setDirectory(".");
+    recorder.setTriggers(FlightRecorder::TRIG_MANUAL);
+
+    // 100 byte records, ring holds 10 of them
+    recordRecords(recorder, 0, 25, 100);
+    if (!recorder.trigger(FlightRecorder::TRIG_MANUAL)) return TEST_FAIL;
+    if (!saved.event.wait(5.0) || saved.error != 0) return TEST_FAIL;
+
+    std::vector<uint8_t> data = readFile(saved.path);
+    if (data.size() < 900 || data.size() > 1000 || data.size() % 100 != 0) return TEST_FAIL;
+    unsigned first = 25 - data.size() / 100;
+    for (size_t i = 0; i < data.size(); i++) {
+        if (data[i] != first + i / 100) return TEST_FAIL;
+    }
+    return TEST_OK;
+}
+
+static int SkipsLarge()
+{
+    Saved &saved = *new Saved;
+    FlightRecorder &recorder = *new FlightRecorder("testSkipsLarge", std::bind(&Saved::cb, &saved, std::placeholders::_1, std::placeholders::_2));
+    recorder.resize(1024);
+    recorder.setDirectory(".");
+    recorder.setTriggers(FlightRecorder::TRIG_MANUAL);
+
+    if (recorder.maxRecordSize() != 128) return TEST_FAIL;
+    recordRecords(recorder, 1, 1, 100);
+    recordRecords(recorder, 2, 1, 200);
+    recordRecords(recorder, 3, 1, 100);
+    if (!recorder.trigger(FlightRecorder::TRIG_MANUAL)) return TEST_FAIL;
+    if (!saved.event.wait(5.0) || saved.error != 0) return TEST_FAIL;
+
+    std::vector<uint8_t> data = readFile(saved.path);
+    if (data.size() != 200) return TEST_FAIL;
+    if (data[0] != 1 || data[199] != 3) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Triggers()
+{
+    Saved &saved = *new Saved;
+    FlightRecorder &recorder = *new FlightRecorder("testTriggers", std::bind(&Saved::cb, &saved, std::placeholders::_1, std::placeholders::_2));
+
+    // Disabled recorder ignores triggers
+    recorder.setTriggers(FlightRecorder::TRIG_SEQUENCE);
+    if (recorder.trigger(FlightRecorder::TRIG_SEQUENCE)) return TEST_FAIL;
+
+    recorder.resize(1024);
+    recorder.setDirectory(".");
+    recordRecords(recorder, 0, 1, 100);
+    if (recorder.trigger(FlightRecorder::TRIG_INTEGRITY)) return TEST_FAIL;
+    if (!recorder.trigger(FlightRecorder::TRIG_SEQUENCE)) return TEST_FAIL;
+    if (!saved.event.wait(5.0) || saved.error != 0) return TEST_FAIL;
+    readFile(saved.path);
+    if (saved.path.find("_sequence.dat") == std::string::npos) return TEST_FAIL;
+
+    // Automatic triggers are held off right after save
+    if (recorder.trigger(FlightRecorder::TRIG_SEQUENCE)) return TEST_FAIL;
+    return TEST_OK;
+}
+
+MAIN(FlightRecorderTest)
+{
+    testPlan(3);
+    testOk(KeepsNewest() == TEST_OK, "Saves most recent records");
+    testOk(SkipsLarge() == TEST_OK,  "Skips records larger than limit");
+    testOk(Triggers() == TEST_OK,    "Enabled triggers save recording");
+    return testDone();
+}
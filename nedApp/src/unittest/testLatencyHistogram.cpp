@@ -0,0 +1,43 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <LatencyHistogram.h>
+
+#include <math.h>
+
+MAIN(latencyHistogramTest)
+{
+    LatencyHistogram hist;
+    LatencyHistogram::Summary s;
+
+    testPlan(10);
+
+    s = hist.collect();
+    testOk(s.count == 0 && s.p50 == 0.0 && s.p99 == 0.0 && s.max == 0.0, "Empty histogram");
+
+    // 1..1000 us
+    for (uint64_t i = 1; i <= 1000; i++)
+        hist.add(i * 1000);
+    s = hist.collect();
+    testOk(s.count == 1000, "count == 1000");
+    testOk(s.max == 1000.0, "max == 1000us");
+    testOk(s.p50 >= 500.0 && s.p50 <= 500.0 * 1.25, "p50 within 25%% of 500us");
+    testOk(s.p99 >= 990.0 && s.p99 <= 1000.0, "p99 within 25%% of 990us, not above max");
+
+    s = hist.collect();
+    testOk(s.count == 0, "collect() resets histogram");
+
+    hist.add(0);
+    hist.add(3);
+    s = hist.collect();
+    testOk(s.count == 2, "small values counted");
+    testOk(s.max == 0.003, "small values max");
+
+    for (int i = 0; i < 99; i++)
+        hist.add(10000);
+    hist.add(1000000000);
+    s = hist.collect();
+    testOk(fabs(s.p50 - 10.0) <= 2.5, "p50 ignores outlier");
+    testOk(s.max == 1000000.0, "max catches outlier");
+
+    return testDone();
+}
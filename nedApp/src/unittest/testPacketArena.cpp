@@ -0,0 +1,64 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <PacketArena.h>
+
+#include <cstring>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+static int Reserve()
+{
+    PacketArena arena(1024);
+    uint8_t *a = arena.reserve(100);
+    if (arena.reserve(100) != a) return TEST_FAIL; // not committed yet
+    memset(a, 0xAA, 100);
+    arena.commit(98);
+    uint8_t *b = arena.reserve(100);
+    if (b != a + 100) return TEST_FAIL; // aligned to 4 bytes
+    arena.commit(100);
+    if (a[99] != 0xAA) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Blocks()
+{
+    PacketArena arena(1024);
+    uint8_t *a = arena.reserve(1000);
+    arena.commit(1000);
+    uint8_t *b = arena.reserve(100);
+    arena.commit(100);
+    if (b >= a && b < a + 1024) return TEST_FAIL; // must be in new block
+    uint8_t *c = arena.reserve(4096);
+    arena.commit(4096);
+    if (arena.capacity() != 2*1024 + 4096) return TEST_FAIL;
+    (void)c;
+    return TEST_OK;
+}
+
+static int Reset()
+{
+    PacketArena arena(1024);
+    uint8_t *a = arena.reserve(1000);
+    arena.commit(1000);
+    arena.reserve(1000);
+    arena.commit(1000);
+    size_t capacity = arena.capacity();
+
+    arena.reset();
+    if (arena.reserve(1000) != a) return TEST_FAIL;
+    arena.commit(1000);
+    arena.reserve(1000);
+    arena.commit(1000);
+    if (arena.capacity() != capacity) return TEST_FAIL; // memory reused
+    return TEST_OK;
+}
+
+MAIN(PacketArenaTest)
+{
+    testPlan(3);
+    testOk(Reserve() == TEST_OK,    "Reserve and commit");
+    testOk(Blocks() == TEST_OK,     "Spill to new blocks");
+    testOk(Reset() == TEST_OK,      "Reuse after reset");
+    return testDone();
+}
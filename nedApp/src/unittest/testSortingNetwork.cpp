@@ -0,0 +1,87 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <SortingNetwork.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+/**
+ * Compare network ranking with stable sort on random inputs.
+ *
+ * Small range of values makes lots of ties.
+ */
+template <size_t N>
+static int Random(int range)
+{
+    srand(N);
+    for (int iter = 0; iter < 100000; iter++) {
+        uint8_t values[N];
+        uint8_t expected[N];
+        uint8_t indexes[N];
+        for (size_t i = 0; i < N; i++) {
+            values[i] = rand() % range;
+            expected[i] = i;
+        }
+        std::stable_sort(expected, expected + N, [&values](uint8_t a, uint8_t b) { return values[a] > values[b]; });
+        SortingNetwork::rankDesc<N>(values, indexes);
+        if (!std::equal(expected, expected + N, indexes)) return TEST_FAIL;
+    }
+    return TEST_OK;
+}
+
+/**
+ * Compare batch ranking with single array ranking.
+ *
+ * Arrays are strided like fields of events, last batch is not full.
+ */
+template <size_t N>
+static int Batch()
+{
+    static const size_t LANES = 16;
+    static const size_t STRIDE = N + 3;
+    srand(N);
+    for (size_t nArrays = 1; nArrays <= LANES; nArrays++) {
+        uint8_t values[LANES*STRIDE];
+        SortingNetwork::Lanes<LANES> ranks[N];
+        for (size_t i = 0; i < sizeof(values); i++)
+            values[i] = rand() % 4;
+        SortingNetwork::rankDesc<N>(values, STRIDE, nArrays, ranks);
+        for (size_t a = 0; a < nArrays; a++) {
+            uint8_t indexes[N];
+            SortingNetwork::rankDesc<N>(values + a*STRIDE, indexes);
+            for (size_t i = 0; i < N; i++) {
+                if (ranks[i].key[a] != indexes[i]) return TEST_FAIL;
+            }
+        }
+    }
+    return TEST_OK;
+}
+
+static int Extremes()
+{
+    uint8_t values[7] = { 0, 255, 0, 255, 1, 254, 0 };
+    uint8_t indexes[7];
+    SortingNetwork::rankDesc<7>(values, indexes);
+    if (indexes[0] != 1 || indexes[1] != 3 || indexes[2] != 5 || indexes[3] != 4) return TEST_FAIL;
+    if (indexes[4] != 0 || indexes[5] != 2 || indexes[6] != 6) return TEST_FAIL;
+    return TEST_OK;
+}
+
+MAIN(SortingNetworkTest)
+{
+    testPlan(10);
+    testOk(Random<7>(4) == TEST_OK,     "7 inputs with ties");
+    testOk(Random<7>(256) == TEST_OK,   "7 inputs full range");
+    testOk(Random<11>(4) == TEST_OK,    "11 inputs with ties");
+    testOk(Random<11>(256) == TEST_OK,  "11 inputs full range");
+    testOk(Random<14>(4) == TEST_OK,    "14 inputs with ties");
+    testOk(Random<14>(256) == TEST_OK,  "14 inputs full range");
+    testOk(Batch<7>() == TEST_OK,       "7 inputs batch");
+    testOk(Batch<11>() == TEST_OK,      "11 inputs batch");
+    testOk(Batch<14>() == TEST_OK,      "14 inputs batch");
+    testOk(Extremes() == TEST_OK,       "Min and max values");
+    return testDone();
+}
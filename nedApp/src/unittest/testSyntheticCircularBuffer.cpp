@@ -0,0 +1,141 @@
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <SyntheticCircularBuffer.h>
+#include <Event.h>
+
+#define TEST_OK     1
+#define TEST_FAIL   0
+
+struct Stats {
+    uint32_t rtdl = 0;
+    uint32_t calib = 0;
+    uint32_t data = 0;
+    uint32_t errors = 0;
+    uint32_t corrupted = 0;
+    uint64_t events = 0;
+    bool sorted = true;
+    bool inRange = true;
+};
+
+/**
+ * Parse all packets from single wait() call.
+ */
+static int Parse(SyntheticCircularBuffer &buffer, const SyntheticCircularBuffer::Config &config, Stats &stats)
+{
+    void *data;
+    uint32_t len;
+    if (buffer.wait(&data, &len, 1.0) != 0) return TEST_FAIL;
+
+    const uint8_t *ptr = reinterpret_cast<const uint8_t *>(data);
+    const uint8_t *end = ptr + len;
+    uint32_t lastTof = 0;
+    while (ptr < end) {
+        const Packet *packet;
+        try {
+            packet = Packet::cast(ptr, end - ptr);
+        } catch (...) {
+            return TEST_FAIL;
+        }
+        ptr += packet->getLength();
+
+        if (packet->getType() == Packet::TYPE_RTDL) {
+            stats.rtdl++;
+            if (!RtdlPacket::cast(packet)->checkIntegrity()) return TEST_FAIL;
+            lastTof = 0;
+        } else if (packet->getType() == Packet::TYPE_ERROR) {
+            stats.errors++;
+        } else if (packet->getType() == Packet::TYPE_DAS_DATA) {
+            const DasDataPacket *dataPacket = DasDataPacket::cast(packet);
+            if (!dataPacket->checkIntegrity()) {
+                stats.corrupted++;
+                continue;
+            }
+            if (dataPacket->getEventsFormat() == DasDataPacket::EVENT_FMT_TIME_CALIB) {
+                stats.calib++;
+                continue;
+            }
+            if (dataPacket->getEventsFormat() != config.format) return TEST_FAIL;
+            if (dataPacket->getNumEvents() > config.eventsPerPacket) return TEST_FAIL;
+
+            stats.data++;
+            stats.events += dataPacket->getNumEvents();
+            const uint8_t *event = dataPacket->getEvents<uint8_t>();
+            for (uint32_t i = 0; i < dataPacket->getNumEvents(); i++) {
+                const uint32_t *fields = reinterpret_cast<const uint32_t *>(event);
+                stats.sorted &= (fields[0] >= lastTof);
+                stats.inRange &= (fields[1] >= config.pixelMin && fields[1] <= config.pixelMax);
+                lastTof = fields[0];
+                event += dataPacket->getEventsSize();
+            }
+        } else {
+            return TEST_FAIL;
+        }
+    }
+    buffer.consume(len);
+    return TEST_OK;
+}
+
+static int Generate(DasDataPacket::EventFormat format, SyntheticCircularBuffer::PixelDistribution dist)
+{
+    SyntheticCircularBuffer buffer;
+    SyntheticCircularBuffer::Config config;
+    config.format = format;
+    config.pixelDist = dist;
+    config.pixelMin = 1000;
+    config.pixelMax = 1999;
+    config.eventRate = 600000;
+    config.eventsPerPacket = 1500;
+    config.realTime = false;
+    buffer.setConfig(config);
+    buffer.start();
+
+    Stats stats;
+    if (Parse(buffer, config, stats) != TEST_OK) return TEST_FAIL;
+    if (stats.rtdl == 0 || stats.rtdl != stats.calib) return TEST_FAIL;
+    if (stats.errors != 0 || stats.corrupted != 0) return TEST_FAIL;
+    // Last pulse may be incomplete
+    if (stats.events < (stats.rtdl - 1) * 10000ULL) return TEST_FAIL;
+    if (!stats.sorted || !stats.inRange) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Errors()
+{
+    SyntheticCircularBuffer buffer;
+    SyntheticCircularBuffer::Config config;
+    config.errorRate = 0.2;
+    config.eventsPerPacket = 100;
+    config.realTime = false;
+    buffer.setConfig(config);
+    buffer.start();
+
+    Stats stats;
+    if (Parse(buffer, config, stats) != TEST_OK) return TEST_FAIL;
+    if (stats.errors == 0 || stats.corrupted == 0) return TEST_FAIL;
+    if ((stats.errors + stats.corrupted) != buffer.getErrorsCount()) return TEST_FAIL;
+    return TEST_OK;
+}
+
+static int Stopped()
+{
+    SyntheticCircularBuffer buffer;
+    void *data;
+    uint32_t len;
+    return (buffer.wait(&data, &len, 0.05) == -ETIME ? TEST_OK : TEST_FAIL);
+}
+
+MAIN(syntheticCircularBufferTest)
+{
+    testPlan(10);
+    testOk(Generate(DasDataPacket::EVENT_FMT_PIXEL,      SyntheticCircularBuffer::DIST_UNIFORM),  "Pixel events, uniform distribution");
+    testOk(Generate(DasDataPacket::EVENT_FMT_PIXEL,      SyntheticCircularBuffer::DIST_GAUSSIAN), "Pixel events, gaussian distribution");
+    testOk(Generate(DasDataPacket::EVENT_FMT_PIXEL,      SyntheticCircularBuffer::DIST_HOTSPOT),  "Pixel events, hotspot distribution");
+    testOk(Generate(DasDataPacket::EVENT_FMT_BNL_RAW,    SyntheticCircularBuffer::DIST_UNIFORM),  "BNL raw events");
+    testOk(Generate(DasDataPacket::EVENT_FMT_ACPC_XY_PS, SyntheticCircularBuffer::DIST_UNIFORM),  "ACPC XY PS events");
+    testOk(Generate(DasDataPacket::EVENT_FMT_LPSD_RAW,   SyntheticCircularBuffer::DIST_UNIFORM),  "LPSD raw events");
+    testOk(Generate(DasDataPacket::EVENT_FMT_AROC_RAW,   SyntheticCircularBuffer::DIST_UNIFORM),  "AROC raw events");
+    testOk(Generate(DasDataPacket::EVENT_FMT_CROC_RAW,   SyntheticCircularBuffer::DIST_UNIFORM),  "CROC raw events");
+    testOk(Errors(), "Error injection");
+    testOk(Stopped(), "No data when stopped");
+    return testDone();
+}